@@ -44,6 +44,12 @@ ASTBlock *parseBlock(TokenStream *tokens)
         case TokenType::WHILE_KEYWORD:
             statement = parseWhileStatement(tokens);
             break;
+        case TokenType::MATCH_KEYWORD:
+            statement = parseMatchStatement(tokens);
+            break;
+        case TokenType::FOR_KEYWORD:
+            statement = parseForStatement(tokens);
+            break;
         case TokenType::CONST_KEYWORD:
         case TokenType::LET_KEYWORD:
             statement = parseDeclaration(tokens);
@@ -75,6 +81,15 @@ ASTParameter *parseParameter(TokenStream *tokens)
     int saved = tokens->getPosition();
     const Token *tok = tokens->peek();
 
+    bool owned = false;
+    if (tok->type == TokenType::OWNED_KEYWORD)
+    {
+        owned = true;
+        tokens->next();
+        tokens->consume(TokenType::WHITESPACE);
+        tok = tokens->peek();
+    }
+
     if (tok->type != TokenType::SYMBOL)
     {
         std::cout << "ERROR: Type must be a name\n";
@@ -112,7 +127,7 @@ ASTParameter *parseParameter(TokenStream *tokens)
         return NULL;
     }
 
-    return new ASTParameter(nameToken, typeSpecifier);
+    return new ASTParameter(nameToken, typeSpecifier, owned);
 }
 
 ASTFunction *parseFunction(TokenStream *tokens)
@@ -386,6 +401,299 @@ ASTNode *parseWhileStatement(TokenStream *tokens)
     return new ASTWhileStatement(condition, loopBody, elseBody);
 }
 
+ASTNode *parseForStatement(TokenStream *tokens)
+{
+    int saved = tokens->getPosition();
+    const Token *tok = tokens->peek();
+
+    if (tok->type != TokenType::FOR_KEYWORD)
+    {
+        tokens->setPosition(saved);
+        return NULL;
+    }
+
+    tokens->next();
+    tokens->consume(TokenType::WHITESPACE);
+    tok = tokens->peek();
+
+    if (tok->type != TokenType::BRACKET_OPEN)
+    {
+        tokens->setPosition(saved);
+        std::cout << "ERROR: For statement must have an opening (\n";
+        return NULL;
+    }
+
+    tokens->next();
+    tokens->consume(TokenType::WHITESPACE);
+
+    // for (i, j in 0..n, 0..m) is a loop nest
+    std::vector<const Token *> nameTokens;
+    do
+    {
+        tokens->consume(TokenType::WHITESPACE);
+        const Token *nameToken = tokens->consume(TokenType::SYMBOL);
+        if (nameToken == NULL)
+        {
+            tokens->setPosition(saved);
+            std::cout << "ERROR: For statement must start with a variable name\n";
+            return NULL;
+        }
+        nameTokens.push_back(nameToken);
+        tokens->consume(TokenType::WHITESPACE);
+    } while (tokens->consume(TokenType::COMMA) != NULL);
+
+    if (tokens->consume(TokenType::IN_KEYWORD) == NULL)
+    {
+        tokens->setPosition(saved);
+        std::cout << "ERROR: Expected 'in' after for variable name\n";
+        return NULL;
+    }
+
+    std::vector<ASTNode *> startValues;
+    std::vector<ASTNode *> endValues;
+    do
+    {
+        tokens->consume(TokenType::WHITESPACE);
+        ASTNode *startValue = parseValueOrOperator(tokens, false);
+        if (startValue == NULL)
+        {
+            return NULL;
+        }
+
+        tokens->consume(TokenType::WHITESPACE);
+        ASTNode *endValue = NULL;
+        if (tokens->consume(TokenType::DOUBLE_PERIOD) != NULL)
+        {
+            tokens->consume(TokenType::WHITESPACE);
+            endValue = parseValueOrOperator(tokens, false);
+            if (endValue == NULL)
+            {
+                return NULL;
+            }
+            tokens->consume(TokenType::WHITESPACE);
+        }
+        startValues.push_back(startValue);
+        endValues.push_back(endValue);
+    } while (tokens->consume(TokenType::COMMA) != NULL);
+
+    tok = tokens->peek();
+    if (tok->type != TokenType::BRACKET_CLOSE)
+    {
+        tokens->setPosition(saved);
+        std::cout << "ERROR: For statement must have an closing )\n";
+        return NULL;
+    }
+
+    tokens->next();
+    tokens->consume(TokenType::WHITESPACE);
+
+    // Optional optimizer hints: vectorize(<width>) unroll(<count>) tile(<size>, ...)
+    int vectorizeWidth = 0;
+    int unrollCount = 0;
+    std::vector<int> tileSizes;
+    while ((tok = tokens->peek())->type == TokenType::SYMBOL && (tok->value == "vectorize" || tok->value == "unroll" || tok->value == "tile"))
+    {
+        tokens->next();
+        if (tok->value == "tile")
+        {
+            // One block size for every index
+            if (tokens->consume(TokenType::BRACKET_OPEN) == NULL)
+            {
+                tokens->setPosition(saved);
+                std::cout << "ERROR: For hint must be written as tile(<size>, ...)\n";
+                return NULL;
+            }
+            do
+            {
+                tokens->consume(TokenType::WHITESPACE);
+                const Token *sizeToken = tokens->consume(TokenType::LITERAL_NUMBER);
+                if (sizeToken == NULL || atoi(sizeToken->value.c_str()) <= 0)
+                {
+                    tokens->setPosition(saved);
+                    std::cout << "ERROR: Tile sizes must be positive numbers\n";
+                    return NULL;
+                }
+                tileSizes.push_back(atoi(sizeToken->value.c_str()));
+                tokens->consume(TokenType::WHITESPACE);
+            } while (tokens->consume(TokenType::COMMA) != NULL);
+            if (tokens->consume(TokenType::BRACKET_CLOSE) == NULL)
+            {
+                tokens->setPosition(saved);
+                std::cout << "ERROR: For hint must be written as tile(<size>, ...)\n";
+                return NULL;
+            }
+            tokens->consume(TokenType::WHITESPACE);
+            continue;
+        }
+
+        const Token *hintToken = NULL;
+        if (tokens->consume(TokenType::BRACKET_OPEN) == NULL || (hintToken = tokens->consume(TokenType::LITERAL_NUMBER)) == NULL || tokens->consume(TokenType::BRACKET_CLOSE) == NULL)
+        {
+            tokens->setPosition(saved);
+            std::cout << "ERROR: For hint must be written as " << tok->value << "(<number>)\n";
+            return NULL;
+        }
+
+        int hint = atoi(hintToken->value.c_str());
+        if (hint <= 0)
+        {
+            tokens->setPosition(saved);
+            std::cout << "ERROR: For hint " << tok->value << " must be positive\n";
+            return NULL;
+        }
+        if (tok->value == "vectorize")
+        {
+            vectorizeWidth = hint;
+        }
+        else
+        {
+            unrollCount = hint;
+        }
+        tokens->consume(TokenType::WHITESPACE);
+    }
+
+    tokens->consume(TokenType::NEWLINE);
+
+    ASTBlock *loopBody = parseBlock(tokens);
+    if (loopBody == NULL)
+    {
+        return NULL;
+    }
+
+    if (nameTokens.size() == 1 && tileSizes.empty())
+    {
+        return new ASTForStatement(nameTokens[0], startValues[0], endValues[0], loopBody, vectorizeWidth, unrollCount);
+    }
+    if (startValues.size() != nameTokens.size() && (startValues.size() != 1 || endValues[0] != NULL))
+    {
+        std::cout << "ERROR: For statement needs a range for every variable, or a single tensor\n";
+        return NULL;
+    }
+    if (!tileSizes.empty() && tileSizes.size() != nameTokens.size())
+    {
+        std::cout << "ERROR: For statement needs a tile size for every variable\n";
+        return NULL;
+    }
+    return new ASTForNestStatement(nameTokens, startValues, endValues, loopBody, vectorizeWidth, unrollCount, tileSizes);
+}
+
+ASTNode *parseMatchStatement(TokenStream *tokens)
+{
+    int saved = tokens->getPosition();
+    const Token *tok = tokens->peek();
+
+    if (tok->type != TokenType::MATCH_KEYWORD)
+    {
+        tokens->setPosition(saved);
+        return NULL;
+    }
+
+    tokens->next();
+    tokens->consume(TokenType::WHITESPACE);
+    tok = tokens->peek();
+
+    if (tok->type != TokenType::BRACKET_OPEN)
+    {
+        tokens->setPosition(saved);
+        std::cout << "ERROR: Match statement must have an opening (\n";
+        return NULL;
+    }
+
+    tokens->next();
+    tokens->consume(TokenType::WHITESPACE);
+
+    ASTNode *value = parseValueOrOperator(tokens, false);
+    if (value == NULL)
+    {
+        return NULL;
+    }
+
+    tokens->consume(TokenType::WHITESPACE);
+    tok = tokens->peek();
+
+    if (tok->type != TokenType::BRACKET_CLOSE)
+    {
+        tokens->setPosition(saved);
+        std::cout << "ERROR: Match statement must have an closing )\n";
+        return NULL;
+    }
+
+    tokens->next();
+    tokens->consume(TokenType::WHITESPACE);
+    tokens->consume(TokenType::NEWLINE);
+    tok = tokens->peek();
+
+    if (tok->type != TokenType::CURLY_BRACKET_OPEN)
+    {
+        tokens->setPosition(saved);
+        std::cout << "ERROR: Expected { to open match arms\n";
+        return NULL;
+    }
+
+    tokens->next();
+
+    std::vector<ASTMatchArm *> arms;
+    while (!tokens->isEndOfFile())
+    {
+        tokens->consume(TokenType::WHITESPACE);
+        tokens->consume(TokenType::NEWLINE);
+        tok = tokens->peek();
+
+        if (tok->type == TokenType::CURLY_BRACKET_CLOSE)
+        {
+            tokens->next();
+            break;
+        }
+
+        // An arm is 'else { ... }', '<pattern> { ... }' or '<name>: <type> { ... }'
+        ASTNode *pattern = NULL;
+        const Token *nameToken = NULL;
+        if (tok->type == TokenType::ELSE_KEYWORD)
+        {
+            tokens->next();
+        }
+        else
+        {
+            if (tok->type == TokenType::SYMBOL)
+            {
+                int armStart = tokens->getPosition();
+                tokens->next();
+                tokens->consume(TokenType::WHITESPACE);
+                if (tokens->peek()->type == TokenType::COLON)
+                {
+                    nameToken = tok;
+                    tokens->next();
+                    tokens->consume(TokenType::WHITESPACE);
+                }
+                else
+                {
+                    tokens->setPosition(armStart);
+                }
+            }
+
+            pattern = parseValueOrOperator(tokens, true);
+            if (pattern == NULL)
+            {
+                std::cout << "ERROR: Could not parse match arm pattern\n";
+                return NULL;
+            }
+        }
+
+        tokens->consume(TokenType::WHITESPACE);
+        tokens->consume(TokenType::NEWLINE);
+
+        ASTBlock *body = parseBlock(tokens);
+        if (body == NULL)
+        {
+            return NULL;
+        }
+
+        arms.push_back(new ASTMatchArm(pattern, nameToken, body));
+    }
+
+    return new ASTMatchStatement(value, arms);
+}
+
 ASTNode *parseUnaryOperator(TokenStream *tokens)
 {
     int saved = tokens->getPosition();
@@ -416,11 +724,34 @@ ASTNode *parseUnaryOperator(TokenStream *tokens)
     return new ASTUnaryOperator(operandToken, operand);
 }
 
+// Parses align(<bytes>), returns -1 when the alignment is invalid
+int64_t parseAlignModifier(TokenStream *tokens)
+{
+    tokens->next();
+    const Token *alignToken = NULL;
+    if (tokens->consume(TokenType::BRACKET_OPEN) == NULL || (alignToken = tokens->consume(TokenType::LITERAL_NUMBER)) == NULL || tokens->consume(TokenType::BRACKET_CLOSE) == NULL)
+    {
+        std::cout << "ERROR: Alignment must be written as align(<bytes>)\n";
+        return -1;
+    }
+    tokens->consume(TokenType::WHITESPACE);
+
+    int64_t align = atoll(alignToken->value.c_str());
+    if (align <= 0 || align > 4096 || (align & (align - 1)) != 0)
+    {
+        std::cout << "ERROR: Alignment must be a power of 2 up to 4096, got " << alignToken->value << "\n";
+        return -1;
+    }
+    return align;
+}
+
 ASTNode *parseArray(TokenStream *tokens)
 {
     int saved = tokens->getPosition();
 
-    bool managed = true, value = false;
+    bool managed = true, value = false, soa = false, growable = false, slice = false;
+    int64_t align = 0;
+    int rank = 0;
     bool readingModifiers = true;
     while (readingModifiers)
     {
@@ -433,11 +764,51 @@ ASTNode *parseArray(TokenStream *tokens)
             tokens->next();
             tokens->consume(TokenType::WHITESPACE);
             break;
+        case TokenType::SOA_KEYWORD:
+            soa = true;
+            tokens->next();
+            tokens->consume(TokenType::WHITESPACE);
+            break;
+        case TokenType::GROWABLE_KEYWORD:
+            growable = true;
+            tokens->next();
+            tokens->consume(TokenType::WHITESPACE);
+            break;
+        case TokenType::ALIGN_KEYWORD:
+            align = parseAlignModifier(tokens);
+            if (align < 0)
+            {
+                tokens->setPosition(saved);
+                return NULL;
+            }
+            break;
         case TokenType::UNMANAGED_KEYWORD:
             managed = false;
             tokens->next();
             tokens->consume(TokenType::WHITESPACE);
             break;
+        case TokenType::TENSOR_KEYWORD:
+        {
+            // tensor(<rank>)
+            tokens->next();
+            const Token *rankToken = NULL;
+            if (tokens->consume(TokenType::BRACKET_OPEN) == NULL || (rankToken = tokens->consume(TokenType::LITERAL_NUMBER)) == NULL || tokens->consume(TokenType::BRACKET_CLOSE) == NULL)
+            {
+                std::cout << "ERROR: Tensor must be written as tensor(<rank>) [T]\n";
+                tokens->setPosition(saved);
+                return NULL;
+            }
+            tokens->consume(TokenType::WHITESPACE);
+
+            rank = atoi(rankToken->value.c_str());
+            if (rank <= 0 || rank > 8)
+            {
+                std::cout << "ERROR: Tensor rank must be between 1 and 8, got " << rankToken->value << "\n";
+                tokens->setPosition(saved);
+                return NULL;
+            }
+            break;
+        }
         default:
             readingModifiers = false;
             break;
@@ -476,6 +847,22 @@ ASTNode *parseArray(TokenStream *tokens)
         tokens->consume(TokenType::NEWLINE);
         tok = tokens->peek();
 
+        if (tok->type == TokenType::DOUBLE_PERIOD)
+        {
+            // [T ..] is the slice type
+            tokens->next();
+            tokens->consume(TokenType::WHITESPACE);
+            if (!values.empty() || tokens->consume(TokenType::SQUARE_BRACKET_CLOSE) == NULL)
+            {
+                std::cout << "ERROR: Slice type must be written as [T ..]\n";
+                tokens->setPosition(saved);
+                return NULL;
+            }
+            values.push_back(new ASTArraySegment(value, NULL));
+            slice = true;
+            break;
+        }
+
         ASTNode *times = NULL;
         if (tok->type == TokenType::OPERATOR_HASHTAG)
         {
@@ -503,14 +890,48 @@ ASTNode *parseArray(TokenStream *tokens)
         values.push_back(new ASTArraySegment(value, times));
     }
 
-    return new ASTArray(values, managed, value);
-}
-
+    if (soa && !managed)
+    {
+        std::cout << "ERROR: Struct-of-arrays must be managed\n";
+        tokens->setPosition(saved);
+        return NULL;
+    }
+    if (slice && (!managed || value || soa || growable || align > 0))
+    {
+        std::cout << "ERROR: Slices cannot have modifiers, they refer to the items of another array\n";
+        tokens->setPosition(saved);
+        return NULL;
+    }
+    if (growable && (!managed || soa || align > 0))
+    {
+        // The items are moved by chocoRealloc, which only keeps the alignment of chocoAlloc
+        std::cout << "ERROR: Growable arrays must be managed and cannot be soa or aligned\n";
+        tokens->setPosition(saved);
+        return NULL;
+    }
+    if (rank > 0 && (!managed || value || soa || growable || slice || align > 0))
+    {
+        std::cout << "ERROR: Tensors cannot have other modifiers, their items are stored in a single managed array\n";
+        tokens->setPosition(saved);
+        return NULL;
+    }
+
+    return new ASTArray(values, managed, value, soa, align, growable, slice, rank);
+}
+
 ASTNode *parseStructDeclaration(TokenStream *tokens)
 {
     int saved = tokens->getPosition();
 
     const Token *tok = tokens->peek();
+    const Token *exportToken = NULL;
+    if (tok->type == TokenType::EXPORT_KEYWORD)
+    {
+        exportToken = tok;
+        tokens->next();
+        tokens->consume(TokenType::WHITESPACE);
+        tok = tokens->peek();
+    }
     if (tok->type != TokenType::STRUCT_KEYWORD)
     {
         tokens->setPosition(saved);
@@ -532,21 +953,30 @@ ASTNode *parseStructDeclaration(TokenStream *tokens)
     tokens->consume(TokenType::WHITESPACE);
     tokens->consume(TokenType::NEWLINE);
 
-    return parseStruct(tokens, nameToken);
+    return parseStruct(tokens, nameToken, exportToken != NULL);
 }
 
-ASTStruct *parseStruct(TokenStream *tokens, const Token *structNameToken)
+ASTStruct *parseStruct(TokenStream *tokens, const Token *structNameToken, bool exported)
 {
     int saved = tokens->getPosition();
     const Token *tok = tokens->peek();
 
-    bool managed = true, packed = false, value = false;
+    bool managed = true, packed = false, value = false, unique = false;
+    int64_t align = 0;
     bool readingModifiers = true;
     while (readingModifiers)
     {
         tok = tokens->peek();
         switch (tok->type)
         {
+        case TokenType::ALIGN_KEYWORD:
+            align = parseAlignModifier(tokens);
+            if (align < 0)
+            {
+                tokens->setPosition(saved);
+                return NULL;
+            }
+            break;
         case TokenType::VALUE_KEYWORD:
             value = true;
             managed = false;
@@ -563,6 +993,12 @@ ASTStruct *parseStruct(TokenStream *tokens, const Token *structNameToken)
             tokens->next();
             tokens->consume(TokenType::WHITESPACE);
             break;
+        case TokenType::UNIQUE_KEYWORD:
+            unique = true;
+            managed = false;
+            tokens->next();
+            tokens->consume(TokenType::WHITESPACE);
+            break;
         default:
             readingModifiers = false;
             break;
@@ -620,7 +1056,20 @@ ASTStruct *parseStruct(TokenStream *tokens, const Token *structNameToken)
         tokens->consume(TokenType::NEWLINE);
     }
 
-    return new ASTStruct(structNameToken, fields, managed, packed, value);
+    if (packed && align > 0)
+    {
+        std::cout << "ERROR: A packed struct cannot be aligned\n";
+        tokens->setPosition(saved);
+        return NULL;
+    }
+    if (unique && value)
+    {
+        std::cout << "ERROR: A value struct cannot be unique, it is not behind a pointer\n";
+        tokens->setPosition(saved);
+        return NULL;
+    }
+
+    return new ASTStruct(structNameToken, fields, managed, packed, value, exported, align, unique);
 }
 
 ASTNode *parseInlineType(TokenStream *tokens)
@@ -638,11 +1087,16 @@ ASTNode *parseValueOrType(TokenStream *tokens, bool parseType)
     {
     case TokenType::PACKED_KEYWORD:
     case TokenType::UNMANAGED_KEYWORD:
+    case TokenType::UNIQUE_KEYWORD:
     case TokenType::VALUE_KEYWORD:
+    case TokenType::SOA_KEYWORD:
+    case TokenType::ALIGN_KEYWORD:
+    case TokenType::GROWABLE_KEYWORD:
+    case TokenType::TENSOR_KEYWORD:
     case TokenType::CURLY_BRACKET_OPEN:
     case TokenType::SQUARE_BRACKET_OPEN:
     {
-        value = parseStruct(tokens, NULL);
+        value = parseStruct(tokens, NULL, false);
         if (value == NULL)
         {
             value = parseArray(tokens);
@@ -678,6 +1132,27 @@ ASTNode *parseValueOrType(TokenStream *tokens, bool parseType)
             return NULL;
         }
 
+        // (a, b) is a tuple
+        std::vector<ASTNode *> *items = NULL;
+        tokens->consume(TokenType::WHITESPACE);
+        while (tokens->consume(TokenType::COMMA) != NULL)
+        {
+            if (items == NULL)
+            {
+                items = new std::vector<ASTNode *>();
+                items->push_back(innerValue);
+            }
+            tokens->consume(TokenType::WHITESPACE);
+            ASTNode *item = parseValueOrOperator(tokens, parseType);
+            if (item == NULL)
+            {
+                std::cout << "ERROR: Invalid tuple item at " << tokens->peek()->position << "\n";
+                return NULL;
+            }
+            items->push_back(item);
+            tokens->consume(TokenType::WHITESPACE);
+        }
+
         tok = tokens->peek();
         if (tok->type != TokenType::BRACKET_CLOSE)
         {
@@ -688,7 +1163,14 @@ ASTNode *parseValueOrType(TokenStream *tokens, bool parseType)
             tokens->next();
         }
 
-        value = new ASTBrackets(innerValue);
+        if (items != NULL)
+        {
+            value = new ASTTuple(items);
+        }
+        else
+        {
+            value = new ASTBrackets(innerValue);
+        }
         break;
     }
 
@@ -789,13 +1271,46 @@ ASTNode *parseValueAndSuffix(TokenStream *tokens, bool parseType)
             tokens->next();
             tokens->consume(TokenType::WHITESPACE);
 
-            ASTNode *indexValue = parseValueOrOperator(tokens, parseType);
-            if (indexValue == NULL)
+            // a[lo..hi] slices, both bounds are optional, tensors are indexed in multiple dimensions with a[i, lo..hi]
+            std::vector<ASTIndexDimension> dimensions;
+            while (1)
             {
-                return NULL;
+                ASTNode *indexValue = NULL;
+                if (tokens->peek()->type != TokenType::DOUBLE_PERIOD)
+                {
+                    indexValue = parseValueOrOperator(tokens, parseType);
+                    if (indexValue == NULL)
+                    {
+                        return NULL;
+                    }
+                    tokens->consume(TokenType::WHITESPACE);
+                }
+
+                bool isRange = false;
+                ASTNode *endIndexValue = NULL;
+                if (tokens->consume(TokenType::DOUBLE_PERIOD) != NULL)
+                {
+                    isRange = true;
+                    tokens->consume(TokenType::WHITESPACE);
+                    if (tokens->peek()->type != TokenType::SQUARE_BRACKET_CLOSE && tokens->peek()->type != TokenType::COMMA)
+                    {
+                        endIndexValue = parseValueOrOperator(tokens, parseType);
+                        if (endIndexValue == NULL)
+                        {
+                            return NULL;
+                        }
+                    }
+                }
+                dimensions.push_back(ASTIndexDimension(indexValue, endIndexValue, isRange));
+
+                tokens->consume(TokenType::WHITESPACE);
+                if (tokens->consume(TokenType::COMMA) == NULL)
+                {
+                    break;
+                }
+                tokens->consume(TokenType::WHITESPACE);
             }
 
-            tokens->consume(TokenType::WHITESPACE);
             tok = tokens->peek();
             if (tok->type != TokenType::SQUARE_BRACKET_CLOSE)
             {
@@ -804,7 +1319,8 @@ ASTNode *parseValueAndSuffix(TokenStream *tokens, bool parseType)
             }
             tokens->next();
 
-            value = new ASTIndexDereference(value, indexValue);
+            std::vector<ASTIndexDimension> otherDimensions(dimensions.begin() + 1, dimensions.end());
+            value = new ASTIndexDereference(value, dimensions[0].index, dimensions[0].endIndex, dimensions[0].isRange, otherDimensions);
         }
         else if (tok->type == TokenType::OPERATOR_QUESTION_MARK)
         {
@@ -938,14 +1454,45 @@ ASTDeclaration *parseDeclaration(TokenStream *tokens)
 
     tok = tokens->peek();
 
+    // let (a, b) = ... takes a tuple apart
     const Token *nameToken = tok;
-    if (nameToken->type != TokenType::SYMBOL)
+    std::vector<const Token *> *itemNameTokens = NULL;
+    if (tok->type == TokenType::BRACKET_OPEN)
+    {
+        itemNameTokens = new std::vector<const Token *>();
+        tokens->next();
+        while (true)
+        {
+            tokens->consume(TokenType::WHITESPACE);
+            const Token *itemNameToken = tokens->consume(TokenType::SYMBOL);
+            if (itemNameToken == NULL)
+            {
+                std::cout << "ERROR: Tuple item name must be symbol, not " << getTokenTypeName(tokens->peek()->type) << "\n";
+                return NULL;
+            }
+            itemNameTokens->push_back(itemNameToken);
+            tokens->consume(TokenType::WHITESPACE);
+            if (tokens->consume(TokenType::BRACKET_CLOSE) != NULL)
+            {
+                break;
+            }
+            if (tokens->consume(TokenType::COMMA) == NULL)
+            {
+                std::cout << "ERROR: Tuple item names should be split using commas\n";
+                return NULL;
+            }
+        }
+        nameToken = (*itemNameTokens)[0];
+    }
+    else if (nameToken->type != TokenType::SYMBOL)
     {
         std::cout << "ERROR: Constant name must be symbol, not " << getTokenTypeName(nameToken->type) << "\n";
         return NULL;
     }
-
-    tokens->next();
+    else
+    {
+        tokens->next();
+    }
     tokens->consume(TokenType::WHITESPACE);
 
     tok = tokens->peek();
@@ -984,7 +1531,12 @@ ASTDeclaration *parseDeclaration(TokenStream *tokens)
             return NULL;
         }
 
-        return new ASTDeclaration(nameToken, value, typeSpecifier);
+        return new ASTDeclaration(nameToken, value, typeSpecifier, itemNameTokens);
+    }
+    else if (itemNameTokens != NULL)
+    {
+        std::cout << "ERROR: A tuple declaration must have a value to take apart\n";
+        return NULL;
     }
     else
     {
@@ -1010,8 +1562,14 @@ ASTFile *parseFile(TokenStream *tokens)
         case TokenType::STRUCT_KEYWORD:
             statement = parseStructDeclaration(tokens);
             break;
-        case TokenType::FUNC_KEYWORD:
         case TokenType::EXPORT_KEYWORD:
+            statement = parseStructDeclaration(tokens);
+            if (statement == NULL)
+            {
+                statement = parseFunction(tokens);
+            }
+            break;
+        case TokenType::FUNC_KEYWORD:
         case TokenType::EXTERN_KEYWORD:
             statement = parseFunction(tokens);
             break;
@@ -1064,8 +1622,7 @@ TypedValue *ASTSymbol::generateLLVM(GenerationContext *context, FunctionScope *s
             UnionType *unionType = static_cast<UnionType *>(typeHint);
             if (unionType->containsNullType())
             {
-                auto llvmPointerType = static_cast<llvm::PointerType *>(typeHint->getLLVMType(context));
-                return new TypedValue(llvm::ConstantPointerNull::get(llvmPointerType), typeHint);
+                return new TypedValue(unionType->createValue(context, new TypedValue(NULL, new NullType())), typeHint);
             }
             else
             {
@@ -1104,16 +1661,173 @@ TypedValue *ASTSymbol::generateLLVM(GenerationContext *context, FunctionScope *s
         return valuePointer;
     }
 
+    if (scope != NULL && scope->isMoved(this->nameToken->value))
+    {
+        std::cout << "ERROR: '" << this->nameToken->value << "' was moved and cannot be used anymore, assign it again first\n";
+        exit(-1);
+
+        return NULL;
+    }
+
+    Type *narrowedType = scope == NULL ? NULL : scope->getNarrowedType(this->nameToken->value);
+    if (narrowedType != NULL)
+    {
+        // The union variable is known to contain narrowedType here, use its data without checking the tag again
+        PointerType *unionPointerType = static_cast<PointerType *>(valuePointer->getType());
+        UnionType *unionType = static_cast<UnionType *>(unionPointerType->getPointedType());
+        if (!expectPointer || narrowedType->getTypeCode() == TypeCode::POINTER)
+        {
+            TypedValue *unionValue = generateReferenceAwareLoad(context, valuePointer);
+            return new TypedValue(unionType->generateGetData(context, unionValue->getValue(), narrowedType), narrowedType, this->nameToken->value);
+        }
+        else
+        {
+            // Only tagged unions contain non-pointer types, point into their data field
+            assert(unionType->getLayout() == UnionLayout::TAGGED);
+            llvm::Value *llvmDataPointer = context->irBuilder->CreateStructGEP(unionType->getLLVMType(context), valuePointer->getValue(), 1, this->nameToken->value + ".data.ptr");
+            llvmDataPointer = context->irBuilder->CreatePointerCast(llvmDataPointer, narrowedType->getLLVMType(context)->getPointerTo(), this->nameToken->value + ".narrowed.ptr");
+            return new TypedValue(llvmDataPointer, narrowedType->getUnmanagedPointerToType(), this->nameToken->value);
+        }
+    }
+
     if (expectPointer)
     {
         return valuePointer;
     }
     else
     {
+        // A constant literal is shared as it is, it is only copied when it is written through a reference (see generateArrayUnshare)
         return generateReferenceAwareLoad(context, valuePointer);
     }
 }
 
+// Generates a value that gets a new owner (a variable, field, parameter or return value)
+// A unique pointer is moved out of the variable or nullable field that holds it, the variable cannot be used until it is assigned again
+static TypedValue *generateOwnedValue(GenerationContext *context, FunctionScope *scope, ASTNode *node, Type *typeHint)
+{
+    if (node->type == ASTNodeType::SYMBOL && scope != NULL)
+    {
+        std::string name = static_cast<ASTSymbol *>(node)->nameToken->value;
+        TypedValue *ownerPointer = scope->getValue(name);
+        if (ownerPointer != NULL && !ownerPointer->isType() && getUniquePointerType(static_cast<PointerType *>(ownerPointer->getType())->getPointedType()) != NULL)
+        {
+            if (scope->isBorrowed(name))
+            {
+                std::cout << "ERROR: Cannot move borrowed parameter '" << name << "', declare it as 'owned " << name << "' to take it over\n";
+                exit(-1);
+
+                return NULL;
+            }
+            if (scope->isMoved(name))
+            {
+                std::cout << "ERROR: '" << name << "' was moved and cannot be used anymore, assign it again first\n";
+                exit(-1);
+
+                return NULL;
+            }
+            if (scope->isDeclaredOutsideLoop(name))
+            {
+                std::cout << "ERROR: Cannot move unique '" << name << "' inside a loop, it was declared outside of the loop\n";
+                exit(-1);
+
+                return NULL;
+            }
+
+            TypedValue *value = generateUniqueMove(context, ownerPointer);
+            scope->setMoved(name, true);
+
+            Type *narrowedType = scope->getNarrowedType(name);
+            if (narrowedType != NULL)
+            {
+                // The whole union variable is moved, it is known to contain narrowedType here
+                UnionType *unionType = static_cast<UnionType *>(value->getType());
+                return new TypedValue(unionType->generateGetData(context, value->getValue(), narrowedType), narrowedType, name);
+            }
+            return value;
+        }
+    }
+
+    TypedValue *value = node->generateLLVM(context, scope, typeHint, false);
+    if (node->type == ASTNodeType::DEREFERENCE_MEMBER && value != NULL && !value->isType() && value->getTypeCode() == TypeCode::POINTER)
+    {
+        // A struct member is a pointer to the field, the field is left empty when its unique pointer is moved out
+        Type *fieldType = static_cast<PointerType *>(value->getType())->getPointedType();
+        if (getUniquePointerType(fieldType) != NULL)
+        {
+            if (fieldType->getTypeCode() != TypeCode::UNION)
+            {
+                std::cout << "ERROR: Cannot move unique field '" << static_cast<ASTMemberDereference *>(node)->getNameToken()->value << "' out of its struct, it must be nullable (" << fieldType->toString() << "|null)\n";
+                exit(-1);
+
+                return NULL;
+            }
+            return generateUniqueMove(context, value);
+        }
+    }
+    return value;
+}
+
+// Generates a value for a borrowed parameter, the caller keeps it alive during the call so no reference is counted for it
+// Only variables of the calling function are lent without counting, other values are temporaries that temporaryOut is set for, they must be released after the call
+static TypedValue *generateBorrowedValue(GenerationContext *context, FunctionScope *scope, ASTNode *node, Type *typeHint, bool *temporaryOut)
+{
+    *temporaryOut = false;
+    if (node->type == ASTNodeType::SYMBOL && scope != NULL)
+    {
+        std::string name = static_cast<ASTSymbol *>(node)->nameToken->value;
+        TypedValue *valuePointer = scope->getValue(name);
+        if (valuePointer != NULL && !valuePointer->isType())
+        {
+            if (scope->isMoved(name))
+            {
+                std::cout << "ERROR: '" << name << "' was moved and cannot be used anymore, assign it again first\n";
+                exit(-1);
+
+                return NULL;
+            }
+
+            // The scope only holds the variables and parameters of this function, the called function cannot assign them
+            // Module values are not found here, they are passed as temporaries below
+            TypedValue *value = generateLoad(context, valuePointer);
+            Type *narrowedType = scope->getNarrowedType(name);
+            if (narrowedType != NULL && narrowedType->getTypeCode() == TypeCode::POINTER)
+            {
+                UnionType *unionType = static_cast<UnionType *>(value->getType());
+                return new TypedValue(unionType->generateGetData(context, value->getValue(), narrowedType), narrowedType, name);
+            }
+            else if (narrowedType == NULL)
+            {
+                return value;
+            }
+        }
+    }
+    else if (node->type == ASTNodeType::DEREFERENCE_MEMBER)
+    {
+        TypedValue *value = node->generateLLVM(context, scope, typeHint, false);
+        if (value == NULL || value->isType() || value->getTypeCode() != TypeCode::POINTER)
+        {
+            *temporaryOut = true;
+            return value;
+        }
+        Type *fieldType = static_cast<PointerType *>(value->getType())->getPointedType();
+        if (fieldType != NULL && getUniquePointerType(fieldType) != NULL)
+        {
+            // A unique pointer cannot be counted, it is lent and stays owned by the field
+            return generateLoad(context, value);
+        }
+        if (fieldType != NULL && (fieldType->getTypeCode() == TypeCode::POINTER || fieldType->getTypeCode() == TypeCode::UNION || fieldType->getTypeCode() == TypeCode::STRING))
+        {
+            // The called function could assign the field while its value is lent, so the argument holds its own reference
+            *temporaryOut = true;
+            return generateReferenceAwareLoad(context, value);
+        }
+        return value;
+    }
+
+    *temporaryOut = true;
+    return node->generateLLVM(context, scope, typeHint, false);
+}
+
 TypedValue *ASTLiteralNumber::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
 {
 #ifdef DEBUG
@@ -1199,18 +1913,81 @@ TypedValue *ASTLiteralNumber::generateLLVM(GenerationContext *context, FunctionS
     }
 }
 
+// The items of a growable array are moved by chocoRealloc, which only keeps the alignment of chocoAlloc
+static ArrayType *getGrowableArrayType(GenerationContext *context, Type *itemType)
+{
+    if (context->module->getDataLayout().getABITypeAlign(itemType->getLLVMType(context)).value() > mallocAlign)
+    {
+        std::cout << "ERROR: Growable array items cannot be aligned to more than " << mallocAlign << " bytes, got " << itemType->toString() << "\n";
+        exit(-1);
+        return NULL;
+    }
+    return new ArrayType(itemType, false, true, false, 0, true);
+}
+
 TypedValue *ASTArray::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
 {
     std::vector<TypedValue *> segmentValues;
     for (auto v : this->values)
     {
         segmentValues.push_back(v->getValue()->generateLLVM(context, scope, NULL, false));
+        if (getUniquePointerType(segmentValues.back()->getType()) != NULL)
+        {
+            std::cout << "ERROR: Arrays cannot hold unique pointers, their items are copied and shared\n";
+            exit(-1);
+            return NULL;
+        }
+    }
+
+    if (this->rank > 0)
+    {
+        // tensor(rank) [T] is only a type, tensors are allocated by calling it with their shape, tensor(2) [T](rows, columns)
+        if (segmentValues.size() != 1 || !segmentValues[0]->isType() || this->values[0]->getTimes() != NULL)
+        {
+            std::cout << "ERROR: Tensor type must be written as tensor(rank) [T]\n";
+            exit(-1);
+            return NULL;
+        }
+        Type *itemType = segmentValues[0]->getType();
+        if (itemType->getTypeCode() != TypeCode::INTEGER && itemType->getTypeCode() != TypeCode::FLOAT)
+        {
+            // Tensor items are zeroed when allocated and stored without counting references
+            std::cout << "ERROR: Tensors can only hold numbers, got " << itemType->toString() << "\n";
+            exit(-1);
+            return NULL;
+        }
+        return new TypedValue(NULL, new TensorType(itemType, this->rank));
     }
 
     if (segmentValues.size() == 1 && segmentValues[0]->isType())
     {
         // This is an array type
 
+        if (this->slice)
+        {
+            return new TypedValue(NULL, new ArrayType(segmentValues[0]->getType(), false, false, false, 0, false, true));
+        }
+
+        if (this->growable)
+        {
+            // growable [T] is the type of a growable array, growable [n # T] allocates an empty one with room for n items
+            ArrayType *arrayType = getGrowableArrayType(context, segmentValues[0]->getType());
+            auto capacity = this->values[0]->getTimes();
+            if (capacity == NULL)
+            {
+                return new TypedValue(NULL, new PointerType(arrayType, true));
+            }
+
+            TypedValue *capacityValue = generateTypeConversion(context, capacity->generateLLVM(context, scope, &UINT64_TYPE, false), &UINT64_TYPE, false);
+            if (capacityValue == NULL || capacityValue->isType())
+            {
+                std::cout << "ERROR: Growable array capacity must be an integer\n";
+                exit(-1);
+                return NULL;
+            }
+            return generateGrowableArrayAllocation(context, arrayType, capacityValue->getValue(), "growable.malloc");
+        }
+
         ArrayType *arrayType = NULL;
         auto times = this->values[0]->getTimes();
         if (times != NULL)
@@ -1219,7 +1996,7 @@ TypedValue *ASTArray::generateLLVM(GenerationContext *context, FunctionScope *sc
             llvm::ConstantInt *llvmTimesValue = llvm::cast<llvm::ConstantInt>(timesValue->getValue());
             uint64_t timesInt = llvmTimesValue->getValue().getZExtValue();
 
-            arrayType = new ArrayType(segmentValues[0]->getType(), timesInt, this->value, this->managed);
+            arrayType = new ArrayType(segmentValues[0]->getType(), timesInt, this->value, this->managed, this->soa, this->align);
         }
         else
         {
@@ -1230,18 +2007,34 @@ TypedValue *ASTArray::generateLLVM(GenerationContext *context, FunctionScope *sc
                 return NULL;
             }
 
-            arrayType = new ArrayType(segmentValues[0]->getType(), this->value, this->managed);
+            arrayType = new ArrayType(segmentValues[0]->getType(), this->value, this->managed, this->soa, this->align);
+        }
+
+        if (this->soa && arrayType->getItemType()->getTypeCode() != TypeCode::STRUCT)
+        {
+            std::cout << "ERROR: Struct-of-arrays can only hold value structs, got " << arrayType->getItemType()->toString() << "\n";
+            exit(-1);
+            return NULL;
         }
 
         return new TypedValue(NULL, arrayType);
     }
+    else if (this->slice)
+    {
+        std::cout << "ERROR: Slice type must be written as [T ..], slices are created with a[lo..hi]\n";
+        exit(-1);
+        return NULL;
+    }
     else
     {
         assert(segmentValues.size() > 0 && "TODO allow empty array");
 
+        // Segments are kept as (value, times) instead of being expanded, so [1000000 # 0] is as cheap to generate as [0]
         uint64_t arrayItemCount = 0;
         Type *arrayItemType = segmentValues[0]->getType();
-        std::vector<llvm::Value *> llvmArrayValues;
+        std::vector<uint64_t> segmentTimes;
+        bool allConstant = true;
+        bool hasRepeatedSegment = false;
         for (int i = 0; i < segmentValues.size(); i++)
         {
             if (*segmentValues[i]->getType() != *arrayItemType)
@@ -1265,12 +2058,46 @@ TypedValue *ASTArray::generateLLVM(GenerationContext *context, FunctionScope *sc
                 timesInt = 1;
             }
 
-            for (uint64_t j = 0; j < timesInt; j++)
+            segmentTimes.push_back(timesInt);
+            arrayItemCount += timesInt;
+            allConstant &= llvm::isa<llvm::Constant>(segmentValues[i]->getValue());
+            hasRepeatedSegment |= timesInt > arrayLiteralUnrollLimit;
+        }
+
+        if (typeHint != NULL && getTypeLanes(typeHint) > 1)
+        {
+            // Float32x4 (value [...]) converts the array to a vector afterwards
+            typeHint = NULL;
+        }
+
+        PointerType *growableTypeHint = NULL;
+        if (typeHint != NULL && typeHint->getTypeCode() == TypeCode::POINTER)
+        {
+            Type *pointedTypeHint = static_cast<PointerType *>(typeHint)->getPointedType();
+            if (pointedTypeHint != NULL && pointedTypeHint->getTypeCode() == TypeCode::ARRAY && static_cast<ArrayType *>(pointedTypeHint)->isGrowable())
+            {
+                growableTypeHint = static_cast<PointerType *>(typeHint);
+            }
+        }
+        if (this->growable || growableTypeHint != NULL)
+        {
+            // The items are copied into a new growable array, which has no room to spare
+            ArrayType *arrayType = growableTypeHint != NULL ? static_cast<ArrayType *>(growableTypeHint->getPointedType()) : getGrowableArrayType(context, arrayItemType);
+            if (*arrayType->getItemType() != *arrayItemType)
             {
-                llvmArrayValues.push_back(segmentValues[i]->getValue());
+                std::cout << "ERROR: Array cannot assign to type " << typeHint->toString() << ", invalid item type\n";
+                exit(-1);
+                return NULL;
             }
 
-            arrayItemCount += timesInt;
+            llvm::Value *llvmCount = llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), arrayItemCount, false);
+            TypedValue *arrayPointer = generateGrowableArrayAllocation(context, arrayType, llvmCount, "growable.malloc");
+            llvm::Value *llvmItems = context->irBuilder->CreateLoad(arrayType->getLLVMArrayPointerType(context), generateGrowableArrayFieldPointer(context, arrayPointer, 2, "growable.items.ptr"), "growable.items");
+            llvm::Type *llvmStorageType = llvm::ArrayType::get(arrayItemType->getLLVMType(context), arrayItemCount);
+            llvm::Value *llvmStorage = context->irBuilder->CreateBitCast(llvmItems, llvmStorageType->getPointerTo(), "growable.storage");
+            generateArrayLiteralFill(context, llvmStorageType, llvmStorage, false, segmentValues, segmentTimes);
+            context->irBuilder->CreateStore(llvmCount, generateGrowableArrayFieldPointer(context, arrayPointer, 0, "growable.length.ptr"));
+            return arrayPointer;
         }
 
         if (typeHint == NULL)
@@ -1283,7 +2110,7 @@ TypedValue *ASTArray::generateLLVM(GenerationContext *context, FunctionScope *sc
                 return NULL;
             }
 
-            typeHint = new ArrayType(arrayItemType, arrayItemCount, this->value, this->managed);
+            typeHint = new ArrayType(arrayItemType, arrayItemCount, this->value, this->managed, this->soa, this->align);
         }
         else
         {
@@ -1303,53 +2130,68 @@ TypedValue *ASTArray::generateLLVM(GenerationContext *context, FunctionScope *sc
 
         ArrayType *arrayType = static_cast<ArrayType *>(typeHint);
 
-        if (this->value)
+        if (arrayType->isSoA())
+        {
+            // The columns are allocated together, a constant soa literal is not placed in read-only data
+            TypedValue *arrayValue = generateSoAAllocation(context, arrayType, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), arrayItemCount, false), "soa.malloc");
+            generateSoAArrayLiteralFill(context, arrayValue, segmentValues, segmentTimes);
+            return arrayValue;
+        }
+        else if (this->value)
         {
             llvm::ArrayType *llvmArrayType = llvm::cast<llvm::ArrayType>(arrayType->getLLVMType(context));
-            llvm::Type *llvmArrayItemType = arrayItemType->getLLVMType(context);
 
-            std::vector<llvm::Constant *> llvmUndefValues;
-            for (auto v : llvmArrayValues)
+            if (allConstant && (!hasRepeatedSegment || (segmentValues.size() == 1 && llvm::cast<llvm::Constant>(segmentValues[0]->getValue())->isNullValue())))
+            {
+                if (hasRepeatedSegment)
+                {
+                    return new TypedValue(llvm::ConstantAggregateZero::get(llvmArrayType), arrayType);
+                }
+
+                std::vector<llvm::Constant *> llvmConstantItems;
+                for (int i = 0; i < segmentValues.size(); i++)
+                {
+                    llvmConstantItems.insert(llvmConstantItems.end(), segmentTimes[i], llvm::cast<llvm::Constant>(segmentValues[i]->getValue()));
+                }
+                return new TypedValue(llvm::ConstantArray::get(llvmArrayType, llvmConstantItems), arrayType);
+            }
+
+            if (hasRepeatedSegment)
             {
-                llvmUndefValues.push_back(llvm::UndefValue::get(llvmArrayItemType));
+                // Large value arrays are filled in memory and loaded at once
+                llvm::Value *llvmArrayPointer = generateAllocaInCurrentFunction(context, llvmArrayType, "array.value", arrayType->getAlign());
+                generateArrayLiteralFill(context, llvmArrayType, llvmArrayPointer, false, segmentValues, segmentTimes);
+                return new TypedValue(context->irBuilder->CreateLoad(llvmArrayType, llvmArrayPointer, "array.value.load"), arrayType);
             }
-            llvm::Value *llvmArrayValue = llvm::ConstantArray::get(llvmArrayType, llvmUndefValues);
 
-            for (uint64_t i = 0; i < arrayItemCount; i++)
+            llvm::Value *llvmArrayValue = llvm::UndefValue::get(llvmArrayType);
+            uint64_t index = 0;
+            for (int i = 0; i < segmentValues.size(); i++)
             {
-                llvm::Value *llvmValue = llvmArrayValues[i];
-                llvmArrayValue = context->irBuilder->CreateInsertValue(llvmArrayValue, llvmValue, (unsigned int)i, "array.set." + std::to_string(i));
+                for (uint64_t j = 0; j < segmentTimes[i]; j++, index++)
+                {
+                    llvmArrayValue = context->irBuilder->CreateInsertValue(llvmArrayValue, segmentValues[i]->getValue(), (unsigned int)index, "array.set." + std::to_string(index));
+                }
             }
 
             return new TypedValue(llvmArrayValue, arrayType);
         }
-        else
+        else if (this->managed && allConstant && arrayItemCount <= constantArrayLiteralLimit && arrayType->getAlign() == 0)
         {
-            auto arrayPointerType = (new PointerType(new ArrayType(arrayItemType, arrayItemCount, true, false), this->managed));
-            auto llvmArrayPointer = generateMalloc(context, arrayPointerType->getLLVMPointedType(context), "array.malloc");
-            // auto llvmArrayPointer = context->irBuilder->CreateBitCast(llvmArrayPointerUncasted, arrayType->getLLVMArrayPointerType(context), "array.malloc");
-
-            // llvmArrayPointerUncasted->print(llvm::outs());
-            // std::cout << "\n";
-            // llvmArrayPointer->print(llvm::outs());
-            // std::cout << "\n";
-
-            for (uint64_t i = 0; i < arrayItemCount; i++)
+            // Constant literals live in read-only data, using them does not allocate
+            std::vector<llvm::Constant *> llvmConstantItems;
+            for (int i = 0; i < segmentValues.size(); i++)
             {
-                llvm::Value *llvmValue = llvmArrayValues[i];
-
-                std::vector<llvm::Value *> indices;
-                indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
-                if (this->managed)
-                {
-                    // TODO: move this to shared code
-                    indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 1, false));
-                }
-                indices.push_back(llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), i, false));
-
-                auto llvmArrayItemPtr = context->irBuilder->CreateGEP(arrayPointerType->getLLVMPointedType(context), llvmArrayPointer, indices, "array.set." + std::to_string(i) + ".gep");
-                context->irBuilder->CreateStore(llvmValue, llvmArrayItemPtr, false);
+                llvmConstantItems.insert(llvmConstantItems.end(), segmentTimes[i], llvm::cast<llvm::Constant>(segmentValues[i]->getValue()));
             }
+            return generateImmortalArray(context, arrayType, llvmConstantItems, "array.constant");
+        }
+        else
+        {
+            auto arrayPointerType = (new PointerType(new ArrayType(arrayItemType, (int64_t)arrayItemCount, true, false), this->managed));
+            auto llvmArrayPointer = generateArrayStorageMalloc(context, arrayType, arrayPointerType->getLLVMPointedType(context), generateSizeOf(context, arrayPointerType->getLLVMPointedType(context), "array.malloc"), "array.malloc");
+
+            generateArrayLiteralFill(context, arrayPointerType->getLLVMPointedType(context), llvmArrayPointer, this->managed, segmentValues, segmentTimes);
 
             if (this->managed)
             {
@@ -1406,6 +2248,7 @@ TypedValue *ASTStruct::generateLLVM(GenerationContext *context, FunctionScope *s
     bool isType = false;
     bool byValue = false;
     bool managed = false;
+    bool unique = false;
 
     // Enforce type hint
     if (typeHint != NULL)
@@ -1418,6 +2261,7 @@ TypedValue *ASTStruct::generateLLVM(GenerationContext *context, FunctionScope *s
                 structType = static_cast<StructType *>(typeHintPointer->getPointedType());
                 byValue = false;
                 managed = typeHintPointer->isManaged();
+                unique = typeHintPointer->isUnique();
             }
         }
         else if (typeHint->getTypeCode() == TypeCode::STRUCT)
@@ -1434,7 +2278,7 @@ TypedValue *ASTStruct::generateLLVM(GenerationContext *context, FunctionScope *s
             return NULL;
         }
 
-        if (this->value || !this->managed || this->packed)
+        if (this->value || !this->managed || this->packed || this->align > 0)
         {
             std::cout << "ERROR: Struct modifier cannot be specified again\n";
             exit(-1);
@@ -1493,9 +2337,10 @@ TypedValue *ASTStruct::generateLLVM(GenerationContext *context, FunctionScope *s
             fieldTypes.push_back(StructTypeField(fieldType, field->getName()));
         }
 
-        structType = new StructType(this->nameToken == NULL ? "" : this->nameToken->value, fieldTypes, this->packed);
+        structType = new StructType(this->nameToken == NULL ? "" : this->nameToken->value, fieldTypes, this->packed, this->exported, this->align);
         byValue = this->value;
         managed = this->managed;
+        unique = this->unique;
     }
 
     if (!isType)
@@ -1511,7 +2356,7 @@ TypedValue *ASTStruct::generateLLVM(GenerationContext *context, FunctionScope *s
                 auto fieldName = pair.first;
                 auto fieldValue = pair.second;
                 auto fieldType = structType->getField(fieldName);
-                auto fieldIndex = structType->getFieldIndex(fieldName);
+                auto fieldIndex = structType->getFieldIndex(context, fieldName);
 
                 TypedValue *convertedFieldValue = generateTypeConversion(context, fieldValue, fieldType->type, false);
                 if (!convertedFieldValue)
@@ -1529,13 +2374,68 @@ TypedValue *ASTStruct::generateLLVM(GenerationContext *context, FunctionScope *s
 
             result = new TypedValue(structValue, structType);
         }
+        else if (context->irBuilder->GetInsertBlock() == NULL)
+        {
+            if (unique)
+            {
+                std::cout << "ERROR: Module-level struct " << structType->toString() << " cannot be unique, it would never be freed\n";
+                exit(-1);
+
+                return NULL;
+            }
+
+            // Module-level objects are globals, managed ones get an immortal reference count so they are never counted or freed
+            llvm::StructType *llvmStructType = llvm::cast<llvm::StructType>(structType->getLLVMType(context));
+            std::vector<llvm::Constant *> llvmFieldValues(llvmStructType->getNumElements(), NULL);
+            for (auto &field : structType->getFields())
+            {
+                TypedValue *fieldValue = fieldValues[field.name];
+                if (fieldValue == NULL)
+                {
+                    std::cout << "ERROR: Struct field " << field.name << " of " << structType->toString() << " must be initialized\n";
+                    exit(-1);
+
+                    return NULL;
+                }
+
+                TypedValue *convertedFieldValue = generateTypeConversion(context, fieldValue, field.type, false);
+                if (convertedFieldValue == NULL || !llvm::isa<llvm::Constant>(convertedFieldValue->getValue()))
+                {
+                    std::cout << "ERROR: Module-level struct field " << field.name << " of " << structType->toString() << " must be constant\n";
+                    exit(-1);
+
+                    return NULL;
+                }
+                llvmFieldValues[structType->getFieldIndex(context, field.name)] = llvm::cast<llvm::Constant>(convertedFieldValue->getValue());
+            }
+
+            if (structType->getAlign() > 0)
+            {
+                // The zero sized alignment field
+                llvmFieldValues.back() = llvm::Constant::getNullValue(llvmStructType->getElementType(llvmFieldValues.size() - 1));
+            }
+
+            llvm::Constant *llvmStructValue = llvm::ConstantStruct::get(llvmStructType, llvmFieldValues);
+            PointerType *structPointerType = new PointerType(structType, managed, unique);
+            if (managed)
+            {
+                std::vector<llvm::Constant *> llvmManagedFields;
+                llvmManagedFields.push_back(llvm::ConstantInt::get(getRefCountType(*context->context), immortalRefCount, true));
+                llvmManagedFields.push_back(llvmStructValue);
+                llvmStructValue = llvm::ConstantStruct::get(llvm::cast<llvm::StructType>(structPointerType->getLLVMPointedType(context)), llvmManagedFields);
+            }
+
+            // Not constant, its fields can still be assigned
+            llvm::GlobalVariable *llvmGlobal = new llvm::GlobalVariable(*context->module, llvmStructValue->getType(), false, llvm::GlobalValue::PrivateLinkage, llvmStructValue, structType->getName());
+            result = new TypedValue(llvmGlobal, structPointerType);
+        }
         else
         {
             // Allocate struct on the heap (or stack)
 
             if (managed)
             {
-                result = new TypedValue(generateMalloc(context, structType->getManagedPointerToType()->getLLVMPointedType(context), structType->getName()), new PointerType(structType, managed));
+                result = new TypedValue(generateMalloc(context, structType->getManagedPointerToType()->getLLVMPointedType(context), structType->getName()), new PointerType(structType, managed, unique));
 
                 // Set initial ref count to 1
                 std::vector<llvm::Value *> indices;
@@ -1545,9 +2445,14 @@ TypedValue *ASTStruct::generateLLVM(GenerationContext *context, FunctionScope *s
                 llvm::Value *refCountFieldPointer = context->irBuilder->CreateGEP(structPointerType->getLLVMPointedType(context), result->getValue(), indices, structType->getName() + ".refcount.ptr");
                 context->irBuilder->CreateStore(llvm::ConstantInt::get(getRefCountType(*context->context), 1, false), refCountFieldPointer, false);
             }
+            else if (unique)
+            {
+                // Unique objects have a single owner, they need no reference count
+                result = new TypedValue(generateMalloc(context, structType->getLLVMType(context), structType->getName()), new PointerType(structType, managed, unique));
+            }
             else
             {
-                result = new TypedValue(generateAllocaInCurrentFunction(context, structType->getLLVMType(context), structType->getName()), new PointerType(structType, managed));
+                result = new TypedValue(generateAllocaInCurrentFunction(context, structType->getLLVMType(context), structType->getName()), new PointerType(structType, managed, unique));
             }
 
             for (auto &pair : fieldValues)
@@ -1555,7 +2460,7 @@ TypedValue *ASTStruct::generateLLVM(GenerationContext *context, FunctionScope *s
                 auto fieldName = pair.first;
                 auto fieldValue = pair.second;
                 auto fieldType = structType->getField(fieldName);
-                auto fieldIndex = structType->getFieldIndex(fieldName);
+                auto fieldIndex = structType->getFieldIndex(context, fieldName);
 
                 std::vector<llvm::Value *> indices;
                 indices.push_back(llvm::ConstantInt::get(llvm::IntegerType::getInt32Ty(*context->context), 0, false));
@@ -1605,7 +2510,7 @@ TypedValue *ASTStruct::generateLLVM(GenerationContext *context, FunctionScope *s
         }
         else
         {
-            type = new TypedValue(NULL, new PointerType(structType, managed));
+            type = new TypedValue(NULL, new PointerType(structType, managed, unique));
         }
 
         if (this->nameToken != NULL)
@@ -1617,6 +2522,7 @@ TypedValue *ASTStruct::generateLLVM(GenerationContext *context, FunctionScope *s
 
                 return NULL;
             }
+            context->structTypes.push_back(structType);
         }
 
         return type;
@@ -1628,7 +2534,12 @@ TypedValue *ASTStructField::generateLLVM(GenerationContext *context, FunctionSco
 #ifdef DEBUG
     std::cout << "debug: ASTStructField::generateLLVM " << this->nameToken->value << "\n";
 #endif
-    return this->value->generateLLVM(context, scope, typeHint, expectPointer);
+    if (expectPointer)
+    {
+        return this->value->generateLLVM(context, scope, typeHint, expectPointer);
+    }
+    // The struct becomes the owner of the field value
+    return generateOwnedValue(context, scope, this->value, typeHint);
 }
 
 TypedValue *ASTUnaryOperator::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
@@ -1723,16 +2634,81 @@ TypedValue *ASTCast::generateLLVM(GenerationContext *context, FunctionScope *sco
 
 TypedValue *ASTOperator::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
 {
-    TokenType operatorType = this->operatorToken->type;
-
 #ifdef DEBUG
     std::cout << "debug: ASTOperator::generateLLVM left\n";
 #endif
-    auto *left = this->left->generateLLVM(context, scope, NULL, false);
+    if (this->operatorToken->type != TokenType::OPERATOR_ADDITION)
+    {
+        return this->generateLLVMWithLeft(context, scope, this->left->generateLLVM(context, scope, NULL, false));
+    }
+
+    // a + b + c is parsed as ((a + b) + c), the first operand of the chain tells if it concatenates Strings,
+    // which are concatenated all at once so only a single allocation is done
+    std::vector<ASTOperator *> chain;
+    ASTNode *first = this;
+    while (first->type == ASTNodeType::OPERATOR && static_cast<ASTOperator *>(first)->operatorToken->type == TokenType::OPERATOR_ADDITION)
+    {
+        chain.insert(chain.begin(), static_cast<ASTOperator *>(first));
+        first = static_cast<ASTOperator *>(first)->left;
+    }
+
+    TypedValue *left = first->generateLLVM(context, scope, NULL, false);
+    TypedValue *firstString = left == NULL || left->isType() ? NULL : generateStringToPointer(context, left);
+    if (firstString != NULL)
+    {
+        std::vector<TypedValue *> parts;
+        parts.push_back(left);
+        for (ASTOperator *addition : chain)
+        {
+            TypedValue *part = addition->right->generateLLVM(context, scope, &STRING_TYPE, false);
+            if (part == NULL)
+            {
+                return NULL;
+            }
+            parts.push_back(part);
+        }
+
+        TypedValue *concatenated = generateStringConcatenation(context, parts);
+        if (concatenated == NULL)
+        {
+            exit(-1);
+            return NULL;
+        }
+        return concatenated;
+    }
+
+    for (ASTOperator *addition : chain)
+    {
+        left = addition->generateLLVMWithLeft(context, scope, left);
+    }
+    return left;
+}
+
+TypedValue *ASTOperator::generateLLVMWithLeft(GenerationContext *context, FunctionScope *scope, TypedValue *left)
+{
+    TokenType operatorType = this->operatorToken->type;
+
 #ifdef DEBUG
     std::cout << "debug: ASTOperator::generateLLVM right\n";
 #endif
-    auto *right = this->right->generateLLVM(context, scope, NULL, false);
+    // Literals next to a vector become vector constants (Float32x8 * 2.0), literals next to an array get its item type
+    Type *rightTypeHint = NULL;
+    if (left != NULL && !left->isType())
+    {
+        if (getTypeLanes(left->getType()) > 1)
+        {
+            rightTypeHint = left->getType();
+        }
+        else if (left->getTypeCode() == TypeCode::ARRAY && this->right->type != ASTNodeType::ARRAY)
+        {
+            rightTypeHint = static_cast<ArrayType *>(left->getType())->getItemType();
+        }
+        else if (left->getTypeCode() == TypeCode::ARRAY_EXPRESSION && this->right->type != ASTNodeType::ARRAY)
+        {
+            rightTypeHint = static_cast<ArrayExpressionType *>(left->getType())->getItemType();
+        }
+    }
+    auto *right = this->right->generateLLVM(context, scope, rightTypeHint, false);
 
     if (!left || !right)
     {
@@ -1843,263 +2819,12 @@ TypedValue *ASTOperator::generateLLVM(GenerationContext *context, FunctionScope
         return NULL;
     }
 
-    bool allowTypeJuggling;
-    switch (operatorType)
-    {
-    case TokenType::OPERATOR_DOUBLE_AND:
-    case TokenType::OPERATOR_DOUBLE_OR:
-        allowTypeJuggling = false;
-        break;
-    default:
-        allowTypeJuggling = true;
-        break;
-    }
-
-    if (allowTypeJuggling)
-    {
-        if (!generateTypeJugging(context, &left, &right))
-        {
-            std::cout << "ERROR: Cannot " << this->operatorToken->value << " values, their types cannot be matched\n";
-            exit(-1);
-
-            return NULL;
-        }
-    }
-    else
-    {
-        if (*left->getType() != *right->getType())
-        {
-            std::cout << "ERROR: Left and right operands must be the same type to perform " << this->operatorToken->value << "\n";
-            exit(-1);
-
-            return NULL;
-        }
-    }
-
-    auto sharedType = left->getType(); // or right->getType()
-    if (sharedType->getTypeCode() == TypeCode::POINTER)
-    {
-        left = generateDereferenceToValue(context, left);
-        right = generateDereferenceToValue(context, right);
-        sharedType = left->getType(); // or right->getType()
-    }
-
-    auto leftValue = left->getValue();
-    auto rightValue = right->getValue();
-    if (sharedType->getTypeCode() == TypeCode::FLOAT)
-    {
-        FloatType *sharedFloatType = static_cast<FloatType *>(sharedType);
-        Type *resultingType = sharedType;
-        llvm::Value *result;
-
-        switch (operatorType)
-        {
-        case TokenType::OPERATOR_ADDITION:
-            result = context->irBuilder->CreateFAdd(leftValue, rightValue, "opaddfp");
-            break;
-        case TokenType::OPERATOR_SUBSTRACTION:
-            result = context->irBuilder->CreateFSub(leftValue, rightValue, "opsubfp");
-            break;
-        case TokenType::OPERATOR_MULTIPLICATION:
-            result = context->irBuilder->CreateFMul(leftValue, rightValue, "opmulfp");
-            break;
-        case TokenType::OPERATOR_DIVISION:
-            result = context->irBuilder->CreateFDiv(leftValue, rightValue, "opdivfp");
-            break;
-        case TokenType::OPERATOR_PERCENT:
-            result = context->irBuilder->CreateFRem(leftValue, rightValue, "opmodfp");
-            break;
-        case TokenType::OPERATOR_LT:
-            result = context->irBuilder->CreateFCmpULT(leftValue, rightValue, "opcmpltfp");
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_GT:
-            result = context->irBuilder->CreateFCmpUGT(leftValue, rightValue, "opcmpgtfp");
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_LTE:
-            result = context->irBuilder->CreateFCmpULE(leftValue, rightValue, "opcmplefp");
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_GTE:
-            result = context->irBuilder->CreateFCmpUGE(leftValue, rightValue, "opcmpgefp");
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_EQUALS:
-            result = context->irBuilder->CreateFCmpUEQ(leftValue, rightValue, "opcmpeqfp");
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_NOT_EQUALS:
-            result = context->irBuilder->CreateFCmpUNE(leftValue, rightValue, "opcmpnefp");
-            resultingType = &BOOL_TYPE;
-            break;
-
-        case TokenType::OPERATOR_DOUBLE_GT:
-        case TokenType::OPERATOR_DOUBLE_LT:
-        case TokenType::OPERATOR_AND:
-        case TokenType::OPERATOR_OR:
-        case TokenType::OPERATOR_DOUBLE_AND:
-        case TokenType::OPERATOR_DOUBLE_OR:
-        case TokenType::OPERATOR_CARET:
-        default:
-            std::cout << "ERROR: Invalid operator '" << this->operatorToken->value << "' on floats\n";
-            exit(-1);
-
-            return NULL;
-        }
-
-        return new TypedValue(result, resultingType);
-    }
-    else if (sharedType->getTypeCode() == TypeCode::INTEGER)
+    if (left->getTypeCode() == TypeCode::ARRAY_EXPRESSION || right->getTypeCode() == TypeCode::ARRAY_EXPRESSION || left->getTypeCode() == TypeCode::ARRAY || right->getTypeCode() == TypeCode::ARRAY)
     {
-        IntegerType *sharedIntType = static_cast<IntegerType *>(sharedType);
-        Type *resultingType = sharedType;
-        llvm::Value *result;
-
-        switch (operatorType)
-        {
-        case TokenType::OPERATOR_ADDITION:
-            result = context->irBuilder->CreateAdd(leftValue, rightValue, "addint");
-            break;
-        case TokenType::OPERATOR_SUBSTRACTION:
-            result = context->irBuilder->CreateSub(leftValue, rightValue, "opsubint");
-            break;
-        case TokenType::OPERATOR_MULTIPLICATION:
-            result = context->irBuilder->CreateMul(leftValue, rightValue, "opmulint");
-            break;
-        case TokenType::OPERATOR_DIVISION:
-            if (sharedIntType->getSigned())
-            {
-                result = context->irBuilder->CreateSDiv(leftValue, rightValue, "opdivint");
-            }
-            else
-            {
-                result = context->irBuilder->CreateUDiv(leftValue, rightValue, "opdivint");
-            }
-            break;
-        case TokenType::OPERATOR_PERCENT:
-            if (sharedIntType->getSigned())
-            {
-                result = context->irBuilder->CreateSRem(leftValue, rightValue, "opmodint");
-            }
-            else
-            {
-                result = context->irBuilder->CreateURem(leftValue, rightValue, "opmodint");
-            }
-            break;
-        case TokenType::OPERATOR_LT:
-            if (sharedIntType->getSigned())
-            {
-                result = context->irBuilder->CreateICmpSLT(leftValue, rightValue, "opcmpltint");
-            }
-            else
-            {
-                result = context->irBuilder->CreateICmpULT(leftValue, rightValue, "opcmpltint");
-            }
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_GT:
-            if (sharedIntType->getSigned())
-            {
-                result = context->irBuilder->CreateICmpSGT(leftValue, rightValue, "opcmpgtint");
-            }
-            else
-            {
-                result = context->irBuilder->CreateICmpUGT(leftValue, rightValue, "opcmpgtint");
-            }
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_LTE:
-            if (sharedIntType->getSigned())
-            {
-                result = context->irBuilder->CreateICmpSLE(leftValue, rightValue, "opcmpleint");
-            }
-            else
-            {
-                result = context->irBuilder->CreateICmpULE(leftValue, rightValue, "opcmpleint");
-            }
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_GTE:
-            if (sharedIntType->getSigned())
-            {
-                result = context->irBuilder->CreateICmpSGE(leftValue, rightValue, "opcmpgeint");
-            }
-            else
-            {
-                result = context->irBuilder->CreateICmpUGE(leftValue, rightValue, "opcmpgeint");
-            }
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_EQUALS:
-            result = context->irBuilder->CreateICmpEQ(leftValue, rightValue, "opcmpeqint");
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_NOT_EQUALS:
-            result = context->irBuilder->CreateICmpNE(leftValue, rightValue, "opcmpneint");
-            resultingType = &BOOL_TYPE;
-            break;
-        case TokenType::OPERATOR_DOUBLE_GT:
-            // TODO: ashr instruction
-            result = context->irBuilder->CreateLShr(leftValue, rightValue, "oplshrint");
-            break;
-        case TokenType::OPERATOR_DOUBLE_LT:
-            result = context->irBuilder->CreateShl(leftValue, rightValue, "opshlint");
-            break;
-        case TokenType::OPERATOR_DOUBLE_AND:
-        {
-            IntegerType *leftIntegerType = static_cast<IntegerType *>(left->getType());
-            IntegerType *rightIntegerType = static_cast<IntegerType *>(right->getType());
-            if (leftIntegerType->getBitSize() != 1 || rightIntegerType->getBitSize() != 1)
-            {
-                std::cout << "ERROR: Logical and operator can only be used on booleans\n";
-                exit(-1);
-
-                return NULL;
-            }
-            result = context->irBuilder->CreateAnd(leftValue, rightValue, "opandint");
-            break;
-        }
-        case TokenType::OPERATOR_DOUBLE_OR:
-        {
-            IntegerType *leftIntegerType = static_cast<IntegerType *>(left->getType());
-            IntegerType *rightIntegerType = static_cast<IntegerType *>(right->getType());
-            if (leftIntegerType->getBitSize() != 1 || rightIntegerType->getBitSize() != 1)
-            {
-                std::cout << "ERROR: Logical or operator can only be used on booleans\n";
-                exit(-1);
-
-                return NULL;
-            }
-            result = context->irBuilder->CreateOr(leftValue, rightValue, "oporint");
-            break;
-        }
-        case TokenType::OPERATOR_AND:
-            result = context->irBuilder->CreateAnd(leftValue, rightValue, "opandint");
-            break;
-        case TokenType::OPERATOR_OR:
-            result = context->irBuilder->CreateOr(leftValue, rightValue, "oporint");
-            break;
-        case TokenType::OPERATOR_CARET:
-            result = context->irBuilder->CreateXor(leftValue, rightValue, "opxorint");
-            break;
-
-        default:
-            std::cout << "ERROR: Invalid operator '" << this->operatorToken->value << "' on integers\n";
-            exit(-1);
-
-            return NULL;
-        }
-
-        return new TypedValue(result, resultingType);
+        return generateArrayExpression(context, this->operatorToken, left, right);
     }
-    else
-    {
-        std::cout << "ERROR: Cannot " << this->operatorToken->value << " values, the type does not support this operator\n";
-        exit(-1);
 
-        return NULL;
-    }
+    return generateBinaryOperator(context, this->operatorToken, left, right);
 }
 
 TypedValue *ASTLiteralString::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
@@ -2107,9 +2832,20 @@ TypedValue *ASTLiteralString::generateLLVM(GenerationContext *context, FunctionS
 #ifdef DEBUG
     std::cout << "debug: ASTLiteralString::generateLLVM\n";
 #endif
-    auto value = context->irBuilder->CreateGlobalString(this->valueToken->value, "str");
-    Type *type = new ArrayType(&CHAR_TYPE, this->valueToken->value.length() + 1, false, true);
-    return new TypedValue(value, type);
+    if (typeHint == NULL || typeHint->getTypeCode() != TypeCode::ARRAY)
+    {
+        return generateStringLiteral(context, this->valueToken->value);
+    }
+
+    // A string literal that is used as an array is an immortal constant array of its characters, it is never counted or freed
+    std::vector<llvm::Constant *> llvmCharacters;
+    for (char character : this->valueToken->value)
+    {
+        llvmCharacters.push_back(llvm::ConstantInt::get(CHAR_TYPE.getLLVMType(context), (uint64_t)(uint8_t)character, false));
+    }
+    llvmCharacters.push_back(llvm::ConstantInt::get(CHAR_TYPE.getLLVMType(context), 0, false));
+    ArrayType *type = new ArrayType(&CHAR_TYPE, (int64_t)llvmCharacters.size(), false, true);
+    return generateImmortalArray(context, type, llvmCharacters, "str");
 }
 
 TypedValue *ASTDeclaration::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
@@ -2118,7 +2854,23 @@ TypedValue *ASTDeclaration::generateLLVM(GenerationContext *context, FunctionSco
     std::cout << "debug: ASTDeclaration::generateLLVM\n";
 #endif
 
-    if (scope->hasValue(this->nameToken->value))
+    if (this->staticPointer != NULL)
+    {
+        return this->staticPointer;
+    }
+    if (this->itemNameTokens != NULL)
+    {
+        return this->generateDestructuring(context, scope);
+    }
+
+    // Module-level declarations become globals, their value is generated outside of any function
+    llvm::IRBuilderBase::InsertPoint savedInsertPoint = context->irBuilder->saveIP();
+    if (this->isStatic)
+    {
+        scope = NULL;
+        context->irBuilder->ClearInsertionPoint();
+    }
+    else if (scope->hasValue(this->nameToken->value))
     {
         std::cout << "ERROR: Cannot redeclare '" << this->nameToken->value << "', it has already been declared\n";
         exit(-1);
@@ -2147,7 +2899,7 @@ TypedValue *ASTDeclaration::generateLLVM(GenerationContext *context, FunctionSco
     TypedValue *initialValue;
     if (this->value != NULL)
     {
-        initialValue = this->value->generateLLVM(context, scope, specifiedType, false);
+        initialValue = generateOwnedValue(context, scope, this->value, specifiedType);
     }
     else
     {
@@ -2166,7 +2918,19 @@ TypedValue *ASTDeclaration::generateLLVM(GenerationContext *context, FunctionSco
     }
     else
     {
-        if (initialValue != NULL)
+        if (initialValue != NULL && initialValue->getTypeCode() == TypeCode::ARRAY_EXPRESSION)
+        {
+            // let c = a * b stores the computed array
+            storedType = static_cast<ArrayExpressionType *>(initialValue->getType())->getResultArrayType();
+        }
+        else if (initialValue != NULL && initialValue->getTypeCode() == TypeCode::TUPLE)
+        {
+            std::cout << "ERROR: A tuple cannot be stored in '" << this->nameToken->value << "', take it apart with let (a, b) = ...\n";
+            exit(-1);
+
+            return NULL;
+        }
+        else if (initialValue != NULL)
         {
             storedType = initialValue->getType();
         }
@@ -2179,8 +2943,28 @@ TypedValue *ASTDeclaration::generateLLVM(GenerationContext *context, FunctionSco
         }
     }
 
-    llvm::Value *pointerValue = generateAllocaInCurrentFunction(context, storedType->getLLVMType(context), this->nameToken->value);
-    TypedValue *valuePointer = new TypedValue(pointerValue, storedType->getUnmanagedPointerToType());
+    if (this->isStatic)
+    {
+        TypedValue *convertedValue = generateTypeConversion(context, initialValue, storedType, false);
+        if (convertedValue == NULL || !llvm::isa<llvm::Constant>(convertedValue->getValue()))
+        {
+            std::cout << "ERROR: Module-level declaration '" << this->nameToken->value << "' must have a constant value\n";
+            exit(-1);
+
+            return NULL;
+        }
+
+        llvm::GlobalVariable *llvmGlobal = new llvm::GlobalVariable(*context->module, storedType->getLLVMType(context), false, llvm::GlobalValue::PrivateLinkage, llvm::cast<llvm::Constant>(convertedValue->getValue()), this->nameToken->value);
+        this->staticPointer = new TypedValue(llvmGlobal, storedType->getUnmanagedPointerToType(), this->nameToken->value);
+
+        context->irBuilder->restoreIP(savedInsertPoint);
+        return this->staticPointer;
+    }
+
+    // The stack slot is only live until the end of the scope, so slots of disjoint scopes can be shared
+    llvm::Value *pointerValue = generateAllocaInCurrentFunction(context, storedType->getLLVMType(context), this->nameToken->value, getTypeAlign(storedType));
+    context->irBuilder->CreateLifetimeStart(pointerValue);
+    TypedValue *valuePointer = new TypedValue(pointerValue, storedType->getUnmanagedPointerToType(), this->nameToken->value);
 
     if (!scope->addValue(this->nameToken->value, valuePointer))
     {
@@ -2202,25 +2986,147 @@ TypedValue *ASTDeclaration::generateLLVM(GenerationContext *context, FunctionSco
     return valuePointer;
 }
 
-TypedValue *ASTAssignment::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+// Declares a variable for every item of a tuple, the variables take over what the items own
+// An item named _ is released right away
+TypedValue *ASTDeclaration::generateDestructuring(GenerationContext *context, FunctionScope *scope)
 {
-#ifdef DEBUG
-    std::cout << "debug: ASTAssignment::generateLLVM\n";
-#endif
+    Type *specifiedType = NULL;
+    if (this->typeSpecifier != NULL)
+    {
+        TypedValue *specifiedTypeValue = this->typeSpecifier->generateLLVM(context, scope, NULL, false);
+        if (!specifiedTypeValue->isType())
+        {
+            std::cout << "ERROR: Declaration type specifier may not have value\n";
+            exit(-1);
 
-    bool isVolatile = false;
+            return NULL;
+        }
+        specifiedType = specifiedTypeValue->getType();
+    }
 
-    TypedValue *valuePointer = this->pointerValue->generateLLVM(context, scope, NULL, true);
-    if (valuePointer == NULL)
+    TypedValue *tupleValue = this->value->generateLLVM(context, scope, specifiedType, false);
+    if (tupleValue != NULL && !tupleValue->isType() && specifiedType != NULL)
     {
-        std::cout << "ERROR: Cannot set variable '" << valuePointer->getOriginVariable() << "', it is not found\n";
+        tupleValue = generateTypeConversion(context, tupleValue, specifiedType, false);
+    }
+    if (tupleValue == NULL || tupleValue->isType() || tupleValue->getTypeCode() != TypeCode::TUPLE)
+    {
+        std::cout << "ERROR: Only a tuple value can be taken apart with let (...)\n";
         exit(-1);
 
         return NULL;
     }
-    if (valuePointer->getTypeCode() != TypeCode::POINTER)
+    std::vector<Type *> &itemTypes = static_cast<TupleType *>(tupleValue->getType())->getItemTypes();
+    if (itemTypes.size() != this->itemNameTokens->size())
     {
-        std::cout << "ERROR: Assert failed: valuePointer->getTypeCode() != TypeCode::POINTER\n";
+        std::cout << "ERROR: Cannot take apart " << tupleValue->getType()->toString() << " into " << this->itemNameTokens->size() << " variables\n";
+        exit(-1);
+
+        return NULL;
+    }
+
+    TypedValue *valuePointer = NULL;
+    for (int i = 0; i < itemTypes.size(); i++)
+    {
+        std::string name = (*this->itemNameTokens)[i]->value;
+        TypedValue *itemValue = new TypedValue(context->irBuilder->CreateExtractValue(tupleValue->getValue(), i, name), itemTypes[i], name);
+        if (name == "_")
+        {
+            generateDecrementReferenceIfPointer(context, itemValue, true);
+            generateUniqueRelease(context, itemValue);
+            continue;
+        }
+        if (scope->hasValue(name))
+        {
+            std::cout << "ERROR: Cannot redeclare '" << name << "', it has already been declared\n";
+            exit(-1);
+
+            return NULL;
+        }
+
+        llvm::Value *pointerValue = generateAllocaInCurrentFunction(context, itemTypes[i]->getLLVMType(context), name, getTypeAlign(itemTypes[i]));
+        context->irBuilder->CreateLifetimeStart(pointerValue);
+        valuePointer = new TypedValue(pointerValue, itemTypes[i]->getUnmanagedPointerToType(), name);
+        if (!scope->addValue(name, valuePointer) || !generateAssignment(context, valuePointer, itemValue, false))
+        {
+            std::cout << "ERROR: Cannot generate declaration for " << name << "\n";
+            exit(-1);
+
+            return NULL;
+        }
+    }
+    return valuePointer;
+}
+
+TypedValue *ASTAssignment::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+{
+#ifdef DEBUG
+    std::cout << "debug: ASTAssignment::generateLLVM\n";
+#endif
+
+    bool isVolatile = false;
+
+    if (this->pointerValue->type == ASTNodeType::DEREFERENCE_INDEX && static_cast<ASTIndexDereference *>(this->pointerValue)->getIsRange())
+    {
+        if (!static_cast<ASTIndexDereference *>(this->pointerValue)->generateVectorStore(context, scope, this->value))
+        {
+            std::cout << "ERROR: Cannot generate assignment\n";
+            exit(-1);
+            return NULL;
+        }
+        return NULL;
+    }
+
+    // A narrowed union variable is assigned as a whole, it is narrowed to the type of its new value afterwards
+    Type *narrowedType = NULL;
+    TypedValue *valuePointer;
+    std::string movedName = "";
+    if (this->pointerValue->type == ASTNodeType::SYMBOL && scope->isBorrowed(static_cast<ASTSymbol *>(this->pointerValue)->nameToken->value))
+    {
+        std::cout << "ERROR: Cannot assign borrowed parameter '" << static_cast<ASTSymbol *>(this->pointerValue)->nameToken->value << "', declare it as owned or use a new variable\n";
+        exit(-1);
+
+        return NULL;
+    }
+    if (this->pointerValue->type == ASTNodeType::SYMBOL && scope->isMoved(static_cast<ASTSymbol *>(this->pointerValue)->nameToken->value))
+    {
+        // A moved variable can be used again after this assignment (but not in its value)
+        movedName = static_cast<ASTSymbol *>(this->pointerValue)->nameToken->value;
+    }
+    if (this->pointerValue->type == ASTNodeType::SYMBOL && (narrowedType = scope->getNarrowedType(static_cast<ASTSymbol *>(this->pointerValue)->nameToken->value)) != NULL)
+    {
+        valuePointer = scope->getValue(static_cast<ASTSymbol *>(this->pointerValue)->nameToken->value);
+    }
+    else if (movedName != "")
+    {
+        valuePointer = scope->getValue(movedName);
+    }
+    else
+    {
+        valuePointer = this->pointerValue->generateLLVM(context, scope, NULL, true);
+    }
+    if (valuePointer == NULL)
+    {
+        std::cout << "ERROR: Cannot set variable '" << valuePointer->getOriginVariable() << "', it is not found\n";
+        exit(-1);
+
+        return NULL;
+    }
+    if (valuePointer->getTypeCode() == TypeCode::SOA_ITEM)
+    {
+        // ps[i] = ... stores every field in its column
+        Type *itemType = static_cast<SoAItemType *>(valuePointer->getType())->getArrayType()->getItemType();
+        if (!generateSoAItemStore(context, valuePointer, this->value->generateLLVM(context, scope, itemType, false)))
+        {
+            std::cout << "ERROR: Cannot generate assignment\n";
+            exit(-1);
+            return NULL;
+        }
+        return valuePointer;
+    }
+    if (valuePointer->getTypeCode() != TypeCode::POINTER)
+    {
+        std::cout << "ERROR: Assert failed: valuePointer->getTypeCode() != TypeCode::POINTER\n";
         exit(-1);
 
         return NULL;
@@ -2229,7 +3135,10 @@ TypedValue *ASTAssignment::generateLLVM(GenerationContext *context, FunctionScop
 
     // TODO: this code will segfault when the declaration hasn't specified a value (previous value is uninitialized)
     llvm::Value *llvmPreviousStoredValue = context->irBuilder->CreateLoad(valuePointerType->getPointedType()->getLLVMType(context), valuePointer->getValue(), valuePointer->getOriginVariable() + ".load");
-    generateDecrementReferenceIfPointer(context, new TypedValue(llvmPreviousStoredValue, valuePointerType->getPointedType()), false);
+    if (valuePointerType->getPointedType()->getTypeCode() != TypeCode::STRING)
+    {
+        generateDecrementReferenceIfPointer(context, new TypedValue(llvmPreviousStoredValue, valuePointerType->getPointedType()), false);
+    }
 
     // if (valuePointerType->getPointedType()->getTypeCode() == TypeCode::POINTER)
     // {
@@ -2248,7 +3157,36 @@ TypedValue *ASTAssignment::generateLLVM(GenerationContext *context, FunctionScop
     //     }
     // }
 
-    TypedValue *newValue = this->value->generateLLVM(context, scope, valuePointerType->getPointedType(), false);
+    TypedValue *newValue = generateOwnedValue(context, scope, this->value, valuePointerType->getPointedType());
+    if (narrowedType != NULL && !(*newValue->getType() == *narrowedType))
+    {
+        std::string name = static_cast<ASTSymbol *>(this->pointerValue)->nameToken->value;
+        if (scope->isNarrowedOutsideLoop(name))
+        {
+            std::cout << "ERROR: Cannot assign " << newValue->getType()->toString() << " to '" << name << "' inside a loop, it is narrowed to " << narrowedType->toString() << " outside of the loop\n";
+            exit(-1);
+            return NULL;
+        }
+
+        // Like an is condition, narrowing to null or a union is useless
+        scope->dropNarrowings(name);
+        if (newValue->getTypeCode() != TypeCode::NULLT && newValue->getTypeCode() != TypeCode::UNION && static_cast<UnionType *>(valuePointerType->getPointedType())->containsType(newValue->getType()))
+        {
+            scope->pushNarrowing(name, newValue->getType());
+        }
+    }
+
+    // The previous unique object is freed once the new value is known, which could have been moved out of it (a = a.next)
+    if (getUniquePointerType(valuePointerType->getPointedType()) != NULL)
+    {
+        llvmPreviousStoredValue = context->irBuilder->CreateLoad(valuePointerType->getPointedType()->getLLVMType(context), valuePointer->getValue(), valuePointer->getOriginVariable() + ".load");
+        generateUniqueRelease(context, new TypedValue(llvmPreviousStoredValue, valuePointerType->getPointedType(), valuePointer->getOriginVariable()));
+    }
+    // Like the previous String, whose bytes the new value could have been built from (s = s + t)
+    if (valuePointerType->getPointedType()->getTypeCode() == TypeCode::STRING)
+    {
+        generateDecrementReferenceIfPointer(context, new TypedValue(llvmPreviousStoredValue, valuePointerType->getPointedType(), valuePointer->getOriginVariable()), true);
+    }
 
     if (!generateAssignment(context, valuePointer, newValue, isVolatile))
     {
@@ -2256,6 +3194,10 @@ TypedValue *ASTAssignment::generateLLVM(GenerationContext *context, FunctionScop
         exit(-1);
         return NULL;
     }
+    if (movedName != "")
+    {
+        scope->setMoved(movedName, false);
+    }
 
     return valuePointer;
 }
@@ -2275,7 +3217,7 @@ TypedValue *ASTReturn::generateLLVM(GenerationContext *context, FunctionScope *s
             return NULL;
         }
 
-        auto value = this->value->generateLLVM(context, scope, returnType, false);
+        auto value = generateOwnedValue(context, scope, this->value, returnType);
         if (value == NULL)
         {
             std::cout << "ERROR: Could not generate return value\n";
@@ -2293,22 +3235,23 @@ TypedValue *ASTReturn::generateLLVM(GenerationContext *context, FunctionScope *s
             return NULL;
         }
 
-        context->irBuilder->CreateStore(newValue->getValue(), context->currentFunctionReturnValuePointer, false);
-        context->irBuilder->CreateBr(context->currentFunctionReturnBlock);
-        return NULL;
+        generateAggregateStore(context, newValue->getValue(), context->currentFunctionReturnValuePointer);
     }
-    else
+    else if (returnType != NULL)
     {
-        if (returnType != NULL)
-        {
-            std::cout << "ERROR: Return statement must provide a value\n";
-            exit(-1);
+        std::cout << "ERROR: Return statement must provide a value\n";
+        exit(-1);
 
-            return NULL;
-        }
-        context->irBuilder->CreateBr(context->currentFunctionReturnBlock);
         return NULL;
     }
+
+    // Leaves every scope up to the function scope
+    for (FunctionScope *exitedScope = scope; exitedScope != NULL; exitedScope = exitedScope->parent)
+    {
+        generateScopeEnd(context, exitedScope);
+    }
+    context->irBuilder->CreateBr(context->currentFunctionReturnBlock);
+    return NULL;
 }
 
 TypedValue *ASTBlock::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
@@ -2316,12 +3259,14 @@ TypedValue *ASTBlock::generateLLVM(GenerationContext *context, FunctionScope *sc
 #ifdef DEBUG
     std::cout << "debug: ASTBlock::generateLLVM\n";
 #endif
+    // Values declared and narrowings from guards in this block end with it
+    FunctionScope *blockScope = new FunctionScope(scope);
     for (ASTNode *statement : *this->statements)
     {
 #ifdef DEBUG
         std::cout << "debug: ASTBlock::generateLLVM generate " << astNodeTypeToString(statement->type) << "\n";
 #endif
-        TypedValue *value = statement->generateLLVM(context, scope, NULL, true);
+        TypedValue *value = statement->generateLLVM(context, blockScope, NULL, true);
 #ifdef DEBUG
         std::cout << "debug: ASTBlock::generateLLVM generate " << astNodeTypeToString(statement->type) << "done \n";
 #endif
@@ -2336,6 +3281,10 @@ TypedValue *ASTBlock::generateLLVM(GenerationContext *context, FunctionScope *sc
 #ifdef DEBUG
     std::cout << "debug: ASTBlock::generateLLVM cdone\n";
 #endif
+    if (context->irBuilder->GetInsertBlock()->getTerminator() == NULL)
+    {
+        generateScopeEnd(context, blockScope);
+    }
     return NULL;
 }
 
@@ -2347,6 +3296,24 @@ TypedValue *ASTParameter::generateLLVM(GenerationContext *context, FunctionScope
     return this->typeSpecifier->generateLLVM(context, scope, typeHint, expectPointer);
 }
 
+// Marks a pointer parameter as non-null and dereferenceable for the size and alignment of llvmPointedType (or align when it is larger)
+static void addPointerParameterAttributes(GenerationContext *context, llvm::Argument *llvmParameter, llvm::Type *llvmPointedType, uint64_t align, bool noAlias)
+{
+    const llvm::DataLayout &dataLayout = context->module->getDataLayout();
+    auto attributeBuilder = llvm::AttrBuilder(*context->context);
+    attributeBuilder.addAttribute(llvm::Attribute::NonNull);
+    if (llvmPointedType->isSized())
+    {
+        attributeBuilder.addDereferenceableAttr(dataLayout.getTypeStoreSize(llvmPointedType));
+        attributeBuilder.addAlignmentAttr(std::max(align, (uint64_t)dataLayout.getABITypeAlign(llvmPointedType).value()));
+    }
+    if (noAlias)
+    {
+        attributeBuilder.addAttribute(llvm::Attribute::NoAlias);
+    }
+    llvmParameter->addAttrs(attributeBuilder);
+}
+
 TypedValue *ASTFunction::generateLLVM(GenerationContext *context, FunctionScope *_, Type *typeHint, bool expectPointer)
 {
 #ifdef DEBUG
@@ -2364,7 +3331,7 @@ TypedValue *ASTFunction::generateLLVM(GenerationContext *context, FunctionScope
 
             return NULL;
         }
-        parameters.push_back(FunctionParameter(parameterTypeValue->getType(), parameter->getParameterName()));
+        parameters.push_back(FunctionParameter(parameterTypeValue->getType(), parameter->getParameterName(), parameter->isOwned()));
     }
 
     Type *returnType;
@@ -2385,7 +3352,7 @@ TypedValue *ASTFunction::generateLLVM(GenerationContext *context, FunctionScope
         returnType = NULL;
     }
 
-    FunctionType *newFunctionType = new FunctionType(returnType, parameters);
+    FunctionType *newFunctionType = new FunctionType(returnType, parameters, !this->exported && this->body != NULL);
 
     bool isVarArg = false;
     llvm::GlobalValue::LinkageTypes linkage = this->exported ? llvm::Function::ExternalLinkage : llvm::Function::PrivateLinkage;
@@ -2408,25 +3375,47 @@ TypedValue *ASTFunction::generateLLVM(GenerationContext *context, FunctionScope
         fnAttributeBuilder.addAttribute("wasm-export-name", this->nameToken->value);
     }
     function->addFnAttrs(fnAttributeBuilder);
+    if (newFunctionType->isInternal())
+    {
+        // Only called from this module, so it does not have to follow the C calling convention
+        function->setCallingConv(llvm::CallingConv::Fast);
+    }
+
+    // The return pointer points to fresh memory of the caller
+    int firstParameter = 0;
+    if (newFunctionType->hasReturnPointer(context))
+    {
+        auto returnPointerValue = function->getArg(firstParameter++);
+        returnPointerValue->setName("return");
+        llvm::Type *llvmReturnType = returnType->getLLVMType(context);
+        addPointerParameterAttributes(context, returnPointerValue, llvmReturnType, getTypeAlign(returnType), true);
+        returnPointerValue->addAttrs(llvm::AttrBuilder(*context->context).addStructRetAttr(llvmReturnType));
+    }
 
     // Name parameters and add parameter attributes when needed
     for (int i = 0; i < parameters.size(); i++)
     {
         auto parameter = parameters[i];
-        auto parameterValue = function->getArg(i);
+        auto parameterValue = function->getArg(firstParameter + i);
         parameterValue->setName(parameter.name);
 
-        // if (parameter.type->getTypeCode() == TypeCode::POINTER)
-        // {
-        //     PointerType *parameterPointerType = static_cast<PointerType *>(parameter.type);
-        //     if (parameterPointerType->isByValue())
-        //     {
-        //         // Add ByVal attribute to pointers that should be passed by value
-        //         auto attributeBuilder = llvm::AttrBuilder(*context->context);
-        //         attributeBuilder.addByValAttr(parameterPointerType->getPointedType()->getLLVMType(context));
-        //         parameterValue->addAttrs(attributeBuilder);
-        //     }
-        // }
+        if (newFunctionType->isPassedByPointer(context, parameter.type))
+        {
+            // The copy is only used by this function
+            addPointerParameterAttributes(context, parameterValue, parameter.type->getLLVMType(context), getTypeAlign(parameter.type), true);
+        }
+        else if (!this->exported && parameter.type->getTypeCode() == TypeCode::POINTER)
+        {
+            // Pointers are never null and point to a whole object, unless they are unioned with null
+            // The object was moved into an owned unique parameter, no other pointer can reach it during the call
+            // A borrowed unique pointer could also be passed to another parameter of the same call
+            PointerType *parameterPointerType = static_cast<PointerType *>(parameter.type);
+            Type *pointedType = parameterPointerType->getPointedType();
+            if (pointedType != NULL && pointedType->getTypeCode() != TypeCode::FUNCTION)
+            {
+                addPointerParameterAttributes(context, parameterValue, parameterPointerType->getLLVMPointedType(context), 0, parameter.owned && parameterPointerType->isUnique());
+            }
+        }
     }
 
     TypedValue *newFunctionPointerType = new TypedValue(function, newFunctionType->getUnmanagedPointerToType());
@@ -2457,12 +3446,20 @@ TypedValue *ASTFunction::generateLLVM(GenerationContext *context, FunctionScope
         PointerType *functionPointerType = static_cast<PointerType *>(newFunctionPointerType->getType());
         context->currentFunction = static_cast<FunctionType *>(functionPointerType->getPointedType());
         context->currentFunctionReturnBlock = llvm::BasicBlock::Create(*context->context, this->nameToken->value + ".return", function);
-        context->currentFunctionReturnValuePointer = returnType == NULL ? NULL : generateAllocaInCurrentFunction(context, returnType->getLLVMType(context), "return");
+        if (firstParameter > 0)
+        {
+            // The return value is built in the memory of the caller
+            context->currentFunctionReturnValuePointer = function->getArg(0);
+        }
+        else
+        {
+            context->currentFunctionReturnValuePointer = returnType == NULL ? NULL : generateAllocaInCurrentFunction(context, returnType->getLLVMType(context), "return", getTypeAlign(returnType));
+        }
 
         for (int i = 0; i < this->parameters->size(); i++)
         {
             ASTParameter *parameter = (*this->parameters)[i];
-            auto parameterValue = function->getArg(i);
+            auto parameterValue = function->getArg(firstParameter + i);
 
             TypedValue *parameterTypeValue = parameter->generateLLVM(context, NULL, NULL, false);
             if (!parameterTypeValue->isType())
@@ -2474,9 +3471,26 @@ TypedValue *ASTFunction::generateLLVM(GenerationContext *context, FunctionScope
             }
             Type *parameterType = parameterTypeValue->getType();
 
-            auto parameterPointer = context->irBuilder->CreateAlloca(parameterType->getLLVMType(context), NULL, "loadarg");
-            context->irBuilder->CreateStore(parameterValue, parameterPointer, false);
-            functionScope->addValue(parameter->getParameterName(), new TypedValue(parameterPointer, parameterType->getUnmanagedPointerToType()));
+            llvm::Value *parameterPointer;
+            if (newFunctionType->isPassedByPointer(context, parameterType))
+            {
+                // The copy of the caller is not used after the call, it becomes the variable
+                parameterPointer = parameterValue;
+            }
+            else
+            {
+                parameterPointer = context->irBuilder->CreateAlloca(parameterType->getLLVMType(context), NULL, "loadarg");
+                context->irBuilder->CreateStore(parameterValue, parameterPointer, false);
+            }
+            if (parameters[i].isBorrowed())
+            {
+                functionScope->addBorrowedValue(parameter->getParameterName(), new TypedValue(parameterPointer, parameterType->getUnmanagedPointerToType()));
+            }
+            else
+            {
+                // Released at the end of the function like a variable
+                functionScope->addValue(parameter->getParameterName(), new TypedValue(parameterPointer, parameterType->getUnmanagedPointerToType()));
+            }
         }
 
         this->body->generateLLVM(context, functionScope, NULL, true);
@@ -2487,6 +3501,7 @@ TypedValue *ASTFunction::generateLLVM(GenerationContext *context, FunctionScope
         {
             if (returnType == NULL)
             {
+                generateScopeEnd(context, functionScope);
                 context->irBuilder->CreateBr(context->currentFunctionReturnBlock);
             }
             else
@@ -2498,41 +3513,10 @@ TypedValue *ASTFunction::generateLLVM(GenerationContext *context, FunctionScope
             }
         }
 
-        // Create return block and free values
+        // Every edge into the return block has released its values already
         context->irBuilder->SetInsertPoint(context->currentFunctionReturnBlock);
 
-        for (auto &p : functionScope->namedValues)
-        {
-            if (p.second->isType())
-            {
-                // std::map value could be null
-                continue;
-            }
-
-            PointerType *valuePointerType = static_cast<PointerType *>(p.second->getType());
-
-            llvm::Value *finalizedValue = context->irBuilder->CreateLoad(valuePointerType->getPointedType()->getLLVMType(context), p.second->getValue(), p.second->getOriginVariable() + ".load");
-            generateDecrementReferenceIfPointer(context, new TypedValue(finalizedValue, valuePointerType->getPointedType()), true);
-
-            // PointerType *valuePointerType = static_cast<PointerType *>(p.second->getType());
-            // if (valuePointerType->getPointedType()->getTypeCode() == TypeCode::POINTER)
-            // {
-            //     PointerType *storedPointerType = static_cast<PointerType *>(valuePointerType->getPointedType());
-            //     if (storedPointerType->isManaged())
-            //     {
-            //         llvm::Value *storedManagedPointer = context->irBuilder->CreateLoad(storedPointerType->getLLVMType(context), p.second->getValue(), p.second->getOriginVariable() + ".load");
-            //         if (!generateDecrementReference(context, new TypedValue(storedManagedPointer, storedPointerType), true))
-            //         {
-            //             std::cout << "ERROR: Could not generate decrement managed pointer code for return\n";
-            // exit(-1);
-
-            //             return NULL;
-            //         }
-            //     }
-            // }
-        }
-
-        if (context->currentFunctionReturnValuePointer != NULL)
+        if (context->currentFunctionReturnValuePointer != NULL && firstParameter == 0)
         {
             // auto returnValue = generateReferenceAwareLoad(context, new TypedValue(context->currentFunctionReturnValuePointer, returnType->getUnmanagedPointerToType(false)));
             auto returnValue = generateLoad(context, new TypedValue(context->currentFunctionReturnValuePointer, returnType->getUnmanagedPointerToType()));
@@ -2559,6 +3543,76 @@ TypedValue *ASTFunction::generateLLVM(GenerationContext *context, FunctionScope
     return newFunctionPointerType;
 }
 
+// Finds the union variable that a '<variable> is <type>' condition tests
+// whenTrue and whenFalse are set to the single type the variable must contain when the condition is true or false, or NULL
+const Token *getIsConditionNarrowing(GenerationContext *context, FunctionScope *scope, ASTNode *condition, Type **whenTrue, Type **whenFalse)
+{
+    *whenTrue = NULL;
+    *whenFalse = NULL;
+
+    if (condition->type != ASTNodeType::OPERATOR)
+    {
+        return NULL;
+    }
+    ASTOperator *operatorNode = static_cast<ASTOperator *>(condition);
+    if (operatorNode->operatorToken->type != TokenType::IS_KEYWORD || operatorNode->left->type != ASTNodeType::SYMBOL)
+    {
+        return NULL;
+    }
+
+    const Token *nameToken = static_cast<ASTSymbol *>(operatorNode->left)->nameToken;
+    TypedValue *variablePointer = scope->getValue(nameToken->value);
+    if (variablePointer == NULL || variablePointer->getTypeCode() != TypeCode::POINTER || scope->getNarrowedType(nameToken->value) != NULL)
+    {
+        return NULL;
+    }
+    Type *variableType = static_cast<PointerType *>(variablePointer->getType())->getPointedType();
+    if (variableType->getTypeCode() != TypeCode::UNION)
+    {
+        return NULL;
+    }
+
+    TypedValue *compareType = operatorNode->right->generateLLVM(context, scope, NULL, false);
+    if (compareType == NULL || !compareType->isType())
+    {
+        return NULL;
+    }
+
+    std::vector<Type *> matching, remaining;
+    for (auto type : static_cast<UnionType *>(variableType)->getTypes())
+    {
+        bool matches;
+        if (compareType->getTypeCode() == TypeCode::UNION)
+        {
+            matches = static_cast<UnionType *>(compareType->getType())->containsType(type);
+        }
+        else
+        {
+            matches = *type == *compareType->getType();
+        }
+
+        if (matches)
+        {
+            matching.push_back(type);
+        }
+        else
+        {
+            remaining.push_back(type);
+        }
+    }
+
+    // Narrowing to null is useless, it has no data
+    if (matching.size() == 1 && matching[0]->getTypeCode() != TypeCode::NULLT)
+    {
+        *whenTrue = matching[0];
+    }
+    if (remaining.size() == 1 && remaining[0]->getTypeCode() != TypeCode::NULLT)
+    {
+        *whenFalse = remaining[0];
+    }
+    return nameToken;
+}
+
 TypedValue *ASTWhileStatement::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
 {
 #ifdef DEBUG
@@ -2585,8 +3639,19 @@ TypedValue *ASTWhileStatement::generateLLVM(GenerationContext *context, Function
 
     context->irBuilder->SetInsertPoint(loopStartBlock);
     loopStartBlock->insertInto(parentFunction);
-    auto loopScope = scope; // TODO: new FunctionScope(*scope); This does not work because finalizers will not free
+    Type *narrowedWhenTrue, *narrowedWhenFalse;
+    const Token *narrowedNameToken = getIsConditionNarrowing(context, scope, this->condition, &narrowedWhenTrue, &narrowedWhenFalse);
+    int narrowingCount = scope->getNarrowingCount();
+
+    // The body and condition run again on every iteration, the loop scope itself holds no values
+    auto loopScope = new FunctionScope(scope);
+    loopScope->loop = true;
+    if (narrowedWhenTrue != NULL)
+    {
+        loopScope->pushNarrowing(narrowedNameToken->value, narrowedWhenTrue);
+    }
     this->loopBody->generateLLVM(context, loopScope, NULL, true);
+    loopScope->popNarrowings(narrowingCount);
 
     TypedValue *conditionValue = this->condition->generateLLVM(context, loopScope, &BOOL_TYPE, false);
     if (*conditionValue->getType() != BOOL_TYPE)
@@ -2604,10 +3669,15 @@ TypedValue *ASTWhileStatement::generateLLVM(GenerationContext *context, Function
 
     context->irBuilder->SetInsertPoint(elseStartBlock);
     elseStartBlock->insertInto(parentFunction);
-    auto elseScope = scope; // TODO: new FunctionScope(*scope); This does not work because finalizers will not free
+    auto elseScope = scope;
     if (this->elseBody != NULL)
     {
+        if (narrowedWhenFalse != NULL)
+        {
+            elseScope->pushNarrowing(narrowedNameToken->value, narrowedWhenFalse);
+        }
         this->elseBody->generateLLVM(context, elseScope, NULL, true);
+        elseScope->popNarrowings(narrowingCount);
     }
     llvm::BasicBlock *elseEndBlock = context->irBuilder->GetInsertBlock(); // Current block could have changed in generateLLVM calls above, update it here
     if (elseEndBlock->getTerminator() == NULL)
@@ -2623,108 +3693,464 @@ TypedValue *ASTWhileStatement::generateLLVM(GenerationContext *context, Function
     return NULL;
 }
 
-TypedValue *ASTIndexDereference::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+// Converts an array index (or slice bound) to 64 bit, a negative index becomes a large unsigned value which fails the bounds check
+static llvm::Value *generateArrayIndex(GenerationContext *context, TypedValue *indexValue)
 {
-#ifdef DEBUG
-    std::cout << "debug: ASTIndexDereference::generateLLVM\n";
-#endif
-
-    TypedValue *valueToIndex = this->toIndex->generateLLVM(context, scope, NULL, false);
-    TypedValue *indexValue = this->index->generateLLVM(context, scope, &UINT64_TYPE, false);
-
-    if (valueToIndex->getTypeCode() == TypeCode::ARRAY)
+    if (indexValue->getTypeCode() != TypeCode::INTEGER)
     {
-        ArrayType *arrayType = static_cast<ArrayType *>(valueToIndex->getType());
-
-        // TODO check indexValue->getValue() array bounds
-
-        llvm::Value *llvmArrayPointer;
-        std::vector<llvm::Value *> indices;
-        if (arrayType->getManaged())
-        {
-            // TODO: move this to shared code
-            // Select array pointer (not length field)
-            indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
-            // Select array (not ref count field)
-            indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 1, false));
-
-            std::vector<unsigned int> lengthIndices;
-            lengthIndices.push_back(1);
-            llvmArrayPointer = context->irBuilder->CreateExtractValue(valueToIndex->getValue(), lengthIndices, "array.ptr");
-        }
-        else
-        {
-            llvmArrayPointer = indexValue->getValue();
-        }
-        indices.push_back(indexValue->getValue());
-
-        auto llvmArrayItemPtr = context->irBuilder->CreateGEP(arrayType->getArrayPointerType()->getLLVMPointedType(context), llvmArrayPointer, indices, "array.index.gep");
+        std::cout << "ERROR: Array index must be an integer, got " << indexValue->getType()->toString() << "\n";
+        exit(-1);
+        return NULL;
+    }
 
-        auto itemPointer = new TypedValue(llvmArrayItemPtr, arrayType->getItemType()->getUnmanagedPointerToType());
-        if (expectPointer)
-        {
-            return itemPointer;
-        }
-        else
-        {
-            return generateReferenceAwareLoad(context, itemPointer);
-        }
+    IntegerType *indexType = static_cast<IntegerType *>(indexValue->getType());
+    if (indexType->getSigned())
+    {
+        return context->irBuilder->CreateSExtOrTrunc(indexValue->getValue(), ArrayType::getLLVMLengthFieldType(context), "array.index");
     }
     else
     {
-        std::cout << "ERROR: Can only index dereference arrays\n";
-        exit(-1);
-        return NULL;
+        return context->irBuilder->CreateZExtOrTrunc(indexValue->getValue(), ArrayType::getLLVMLengthFieldType(context), "array.index");
     }
 }
 
-TypedValue *ASTMemberDereference::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+TypedValue *ASTIndexDereference::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
 {
 #ifdef DEBUG
-    std::cout << "debug: ASTMemberDereference::generateLLVM\n";
+    std::cout << "debug: ASTIndexDereference::generateLLVM\n";
 #endif
 
+    // Indexing an array variable reads through its pointer, so reading a constant literal does not copy it
     TypedValue *valueToIndex = this->toIndex->generateLLVM(context, scope, NULL, true);
-
-    if (valueToIndex->isType())
+    TypedValue *stringPointer = generateStringToPointer(context, valueToIndex);
+    if (stringPointer != NULL)
     {
-        if (valueToIndex->getType()->getTypeCode() == TypeCode::MODULE)
+        if (this->isRange)
         {
-            ModuleType *mod = static_cast<ModuleType *>(valueToIndex->getType());
-            TypedValue *moduleValue = mod->getValue(this->nameToken->value, context, scope);
-            if (moduleValue == NULL)
+            // s[lo..hi] is a [UInt8 ..] slice of a copy of the bytes, it stays valid when the String is gone
+            llvm::Value *llvmStart = this->index == NULL ? NULL : generateArrayIndex(context, this->index->generateLLVM(context, scope, &UINT64_TYPE, false));
+            llvm::Value *llvmEnd = this->endIndex == NULL ? NULL : generateArrayIndex(context, this->endIndex->generateLLVM(context, scope, &UINT64_TYPE, false));
+            TypedValue *sliceValue = generateStringSlice(context, stringPointer, llvmStart, llvmEnd, true);
+            if (sliceValue == NULL)
             {
-                std::cout << "ERROR: '" << this->nameToken->value << "' cannot be found in module '" << mod->getFullName() << "'\n";
                 exit(-1);
-
                 return NULL;
             }
-            return moduleValue;
+            return sliceValue;
         }
-        else
+
+        // Strings are never mutated, so s[i] is the byte at i and not a pointer to it
+        llvm::Value *llvmIndex = generateArrayIndex(context, this->index->generateLLVM(context, scope, &UINT64_TYPE, false));
+        llvm::Value *llvmLength;
+        llvm::Value *llvmBytes = generateStringBytes(context, stringPointer, &llvmLength);
+        generateBoundsCheck(context, llvmIndex, llvmLength, "string.index");
+        llvm::Value *llvmBytePointer = context->irBuilder->CreateInBoundsGEP(BYTE_TYPE.getLLVMType(context), llvmBytes, llvmIndex, "string.index.gep");
+        return new TypedValue(context->irBuilder->CreateLoad(BYTE_TYPE.getLLVMType(context), llvmBytePointer, "string.index.load"), &BYTE_TYPE);
+    }
+    Type *dereferencedType = valueToIndex->getType();
+    while (dereferencedType->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(dereferencedType)->getPointedType() != NULL)
+    {
+        dereferencedType = static_cast<PointerType *>(dereferencedType)->getPointedType();
+    }
+    if (dereferencedType->getTypeCode() == TypeCode::TENSOR)
+    {
+        // t[i, j] is a single address computation, t[i] and t[lo..hi, j] are views of the same items
+        TypedValue *tensorValue = generateDereferenceToValue(context, valueToIndex);
+        std::vector<llvm::Value *> llvmStarts;
+        std::vector<llvm::Value *> llvmEnds;
+        std::vector<bool> ranges;
+        std::vector<ASTIndexDimension> dimensions;
+        dimensions.push_back(ASTIndexDimension(this->index, this->endIndex, this->isRange));
+        dimensions.insert(dimensions.end(), this->otherDimensions.begin(), this->otherDimensions.end());
+        for (auto &dimension : dimensions)
         {
-            std::cout << "ERROR: Type has no members to dereference\n";
-            exit(-1);
+            llvmStarts.push_back(dimension.index == NULL ? NULL : generateArrayIndex(context, dimension.index->generateLLVM(context, scope, &UINT64_TYPE, false)));
+            llvmEnds.push_back(dimension.endIndex == NULL ? NULL : generateArrayIndex(context, dimension.endIndex->generateLLVM(context, scope, &UINT64_TYPE, false)));
+            ranges.push_back(dimension.isRange);
+        }
 
+        TypedValue *indexedValue = generateTensorIndex(context, tensorValue, llvmStarts, llvmEnds, ranges);
+        if (indexedValue == NULL)
+        {
+            exit(-1);
             return NULL;
         }
+        if (indexedValue->getTypeCode() == TypeCode::TENSOR || expectPointer)
+        {
+            return indexedValue;
+        }
+        return generateLoad(context, indexedValue);
     }
-
-    TypedValue *pointerToIndex = generateDereferenceToPointer(context, valueToIndex);
-    if (pointerToIndex == NULL)
+    if (!this->otherDimensions.empty())
     {
-        std::cout << "ERROR: Member dereference only supports pointers\n";
+        std::cout << "ERROR: Only tensors can be indexed in multiple dimensions, got " << dereferencedType->toString() << "\n";
+        exit(-1);
+        return NULL;
+    }
+    if (this->isRange)
+    {
+        // a[lo..hi] does not copy, the items are only unshared when they are mutated through the slice
+        // A constant literal is unshared first, the slice would not see writes to the copy the array gets when it is mutated
+        if (valueToIndex->getTypeCode() == TypeCode::POINTER)
+        {
+            valueToIndex = generateDereferenceToPointer(context, valueToIndex);
+            generateArrayUnshare(context, valueToIndex);
+        }
+        TypedValue *arrayValue = generateDereferenceToValue(context, valueToIndex);
+        if (arrayValue->getTypeCode() != TypeCode::ARRAY)
+        {
+            std::cout << "ERROR: Only arrays can be sliced, got " << arrayValue->getType()->toString() << "\n";
+            exit(-1);
+            return NULL;
+        }
+
+        llvm::Value *llvmStart = this->index == NULL ? NULL : generateArrayIndex(context, this->index->generateLLVM(context, scope, &UINT64_TYPE, false));
+        llvm::Value *llvmEnd = this->endIndex == NULL ? NULL : generateArrayIndex(context, this->endIndex->generateLLVM(context, scope, &UINT64_TYPE, false));
+        TypedValue *sliceValue = generateArraySlice(context, arrayValue, llvmStart, llvmEnd);
+        if (sliceValue == NULL)
+        {
+            exit(-1);
+            return NULL;
+        }
+        return sliceValue;
+    }
+    if (expectPointer && valueToIndex->getTypeCode() == TypeCode::ARRAY && (static_cast<ArrayType *>(valueToIndex->getType())->isSlice() || (static_cast<ArrayType *>(valueToIndex->getType())->getManaged() && !static_cast<ArrayType *>(valueToIndex->getType())->getByValue())))
+    {
+        // a[1..3][0] = x and f()[0] = x, the array must be in memory so it can be unshared
+        llvm::Value *llvmArrayPointer = generateAllocaInCurrentFunction(context, valueToIndex->getType()->getLLVMType(context), "array.temp");
+        context->irBuilder->CreateStore(valueToIndex->getValue(), llvmArrayPointer);
+        valueToIndex = new TypedValue(llvmArrayPointer, valueToIndex->getType()->getUnmanagedPointerToType());
+    }
+    if (expectPointer)
+    {
+        generateArrayUnshare(context, valueToIndex);
+    }
+    valueToIndex = generateDereferenceToValue(context, valueToIndex);
+
+    int vectorLanes = getTypeLanes(valueToIndex->getType());
+    if (vectorLanes > 1)
+    {
+        if (this->index->type == ASTNodeType::ARRAY)
+        {
+            // v[[3, 2, 1, 0]] shuffles the lanes of a vector, the result has as many lanes as the literal has items
+            std::vector<int> shuffleMask;
+            for (ASTArraySegment *segment : static_cast<ASTArray *>(this->index)->getValues())
+            {
+                TypedValue *laneIndex = segment->getValue()->generateLLVM(context, scope, &UINT32_TYPE, false);
+                llvm::ConstantInt *llvmLaneIndex = llvm::dyn_cast<llvm::ConstantInt>(laneIndex->getValue());
+                if (llvmLaneIndex == NULL || llvmLaneIndex->getZExtValue() >= vectorLanes)
+                {
+                    std::cout << "ERROR: Vector shuffle lanes must be constants smaller than " << vectorLanes << "\n";
+                    exit(-1);
+                    return NULL;
+                }
+
+                int times = 1;
+                if (segment->getTimes() != NULL)
+                {
+                    TypedValue *timesValue = segment->getTimes()->generateLLVM(context, scope, &UINT32_TYPE, false);
+                    llvm::ConstantInt *llvmTimes = llvm::dyn_cast<llvm::ConstantInt>(timesValue->getValue());
+                    if (llvmTimes == NULL)
+                    {
+                        std::cout << "ERROR: Vector shuffle repeat count must be a constant\n";
+                        exit(-1);
+                        return NULL;
+                    }
+                    times = llvmTimes->getZExtValue();
+                }
+
+                for (int i = 0; i < times; i++)
+                {
+                    shuffleMask.push_back(llvmLaneIndex->getZExtValue());
+                }
+            }
+
+            Type *laneType = getTypeLaneType(valueToIndex->getType());
+            Type *resultType = laneType->getTypeCode() == TypeCode::FLOAT ? (Type *)new FloatType(static_cast<FloatType *>(laneType)->getBitSize(), shuffleMask.size()) : (Type *)new IntegerType(static_cast<IntegerType *>(laneType)->getBitSize(), static_cast<IntegerType *>(laneType)->getSigned(), shuffleMask.size());
+            if (shuffleMask.size() == 1)
+            {
+                return new TypedValue(context->irBuilder->CreateExtractElement(valueToIndex->getValue(), (uint64_t)shuffleMask[0], "vector.lane"), laneType);
+            }
+            return new TypedValue(context->irBuilder->CreateShuffleVector(valueToIndex->getValue(), shuffleMask, "vector.shuffle"), resultType);
+        }
+
+        TypedValue *laneIndex = this->index->generateLLVM(context, scope, &UINT32_TYPE, false);
+        if (laneIndex->getTypeCode() != TypeCode::INTEGER)
+        {
+            std::cout << "ERROR: Vector lane index must be an integer, got " << laneIndex->getType()->toString() << "\n";
+            exit(-1);
+            return NULL;
+        }
+        llvm::Value *llvmLaneIndex = context->irBuilder->CreateZExtOrTrunc(laneIndex->getValue(), llvm::Type::getInt32Ty(*context->context), "vector.lane.index");
+        if (!llvm::isa<llvm::ConstantInt>(llvmLaneIndex) || llvm::cast<llvm::ConstantInt>(llvmLaneIndex)->getZExtValue() >= vectorLanes)
+        {
+            generateBoundsCheck(context, llvmLaneIndex, llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), vectorLanes, false), "vector.lane");
+        }
+        return new TypedValue(context->irBuilder->CreateExtractElement(valueToIndex->getValue(), llvmLaneIndex, "vector.lane"), getTypeLaneType(valueToIndex->getType()));
+    }
+
+    TypedValue *indexValue = this->index->generateLLVM(context, scope, &UINT64_TYPE, false);
+
+    if (valueToIndex->getTypeCode() == TypeCode::ARRAY)
+    {
+        ArrayType *arrayType = static_cast<ArrayType *>(valueToIndex->getType());
+
+        llvm::Value *llvmIndex = generateArrayIndex(context, indexValue);
+
+        llvm::Value *llvmArrayLength;
+        llvm::Value *llvmArrayPointer = generateArrayStoragePointer(context, valueToIndex, &llvmArrayLength);
+        if (llvmArrayLength != NULL)
+        {
+            generateBoundsCheck(context, llvmIndex, llvmArrayLength, "array.index");
+        }
+
+        if (arrayType->isSoA())
+        {
+            // The item is not gathered when only a field is used, ps[i].x is read from the x column
+            auto soaItem = new TypedValue(llvmIndex, new SoAItemType(arrayType, valueToIndex->getValue()));
+            if (expectPointer)
+            {
+                return soaItem;
+            }
+            else
+            {
+                return generateSoAItemLoad(context, soaItem);
+            }
+        }
+
+        auto llvmArrayItemPtr = generateArrayItemPointer(context, arrayType, llvmArrayPointer, llvmIndex, "array.index");
+
+        auto itemPointer = new TypedValue(llvmArrayItemPtr, arrayType->getItemType()->getUnmanagedPointerToType());
+        if (expectPointer)
+        {
+            return itemPointer;
+        }
+        else
+        {
+            return generateReferenceAwareLoad(context, itemPointer);
+        }
+    }
+    else
+    {
+        std::cout << "ERROR: Can only index dereference arrays\n";
+        exit(-1);
+        return NULL;
+    }
+}
+
+bool ASTIndexDereference::generateVectorStore(GenerationContext *context, FunctionScope *scope, ASTNode *vector)
+{
+#ifdef DEBUG
+    std::cout << "debug: ASTIndexDereference::generateVectorStore\n";
+#endif
+
+    // The items are written in place, so the array is unshared like for a[i] = x
+    TypedValue *arrayPointer = this->toIndex->generateLLVM(context, scope, NULL, true);
+    if (arrayPointer->getTypeCode() == TypeCode::POINTER)
+    {
+        arrayPointer = generateDereferenceToPointer(context, arrayPointer);
+        generateArrayUnshare(context, arrayPointer);
+    }
+    TypedValue *arrayValue = generateDereferenceToValue(context, arrayPointer);
+    if (arrayValue->getTypeCode() != TypeCode::ARRAY || !this->otherDimensions.empty())
+    {
+        std::cout << "ERROR: Vectors can only be stored into a range of array items, got " << arrayValue->getType()->toString() << "\n";
+        return false;
+    }
+
+    llvm::Value *llvmStart = this->index == NULL ? llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false) : generateArrayIndex(context, this->index->generateLLVM(context, scope, &UINT64_TYPE, false));
+    llvm::Value *llvmEnd = this->endIndex == NULL ? NULL : generateArrayIndex(context, this->endIndex->generateLLVM(context, scope, &UINT64_TYPE, false));
+    return ::generateVectorStore(context, arrayValue, llvmStart, llvmEnd, vector->generateLLVM(context, scope, NULL, false));
+}
+
+TypedValue *ASTMemberDereference::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+{
+#ifdef DEBUG
+    std::cout << "debug: ASTMemberDereference::generateLLVM\n";
+#endif
+
+    return this->generateMember(context, scope, this->toIndex->generateLLVM(context, scope, NULL, true), expectPointer);
+}
+
+TypedValue *ASTMemberDereference::generateMember(GenerationContext *context, FunctionScope *scope, TypedValue *valueToIndex, bool expectPointer)
+{
+    if (valueToIndex->isType())
+    {
+        if (valueToIndex->getType()->getTypeCode() == TypeCode::MODULE)
+        {
+            ModuleType *mod = static_cast<ModuleType *>(valueToIndex->getType());
+            TypedValue *moduleValue = mod->getValue(this->nameToken->value, context, scope);
+            if (moduleValue == NULL)
+            {
+                std::cout << "ERROR: '" << this->nameToken->value << "' cannot be found in module '" << mod->getFullName() << "'\n";
+                exit(-1);
+
+                return NULL;
+            }
+            return moduleValue;
+        }
+        else
+        {
+            std::cout << "ERROR: Type has no members to dereference\n";
+            exit(-1);
+
+            return NULL;
+        }
+    }
+
+    if (valueToIndex->getTypeCode() == TypeCode::SOA_ITEM)
+    {
+        return generateSoAFieldPointer(context, valueToIndex, this->nameToken->value);
+    }
+
+    Type *dereferencedType = valueToIndex->getType();
+    while (dereferencedType->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(dereferencedType)->getPointedType() != NULL)
+    {
+        dereferencedType = static_cast<PointerType *>(dereferencedType)->getPointedType();
+    }
+    if (dereferencedType->getTypeCode() == TypeCode::TENSOR)
+    {
+        TypedValue *member = generateTensorMember(context, generateDereferenceToValue(context, valueToIndex), this->nameToken->value);
+        if (member == NULL)
+        {
+            std::cout << "ERROR: Tensor has no member '" << this->nameToken->value << "', only shape, strides and transpose\n";
+            exit(-1);
+            return NULL;
+        }
+        return member;
+    }
+    if (isBytesOperation(this->nameToken->value))
+    {
+        // s.hash, s.isUtf8, s.lines, s.lower and s.upper on Strings and arrays of UInt8, like s.hash()
+        TypedValue *bytesSlice = generateBytesSlice(context, valueToIndex, false);
+        if (bytesSlice != NULL)
+        {
+            std::vector<TypedValue *> arguments;
+            TypedValue *result = generateBytesOperation(context, bytesSlice, this->nameToken->value, arguments);
+            if (result == NULL)
+            {
+                exit(-1);
+            }
+            return result;
+        }
+    }
+    if (dereferencedType->getTypeCode() == TypeCode::STRING)
+    {
+        if (this->nameToken->value != "length")
+        {
+            std::cout << "ERROR: Can only read length of String\n";
+            exit(-1);
+            return NULL;
+        }
+
+        // The length is the number of bytes, not characters, it is read without taking a reference to the String
+        return new TypedValue(generateStringLength(context, generateLoad(context, generateStringToPointer(context, valueToIndex))), &UINT64_TYPE);
+    }
+    if (valueToIndex->getTypeCode() == TypeCode::ARRAY_EXPRESSION || dereferencedType->getTypeCode() == TypeCode::ARRAY)
+    {
+        TypedValue *reduced = generateArrayReduction(context, valueToIndex, this->nameToken->value);
+        if (reduced != NULL)
+        {
+            return reduced;
+        }
+        if (valueToIndex->getTypeCode() == TypeCode::ARRAY_EXPRESSION)
+        {
+            std::cout << "ERROR: Array expression has no member '" << this->nameToken->value << "'\n";
+            exit(-1);
+            return NULL;
+        }
+    }
+    if (getTypeLanes(dereferencedType) > 1)
+    {
+        TypedValue *vectorValue = generateDereferenceToValue(context, valueToIndex);
+        TypedValue *reduced = generateVectorReduction(context, vectorValue, this->nameToken->value);
+        if (reduced == NULL)
+        {
+            std::cout << "ERROR: Vector type " << vectorValue->getType()->toString() << " has no member '" << this->nameToken->value << "'\n";
+            exit(-1);
+            return NULL;
+        }
+        return reduced;
+    }
+
+    if (valueToIndex->getTypeCode() == TypeCode::ARRAY && this->nameToken->value == "length")
+    {
+        // The length of an array that is not stored in a variable, like a[1..3].length
+        llvm::Value *llvmLength;
+        generateArrayStoragePointer(context, valueToIndex, &llvmLength);
+        if (llvmLength == NULL)
+        {
+            std::cout << "ERROR: Cannot get length of " << valueToIndex->getType()->toString() << ", its length is unknown\n";
+            exit(-1);
+            return NULL;
+        }
+        return new TypedValue(llvmLength, &UINT64_TYPE);
+    }
+
+    if (valueToIndex->getTypeCode() != TypeCode::POINTER)
+    {
+        std::cout << "ERROR: Member dereference only supports pointers\n";
         exit(-1);
 
         return NULL;
     }
 
+    // The object is only used to find the member, loading it from a variable or field does not count a reference
+    // A temporary object (f().x) came with a reference, it is released without freeing the object
+    TypedValue *pointerToIndex = valueToIndex;
+    bool temporary = true;
+    while (static_cast<PointerType *>(pointerToIndex->getType())->getPointedType() != NULL && static_cast<PointerType *>(pointerToIndex->getType())->getPointedType()->getTypeCode() == TypeCode::POINTER)
+    {
+        pointerToIndex = generateLoad(context, pointerToIndex);
+        temporary = false;
+    }
+    if (temporary)
+    {
+        generateDecrementReferenceIfPointer(context, pointerToIndex, false);
+    }
+
     PointerType *pointerTypeToIndex = static_cast<PointerType *>(pointerToIndex->getType());
 
     if (pointerTypeToIndex->getPointedType()->getTypeCode() == TypeCode::ARRAY)
     {
         ArrayType *arrayType = static_cast<ArrayType *>(pointerTypeToIndex->getPointedType());
 
+        if (arrayType->isGrowable())
+        {
+            llvm::Value *llvmFieldPointer;
+            if (this->nameToken->value == "length" || this->nameToken->value == "capacity")
+            {
+                llvmFieldPointer = generateGrowableArrayFieldPointer(context, pointerToIndex, this->nameToken->value == "length" ? 0 : 1, "array." + this->nameToken->value + ".gep");
+            }
+            else if (this->nameToken->value == "refs")
+            {
+                llvmFieldPointer = context->irBuilder->CreateStructGEP(pointerTypeToIndex->getLLVMPointedType(context), pointerToIndex->getValue(), 0, "array.refs.gep");
+            }
+            else
+            {
+                std::cout << "ERROR: Can only read length, capacity and refs of growable array\n";
+                exit(-1);
+                return NULL;
+            }
+
+            // Only push, pop, reserve and truncate change the length and capacity, so no pointer is returned
+            return generateLoad(context, new TypedValue(llvmFieldPointer, UINT64_TYPE.getUnmanagedPointerToType()));
+        }
+
+        if (arrayType->isSlice())
+        {
+            if (this->nameToken->value != "length")
+            {
+                std::cout << "ERROR: Can only read length of slice\n";
+                exit(-1);
+                return NULL;
+            }
+
+            // A slice is changed by slicing it again, its length is not assignable
+            llvm::Value *llvmLengthPointer = context->irBuilder->CreateStructGEP(pointerTypeToIndex->getLLVMPointedType(context), pointerToIndex->getValue(), 0, "slice.length.gep");
+            return generateLoad(context, new TypedValue(llvmLengthPointer, UINT64_TYPE.getUnmanagedPointerToType()));
+        }
+
         if (this->nameToken->value == "length")
         {
             if (!arrayType->getManaged())
@@ -2741,8 +4167,6 @@ TypedValue *ASTMemberDereference::generateLLVM(GenerationContext *context, Funct
 
             auto llvmArrayLength = context->irBuilder->CreateGEP(pointerTypeToIndex->getLLVMPointedType(context), pointerToIndex->getValue(), indices, "array.length.gep");
 
-            generateDecrementReferenceIfPointer(context, pointerToIndex, false);
-
             auto itemPointer = new TypedValue(llvmArrayLength, UINT64_TYPE.getUnmanagedPointerToType());
             if (expectPointer)
             {
@@ -2772,8 +4196,6 @@ TypedValue *ASTMemberDereference::generateLLVM(GenerationContext *context, Funct
 
             auto llvmArrayRefsPtr = context->irBuilder->CreateGEP(pointerTypeToIndex->getLLVMPointedType(context), pointerToIndex->getValue(), indices, "array.refs.gep");
 
-            generateDecrementReferenceIfPointer(context, pointerToIndex, false);
-
             auto itemPointer = new TypedValue(llvmArrayRefsPtr, UINT64_TYPE.getUnmanagedPointerToType());
             if (expectPointer)
             {
@@ -2814,12 +4236,10 @@ TypedValue *ASTMemberDereference::generateLLVM(GenerationContext *context, Funct
             std::string twine = pointerToIndex->getOriginVariable() + ".refs";
             llvm::Value *fieldPointer = context->irBuilder->CreateGEP(pointerTypeToIndex->getLLVMPointedType(context), pointerToIndex->getValue(), indices, twine);
 
-            generateDecrementReferenceIfPointer(context, pointerToIndex, false);
-
             return new TypedValue(fieldPointer, UINT64_TYPE.getUnmanagedPointerToType());
         }
 
-        int fieldIndex = structType->getFieldIndex(this->nameToken->value);
+        int fieldIndex = structType->getFieldIndex(context, this->nameToken->value);
         if (fieldIndex < 0)
         {
             std::cout << "ERROR: Cannot access member '" << this->nameToken->value << "' of struct\n";
@@ -2848,8 +4268,6 @@ TypedValue *ASTMemberDereference::generateLLVM(GenerationContext *context, Funct
         std::string twine = pointerToIndex->getOriginVariable() + "." + this->nameToken->value + ".ptr";
         llvm::Value *fieldPointer = context->irBuilder->CreateGEP(pointerTypeToIndex->getLLVMPointedType(context), pointerToIndex->getValue(), indices, twine);
 
-        generateDecrementReferenceIfPointer(context, pointerToIndex, false);
-
         return new TypedValue(fieldPointer, structField->type->getUnmanagedPointerToType(), twine);
     }
     else
@@ -2884,8 +4302,21 @@ TypedValue *ASTIfStatement::generateLLVM(GenerationContext *context, FunctionSco
 
     context->irBuilder->SetInsertPoint(thenStartBlock);
     thenStartBlock->insertInto(parentFunction);
-    auto thenScope = scope; // TODO: new FunctionScope(*scope); This does not work because finalizers will not free
+    Type *narrowedWhenTrue, *narrowedWhenFalse;
+    const Token *narrowedNameToken = getIsConditionNarrowing(context, scope, this->condition, &narrowedWhenTrue, &narrowedWhenFalse);
+    int narrowingCount = scope->getNarrowingCount();
+
+    // Both branches start with the same moved variables
+    std::set<std::string> movedBefore = scope->getMovedValues();
+    auto thenScope = scope;
+    if (narrowedWhenTrue != NULL)
+    {
+        thenScope->pushNarrowing(narrowedNameToken->value, narrowedWhenTrue);
+    }
     this->thenBody->generateLLVM(context, thenScope, NULL, true);
+    thenScope->popNarrowings(narrowingCount);
+    std::set<std::string> movedInThen = scope->getMovedValues();
+    scope->setMovedValues(movedBefore);
 
     llvm::BasicBlock *thenEndBlock = context->irBuilder->GetInsertBlock(); // Current block could have changed in generateLLVM calls above, update it here
     if (thenEndBlock->getTerminator() == NULL)
@@ -2895,10 +4326,15 @@ TypedValue *ASTIfStatement::generateLLVM(GenerationContext *context, FunctionSco
 
     context->irBuilder->SetInsertPoint(elseStartBlock);
     elseStartBlock->insertInto(parentFunction);
-    auto elseScope = scope; // TODO: new FunctionScope(*scope); This does not work because finalizers will not free
+    auto elseScope = scope;
     if (this->elseBody != NULL)
     {
+        if (narrowedWhenFalse != NULL)
+        {
+            elseScope->pushNarrowing(narrowedNameToken->value, narrowedWhenFalse);
+        }
         this->elseBody->generateLLVM(context, elseScope, NULL, true);
+        elseScope->popNarrowings(narrowingCount);
     }
 
     llvm::BasicBlock *elseEndBlock = context->irBuilder->GetInsertBlock(); // Current block could have changed in generateLLVM calls above, update it here
@@ -2913,60 +4349,795 @@ TypedValue *ASTIfStatement::generateLLVM(GenerationContext *context, FunctionSco
         continueBlock->insertInto(parentFunction);
     }
 
-    return NULL;
-}
+    // When one branch always returns, the code after this statement can only be reached through the other branch
+    // The narrowing stays until the end of the enclosing block
+    bool thenTerminating = this->thenBody->isTerminating();
+    bool elseTerminating = this->elseBody != NULL && this->elseBody->isTerminating();
 
-TypedValue *ASTInvocation::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
-{
-#ifdef DEBUG
-    std::cout << "debug: ASTInvocation::generateLLVM\n";
-#endif
-    TypedValue *functionValue = this->functionPointerValue->generateLLVM(context, scope, NULL, true);
-    if (functionValue == NULL)
+    // A variable moved in a branch that can reach the code after this statement is moved there
+    std::set<std::string> movedAfter = elseTerminating ? movedBefore : scope->getMovedValues();
+    if (!thenTerminating)
     {
-        std::cout << "ERROR: Function to call not found\n";
-        exit(-1);
-
-        return NULL;
+        movedAfter.insert(movedInThen.begin(), movedInThen.end());
     }
+    scope->setMovedValues(movedAfter);
 
-    if (functionValue->getTypeCode() != TypeCode::POINTER)
+    if (thenTerminating && !elseTerminating && narrowedWhenFalse != NULL)
     {
-        std::cout << "ERROR: Cannot invoke '" << functionValue->getOriginVariable() << "', it must be a pointer\n";
-        exit(-1);
-
-        return NULL;
+        scope->pushNarrowing(narrowedNameToken->value, narrowedWhenFalse);
     }
-    PointerType *functionPointerType = static_cast<PointerType *>(functionValue->getType());
-    if (functionPointerType->getPointedType()->getTypeCode() != TypeCode::FUNCTION)
+    else if (elseTerminating && !thenTerminating && narrowedWhenTrue != NULL)
     {
-        std::cout << "ERROR: Cannot invoke '" << functionValue->getOriginVariable() << "', it must be a function pointer\n";
-        exit(-1);
-
-        return NULL;
+        scope->pushNarrowing(narrowedNameToken->value, narrowedWhenTrue);
     }
 
-    llvm::Function *function = static_cast<llvm::Function *>(functionValue->getValue());
-    FunctionType *functionType = static_cast<FunctionType *>(functionPointerType->getPointedType());
+    return NULL;
+}
 
-    std::vector<FunctionParameter> &parameters = functionType->getParameters();
-    int parameterCount = this->parameterValues->size();
-    int actualParameterCount = parameters.size();
-    if (actualParameterCount != parameterCount)
+// Evaluates the bounds of the range start..end of a for statement, both are converted to the same integer type
+static void generateForRange(GenerationContext *context, FunctionScope *scope, ASTNode *startNode, ASTNode *endNode, TypedValue **startValueOut, TypedValue **endValueOut)
+{
+    TypedValue *startValue = startNode->generateLLVM(context, scope, NULL, false);
+    TypedValue *endValue = endNode->generateLLVM(context, scope, startValue->getType(), false);
+    if (*startValue->getType() != *endValue->getType() && llvm::isa<llvm::Constant>(startValue->getValue()))
     {
-        std::cout << "ERROR: Invalid amount of parameters for function '" << functionValue->getOriginVariable() << "' invocation, expected " << actualParameterCount << ", got " << parameterCount << "\n";
+        // Allow 0..length
+        TypedValue *convertedStartValue = generateTypeConversion(context, startValue, endValue->getType(), false);
+        if (convertedStartValue != NULL)
+        {
+            startValue = convertedStartValue;
+        }
+    }
+    if (!generateTypeJugging(context, &startValue, &endValue) || startValue->getTypeCode() != TypeCode::INTEGER)
+    {
+        std::cout << "ERROR: For range bounds must be integers, got " << startValue->getType()->toString() << " and " << endValue->getType()->toString() << "\n";
+        exit(-1);
+    }
+    *startValueOut = startValue;
+    *endValueOut = endValue;
+}
+
+TypedValue *ASTForStatement::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+{
+#ifdef DEBUG
+    std::cout << "debug: ASTForStatement::generateLLVM\n";
+#endif
+
+    // The bounds are evaluated once (except the length of a growable array), the loop is lowered to a guarded bottom-tested loop
+    // with a single counter so the loop vectorizer and unroller recognize it
+    TypedValue *arrayValue = NULL;
+    TypedValue *arrayPointer = NULL;
+    ArrayType *arrayType = NULL;
+    llvm::Value *llvmArrayStorage = NULL;
+    TypedValue *startValue;
+    TypedValue *endValue;
+    if (this->endValue != NULL)
+    {
+        generateForRange(context, scope, this->startValue, this->endValue, &startValue, &endValue);
+    }
+    else
+    {
+        TypedValue *iteratedValue = this->startValue->generateLLVM(context, scope, NULL, true);
+        if (iteratedValue->getTypeCode() == TypeCode::POINTER)
+        {
+            arrayPointer = generateDereferenceToPointer(context, iteratedValue);
+            iteratedValue = arrayPointer;
+        }
+        arrayValue = generateDereferenceToValue(context, iteratedValue);
+        if (arrayValue->getTypeCode() != TypeCode::ARRAY)
+        {
+            std::cout << "ERROR: For can only iterate ranges and arrays, got " << arrayValue->getType()->toString() << "\n";
+            exit(-1);
+            return NULL;
+        }
+        arrayType = static_cast<ArrayType *>(arrayValue->getType());
+
+        llvm::Value *llvmLength;
+        llvmArrayStorage = generateArrayStoragePointer(context, arrayValue, &llvmLength);
+        if (llvmLength == NULL)
+        {
+            std::cout << "ERROR: Cannot iterate array " << arrayType->toString() << ", its length is unknown\n";
+            exit(-1);
+            return NULL;
+        }
+        startValue = new TypedValue(llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false), &UINT64_TYPE);
+        endValue = new TypedValue(llvmLength, &UINT64_TYPE);
+        if (!arrayType->isGrowable())
+        {
+            arrayPointer = NULL;
+        }
+    }
+
+    IntegerType *counterType = static_cast<IntegerType *>(startValue->getType());
+    bool isSigned = counterType->getSigned();
+    llvm::Type *llvmCounterType = counterType->getLLVMType(context);
+
+    llvm::Function *parentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *loopStartBlock = llvm::BasicBlock::Create(*context->context, "forbody");
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "forcont");
+
+    llvm::AllocaInst *llvmCounterPointer = generateAllocaInCurrentFunction(context, llvmCounterType, this->nameToken->value + ".counter");
+    context->irBuilder->CreateStore(startValue->getValue(), llvmCounterPointer);
+    llvm::Value *llvmEnterCondition = isSigned ? context->irBuilder->CreateICmpSLT(startValue->getValue(), endValue->getValue(), "forguard") : context->irBuilder->CreateICmpULT(startValue->getValue(), endValue->getValue(), "forguard");
+    context->irBuilder->CreateCondBr(llvmEnterCondition, loopStartBlock, continueBlock);
+
+    context->irBuilder->SetInsertPoint(loopStartBlock);
+    loopStartBlock->insertInto(parentFunction);
+    llvm::Value *llvmCounter = context->irBuilder->CreateLoad(llvmCounterType, llvmCounterPointer, this->nameToken->value + ".counter.load");
+
+    // The loop variable is a copy, changing it does not affect the iteration
+    TypedValue *loopValue;
+    if (arrayType != NULL && arrayType->isSoA())
+    {
+        loopValue = generateSoAItemLoad(context, new TypedValue(llvmCounter, new SoAItemType(arrayType, arrayValue->getValue())));
+    }
+    else if (arrayType != NULL)
+    {
+        if (arrayPointer != NULL)
+        {
+            // The body can push to a growable array, which moves its items, so they are loaded again every iteration
+            llvm::Value *llvmUnusedLength;
+            llvmArrayStorage = generateArrayStoragePointer(context, generateLoad(context, arrayPointer), &llvmUnusedLength);
+        }
+        llvm::Value *llvmItemPointer = generateArrayItemPointer(context, arrayType, llvmArrayStorage, llvmCounter, "for.item");
+        loopValue = generateReferenceAwareLoad(context, new TypedValue(llvmItemPointer, arrayType->getItemType()->getUnmanagedPointerToType()));
+    }
+    else
+    {
+        loopValue = new TypedValue(llvmCounter, counterType);
+    }
+    TypedValue *loopValuePointer = new TypedValue(generateAllocaInCurrentFunction(context, loopValue->getType()->getLLVMType(context), this->nameToken->value, getTypeAlign(loopValue->getType())), loopValue->getType()->getUnmanagedPointerToType(), this->nameToken->value);
+    context->irBuilder->CreateLifetimeStart(loopValuePointer->getValue());
+    context->irBuilder->CreateStore(loopValue->getValue(), loopValuePointer->getValue());
+
+    // The loop variable only exists in the body, it is released at the end of every iteration
+    FunctionScope *loopScope = new FunctionScope(scope);
+    loopScope->loop = true;
+    if (!loopScope->addValue(this->nameToken->value, loopValuePointer))
+    {
+        std::cout << "ERROR: Cannot declare for variable '" << this->nameToken->value << "', it already exists\n";
+        exit(-1);
+        return NULL;
+    }
+
+    this->loopBody->generateLLVM(context, loopScope, NULL, true);
+
+    if (context->irBuilder->GetInsertBlock()->getTerminator() == NULL)
+    {
+        generateScopeEnd(context, loopScope);
+
+        // Cannot overflow, the counter is smaller than the end value
+        llvm::Value *llvmNextCounter = context->irBuilder->CreateAdd(llvmCounter, llvm::ConstantInt::get(llvmCounterType, 1), this->nameToken->value + ".counter.next", !isSigned, isSigned);
+        context->irBuilder->CreateStore(llvmNextCounter, llvmCounterPointer);
+        if (arrayPointer != NULL)
+        {
+            // The length is loaded again too, items the body pushes are iterated and removed ones are not
+            llvm::Value *llvmLength;
+            generateArrayStoragePointer(context, generateLoad(context, arrayPointer), &llvmLength);
+            endValue = new TypedValue(llvmLength, &UINT64_TYPE);
+        }
+        llvm::Value *llvmLoopCondition = isSigned ? context->irBuilder->CreateICmpSLT(llvmNextCounter, endValue->getValue(), "forcond") : context->irBuilder->CreateICmpULT(llvmNextCounter, endValue->getValue(), "forcond");
+        llvm::BranchInst *llvmLatch = context->irBuilder->CreateCondBr(llvmLoopCondition, loopStartBlock, continueBlock);
+        llvmLatch->setMetadata(llvm::LLVMContext::MD_loop, generateLoopMetadata(context, this->vectorizeWidth, this->unrollCount));
+    }
+
+    context->irBuilder->SetInsertPoint(continueBlock);
+    continueBlock->insertInto(parentFunction);
+
+    return NULL;
+}
+
+// Generates a guarded bottom-tested loop over [llvmStart, llvmEnd) in steps of llvmStep (like ASTForStatement), generateBody is called with the counter
+// The loop does not continue when the body ends its block (like a return)
+static void generateCountedLoop(GenerationContext *context, IntegerType *counterType, llvm::Value *llvmStart, llvm::Value *llvmEnd, uint64_t step, std::string twine, llvm::MDNode *llvmLoopMetadata, std::function<void(llvm::Value *)> generateBody)
+{
+    bool isSigned = counterType->getSigned();
+    llvm::Type *llvmCounterType = counterType->getLLVMType(context);
+
+    llvm::Function *parentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *loopStartBlock = llvm::BasicBlock::Create(*context->context, twine + ".body", parentFunction);
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, twine + ".cont");
+
+    llvm::AllocaInst *llvmCounterPointer = generateAllocaInCurrentFunction(context, llvmCounterType, twine + ".counter");
+    context->irBuilder->CreateStore(llvmStart, llvmCounterPointer);
+    llvm::Value *llvmEnterCondition = isSigned ? context->irBuilder->CreateICmpSLT(llvmStart, llvmEnd, twine + ".guard") : context->irBuilder->CreateICmpULT(llvmStart, llvmEnd, twine + ".guard");
+    context->irBuilder->CreateCondBr(llvmEnterCondition, loopStartBlock, continueBlock);
+
+    context->irBuilder->SetInsertPoint(loopStartBlock);
+    llvm::Value *llvmCounter = context->irBuilder->CreateLoad(llvmCounterType, llvmCounterPointer, twine + ".counter.load");
+    generateBody(llvmCounter);
+
+    if (context->irBuilder->GetInsertBlock()->getTerminator() == NULL)
+    {
+        // A step of 1 cannot overflow, the counter is smaller than the end value
+        llvm::Value *llvmNextCounter = context->irBuilder->CreateAdd(llvmCounter, llvm::ConstantInt::get(llvmCounterType, step), twine + ".counter.next", step == 1 && !isSigned, step == 1 && isSigned);
+        context->irBuilder->CreateStore(llvmNextCounter, llvmCounterPointer);
+        llvm::Value *llvmLoopCondition = isSigned ? context->irBuilder->CreateICmpSLT(llvmNextCounter, llvmEnd, twine + ".cond") : context->irBuilder->CreateICmpULT(llvmNextCounter, llvmEnd, twine + ".cond");
+        llvm::BranchInst *llvmLatch = context->irBuilder->CreateCondBr(llvmLoopCondition, loopStartBlock, continueBlock);
+        llvmLatch->setMetadata(llvm::LLVMContext::MD_loop, llvmLoopMetadata);
+    }
+
+    context->irBuilder->SetInsertPoint(continueBlock);
+    continueBlock->insertInto(parentFunction);
+}
+
+TypedValue *ASTForNestStatement::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+{
+#ifdef DEBUG
+    std::cout << "debug: ASTForNestStatement::generateLLVM\n";
+#endif
+
+    int dimensions = this->nameTokens.size();
+    std::vector<TypedValue *> startValues;
+    std::vector<TypedValue *> endValues;
+    if (this->endValues[0] == NULL)
+    {
+        // The indices of every item of a tensor, for (i, j in t)
+        TypedValue *tensorValue = generateDereferenceToValue(context, this->startValues[0]->generateLLVM(context, scope, NULL, true));
+        if (tensorValue->getTypeCode() != TypeCode::TENSOR || static_cast<TensorType *>(tensorValue->getType())->getRank() != dimensions)
+        {
+            std::cout << "ERROR: For with " << dimensions << " variables can only iterate ranges or a tensor of rank " << dimensions << ", got " << tensorValue->getType()->toString() << "\n";
+            exit(-1);
+            return NULL;
+        }
+        for (int dimension = 0; dimension < dimensions; dimension++)
+        {
+            startValues.push_back(new TypedValue(llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false), &UINT64_TYPE));
+            endValues.push_back(new TypedValue(context->irBuilder->CreateExtractValue(tensorValue->getValue(), {2, (unsigned int)dimension}, "for.tensor.shape"), &UINT64_TYPE));
+        }
+    }
+    else
+    {
+        for (int dimension = 0; dimension < dimensions; dimension++)
+        {
+            if (this->endValues[dimension] == NULL)
+            {
+                std::cout << "ERROR: For with " << dimensions << " variables needs a range for every variable\n";
+                exit(-1);
+                return NULL;
+            }
+            TypedValue *startValue;
+            TypedValue *endValue;
+            generateForRange(context, scope, this->startValues[dimension], this->endValues[dimension], &startValue, &endValue);
+            startValues.push_back(startValue);
+            endValues.push_back(endValue);
+        }
+    }
+
+    // The loop variables are copies of the counters, they only exist in the body
+    FunctionScope *loopScope = new FunctionScope(scope);
+    loopScope->loop = true;
+    std::vector<llvm::Value *> llvmVariablePointers;
+    for (int dimension = 0; dimension < dimensions; dimension++)
+    {
+        Type *counterType = startValues[dimension]->getType();
+        std::string name = this->nameTokens[dimension]->value;
+        llvmVariablePointers.push_back(generateAllocaInCurrentFunction(context, counterType->getLLVMType(context), name));
+        if (!loopScope->addValue(name, new TypedValue(llvmVariablePointers[dimension], counterType->getUnmanagedPointerToType(), name)))
+        {
+            std::cout << "ERROR: Cannot declare for variable '" << name << "', it already exists\n";
+            exit(-1);
+            return NULL;
+        }
+    }
+
+    // A tiled nest first loops over the blocks of every index, then over the indices in the block, the innermost loop gets the optimizer hints
+    bool tiled = !this->tileSizes.empty();
+    int levels = tiled ? dimensions * 2 : dimensions;
+    std::vector<llvm::Value *> llvmBlockStarts(dimensions);
+    std::function<void(int)> generateLevel = [&](int level)
+    {
+        if (level == levels)
+        {
+            this->loopBody->generateLLVM(context, loopScope, NULL, true);
+            if (context->irBuilder->GetInsertBlock()->getTerminator() == NULL)
+            {
+                generateScopeEnd(context, loopScope);
+            }
+            return;
+        }
+
+        int dimension = level % dimensions;
+        std::string name = this->nameTokens[dimension]->value;
+        IntegerType *counterType = static_cast<IntegerType *>(startValues[dimension]->getType());
+        llvm::MDNode *llvmLoopMetadata = level == levels - 1 ? generateLoopMetadata(context, this->vectorizeWidth, this->unrollCount) : generateLoopMetadata(context, 0, 0);
+        if (tiled && level < dimensions)
+        {
+            generateCountedLoop(context, counterType, startValues[dimension]->getValue(), endValues[dimension]->getValue(), this->tileSizes[dimension], name + ".block", llvmLoopMetadata, [&](llvm::Value *llvmBlockStart)
+                                {
+                llvmBlockStarts[dimension] = llvmBlockStart;
+                generateLevel(level + 1); });
+            return;
+        }
+
+        llvm::Value *llvmStart = startValues[dimension]->getValue();
+        llvm::Value *llvmEnd = endValues[dimension]->getValue();
+        if (tiled)
+        {
+            // The last block of an index can be smaller, min(block start + tile size, end)
+            llvm::Value *llvmTileSize = llvm::ConstantInt::get(counterType->getLLVMType(context), this->tileSizes[dimension]);
+            llvm::Value *llvmRemaining = context->irBuilder->CreateSub(llvmEnd, llvmBlockStarts[dimension], name + ".block.remaining");
+            llvm::Value *llvmIsFull = counterType->getSigned() ? context->irBuilder->CreateICmpSGT(llvmRemaining, llvmTileSize, name + ".block.full") : context->irBuilder->CreateICmpUGT(llvmRemaining, llvmTileSize, name + ".block.full");
+            llvmStart = llvmBlockStarts[dimension];
+            llvmEnd = context->irBuilder->CreateSelect(llvmIsFull, context->irBuilder->CreateAdd(llvmStart, llvmTileSize, name + ".block.end"), llvmEnd, name + ".block.end");
+        }
+        generateCountedLoop(context, counterType, llvmStart, llvmEnd, 1, name, llvmLoopMetadata, [&](llvm::Value *llvmCounter)
+                            {
+            context->irBuilder->CreateStore(llvmCounter, llvmVariablePointers[dimension]);
+            generateLevel(level + 1); });
+    };
+    generateLevel(0);
+
+    return NULL;
+}
+
+TypedValue *ASTMatchArm::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+{
+#ifdef DEBUG
+    std::cout << "debug: ASTMatchArm::generateLLVM\n";
+#endif
+    return this->pattern->generateLLVM(context, scope, typeHint, expectPointer);
+}
+
+TypedValue *ASTMatchStatement::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+{
+#ifdef DEBUG
+    std::cout << "debug: ASTMatchStatement::generateLLVM\n";
+#endif
+
+    // The arms take over the matched value, a unique pointer is moved into them
+    TypedValue *value = generateOwnedValue(context, scope, this->value, NULL);
+    if (value == NULL || value->isType())
+    {
+        std::cout << "ERROR: Match requires a value\n";
+        exit(-1);
+
+        return NULL;
+    }
+    if (value->getTypeCode() != TypeCode::UNION && value->getTypeCode() != TypeCode::INTEGER)
+    {
+        std::cout << "ERROR: Cannot match on " << value->getType()->toString() << ", only unions and integers can be matched\n";
+        exit(-1);
+
+        return NULL;
+    }
+    bool isUnion = value->getTypeCode() == TypeCode::UNION;
+
+    llvm::Function *parentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *elseBlock = llvm::BasicBlock::Create(*context->context, "matchelse");
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "matchcont");
+
+    ASTMatchArm *elseArm = NULL;
+    std::vector<ASTMatchArm *> caseArms;
+    for (auto arm : this->arms)
+    {
+        if (arm->pattern != NULL)
+        {
+            caseArms.push_back(arm);
+        }
+        else if (elseArm != NULL)
+        {
+            std::cout << "ERROR: Match can only have one else arm\n";
+            exit(-1);
+
+            return NULL;
+        }
+        else
+        {
+            elseArm = arm;
+        }
+    }
+
+    // The tag (or integer) is only read once, every arm is a case of a single switch
+    std::vector<llvm::BasicBlock *> caseBlocks;
+    std::vector<Type *> caseTypes;
+    if (isUnion)
+    {
+        UnionType *unionType = static_cast<UnionType *>(value->getType());
+        for (auto arm : caseArms)
+        {
+            TypedValue *pattern = arm->generateLLVM(context, scope, NULL, false);
+            if (pattern == NULL || !pattern->isType())
+            {
+                std::cout << "ERROR: Match arms on union " << unionType->toString() << " must be types\n";
+                exit(-1);
+
+                return NULL;
+            }
+            if (!unionType->containsType(pattern->getType()))
+            {
+                std::cout << "ERROR: Match arm " << pattern->getType()->toString() << " is not part of union " << unionType->toString() << "\n";
+                exit(-1);
+
+                return NULL;
+            }
+            for (auto type : caseTypes)
+            {
+                if (*type == *pattern->getType())
+                {
+                    std::cout << "ERROR: Duplicate match arm " << type->toString() << "\n";
+                    exit(-1);
+
+                    return NULL;
+                }
+            }
+            caseTypes.push_back(pattern->getType());
+        }
+
+        this->exhaustive = caseTypes.size() == unionType->getTypes().size();
+        if (!this->exhaustive && elseArm == NULL)
+        {
+            std::string missing = "";
+            for (auto type : unionType->getTypes())
+            {
+                bool found = false;
+                for (auto caseType : caseTypes)
+                {
+                    found |= *type == *caseType;
+                }
+                if (!found)
+                {
+                    missing += " " + type->toString();
+                }
+            }
+            std::cout << "ERROR: Match on union " << unionType->toString() << " is not exhaustive, missing arms for" << missing << " (or add an else arm)\n";
+            exit(-1);
+
+            return NULL;
+        }
+
+        caseBlocks = generateUnionSwitch(context, value, caseTypes, elseBlock);
+    }
+    else
+    {
+        llvm::SwitchInst *llvmSwitch = context->irBuilder->CreateSwitch(value->getValue(), elseBlock, caseArms.size());
+        for (auto arm : caseArms)
+        {
+            if (arm->nameToken != NULL)
+            {
+                std::cout << "ERROR: Match arms on integers cannot bind a name\n";
+                exit(-1);
+
+                return NULL;
+            }
+
+            TypedValue *pattern = arm->generateLLVM(context, scope, value->getType(), false);
+            TypedValue *convertedPattern = pattern == NULL || pattern->isType() ? NULL : generateTypeConversion(context, pattern, value->getType(), false);
+            llvm::ConstantInt *constant = convertedPattern == NULL ? NULL : llvm::dyn_cast<llvm::ConstantInt>(convertedPattern->getValue());
+            if (constant == NULL)
+            {
+                std::cout << "ERROR: Match arms on " << value->getType()->toString() << " must be constant integers\n";
+                exit(-1);
+
+                return NULL;
+            }
+            if (llvmSwitch->findCaseValue(constant) != llvmSwitch->case_default())
+            {
+                std::cout << "ERROR: Duplicate match arm " << constant->getSExtValue() << "\n";
+                exit(-1);
+
+                return NULL;
+            }
+
+            llvm::BasicBlock *caseBlock = llvm::BasicBlock::Create(*context->context, "matchcase", parentFunction);
+            llvmSwitch->addCase(constant, caseBlock);
+            caseBlocks.push_back(caseBlock);
+        }
+
+        IntegerType *integerType = static_cast<IntegerType *>(value->getType());
+        this->exhaustive = integerType->getBitSize() < 64 && caseArms.size() == ((uint64_t)1 << integerType->getBitSize());
+    }
+
+    // Every arm starts with the same moved variables, the ones moved in an arm that does not return are moved after the match
+    std::set<std::string> movedBefore = scope->getMovedValues();
+    std::set<std::string> movedAfter = movedBefore;
+    for (int i = 0; i < caseArms.size(); i++)
+    {
+        ASTMatchArm *arm = caseArms[i];
+        context->irBuilder->SetInsertPoint(caseBlocks[i]);
+        scope->setMovedValues(movedBefore);
+
+        // The bound name only lives inside the arm, it takes over the reference of the matched value
+        FunctionScope *armScope = new FunctionScope(scope);
+        TypedValue *bindingPointer = NULL;
+        if (isUnion)
+        {
+            if (arm->nameToken != NULL)
+            {
+                if (caseTypes[i]->getTypeCode() == TypeCode::NULLT)
+                {
+                    std::cout << "ERROR: Cannot bind '" << arm->nameToken->value << "' to null\n";
+                    exit(-1);
+
+                    return NULL;
+                }
+
+                TypedValue *data = generateUnionGetData(context, value, caseTypes[i]);
+                bindingPointer = new TypedValue(generateAllocaInCurrentFunction(context, caseTypes[i]->getLLVMType(context), arm->nameToken->value), caseTypes[i]->getUnmanagedPointerToType(), arm->nameToken->value);
+                context->irBuilder->CreateLifetimeStart(bindingPointer->getValue());
+                context->irBuilder->CreateStore(data->getValue(), bindingPointer->getValue());
+                if (!armScope->addValue(arm->nameToken->value, bindingPointer))
+                {
+                    std::cout << "ERROR: Cannot bind match arm to '" << arm->nameToken->value << "', it already exists\n";
+                    exit(-1);
+
+                    return NULL;
+                }
+            }
+            else
+            {
+                generateDecrementReferenceIfPointer(context, value, false);
+                generateUniqueRelease(context, value);
+            }
+        }
+
+        arm->body->generateLLVM(context, armScope, NULL, true);
+
+        if (context->irBuilder->GetInsertBlock()->getTerminator() == NULL)
+        {
+            generateScopeEnd(context, armScope);
+            context->irBuilder->CreateBr(continueBlock);
+
+            std::set<std::string> movedInArm = scope->getMovedValues();
+            movedAfter.insert(movedInArm.begin(), movedInArm.end());
+        }
+    }
+
+    context->irBuilder->SetInsertPoint(elseBlock);
+    elseBlock->insertInto(parentFunction);
+    scope->setMovedValues(movedBefore);
+    if (elseArm != NULL)
+    {
+        if (isUnion)
+        {
+            generateDecrementReferenceIfPointer(context, value, false);
+            generateUniqueRelease(context, value);
+        }
+        elseArm->body->generateLLVM(context, scope, NULL, true);
+        if (context->irBuilder->GetInsertBlock()->getTerminator() == NULL)
+        {
+            context->irBuilder->CreateBr(continueBlock);
+
+            std::set<std::string> movedInArm = scope->getMovedValues();
+            movedAfter.insert(movedInArm.begin(), movedInArm.end());
+        }
+    }
+    else if (this->exhaustive)
+    {
+        // Every tag has an arm, this allows a jump table without range check
+        context->irBuilder->CreateUnreachable();
+    }
+    else
+    {
+        if (isUnion)
+        {
+            generateUniqueRelease(context, value);
+        }
+        context->irBuilder->CreateBr(continueBlock);
+    }
+    scope->setMovedValues(movedAfter);
+
+    context->irBuilder->SetInsertPoint(continueBlock);
+    if (continueBlock->hasNPredecessorsOrMore(1))
+    {
+        continueBlock->insertInto(parentFunction);
+    }
+
+    return NULL;
+}
+
+TypedValue *ASTInvocation::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+{
+#ifdef DEBUG
+    std::cout << "debug: ASTInvocation::generateLLVM\n";
+#endif
+    if (this->functionPointerValue->type == ASTNodeType::DEREFERENCE_MEMBER && static_cast<ASTMemberDereference *>(this->functionPointerValue)->getNameToken()->value == "dot")
+    {
+        // a.dot(b) is the sum of a * b, it is computed in a single loop
+        ASTMemberDereference *member = static_cast<ASTMemberDereference *>(this->functionPointerValue);
+        TypedValue *left = member->getToIndex()->generateLLVM(context, scope, NULL, false);
+        if (left->getTypeCode() == TypeCode::ARRAY || left->getTypeCode() == TypeCode::ARRAY_EXPRESSION)
+        {
+            if (this->parameterValues->size() != 1)
+            {
+                std::cout << "ERROR: dot expects 1 array, got " << this->parameterValues->size() << " parameters\n";
+                exit(-1);
+                return NULL;
+            }
+            TypedValue *right = (*this->parameterValues)[0]->generateLLVM(context, scope, NULL, false);
+            if (right->getTypeCode() != TypeCode::ARRAY && right->getTypeCode() != TypeCode::ARRAY_EXPRESSION)
+            {
+                std::cout << "ERROR: dot expects an array, got " << right->getType()->toString() << "\n";
+                exit(-1);
+                return NULL;
+            }
+            Token *multiplyToken = new Token(member->getNameToken()->position, TokenType::OPERATOR_MULTIPLICATION, "*");
+            return generateArrayReduction(context, generateArrayExpression(context, multiplyToken, left, right), "sum");
+        }
+        std::cout << "ERROR: dot can only be used on arrays, got " << left->getType()->toString() << "\n";
+        exit(-1);
+        return NULL;
+    }
+
+    TypedValue *functionValue = NULL;
+    if (this->functionPointerValue->type == ASTNodeType::DEREFERENCE_MEMBER)
+    {
+        ASTMemberDereference *member = static_cast<ASTMemberDereference *>(this->functionPointerValue);
+        std::string name = member->getNameToken()->value;
+        if (name == "push" || name == "pop" || name == "reserve" || name == "truncate")
+        {
+            // Built-in methods of growable arrays, they work on the shared array so every reference sees the change
+            // The array is usually read from a variable, which keeps it alive during the call, so it is used without counting a reference
+            TypedValue *arrayPointer = member->getToIndex()->generateLLVM(context, scope, NULL, true);
+            bool borrowed = false;
+            while (!arrayPointer->isType() && arrayPointer->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(arrayPointer->getType())->getPointedType()->getTypeCode() == TypeCode::POINTER)
+            {
+                arrayPointer = generateLoad(context, arrayPointer);
+                borrowed = true;
+            }
+            PointerType *arrayPointerType = arrayPointer->getTypeCode() == TypeCode::POINTER ? static_cast<PointerType *>(arrayPointer->getType()) : NULL;
+            if (arrayPointer->isType() || arrayPointerType == NULL || !arrayPointerType->isManaged() || arrayPointerType->getPointedType()->getTypeCode() != TypeCode::ARRAY || !static_cast<ArrayType *>(arrayPointerType->getPointedType())->isGrowable())
+            {
+                std::cout << "ERROR: " << name << " can only be used on growable arrays, got " << arrayPointer->getType()->toString() << "\n";
+                exit(-1);
+                return NULL;
+            }
+            ArrayType *arrayType = static_cast<ArrayType *>(arrayPointerType->getPointedType());
+
+            int expectedParameterCount = name == "pop" ? 0 : 1;
+            if (this->parameterValues->size() != expectedParameterCount)
+            {
+                std::cout << "ERROR: " << name << " expects " << expectedParameterCount << " parameters, got " << this->parameterValues->size() << "\n";
+                exit(-1);
+                return NULL;
+            }
+
+            TypedValue *result = NULL;
+            if (name == "push")
+            {
+                TypedValue *newValue = (*this->parameterValues)[0]->generateLLVM(context, scope, arrayType->getItemType(), false);
+                if (!generateGrowableArrayPush(context, arrayPointer, newValue))
+                {
+                    std::cout << "ERROR: Cannot push " << newValue->getType()->toString() << " to " << arrayType->toString() << "\n";
+                    exit(-1);
+                    return NULL;
+                }
+            }
+            else if (name == "pop")
+            {
+                result = generateGrowableArrayPop(context, arrayPointer);
+            }
+            else
+            {
+                TypedValue *countValue = generateTypeConversion(context, (*this->parameterValues)[0]->generateLLVM(context, scope, &UINT64_TYPE, false), &UINT64_TYPE, false);
+                if (countValue == NULL || countValue->isType())
+                {
+                    std::cout << "ERROR: " << name << " expects an item count\n";
+                    exit(-1);
+                    return NULL;
+                }
+                if (name == "reserve")
+                {
+                    generateGrowableArrayReserve(context, arrayPointer, countValue->getValue(), countValue->getValue());
+                }
+                else
+                {
+                    generateGrowableArrayTruncate(context, arrayPointer, countValue->getValue());
+                }
+            }
+
+            if (!borrowed)
+            {
+                generateDecrementReferenceIfPointer(context, arrayPointer, true);
+            }
+            return result;
+        }
+        if (isBytesOperation(name))
+        {
+            // Built-in methods on the bytes of Strings and arrays of UInt8, other values (like modules) are invoked as usual
+            // The receiver is only generated once, its member is the function to invoke when it has no bytes
+            TypedValue *bytesSlice = NULL;
+            TypedValue *receiver = member->getToIndex()->generateLLVM(context, scope, NULL, true);
+            if (!receiver->isType())
+            {
+                // The parts of split point into the bytes, so they are copied from a String that could be gone before the parts are
+                bytesSlice = generateBytesSlice(context, receiver, name == "split");
+            }
+            if (bytesSlice == NULL)
+            {
+                functionValue = member->generateMember(context, scope, receiver, true);
+            }
+            else
+            {
+                std::vector<TypedValue *> arguments;
+                for (ASTNode *parameterNode : *this->parameterValues)
+                {
+                    arguments.push_back(parameterNode->generateLLVM(context, scope, &BYTE_TYPE, false));
+                }
+                TypedValue *result = generateBytesOperation(context, bytesSlice, name, arguments);
+                if (result == NULL)
+                {
+                    exit(-1);
+                }
+                for (TypedValue *argument : arguments)
+                {
+                    generateDecrementReferenceIfPointer(context, argument, true);
+                }
+                return result;
+            }
+        }
+    }
+
+    if (functionValue == NULL)
+    {
+        functionValue = this->functionPointerValue->generateLLVM(context, scope, NULL, true);
+    }
+    if (functionValue == NULL)
+    {
+        std::cout << "ERROR: Function to call not found\n";
+        exit(-1);
+
+        return NULL;
+    }
+
+    if (functionValue->isType() && functionValue->getTypeCode() == TypeCode::TENSOR)
+    {
+        // tensor(2) [T](rows, columns) allocates a zeroed tensor with that shape
+        TensorType *tensorType = static_cast<TensorType *>(functionValue->getType());
+        if (this->parameterValues->size() != tensorType->getRank())
+        {
+            std::cout << "ERROR: " << tensorType->toString() << " expects " << tensorType->getRank() << " dimensions, got " << this->parameterValues->size() << "\n";
+            exit(-1);
+            return NULL;
+        }
+        std::vector<llvm::Value *> llvmShape;
+        for (ASTNode *parameterNode : *this->parameterValues)
+        {
+            llvmShape.push_back(generateArrayIndex(context, parameterNode->generateLLVM(context, scope, &UINT64_TYPE, false)));
+        }
+        return generateTensorAllocation(context, tensorType, llvmShape);
+    }
+
+    if (functionValue->getTypeCode() != TypeCode::POINTER)
+    {
+        std::cout << "ERROR: Cannot invoke '" << functionValue->getOriginVariable() << "', it must be a pointer\n";
+        exit(-1);
+
+        return NULL;
+    }
+    PointerType *functionPointerType = static_cast<PointerType *>(functionValue->getType());
+    if (functionPointerType->getPointedType()->getTypeCode() != TypeCode::FUNCTION)
+    {
+        std::cout << "ERROR: Cannot invoke '" << functionValue->getOriginVariable() << "', it must be a function pointer\n";
+        exit(-1);
+
+        return NULL;
+    }
+
+    llvm::Function *function = static_cast<llvm::Function *>(functionValue->getValue());
+    FunctionType *functionType = static_cast<FunctionType *>(functionPointerType->getPointedType());
+
+    std::vector<FunctionParameter> &parameters = functionType->getParameters();
+    int parameterCount = this->parameterValues->size();
+    int actualParameterCount = parameters.size();
+    if (actualParameterCount != parameterCount)
+    {
+        std::cout << "ERROR: Invalid amount of parameters for function '" << functionValue->getOriginVariable() << "' invocation, expected " << actualParameterCount << ", got " << parameterCount << "\n";
         exit(-1);
 
         return NULL;
     }
 
     std::vector<llvm::Value *> parameterValues;
+    // Values that only live for this call, they are released after it
+    std::vector<TypedValue *> temporaryValues;
 
     for (int p = 0; p < actualParameterCount; p++)
     {
         FunctionParameter &parameter = parameters[p];
         ASTNode *parameterNode = (*this->parameterValues)[p];
-        TypedValue *parameterValue = parameterNode->generateLLVM(context, scope, parameter.type, false);
+        bool temporary = false;
+        TypedValue *parameterValue = parameter.isBorrowed() ? generateBorrowedValue(context, scope, parameterNode, parameter.type, &temporary) : generateOwnedValue(context, scope, parameterNode, parameter.type);
         if (parameterValue == NULL || parameterValue->getValue() == NULL)
         {
             return NULL;
@@ -2987,10 +5158,40 @@ TypedValue *ASTInvocation::generateLLVM(GenerationContext *context, FunctionScop
 
             return NULL;
         }
-        parameterValues.push_back(convertedValue->getValue());
+        if (functionType->isPassedByPointer(context, parameter.type))
+        {
+            // The function gets its own copy, which it can change
+            llvm::Value *llvmCopyPointer = generateAllocaInCurrentFunction(context, convertedValue->getValue()->getType(), parameter.name + ".arg", getTypeAlign(parameter.type));
+            generateAggregateStore(context, convertedValue->getValue(), llvmCopyPointer);
+            parameterValues.push_back(llvmCopyPointer);
+        }
+        else
+        {
+            parameterValues.push_back(convertedValue->getValue());
+        }
+        if (temporary)
+        {
+            temporaryValues.push_back(convertedValue);
+        }
+    }
+
+    llvm::Value *llvmReturnPointer = NULL;
+    if (functionType->hasReturnPointer(context))
+    {
+        llvmReturnPointer = generateAllocaInCurrentFunction(context, functionType->getReturnType()->getLLVMType(context), (function->getName() + ".result").str(), getTypeAlign(functionType->getReturnType()));
+        parameterValues.insert(parameterValues.begin(), llvmReturnPointer);
     }
 
-    auto callResult = context->irBuilder->CreateCall(function, parameterValues, functionType->getReturnType() == NULL ? "" : (function->getName() + ".call"));
+    auto callResult = context->irBuilder->CreateCall(function, parameterValues, functionType->getReturnType() == NULL || llvmReturnPointer != NULL ? "" : (function->getName() + ".call"));
+    // The call must match the calling convention and parameter attributes of the function
+    callResult->setCallingConv(function->getCallingConv());
+    callResult->setAttributes(function->getAttributes());
+
+    for (TypedValue *temporaryValue : temporaryValues)
+    {
+        generateDecrementReferenceIfPointer(context, temporaryValue, true);
+        generateUniqueRelease(context, temporaryValue);
+    }
 #ifdef DEBUG
     std::cout << "debug: ASTInvocation::generateLLVM done\n";
 #endif
@@ -2998,6 +5199,10 @@ TypedValue *ASTInvocation::generateLLVM(GenerationContext *context, FunctionScop
     {
         return NULL;
     }
+    else if (llvmReturnPointer != NULL)
+    {
+        return generateLoad(context, new TypedValue(llvmReturnPointer, functionType->getReturnType()->getUnmanagedPointerToType()));
+    }
     else
     {
         return new TypedValue(callResult, functionType->getReturnType());
@@ -3012,6 +5217,75 @@ TypedValue *ASTBrackets::generateLLVM(GenerationContext *context, FunctionScope
     return this->inner->generateLLVM(context, scope, typeHint, expectPointer);
 }
 
+TypedValue *ASTTuple::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
+{
+#ifdef DEBUG
+    std::cout << "debug: ASTTuple::generateLLVM\n";
+#endif
+    TupleType *tupleHint = typeHint != NULL && typeHint->getTypeCode() == TypeCode::TUPLE ? static_cast<TupleType *>(typeHint) : NULL;
+    if (tupleHint != NULL && tupleHint->getItemTypes().size() != this->items->size())
+    {
+        tupleHint = NULL;
+    }
+
+    std::vector<TypedValue *> itemValues;
+    std::vector<Type *> itemTypes;
+    for (int i = 0; i < this->items->size(); i++)
+    {
+        ASTNode *item = (*this->items)[i];
+        Type *itemHint = tupleHint == NULL ? NULL : tupleHint->getItemTypes()[i];
+
+        // Every item gets the tuple as its new owner
+        TypedValue *itemValue = generateOwnedValue(context, scope, item, itemHint);
+        if (itemValue == NULL || (i > 0 && itemValue->isType() != itemValues[0]->isType()))
+        {
+            std::cout << "ERROR: A tuple must contain only values or only types\n";
+            exit(-1);
+
+            return NULL;
+        }
+        if (!itemValue->isType())
+        {
+            if (itemHint != NULL)
+            {
+                itemValue = generateTypeConversion(context, itemValue, itemHint, false);
+            }
+            else if (itemValue->getTypeCode() == TypeCode::SOA_ITEM)
+            {
+                itemValue = generateSoAItemLoad(context, itemValue);
+            }
+            else if ((item->type == ASTNodeType::DEREFERENCE_MEMBER || item->type == ASTNodeType::DEREFERENCE_INDEX) && itemValue->getTypeCode() == TypeCode::POINTER && !static_cast<PointerType *>(itemValue->getType())->isManaged() && !static_cast<PointerType *>(itemValue->getType())->isUnique())
+            {
+                // Members and indexing result in a pointer to the field or item
+                itemValue = generateReferenceAwareLoad(context, itemValue);
+            }
+            if (itemValue == NULL)
+            {
+                std::cout << "ERROR: Cannot convert tuple item " << i << " to " << itemHint->toString() << "\n";
+                exit(-1);
+
+                return NULL;
+            }
+        }
+        itemValues.push_back(itemValue);
+        itemTypes.push_back(itemValue->getType());
+    }
+
+    TupleType *tupleType = new TupleType(itemTypes);
+    if (itemValues[0]->isType())
+    {
+        return new TypedValue(NULL, tupleType);
+    }
+
+    // A first-class struct, it is kept in registers
+    llvm::Value *llvmTuple = llvm::UndefValue::get(tupleType->getLLVMType(context));
+    for (int i = 0; i < itemValues.size(); i++)
+    {
+        llvmTuple = context->irBuilder->CreateInsertValue(llvmTuple, itemValues[i]->getValue(), i, "tuple");
+    }
+    return new TypedValue(llvmTuple, tupleType);
+}
+
 TypedValue *ASTFile::generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer)
 {
 #ifdef DEBUG
@@ -3049,6 +5323,8 @@ std::string astNodeTypeToString(ASTNodeType type)
         return "SYMBOL";
     case ASTNodeType::BRACKETS:
         return "BRACKETS";
+    case ASTNodeType::TUPLE:
+        return "TUPLE";
     case ASTNodeType::FILE:
         return "FILE";
     case ASTNodeType::RETURN:
@@ -3075,6 +5351,10 @@ std::string astNodeTypeToString(ASTNodeType type)
         return "DEREFERENCE_INDEX";
     case ASTNodeType::CAST:
         return "CAST";
+    case ASTNodeType::MATCH:
+        return "MATCH";
+    case ASTNodeType::MATCH_ARM:
+        return "MATCH_ARM";
     default:
         return "Unknown";
     }
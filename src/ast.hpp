@@ -53,7 +53,10 @@ enum class ASTNodeType
     CAST,
     ARRAY,
     ARRAY_SEGMENT,
-    NULL_COALESCE
+    NULL_COALESCE,
+    MATCH,
+    MATCH_ARM,
+    TUPLE
 };
 
 std::string astNodeTypeToString(ASTNodeType type);
@@ -123,6 +126,9 @@ public:
     }
 
     TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
+
+    // Generates the right operand and applies the operator to an already generated left operand
+    TypedValue *generateLLVMWithLeft(GenerationContext *context, FunctionScope *scope, TypedValue *left);
 };
 
 class ASTCast : public ASTNode
@@ -176,14 +182,22 @@ private:
 class ASTStruct : public ASTNode
 {
 public:
-    ASTStruct(const Token *nameToken, std::vector<ASTStructField *> fields, bool managed = true, bool packed = false, bool value = false) : ASTNode(ASTNodeType::STRUCT), nameToken(nameToken), fields(fields), managed(managed), packed(packed), value(value) {}
+    ASTStruct(const Token *nameToken, std::vector<ASTStructField *> fields, bool managed = true, bool packed = false, bool value = false, bool exported = false, uint64_t align = 0, bool unique = false) : ASTNode(ASTNodeType::STRUCT), nameToken(nameToken), fields(fields), managed(managed), packed(packed), value(value), exported(exported), align(align), unique(unique) {}
 
     TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
 
     std::string toString() override
     {
         std::string str = "";
-        if (!this->managed)
+        if (this->exported)
+        {
+            str += "export ";
+        }
+        if (this->unique)
+        {
+            str += "unique ";
+        }
+        else if (!this->managed)
         {
             str += "unmanaged ";
         }
@@ -191,6 +205,10 @@ public:
         {
             str += "packed ";
         }
+        if (this->align > 0)
+        {
+            str += "align(" + std::to_string(this->align) + ") ";
+        }
         if (this->value)
         {
             str += "value ";
@@ -231,6 +249,9 @@ private:
     bool managed = true;
     bool packed = false;
     bool value = false;
+    bool exported = false;
+    uint64_t align = 0;
+    bool unique = false;
     const Token *nameToken;
 };
 
@@ -289,7 +310,8 @@ private:
 class ASTArray : public ASTNode
 {
 public:
-    ASTArray(std::vector<ASTArraySegment *> values, bool managed = true, bool value = false) : ASTNode(ASTNodeType::ARRAY), values(values), managed(managed), value(value) {}
+    // rank > 0 makes tensor(rank) [T], the type of a tensor of T items
+    ASTArray(std::vector<ASTArraySegment *> values, bool managed = true, bool value = false, bool soa = false, uint64_t align = 0, bool growable = false, bool slice = false, int rank = 0) : ASTNode(ASTNodeType::ARRAY), values(values), managed(managed), value(value), soa(soa), align(align), growable(growable), slice(slice), rank(rank) {}
 
     TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
 
@@ -304,6 +326,22 @@ public:
         {
             str += "value ";
         }
+        if (this->soa)
+        {
+            str += "soa ";
+        }
+        if (this->growable)
+        {
+            str += "growable ";
+        }
+        if (this->align > 0)
+        {
+            str += "align(" + std::to_string(this->align) + ") ";
+        }
+        if (this->rank > 0)
+        {
+            str += "tensor(" + std::to_string(this->rank) + ") ";
+        }
         str += "[";
         bool first = true;
         for (auto &value : this->values)
@@ -318,14 +356,28 @@ public:
             }
             str += value->toString();
         }
+        if (this->slice)
+        {
+            str += " ..";
+        }
         str += "]";
         return str;
     }
 
+    std::vector<ASTArraySegment *> &getValues()
+    {
+        return this->values;
+    }
+
 private:
     std::vector<ASTArraySegment *> values;
     bool managed;
     bool value;
+    bool soa;
+    uint64_t align;
+    bool growable;
+    bool slice;
+    int rank;
 };
 
 class ASTBrackets : public ASTNode
@@ -345,6 +397,31 @@ public:
     TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
 };
 
+// (a, b) is a tuple value, (Int64, Int64) a tuple type
+class ASTTuple : public ASTNode
+{
+public:
+    ASTTuple(std::vector<ASTNode *> *items) : ASTNode(ASTNodeType::TUPLE), items(items) {}
+    std::vector<ASTNode *> *items;
+
+    std::string toString() override
+    {
+        std::string str = "(";
+        for (int i = 0; i < this->items->size(); i++)
+        {
+            if (i > 0)
+            {
+                str += ", ";
+            }
+            str += (*this->items)[i]->toString();
+        }
+        str += ")";
+        return str;
+    }
+
+    TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
+};
+
 class ASTSymbol : public ASTNode
 {
 public:
@@ -359,24 +436,71 @@ public:
     TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
 };
 
+// A dimension of a[i, lo..hi], index..endIndex when isRange is set, the bounds can be NULL
+class ASTIndexDimension
+{
+public:
+    ASTIndexDimension(ASTNode *index, ASTNode *endIndex, bool isRange) : index(index), endIndex(endIndex), isRange(isRange) {}
+
+    std::string toString()
+    {
+        std::string str = "";
+        if (this->index != NULL)
+        {
+            str += this->index->toString();
+        }
+        if (this->isRange)
+        {
+            str += "..";
+            if (this->endIndex != NULL)
+            {
+                str += this->endIndex->toString();
+            }
+        }
+        return str;
+    }
+
+    ASTNode *index;
+    ASTNode *endIndex;
+    bool isRange;
+};
+
 class ASTIndexDereference : public ASTNode
 {
 public:
-    ASTIndexDereference(ASTNode *toIndex, ASTNode *index) : ASTNode(ASTNodeType::DEREFERENCE_INDEX), toIndex(toIndex), index(index) {}
+    // a[index..endIndex] when isRange is set, the bounds can be NULL
+    // Tensors can be indexed in more dimensions, a[index, otherDimensions...]
+    ASTIndexDereference(ASTNode *toIndex, ASTNode *index, ASTNode *endIndex = NULL, bool isRange = false, std::vector<ASTIndexDimension> otherDimensions = {}) : ASTNode(ASTNodeType::DEREFERENCE_INDEX), toIndex(toIndex), index(index), endIndex(endIndex), isRange(isRange), otherDimensions(otherDimensions) {}
 
     std::string toString() override
     {
         std::string str = this->toIndex->toString();
-        str += "[" + this->index->toString();
+        str += "[";
+        str += ASTIndexDimension(this->index, this->endIndex, this->isRange).toString();
+        for (auto &dimension : this->otherDimensions)
+        {
+            str += ", ";
+            str += dimension.toString();
+        }
         str += "]";
         return str;
     }
 
     TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
+    // a[lo..hi] = v stores the lanes of the vector v into the items from lo
+    bool generateVectorStore(GenerationContext *context, FunctionScope *scope, ASTNode *vector);
+
+    bool getIsRange()
+    {
+        return this->isRange;
+    }
 
 private:
     ASTNode *toIndex;
     ASTNode *index;
+    ASTNode *endIndex;
+    bool isRange;
+    std::vector<ASTIndexDimension> otherDimensions;
 };
 
 class ASTMemberDereference : public ASTNode
@@ -392,6 +516,18 @@ public:
     }
 
     TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
+    // Dereferences the member of an already generated toIndex value
+    TypedValue *generateMember(GenerationContext *context, FunctionScope *scope, TypedValue *valueToIndex, bool expectPointer);
+
+    ASTNode *getToIndex()
+    {
+        return this->toIndex;
+    }
+
+    const Token *getNameToken()
+    {
+        return this->nameToken;
+    }
 
 private:
     ASTNode *toIndex;
@@ -433,15 +569,30 @@ public:
 class ASTDeclaration : public ASTNode
 {
 public:
-    ASTDeclaration(const Token *nameToken, ASTNode *value, ASTNode *typeSpecifier) : ASTNode(ASTNodeType::DECLARATION), nameToken(nameToken), value(value), typeSpecifier(typeSpecifier) {}
+    // let (a, b) = ... declares a variable for every item of a tuple, nameToken is the first name then
+    ASTDeclaration(const Token *nameToken, ASTNode *value, ASTNode *typeSpecifier, std::vector<const Token *> *itemNameTokens = NULL) : ASTNode(ASTNodeType::DECLARATION), nameToken(nameToken), value(value), typeSpecifier(typeSpecifier), itemNameTokens(itemNameTokens) {}
     const Token *nameToken;
     ASTNode *value;
     ASTNode *typeSpecifier;
+    std::vector<const Token *> *itemNameTokens;
 
     std::string toString() override
     {
         std::string str = "let ";
-        str += this->nameToken->value;
+        if (this->itemNameTokens != NULL)
+        {
+            str += "(";
+            for (int i = 0; i < this->itemNameTokens->size(); i++)
+            {
+                str += i > 0 ? ", " : "";
+                str += (*this->itemNameTokens)[i]->value;
+            }
+            str += ")";
+        }
+        else
+        {
+            str += this->nameToken->value;
+        }
         if (this->typeSpecifier != NULL)
         {
             str += ": ";
@@ -455,7 +606,26 @@ public:
         return str;
     }
 
+    void declareStaticNames(ModuleType *currentModule) override
+    {
+        if (this->itemNameTokens != NULL)
+        {
+            std::cout << "ERROR: A tuple can only be taken apart in a function\n";
+            exit(-1);
+        }
+
+        // Only module-level declarations are declared statically
+        this->isStatic = true;
+        currentModule->addLazyValue(this->nameToken->value, this);
+    }
+
     TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
+
+private:
+    TypedValue *generateDestructuring(GenerationContext *context, FunctionScope *scope);
+
+    bool isStatic = false;
+    TypedValue *staticPointer = NULL;
 };
 
 class ASTAssignment : public ASTNode
@@ -537,13 +707,14 @@ public:
 class ASTParameter : public ASTNode
 {
 public:
-    ASTParameter(const Token *nameToken, ASTNode *typeSpecifier = NULL) : ASTNode(ASTNodeType::PARAMETER), nameToken(nameToken), typeSpecifier(typeSpecifier)
+    ASTParameter(const Token *nameToken, ASTNode *typeSpecifier = NULL, bool owned = false) : ASTNode(ASTNodeType::PARAMETER), nameToken(nameToken), typeSpecifier(typeSpecifier), owned(owned)
     {
     }
 
     std::string toString() override
     {
-        std::string str = this->nameToken->value;
+        std::string str = this->owned ? "owned " : "";
+        str += this->nameToken->value;
         if (this->typeSpecifier != NULL)
         {
             str += ": ";
@@ -559,9 +730,16 @@ public:
         return this->nameToken->value;
     }
 
+    // Owned parameters take over the reference of the caller, other parameters are borrowed
+    bool isOwned()
+    {
+        return this->owned;
+    }
+
 private:
     const Token *nameToken;
     ASTNode *typeSpecifier;
+    bool owned;
 };
 
 class ASTInvocation : public ASTNode
@@ -745,7 +923,178 @@ public:
     TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
 };
 
+class ASTForStatement : public ASTNode
+{
+public:
+    ASTForStatement(const Token *nameToken, ASTNode *startValue, ASTNode *endValue, ASTNode *loopBody, int vectorizeWidth, int unrollCount) : ASTNode(ASTNodeType::FOR), nameToken(nameToken), startValue(startValue), endValue(endValue), loopBody(loopBody), vectorizeWidth(vectorizeWidth), unrollCount(unrollCount) {}
+    const Token *nameToken;
+    // The array to iterate when endValue is NULL, otherwise the start of the range
+    ASTNode *startValue;
+    // The (exclusive) end of the range, NULL when iterating an array
+    ASTNode *endValue;
+    ASTNode *loopBody;
+    // Optimizer hints, 0 when not specified
+    int vectorizeWidth;
+    int unrollCount;
+
+    std::string toString() override
+    {
+        std::string str = "for ";
+        str += this->nameToken->value;
+        str += " in ";
+        str += this->startValue->toString();
+        if (this->endValue != NULL)
+        {
+            str += "..";
+            str += this->endValue->toString();
+        }
+        str += this->loopBody->toString();
+        return str;
+    }
+
+    bool isTerminating() override
+    {
+        // The body may not run at all
+        return false;
+    }
+
+    TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
+};
+
+// for (i, j in 0..n, 0..m) iterates every index of a loop nest, the last index changes fastest
+// for (i, j in t) iterates the shape of the tensor t, tile(a, b) iterates blocks of a x b indices at a time so the items they touch stay in cache
+class ASTForNestStatement : public ASTNode
+{
+public:
+    ASTForNestStatement(std::vector<const Token *> nameTokens, std::vector<ASTNode *> startValues, std::vector<ASTNode *> endValues, ASTNode *loopBody, int vectorizeWidth, int unrollCount, std::vector<int> tileSizes) : ASTNode(ASTNodeType::FOR), nameTokens(nameTokens), startValues(startValues), endValues(endValues), loopBody(loopBody), vectorizeWidth(vectorizeWidth), unrollCount(unrollCount), tileSizes(tileSizes) {}
+    std::vector<const Token *> nameTokens;
+    // The range of every index, or a single tensor with a NULL end value
+    std::vector<ASTNode *> startValues;
+    std::vector<ASTNode *> endValues;
+    ASTNode *loopBody;
+    // Optimizer hints for the innermost loop, 0 when not specified
+    int vectorizeWidth;
+    int unrollCount;
+    // The block size of every index, empty when the nest is not tiled
+    std::vector<int> tileSizes;
+
+    std::string toString() override
+    {
+        std::string str = "for ";
+        for (int i = 0; i < this->nameTokens.size(); i++)
+        {
+            str += i == 0 ? "" : ", ";
+            str += this->nameTokens[i]->value;
+        }
+        str += " in ";
+        for (int i = 0; i < this->startValues.size(); i++)
+        {
+            str += i == 0 ? "" : ", ";
+            str += this->startValues[i]->toString();
+            if (this->endValues[i] != NULL)
+            {
+                str += "..";
+                str += this->endValues[i]->toString();
+            }
+        }
+        str += this->loopBody->toString();
+        return str;
+    }
+
+    bool isTerminating() override
+    {
+        // The body may not run at all
+        return false;
+    }
+
+    TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
+};
+
+class ASTMatchArm : public ASTNode
+{
+public:
+    ASTMatchArm(ASTNode *pattern, const Token *nameToken, ASTNode *body) : ASTNode(ASTNodeType::MATCH_ARM), pattern(pattern), nameToken(nameToken), body(body) {}
+    // The type (for unions) or constant (for integers) this arm matches, NULL for the else arm
+    ASTNode *pattern;
+    // The name the matched union data is bound to in the arm body, can be NULL
+    const Token *nameToken;
+    ASTNode *body;
+
+    std::string toString() override
+    {
+        std::string str = "";
+        if (this->pattern == NULL)
+        {
+            str += "else";
+        }
+        else
+        {
+            if (this->nameToken != NULL)
+            {
+                str += this->nameToken->value + ": ";
+            }
+            str += this->pattern->toString();
+        }
+        str += " ";
+        str += this->body->toString();
+        return str;
+    }
+
+    bool isTerminating() override
+    {
+        return this->body->isTerminating();
+    }
+
+    // Generates the pattern, the body is generated by ASTMatchStatement
+    TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
+};
+
+class ASTMatchStatement : public ASTNode
+{
+public:
+    ASTMatchStatement(ASTNode *value, std::vector<ASTMatchArm *> arms) : ASTNode(ASTNodeType::MATCH), value(value), arms(arms), exhaustive(false) {}
+    ASTNode *value;
+    std::vector<ASTMatchArm *> arms;
+    // True when the arms cover every possible value, only known after generateLLVM
+    bool exhaustive;
+
+    std::string toString() override
+    {
+        std::string str = "match ";
+        str += this->value->toString();
+        str += " {\n";
+        for (auto arm : this->arms)
+        {
+            str += arm->toString();
+            str += "\n";
+        }
+        str += "}";
+        return str;
+    }
+
+    bool isTerminating() override
+    {
+        bool hasElse = false;
+        for (auto arm : this->arms)
+        {
+            if (!arm->isTerminating())
+            {
+                return false;
+            }
+            if (arm->pattern == NULL)
+            {
+                hasElse = true;
+            }
+        }
+        return hasElse || this->exhaustive;
+    }
+
+    TypedValue *generateLLVM(GenerationContext *context, FunctionScope *scope, Type *typeHint, bool expectPointer) override;
+};
+
 ASTNode *parseIfStatement(TokenStream *tokens);
+ASTNode *parseMatchStatement(TokenStream *tokens);
+ASTNode *parseForStatement(TokenStream *tokens);
 ASTNode *parseWhileStatement(TokenStream *tokens);
 ASTDeclaration *parseDeclaration(TokenStream *tokens);
 ASTNode *parseValueOrOperator(TokenStream *tokens, bool parseType);
@@ -756,6 +1105,7 @@ ASTFile *parseFile(TokenStream *tokens);
 ASTReturn *parseReturn(TokenStream *tokens);
 ASTParameter *parseParameter(TokenStream *tokens);
 ASTNode *parseValueAndSuffix(TokenStream *tokens, bool parseType);
-ASTStruct *parseStruct(TokenStream *tokens, const Token *structNameToken);
+ASTStruct *parseStruct(TokenStream *tokens, const Token *structNameToken, bool exported);
 ASTNode *parseInlineType(TokenStream *tokens);
-ASTNode *parseStructDeclaration(TokenStream *tokens);
\ No newline at end of file
+ASTNode *parseStructDeclaration(TokenStream *tokens);
+int64_t parseAlignModifier(TokenStream *tokens);
\ No newline at end of file
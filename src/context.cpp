@@ -5,14 +5,27 @@ GenerationContext::GenerationContext() : context(std::make_unique<llvm::LLVMCont
                                          irBuilder(std::make_unique<llvm::IRBuilder<>>(*context)),
                                          module(std::make_unique<llvm::Module>("default-choco-module", *context)),
                                          passManager(std::make_unique<llvm::legacy::FunctionPassManager>(module.get())),
-                                         globalModule(new ModuleType("Global"))
+                                         globalModule(new ModuleType("Global")),
+                                         boundsChecks(true)
 {
     this->unionTypeIds.push_back(new NullType());
 #ifndef DEBUG
     passManager->add(llvm::createPromoteMemoryToRegisterPass());
+    passManager->add(llvm::createSROAPass());
     passManager->add(llvm::createGVNPass());
     passManager->add(llvm::createReassociatePass());
     passManager->add(llvm::createInstructionCombiningPass());
+    // Bounds check elimination: remove checks implied by dominating checks or by the range of a loop induction variable
+    passManager->add(llvm::createCorrelatedValuePropagationPass());
+    passManager->add(llvm::createLoopSimplifyPass());
+    passManager->add(llvm::createLCSSAPass());
+    passManager->add(llvm::createIndVarSimplifyPass());
+    passManager->add(llvm::createInductiveRangeCheckEliminationPass());
+    passManager->add(llvm::createCorrelatedValuePropagationPass());
+    // Without target information the vectorizer only acts on loops with a vectorize hint (see ASTForStatement)
+    passManager->add(llvm::createLoopVectorizePass());
+    passManager->add(llvm::createLoopUnrollPass());
+    passManager->add(llvm::createInstructionCombiningPass());
     passManager->add(llvm::createMemCpyOptPass());
     passManager->add(llvm::createCFGSimplificationPass());
     passManager->add(llvm::createDeadCodeEliminationPass());
@@ -33,12 +46,9 @@ uint64_t GenerationContext::getTypeId(Type *type)
     return this->unionTypeIds.size() - 1;
 }
 
-FunctionScope::FunctionScope(const FunctionScope &copyFrom)
+FunctionScope::FunctionScope(FunctionScope *parent) : parent(parent), loop(false)
 {
-    for (auto const &p : copyFrom.namedValues)
-    {
-        this->namedValues[p.first] = p.second;
-    }
+    this->narrowings = parent->narrowings;
 }
 
 bool FunctionScope::addValue(const std::string &name, TypedValue *value)
@@ -50,13 +60,36 @@ bool FunctionScope::addValue(const std::string &name, TypedValue *value)
     else
     {
         this->namedValues[name] = value;
+        this->locals.push_back(value);
+        // A variable of a disjoint scope could have had this name
+        this->setMoved(name, false);
         return true;
     }
 }
 
+bool FunctionScope::addBorrowedValue(const std::string &name, TypedValue *value)
+{
+    if (this->hasValue(name))
+    {
+        return false;
+    }
+    this->namedValues[name] = value;
+    this->borrowedValues.insert(name);
+    return true;
+}
+
+bool FunctionScope::isBorrowed(const std::string &name)
+{
+    if (this->namedValues.count(name) > 0)
+    {
+        return this->borrowedValues.count(name) > 0;
+    }
+    return this->parent != NULL && this->parent->isBorrowed(name);
+}
+
 bool FunctionScope::hasValue(const std::string &name)
 {
-    return this->namedValues.count(name) > 0;
+    return this->getValue(name) != NULL;
 }
 
 TypedValue *FunctionScope::getValue(const std::string &name)
@@ -65,8 +98,118 @@ TypedValue *FunctionScope::getValue(const std::string &name)
     {
         return this->namedValues[name];
     }
+    else if (this->parent != NULL)
+    {
+        return this->parent->getValue(name);
+    }
     else
     {
         return NULL;
     }
-}
\ No newline at end of file
+}
+
+void FunctionScope::pushNarrowing(const std::string &name, Type *type)
+{
+    this->narrowings.push_back(std::pair<std::string, Type *>(name, type));
+}
+
+void FunctionScope::popNarrowings(int count)
+{
+    this->narrowings.resize(count);
+}
+
+int FunctionScope::getNarrowingCount()
+{
+    return this->narrowings.size();
+}
+
+Type *FunctionScope::getNarrowedType(const std::string &name)
+{
+    // The last narrowing is the most specific
+    for (auto it = this->narrowings.rbegin(); it != this->narrowings.rend(); it++)
+    {
+        if (it->first == name)
+        {
+            return it->second;
+        }
+    }
+    return NULL;
+}
+
+void FunctionScope::dropNarrowings(const std::string &name)
+{
+    // The entries are kept, so the counts given to popNarrowings stay valid
+    for (auto &narrowing : this->narrowings)
+    {
+        if (narrowing.first == name)
+        {
+            narrowing.second = NULL;
+        }
+    }
+    if (this->parent != NULL)
+    {
+        this->parent->dropNarrowings(name);
+    }
+}
+
+bool FunctionScope::isNarrowedOutsideLoop(const std::string &name)
+{
+    for (FunctionScope *scope = this; scope != NULL; scope = scope->parent)
+    {
+        if (scope->loop)
+        {
+            return scope->parent != NULL && scope->parent->getNarrowedType(name) != NULL;
+        }
+    }
+    return false;
+}
+
+void FunctionScope::setMoved(const std::string &name, bool moved)
+{
+    if (this->parent != NULL)
+    {
+        this->parent->setMoved(name, moved);
+    }
+    else if (moved)
+    {
+        this->movedValues.insert(name);
+    }
+    else
+    {
+        this->movedValues.erase(name);
+    }
+}
+
+bool FunctionScope::isMoved(const std::string &name)
+{
+    return this->parent != NULL ? this->parent->isMoved(name) : this->movedValues.count(name) > 0;
+}
+
+std::set<std::string> FunctionScope::getMovedValues()
+{
+    return this->parent != NULL ? this->parent->getMovedValues() : this->movedValues;
+}
+
+void FunctionScope::setMovedValues(std::set<std::string> movedValues)
+{
+    if (this->parent != NULL)
+    {
+        this->parent->setMovedValues(movedValues);
+    }
+    else
+    {
+        this->movedValues = movedValues;
+    }
+}
+
+bool FunctionScope::isDeclaredOutsideLoop(const std::string &name)
+{
+    for (FunctionScope *scope = this; scope != NULL && scope->namedValues.count(name) == 0; scope = scope->parent)
+    {
+        if (scope->loop)
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <map>
+#include <set>
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/BasicBlock.h"
@@ -19,27 +20,76 @@
 #include "llvm/Transforms/Scalar/GVN.h"
 #include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #include "llvm/Transforms/Utils.h"
+#include "llvm/Transforms/Vectorize.h"
 
 class TypedValue;
 class ModuleType;
 class FunctionType;
+class StructType;
 class Type;
 
 class FunctionScope
 {
 public:
-    FunctionScope() {}
-    FunctionScope(const FunctionScope &copyFrom);
+    FunctionScope() : parent(NULL), loop(false) {}
+    // Creates a scope nested in parent, the values added to it must be released when it ends (see generateScopeEnd)
+    FunctionScope(FunctionScope *parent);
 
-    // Returns false if the name already exists locally
+    // Returns false if the name already exists in this scope or a parent scope
     bool addValue(const std::string &name, TypedValue *value);
 
+    // Adds a value that is not released when the scope ends (see generateScopeEnd), it cannot be assigned or moved
+    bool addBorrowedValue(const std::string &name, TypedValue *value);
+
+    bool isBorrowed(const std::string &name);
+
     bool hasValue(const std::string &name);
 
     TypedValue *getValue(const std::string &name);
 
+    // Marks a union variable as only containing type, until popped with popNarrowings
+    void pushNarrowing(const std::string &name, Type *type);
+
+    // Removes the narrowings that were pushed after getNarrowingCount() returned count
+    void popNarrowings(int count);
+
+    int getNarrowingCount();
+
+    // Returns the type a union variable is known to contain at this point, or NULL
+    Type *getNarrowedType(const std::string &name);
+
+    // Ends the narrowings of a union variable in this scope and the scopes it is nested in, after it got a value of another type
+    void dropNarrowings(const std::string &name);
+
+    // Returns true when the union variable was narrowed outside of a loop this scope is in, the code before an assignment in the loop
+    // assumes the narrowed type on the next iteration too
+    bool isNarrowedOutsideLoop(const std::string &name);
+
+    // Marks a variable that owns a unique pointer as moved, it cannot be used until it is assigned again
+    void setMoved(const std::string &name, bool moved);
+
+    bool isMoved(const std::string &name);
+
+    // The moved variables of the whole function, so branches can be generated from the same state and merged
+    std::set<std::string> getMovedValues();
+
+    void setMovedValues(std::set<std::string> movedValues);
+
+    // Returns true when the variable was declared outside of a loop this scope is in, moving it would move it again on the next iteration
+    bool isDeclaredOutsideLoop(const std::string &name);
+
     // private:
+    FunctionScope *parent;
+    // True for the scope of a loop body
+    bool loop;
     std::map<std::string, TypedValue *> namedValues;
+    // The values added to this scope in declaration order
+    std::vector<TypedValue *> locals;
+    // The names of the borrowed values in namedValues
+    std::set<std::string> borrowedValues;
+    std::vector<std::pair<std::string, Type *>> narrowings;
+    // Only used in the function scope (without parent)
+    std::set<std::string> movedValues;
 };
 
 class GenerationContext
@@ -60,4 +110,8 @@ public:
     std::map<llvm::Type *, llvm::Function *> mallocFunctions;
     std::vector<Type *> unionTypeIds;
     ModuleType *globalModule;
+    // The named structs that were generated, in generation order
+    std::vector<StructType *> structTypes;
+    // When false, no array bounds checks are emitted (for trusted builds)
+    bool boundsChecks;
 };
\ No newline at end of file
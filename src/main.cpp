@@ -25,8 +25,28 @@ extern "C" double printDouble(double X)
     return 0;
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    bool boundsChecks = true;
+    bool layoutReport = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--no-bounds-checks")
+        {
+            boundsChecks = false;
+        }
+        else if (argument == "--layout-report")
+        {
+            layoutReport = true;
+        }
+        else
+        {
+            std::cout << "ERROR: Unknown argument '" << argument << "'\n";
+            return 1;
+        }
+    }
+
     llvm::InitializeAllTargetInfos();
     llvm::InitializeAllTargets();
     llvm::InitializeAllTargetMCs();
@@ -67,6 +87,26 @@ int main()
     std::cout << "[3/4] Generating code...\n";
 
     auto context = new GenerationContext();
+
+    // The data layout is known before generating, struct layouts and copy strategies depend on it
+    auto targetCpu = "x86-64";                               // x86-64
+    auto targetFeatures = "";                                // "+avx,+avx2,+aes,+sse,+sse2,+sse3";
+    auto targetTriple = llvm::sys::getDefaultTargetTriple(); // "wasm32"
+    std::string targetTripleError;
+    auto target = llvm::TargetRegistry::lookupTarget(targetTriple, targetTripleError);
+    if (!target)
+    {
+        std::cout << "Could not lookup target: " << targetTripleError;
+        return 1;
+    }
+
+    llvm::TargetOptions targetOptions;
+    auto targetMachine = target->createTargetMachine(targetTriple, targetCpu, targetFeatures, targetOptions, llvm::Reloc::DynamicNoPIC);
+
+    context->module->setDataLayout(targetMachine->createDataLayout());
+    context->module->setTargetTriple(targetTriple);
+
+    context->boundsChecks = boundsChecks;
     file->declareStaticNames(context->globalModule);
     context->globalModule->addValue("Float32", new TypedValue(NULL, new FloatType(32)));
     context->globalModule->addValue("Float64", new TypedValue(NULL, new FloatType(64)));
@@ -79,6 +119,27 @@ int main()
     context->globalModule->addValue("Int8", new TypedValue(NULL, new IntegerType(8, true)));
     context->globalModule->addValue("UInt8", new TypedValue(NULL, new IntegerType(8, false)));
     context->globalModule->addValue("Bool", new TypedValue(NULL, new IntegerType(1, false)));
+    context->globalModule->addValue("String", new TypedValue(NULL, &STRING_TYPE));
+
+    // SIMD vector types (Float32x8 is 8 lanes of Float32) from 64 to 512 bits, comparing them results in a mask (Boolx8)
+    for (int lanes = 2; lanes <= 64; lanes *= 2)
+    {
+        std::string suffix = "x" + std::to_string(lanes);
+        for (int bitSize = 8; bitSize <= 64; bitSize *= 2)
+        {
+            if (bitSize * lanes < 64 || bitSize * lanes > 512)
+            {
+                continue;
+            }
+            context->globalModule->addValue("Int" + std::to_string(bitSize) + suffix, new TypedValue(NULL, new IntegerType(bitSize, true, lanes)));
+            context->globalModule->addValue("UInt" + std::to_string(bitSize) + suffix, new TypedValue(NULL, new IntegerType(bitSize, false, lanes)));
+            if (bitSize >= 32)
+            {
+                context->globalModule->addValue("Float" + std::to_string(bitSize) + suffix, new TypedValue(NULL, new FloatType(bitSize, lanes)));
+            }
+        }
+        context->globalModule->addValue("Bool" + suffix, new TypedValue(NULL, new IntegerType(1, false, lanes)));
+    }
 
     std::cout << context->globalModule->toString() << "\n";
 
@@ -96,24 +157,15 @@ int main()
     context->module->print(llvm::errs(), NULL);
     // #endif
 
-    std::cout << "[4/4] Creating executable...\n";
-
-    auto targetCpu = "x86-64";                               // x86-64
-    auto targetFeatures = "";                                // "+avx,+avx2,+aes,+sse,+sse2,+sse3";
-    auto targetTriple = llvm::sys::getDefaultTargetTriple(); // "wasm32"
-    std::string targetTripleError;
-    auto target = llvm::TargetRegistry::lookupTarget(targetTriple, targetTripleError);
-    if (!target)
+    if (layoutReport)
     {
-        std::cout << "Could not lookup target: " << targetTripleError;
-        return 1;
+        for (StructType *structType : context->structTypes)
+        {
+            std::cout << structType->getLayoutReport(context);
+        }
     }
 
-    llvm::TargetOptions targetOptions;
-    auto targetMachine = target->createTargetMachine(targetTriple, targetCpu, targetFeatures, targetOptions, llvm::Reloc::DynamicNoPIC);
-
-    context->module->setDataLayout(targetMachine->createDataLayout());
-    context->module->setTargetTriple(targetTriple);
+    std::cout << "[4/4] Creating executable...\n";
 
     llvm::legacy::PassManager passManager;
     std::error_code outputFileErrorCode;
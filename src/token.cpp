@@ -74,7 +74,9 @@ void parseString(std::string &input, std::vector<const Token *> &tokenList)
         }
         else if (state == TokenizeState::PARSING_LITERAL_NUMBER)
         {
-            if (isalnum(currentChar) || currentChar == '.' || currentChar == '_')
+            // A number followed by .. is the start of a range, not a decimal point
+            bool isRange = currentChar == '.' && i + 1 < input.length() && input[i + 1] == '.';
+            if ((isalnum(currentChar) || currentChar == '.' || currentChar == '_') && !isRange)
             {
                 currentString += currentChar;
             }
@@ -145,6 +147,14 @@ void parseString(std::string &input, std::vector<const Token *> &tokenList)
                 {
                     type = TokenType::UNMANAGED_KEYWORD;
                 }
+                else if (currentString == "unique")
+                {
+                    type = TokenType::UNIQUE_KEYWORD;
+                }
+                else if (currentString == "owned")
+                {
+                    type = TokenType::OWNED_KEYWORD;
+                }
                 else if (currentString == "interface")
                 {
                     type = TokenType::INTERFACE_KEYWORD;
@@ -153,6 +163,22 @@ void parseString(std::string &input, std::vector<const Token *> &tokenList)
                 {
                     type = TokenType::VALUE_KEYWORD;
                 }
+                else if (currentString == "soa")
+                {
+                    type = TokenType::SOA_KEYWORD;
+                }
+                else if (currentString == "align")
+                {
+                    type = TokenType::ALIGN_KEYWORD;
+                }
+                else if (currentString == "growable")
+                {
+                    type = TokenType::GROWABLE_KEYWORD;
+                }
+                else if (currentString == "tensor")
+                {
+                    type = TokenType::TENSOR_KEYWORD;
+                }
                 else if (currentString == "as")
                 {
                     type = TokenType::AS_KEYWORD;
@@ -165,6 +191,14 @@ void parseString(std::string &input, std::vector<const Token *> &tokenList)
                 {
                     type = TokenType::IS_KEYWORD;
                 }
+                else if (currentString == "match")
+                {
+                    type = TokenType::MATCH_KEYWORD;
+                }
+                else if (currentString == "in")
+                {
+                    type = TokenType::IN_KEYWORD;
+                }
                 else
                 {
                     type = TokenType::SYMBOL;
@@ -359,7 +393,7 @@ void parseString(std::string &input, std::vector<const Token *> &tokenList)
 
         if (state == TokenizeState::NONE)
         {
-            if (isalpha(currentChar))
+            if (isalpha(currentChar) || currentChar == '_')
             {
                 state = TokenizeState::PARSING_SYMBOL;
                 currentString = std::string(1, currentChar);
@@ -438,7 +472,15 @@ void parseString(std::string &input, std::vector<const Token *> &tokenList)
                     tokenList.push_back(new Token(i, TokenType::SEMICOLON, std::string(1, currentChar)));
                     break;
                 case '.':
-                    tokenList.push_back(new Token(i, TokenType::PERIOD, std::string(1, currentChar)));
+                    if (i + 1 < input.length() && input[i + 1] == '.')
+                    {
+                        tokenList.push_back(new Token(i, TokenType::DOUBLE_PERIOD, ".."));
+                        i++;
+                    }
+                    else
+                    {
+                        tokenList.push_back(new Token(i, TokenType::PERIOD, std::string(1, currentChar)));
+                    }
                     break;
 
                 default:
@@ -549,6 +591,10 @@ const char *getTokenTypeName(TokenType type)
         return "INTERFACE_KEYWORD";
     case TokenType::UNMANAGED_KEYWORD:
         return "UNMANAGED_KEYWORD";
+    case TokenType::UNIQUE_KEYWORD:
+        return "UNIQUE_KEYWORD";
+    case TokenType::OWNED_KEYWORD:
+        return "OWNED_KEYWORD";
     case TokenType::PACKED_KEYWORD:
         return "PACKED_KEYWORD";
     case TokenType::PERIOD:
@@ -559,6 +605,14 @@ const char *getTokenTypeName(TokenType type)
         return "OPERATOR_DOUBLE_OR";
     case TokenType::VALUE_KEYWORD:
         return "VALUE_KEWORD";
+    case TokenType::SOA_KEYWORD:
+        return "SOA_KEYWORD";
+    case TokenType::ALIGN_KEYWORD:
+        return "ALIGN_KEYWORD";
+    case TokenType::GROWABLE_KEYWORD:
+        return "GROWABLE_KEYWORD";
+    case TokenType::TENSOR_KEYWORD:
+        return "TENSOR_KEYWORD";
     case TokenType::AS_KEYWORD:
         return "AS_KEWORD";
     case TokenType::STRUCT_KEYWORD:
@@ -573,6 +627,12 @@ const char *getTokenTypeName(TokenType type)
         return "OPERATOR_QUESTION_MARK";
     case TokenType::IS_KEYWORD:
         return "IS_KEYWORD";
+    case TokenType::MATCH_KEYWORD:
+        return "MATCH_KEYWORD";
+    case TokenType::IN_KEYWORD:
+        return "IN_KEYWORD";
+    case TokenType::DOUBLE_PERIOD:
+        return "DOUBLE_PERIOD";
     default:
         return "Unknown";
     }
@@ -55,6 +55,8 @@ enum class TokenType
     INTERFACE_KEYWORD,
     PACKED_KEYWORD,
     UNMANAGED_KEYWORD,
+    UNIQUE_KEYWORD,
+    OWNED_KEYWORD,
     AS_KEYWORD,
     VALUE_KEYWORD,
     PERIOD,
@@ -64,6 +66,13 @@ enum class TokenType
     OPERATOR_HASHTAG,
     OPERATOR_QUESTION_MARK,
     IS_KEYWORD,
+    MATCH_KEYWORD,
+    IN_KEYWORD,
+    DOUBLE_PERIOD,
+    SOA_KEYWORD,
+    ALIGN_KEYWORD,
+    GROWABLE_KEYWORD,
+    TENSOR_KEYWORD,
 };
 
 class Token
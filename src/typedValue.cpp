@@ -8,6 +8,7 @@ IntegerType CHAR_TYPE(8, false);
 IntegerType BOOL_TYPE(1, false);
 IntegerType UINT32_TYPE(32, false);
 IntegerType UINT64_TYPE(64, false);
+StringType STRING_TYPE;
 
 PointerType *Type::getUnmanagedPointerToType()
 {
@@ -76,6 +77,12 @@ std::string typeCodeToString(TypeCode code)
         return "POINTER";
     case TypeCode::MODULE:
         return "MODULE";
+    case TypeCode::SOA_ITEM:
+        return "SOA_ITEM";
+    case TypeCode::TENSOR:
+        return "TENSOR";
+    case TypeCode::TUPLE:
+        return "TUPLE";
     default:
         return "Unknown";
     }
@@ -180,18 +187,73 @@ bool UnionType::operator==(const Type &b) const
     }
 }
 
+// Managed allocations start with a 64 bit reference count, so their pointers always have these low bits cleared
+const int MANAGED_POINTER_SPARE_BITS = 3;
+
+UnionLayout UnionType::getLayout() const
+{
+    int pointerCount = 0, managedPointerCount = 0, nullCount = 0;
+    for (auto type : this->types)
+    {
+        if (type->getTypeCode() == TypeCode::NULLT)
+        {
+            nullCount++;
+        }
+        else if (type->getTypeCode() == TypeCode::POINTER)
+        {
+            pointerCount++;
+            if (static_cast<PointerType *>(type)->isManaged())
+            {
+                managedPointerCount++;
+            }
+        }
+    }
+
+    if (this->types.size() == 2 && pointerCount == 1 && nullCount == 1)
+    {
+        return UnionLayout::NULL_POINTER_NICHE;
+    }
+    if (managedPointerCount + nullCount == this->types.size() && this->types.size() <= (1 << MANAGED_POINTER_SPARE_BITS))
+    {
+        return UnionLayout::POINTER_SPARE_BITS;
+    }
+    return UnionLayout::TAGGED;
+}
+
 llvm::Type *UnionType::getLLVMType(GenerationContext *context) const
 {
-    std::vector<llvm::Type *> fields;
-    fields.push_back(getUnionIdType(*context->context));
-    fields.push_back(this->getLLVMDataType(context));
-    return llvm::StructType::get(*context->context, fields, false);
+    switch (this->getLayout())
+    {
+    case UnionLayout::NULL_POINTER_NICHE:
+        return this->getLLVMDataType(context);
+    case UnionLayout::POINTER_SPARE_BITS:
+        return llvm::Type::getInt64Ty(*context->context);
+    case UnionLayout::TAGGED:
+    default:
+    {
+        std::vector<llvm::Type *> fields;
+        fields.push_back(this->getLLVMTagType(context));
+        fields.push_back(this->getLLVMDataType(context));
+        return llvm::StructType::get(*context->context, fields, false);
+    }
+    }
 }
 
 llvm::Type *UnionType::getLLVMDataType(GenerationContext *context) const
 {
     assert(this->types.size() >= 2);
 
+    if (this->getLayout() == UnionLayout::NULL_POINTER_NICHE)
+    {
+        for (auto type : this->types)
+        {
+            if (type->getTypeCode() != TypeCode::NULLT)
+            {
+                return type->getLLVMType(context);
+            }
+        }
+    }
+
     // Find max size of all type
     int largestSizeBits = 0;
     Type *largestType = NULL;
@@ -214,30 +276,200 @@ llvm::Type *UnionType::getLLVMDataType(GenerationContext *context) const
     return llvm::Type::getIntNTy(*context->context, largestSizeBits);
 }
 
+llvm::Type *UnionType::getLLVMTagType(GenerationContext *context) const
+{
+    switch (this->getLayout())
+    {
+    case UnionLayout::NULL_POINTER_NICHE:
+        // 0 for null, 1 for the pointer
+        return llvm::Type::getInt1Ty(*context->context);
+    case UnionLayout::POINTER_SPARE_BITS:
+        return llvm::Type::getInt64Ty(*context->context);
+    case UnionLayout::TAGGED:
+    default:
+    {
+        uint64_t largestTypeId = 0;
+        for (auto type : this->types)
+        {
+            largestTypeId = std::max(largestTypeId, context->getTypeId(type));
+        }
+
+        // The highest bit is reserved for the managed pointer flag
+        int bits = 8;
+        while (bits < 64 && largestTypeId >= (1ull << (bits - 1)))
+        {
+            bits *= 2;
+        }
+        return llvm::Type::getIntNTy(*context->context, bits);
+    }
+    }
+}
+
+llvm::Constant *UnionType::getLLVMTag(GenerationContext *context, Type *memberType) const
+{
+    llvm::Type *llvmTagType = this->getLLVMTagType(context);
+    switch (this->getLayout())
+    {
+    case UnionLayout::NULL_POINTER_NICHE:
+        return llvm::ConstantInt::get(llvmTagType, memberType->getTypeCode() == TypeCode::NULLT ? 0 : 1, false);
+    case UnionLayout::POINTER_SPARE_BITS:
+        for (int i = 0; i < this->types.size(); i++)
+        {
+            if (*this->types[i] == *memberType)
+            {
+                return llvm::ConstantInt::get(llvmTagType, i, false);
+            }
+        }
+        assert(false && "getLLVMTag memberType is not part of union");
+        return NULL;
+    case UnionLayout::TAGGED:
+    default:
+    {
+        uint64_t tag = context->getTypeId(memberType);
+        if (memberType->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(memberType)->isManaged())
+        {
+            tag |= 1ull << (llvmTagType->getIntegerBitWidth() - 1);
+        }
+        return llvm::ConstantInt::get(llvmTagType, tag, false);
+    }
+    }
+}
+
+bool UnionType::containsManagedPointer() const
+{
+    for (auto type : this->types)
+    {
+        if (type->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(type)->isManaged())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+llvm::Value *UnionType::generateHasManagedPointer(GenerationContext *context, llvm::Value *llvmUnionValue) const
+{
+    assert(this->containsManagedPointer());
+
+    switch (this->getLayout())
+    {
+    case UnionLayout::NULL_POINTER_NICHE:
+        return context->irBuilder->CreateIsNotNull(llvmUnionValue, "union.ismanaged");
+    case UnionLayout::POINTER_SPARE_BITS:
+    {
+        // Only Null has no pointer bits
+        auto llvmPointerBits = context->irBuilder->CreateAnd(llvmUnionValue, ~(uint64_t)((1 << MANAGED_POINTER_SPARE_BITS) - 1), "union.data.untagged");
+        return context->irBuilder->CreateIsNotNull(llvmPointerBits, "union.ismanaged");
+    }
+    case UnionLayout::TAGGED:
+    default:
+    {
+        auto llvmTag = this->generateGetTag(context, llvmUnionValue);
+        return context->irBuilder->CreateICmpSLT(llvmTag, llvm::ConstantInt::get(llvmTag->getType(), 0, false), "union.ismanaged");
+    }
+    }
+}
+
+llvm::Value *UnionType::generateGetTag(GenerationContext *context, llvm::Value *llvmUnionValue) const
+{
+    switch (this->getLayout())
+    {
+    case UnionLayout::NULL_POINTER_NICHE:
+        return context->irBuilder->CreateIsNotNull(llvmUnionValue, "union.typeid");
+    case UnionLayout::POINTER_SPARE_BITS:
+        return context->irBuilder->CreateAnd(llvmUnionValue, (1 << MANAGED_POINTER_SPARE_BITS) - 1, "union.typeid");
+    case UnionLayout::TAGGED:
+    default:
+    {
+        std::vector<unsigned int> indices;
+        indices.push_back(0);
+        return context->irBuilder->CreateExtractValue(llvmUnionValue, indices, "union.typeid");
+    }
+    }
+}
+
+llvm::Value *UnionType::generateGetData(GenerationContext *context, llvm::Value *llvmUnionValue, Type *asType) const
+{
+    if (asType->getTypeCode() == TypeCode::NULLT)
+    {
+        return NULL;
+    }
+
+    auto llvmTargetType = asType->getLLVMType(context);
+    switch (this->getLayout())
+    {
+    case UnionLayout::NULL_POINTER_NICHE:
+        return context->irBuilder->CreateBitCast(llvmUnionValue, llvmTargetType, "union.data");
+    case UnionLayout::POINTER_SPARE_BITS:
+    {
+        auto llvmPointerBits = context->irBuilder->CreateAnd(llvmUnionValue, ~(uint64_t)((1 << MANAGED_POINTER_SPARE_BITS) - 1), "union.data.untagged");
+        return context->irBuilder->CreateIntToPtr(llvmPointerBits, llvmTargetType, "union.data");
+    }
+    case UnionLayout::TAGGED:
+    default:
+    {
+        std::vector<unsigned int> indices;
+        indices.push_back(1);
+        llvm::Value *llvmUnionData = context->irBuilder->CreateExtractValue(llvmUnionValue, indices, "union.data.asint");
+
+        int asTypeBitSize = context->module->getDataLayout().getTypeStoreSizeInBits(llvmTargetType);
+        auto llvmCastedAsIntValue = context->irBuilder->CreateTruncOrBitCast(llvmUnionData, llvm::Type::getIntNTy(*context->context, asTypeBitSize), "union.data.trunc");
+        return context->irBuilder->CreateBitOrPointerCast(llvmCastedAsIntValue, llvmTargetType, "union.data");
+    }
+    }
+}
+
 llvm::Value *UnionType::createValue(GenerationContext *context, TypedValue *value) const
 {
     assert(this->managed && "Unmanaged not supported");
     assert(this->containsType(value->getType()));
 
-    uint64_t typeId = context->getTypeId(value->getType());
-
+    bool isNull = value->getTypeCode() == TypeCode::NULLT;
     auto llvmType = this->getLLVMType(context);
-    llvm::Value *llvmUnionValue = llvm::UndefValue::get(llvmType);
+    auto llvmTag = this->getLLVMTag(context, value->getType());
 
-    std::vector<unsigned int> indices;
-    indices.push_back(0);
-    llvmUnionValue = context->irBuilder->CreateInsertValue(llvmUnionValue, llvm::ConstantInt::get(getUnionIdType(*context->context), typeId, false), indices, "union.novalue");
+    switch (this->getLayout())
+    {
+    case UnionLayout::NULL_POINTER_NICHE:
+        if (isNull)
+        {
+            return llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(llvmType));
+        }
+        return context->irBuilder->CreateBitCast(value->getValue(), llvmType, "union");
+    case UnionLayout::POINTER_SPARE_BITS:
+    {
+        if (isNull)
+        {
+            return llvmTag;
+        }
+        auto llvmPointerBits = context->irBuilder->CreatePtrToInt(value->getValue(), llvmType, "union.value.asint");
+        return context->irBuilder->CreateOr(llvmPointerBits, llvmTag, "union");
+    }
+    case UnionLayout::TAGGED:
+    default:
+    {
+        llvm::Value *llvmUnionValue = llvm::UndefValue::get(llvmType);
 
-    int typeBits = context->module->getDataLayout().getTypeStoreSizeInBits(value->getValue()->getType());
-    auto llvmValueAsInteger = context->irBuilder->CreateBitOrPointerCast(value->getValue(), llvm::Type::getIntNTy(*context->context, typeBits), "union.value.asint");
+        std::vector<unsigned int> indices;
+        indices.push_back(0);
+        llvmUnionValue = context->irBuilder->CreateInsertValue(llvmUnionValue, llvmTag, indices, "union.novalue");
+        if (isNull)
+        {
+            return llvmUnionValue;
+        }
+
+        int typeBits = context->module->getDataLayout().getTypeStoreSizeInBits(value->getValue()->getType());
+        auto llvmValueAsInteger = context->irBuilder->CreateBitOrPointerCast(value->getValue(), llvm::Type::getIntNTy(*context->context, typeBits), "union.value.asint");
 
-    auto llvmDataType = this->getLLVMDataType(context);
-    llvm::Value *llvmBitCastedValue = context->irBuilder->CreateZExtOrBitCast(llvmValueAsInteger, llvmDataType, "union.value.zext");
+        auto llvmDataType = this->getLLVMDataType(context);
+        llvm::Value *llvmBitCastedValue = context->irBuilder->CreateZExtOrBitCast(llvmValueAsInteger, llvmDataType, "union.value.zext");
 
-    indices[0] = 1;
-    llvmUnionValue = context->irBuilder->CreateInsertValue(llvmUnionValue, llvmBitCastedValue, indices, "union");
+        indices[0] = 1;
+        llvmUnionValue = context->irBuilder->CreateInsertValue(llvmUnionValue, llvmBitCastedValue, indices, "union");
 
-    return llvmUnionValue;
+        return llvmUnionValue;
+    }
+    }
 }
 
 bool FloatType::operator==(const Type &b) const
@@ -245,7 +477,7 @@ bool FloatType::operator==(const Type &b) const
     if (b.getTypeCode() == TypeCode::FLOAT)
     {
         auto f = static_cast<const FloatType &>(b);
-        return f.bitSize == this->bitSize;
+        return f.bitSize == this->bitSize && f.lanes == this->lanes;
     }
     else
     {
@@ -257,24 +489,39 @@ std::string FloatType::toString()
 {
     std::string str = "Float";
     str += std::to_string(this->bitSize);
+    if (this->lanes > 1)
+    {
+        str += "x" + std::to_string(this->lanes);
+    }
     return str;
 }
 
 llvm::Type *FloatType::getLLVMType(GenerationContext *context) const
 {
+    llvm::Type *llvmLaneType;
     switch (this->bitSize)
     {
     case 32:
-        return llvm::Type::getFloatTy(*context->context);
+        llvmLaneType = llvm::Type::getFloatTy(*context->context);
+        break;
     case 64:
-        return llvm::Type::getDoubleTy(*context->context);
+        llvmLaneType = llvm::Type::getDoubleTy(*context->context);
+        break;
     case 128:
-        return llvm::Type::getFP128Ty(*context->context);
+        llvmLaneType = llvm::Type::getFP128Ty(*context->context);
+        break;
 
     default:
         std::cout << "ERROR: FloatType.getLLVMType() cannot create LLVM type with given bit size " << this->bitSize << "\n";
         return NULL;
     }
+
+    if (this->lanes > 1)
+    {
+        // Vectors wider than the target supports are split by the backend
+        return llvm::FixedVectorType::get(llvmLaneType, this->lanes);
+    }
+    return llvmLaneType;
 }
 
 bool IntegerType::operator==(const Type &b) const
@@ -282,7 +529,7 @@ bool IntegerType::operator==(const Type &b) const
     if (b.getTypeCode() == TypeCode::INTEGER)
     {
         auto i = static_cast<const IntegerType &>(b);
-        return i.isSigned == this->isSigned && i.bitSize == this->bitSize;
+        return i.isSigned == this->isSigned && i.bitSize == this->bitSize && i.lanes == this->lanes;
     }
     else
     {
@@ -292,16 +539,64 @@ bool IntegerType::operator==(const Type &b) const
 
 llvm::Type *IntegerType::getLLVMType(GenerationContext *context) const
 {
-    return llvm::Type::getIntNTy(*context->context, this->bitSize);
+    llvm::Type *llvmLaneType = llvm::Type::getIntNTy(*context->context, this->bitSize);
+    if (this->lanes > 1)
+    {
+        return llvm::FixedVectorType::get(llvmLaneType, this->lanes);
+    }
+    return llvmLaneType;
 }
 
 std::string IntegerType::toString()
 {
     std::string str = this->isSigned ? "Int" : "UInt";
     str += std::to_string(this->bitSize);
+    if (this->lanes > 1)
+    {
+        str += "x" + std::to_string(this->lanes);
+    }
     return str;
 }
 
+int getTypeLanes(Type *type)
+{
+    switch (type->getTypeCode())
+    {
+    case TypeCode::INTEGER:
+        return static_cast<IntegerType *>(type)->getLanes();
+    case TypeCode::FLOAT:
+        return static_cast<FloatType *>(type)->getLanes();
+    default:
+        return 1;
+    }
+}
+
+Type *getTypeLaneType(Type *type)
+{
+    switch (type->getTypeCode())
+    {
+    case TypeCode::INTEGER:
+        return static_cast<IntegerType *>(type)->getLaneType();
+    case TypeCode::FLOAT:
+        return static_cast<FloatType *>(type)->getLaneType();
+    default:
+        return type;
+    }
+}
+
+uint64_t getTypeAlign(Type *type)
+{
+    switch (type->getTypeCode())
+    {
+    case TypeCode::STRUCT:
+        return static_cast<StructType *>(type)->getAlign();
+    case TypeCode::ARRAY:
+        return static_cast<ArrayType *>(type)->getAlign();
+    default:
+        return 0;
+    }
+}
+
 bool RangeType::operator==(const Type &b) const
 {
     if (b.getTypeCode() == TypeCode::RANGE)
@@ -329,12 +624,28 @@ std::string RangeType::toString()
     return str;
 }
 
+llvm::Type *StringType::getLLVMType(GenerationContext *context) const
+{
+    std::string name = "string";
+    auto type = llvm::StructType::getTypeByName(*context->context, name);
+    if (type == NULL)
+    {
+        std::vector<llvm::Type *> llvmStringFields;
+        llvmStringFields.push_back(llvm::Type::getInt8PtrTy(*context->context));
+        llvmStringFields.push_back(ArrayType::getLLVMLengthFieldType(context));
+        llvmStringFields.push_back(llvm::ArrayType::get(llvm::Type::getInt8Ty(*context->context), 7));
+        llvmStringFields.push_back(llvm::Type::getInt8Ty(*context->context));
+        type = llvm::StructType::create(llvmStringFields, name, false);
+    }
+    return type;
+}
+
 bool PointerType::operator==(const Type &b) const
 {
     if (b.getTypeCode() == TypeCode::POINTER)
     {
         const PointerType &pointerType = static_cast<const PointerType &>(b);
-        return pointerType.managed == this->managed && *pointerType.pointedType == *this->pointedType;
+        return pointerType.managed == this->managed && pointerType.unique == this->unique && *pointerType.pointedType == *this->pointedType;
     }
     else
     {
@@ -371,6 +682,8 @@ std::string PointerType::toString()
     std::string str = "";
     if (this->managed)
         str += "m";
+    if (this->unique)
+        str += "u";
     str += "*";
     if (this->pointedType != NULL)
     {
@@ -383,6 +696,46 @@ std::string PointerType::toString()
     return str;
 }
 
+bool FunctionParameter::isBorrowed()
+{
+    if (this->owned)
+    {
+        return false;
+    }
+    if (this->type->getTypeCode() == TypeCode::STRING)
+    {
+        return true;
+    }
+    if (this->type->getTypeCode() == TypeCode::UNION)
+    {
+        // A union of plain values (like Int64|null) is copied, so it stays assignable
+        return static_cast<UnionType *>(this->type)->containsManagedPointer() || getUniquePointerType(this->type) != NULL;
+    }
+    if (this->type->getTypeCode() == TypeCode::POINTER)
+    {
+        PointerType *pointerType = static_cast<PointerType *>(this->type);
+        return pointerType->isManaged() || pointerType->isUnique();
+    }
+    return false;
+}
+
+// Value aggregates up to aggregateCopyByteLimit are passed and returned in registers, LLVM splits them into their fields
+static bool isLargeValueAggregate(GenerationContext *context, Type *type)
+{
+    llvm::Type *llvmType = type->getLLVMType(context);
+    return llvmType->isAggregateType() && context->module->getDataLayout().getTypeStoreSize(llvmType) > aggregateCopyByteLimit;
+}
+
+bool FunctionType::hasReturnPointer(GenerationContext *context) const
+{
+    return this->internal && this->returnType != NULL && isLargeValueAggregate(context, this->returnType);
+}
+
+bool FunctionType::isPassedByPointer(GenerationContext *context, Type *parameterType) const
+{
+    return this->internal && isLargeValueAggregate(context, parameterType);
+}
+
 llvm::Type *FunctionType::getLLVMType(GenerationContext *context) const
 {
     std::vector<llvm::Type *> parameters;
@@ -392,6 +745,11 @@ llvm::Type *FunctionType::getLLVMType(GenerationContext *context) const
     {
         returnType = llvm::Type::getVoidTy(*context->context);
     }
+    else if (this->hasReturnPointer(context))
+    {
+        parameters.push_back(this->returnType->getLLVMType(context)->getPointerTo());
+        returnType = llvm::Type::getVoidTy(*context->context);
+    }
     else
     {
         returnType = this->returnType->getLLVMType(context);
@@ -399,7 +757,8 @@ llvm::Type *FunctionType::getLLVMType(GenerationContext *context) const
 
     for (auto &param : this->parameters)
     {
-        parameters.push_back(param.type->getLLVMType(context));
+        llvm::Type *llvmParameterType = param.type->getLLVMType(context);
+        parameters.push_back(this->isPassedByPointer(context, param.type) ? llvmParameterType->getPointerTo() : llvmParameterType);
     }
 
     return llvm::FunctionType::get(returnType, parameters, this->isVarArg);
@@ -421,6 +780,10 @@ std::string FunctionType::toString()
             str += ", ";
         }
 
+        if (param.owned)
+        {
+            str += "owned ";
+        }
         str += param.name;
         str += ": ";
         str += param.type->toString();
@@ -439,12 +802,21 @@ std::string FunctionType::toString()
 
 PointerType *ArrayType::getArrayPointerType() const
 {
-    assert(!this->value);
+    assert(!this->value && !this->soa && !this->growable && !this->slice);
     return new PointerType(new ArrayType(this->innerType, this->count, true, false), this->managed);
 }
 
 llvm::Type *ArrayType::getLLVMArrayPointerType(GenerationContext *context) const
 {
+    if (this->soa)
+    {
+        // The column offsets depend on the length, see generateSoAColumnPointer
+        return llvm::Type::getInt8PtrTy(*context->context);
+    }
+    if (this->growable || this->slice)
+    {
+        return this->innerType->getLLVMType(context)->getPointerTo();
+    }
     return this->getArrayPointerType()->getLLVMType(context);
 }
 
@@ -460,7 +832,31 @@ llvm::StructType *ArrayType::getLLVMLengthStructType(GenerationContext *context)
 
 llvm::Type *ArrayType::getLLVMType(GenerationContext *context) const
 {
-    if (this->value)
+    if (this->growable)
+    {
+        std::vector<llvm::Type *> llvmGrowableFields;
+        llvmGrowableFields.push_back(getLLVMLengthFieldType(context));
+        llvmGrowableFields.push_back(getLLVMLengthFieldType(context));
+        llvmGrowableFields.push_back(this->getLLVMArrayPointerType(context));
+
+        // Named, so its free function is not shared with a struct that has the same fields
+        std::string name = "growable." + this->innerType->toString();
+        auto type = llvm::StructType::getTypeByName(*context->context, name);
+        if (type == NULL)
+        {
+            type = llvm::StructType::create(llvmGrowableFields, name, false);
+        }
+        return type;
+    }
+    else if (this->slice)
+    {
+        std::vector<llvm::Type *> llvmSliceFields;
+        llvmSliceFields.push_back(getLLVMLengthFieldType(context));
+        llvmSliceFields.push_back(this->getLLVMArrayPointerType(context));
+        llvmSliceFields.push_back(getRefCountType(*context->context)->getPointerTo());
+        return llvm::StructType::get(*context->context, llvmSliceFields, false);
+    }
+    else if (this->value)
     {
         return llvm::ArrayType::get(this->innerType->getLLVMType(context), this->count < 0 ? 0 : this->count);
     }
@@ -486,17 +882,137 @@ llvm::Type *ArrayType::getLLVMLengthFieldType(GenerationContext *context)
 
 std::string ArrayType::toString()
 {
-    std::string str = "[";
+    std::string str = this->soa ? "soa " : "";
+    if (this->growable)
+    {
+        str += "growable ";
+    }
+    if (this->align > 0)
+    {
+        str += "align(" + std::to_string(this->align) + ") ";
+    }
+    str += "[";
     str += this->innerType->toString();
     if (this->count >= 0)
     {
         str += " # ";
         str += std::to_string(this->count);
     }
+    if (this->slice)
+    {
+        str += " ..";
+    }
     str += "]";
     return str;
 }
 
+bool ArrayExpressionType::operator==(const Type &b) const
+{
+    // Every expression is a different computation
+    return this == &b;
+}
+
+llvm::Type *ArrayExpressionType::getLLVMType(GenerationContext *context) const
+{
+    return ArrayType::getLLVMLengthFieldType(context);
+}
+
+std::string ArrayExpressionType::toString()
+{
+    return "[" + this->itemType->toString() + " expression]";
+}
+
+ArrayType *ArrayExpressionType::getResultArrayType()
+{
+    return new ArrayType(this->itemType, false, true);
+}
+
+llvm::Type *TensorType::getLLVMType(GenerationContext *context) const
+{
+    llvm::Type *llvmDimensionsType = llvm::ArrayType::get(ArrayType::getLLVMLengthFieldType(context), this->rank);
+
+    std::vector<llvm::Type *> llvmTensorFields;
+    llvmTensorFields.push_back(this->itemType->getLLVMType(context)->getPointerTo());
+    llvmTensorFields.push_back(getRefCountType(*context->context)->getPointerTo());
+    llvmTensorFields.push_back(llvmDimensionsType);
+    llvmTensorFields.push_back(llvmDimensionsType);
+    return llvm::StructType::get(*context->context, llvmTensorFields, false);
+}
+
+std::string TensorType::toString()
+{
+    return "tensor(" + std::to_string(this->rank) + ") [" + this->itemType->toString() + "]";
+}
+
+bool TupleType::operator==(const Type &b) const
+{
+    if (b.getTypeCode() != TypeCode::TUPLE)
+    {
+        return false;
+    }
+    auto other = static_cast<const TupleType &>(b);
+    if (other.itemTypes.size() != this->itemTypes.size())
+    {
+        return false;
+    }
+    for (int i = 0; i < this->itemTypes.size(); i++)
+    {
+        if (*other.itemTypes[i] != *this->itemTypes[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+llvm::Type *TupleType::getLLVMType(GenerationContext *context) const
+{
+    std::vector<llvm::Type *> llvmItemTypes;
+    for (Type *itemType : this->itemTypes)
+    {
+        llvmItemTypes.push_back(itemType->getLLVMType(context));
+    }
+    return llvm::StructType::get(*context->context, llvmItemTypes, false);
+}
+
+std::string TupleType::toString()
+{
+    std::string str = "(";
+    for (int i = 0; i < this->itemTypes.size(); i++)
+    {
+        if (i > 0)
+        {
+            str += ", ";
+        }
+        str += this->itemTypes[i]->toString();
+    }
+    str += ")";
+    return str;
+}
+
+bool SoAItemType::operator==(const Type &b) const
+{
+    if (b.getTypeCode() == TypeCode::SOA_ITEM)
+    {
+        auto other = static_cast<const SoAItemType &>(b);
+        return *other.arrayType == *this->arrayType;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+llvm::Type *SoAItemType::getLLVMType(GenerationContext *context) const
+{
+    return ArrayType::getLLVMLengthFieldType(context);
+}
+
+std::string SoAItemType::toString()
+{
+    return this->arrayType->getItemType()->toString() + " in " + this->arrayType->toString();
+}
+
 bool StructType::operator==(const Type &b) const
 {
     if (b.getTypeCode() == TypeCode::STRUCT)
@@ -507,7 +1023,7 @@ bool StructType::operator==(const Type &b) const
             return false;
         }
 
-        if (other.packed != this->packed)
+        if (other.packed != this->packed || other.reordered != this->reordered || other.align != this->align)
         {
             return false;
         }
@@ -528,12 +1044,38 @@ bool StructType::operator==(const Type &b) const
     }
 }
 
+const std::vector<int> &StructType::getLayoutOrder(GenerationContext *context) const
+{
+    if (this->layoutOrder.size() != this->fields.size())
+    {
+        this->layoutOrder.clear();
+        for (int i = 0; i < this->fields.size(); i++)
+        {
+            this->layoutOrder.push_back(i);
+        }
+
+        if (this->reordered)
+        {
+            // Sizes are multiples of alignments, so placing the most aligned fields first leaves no padding between fields
+            const llvm::DataLayout &dataLayout = context->module->getDataLayout();
+            std::stable_sort(this->layoutOrder.begin(), this->layoutOrder.end(), [&](int a, int b)
+                             { return dataLayout.getABITypeAlign(this->fields[a].type->getLLVMType(context)) > dataLayout.getABITypeAlign(this->fields[b].type->getLLVMType(context)); });
+        }
+    }
+    return this->layoutOrder;
+}
+
 llvm::Type *StructType::getLLVMType(GenerationContext *context) const
 {
     std::vector<llvm::Type *> fieldTypes;
-    for (auto &field : this->fields)
+    for (int fieldIndex : this->getLayoutOrder(context))
+    {
+        fieldTypes.push_back(this->fields[fieldIndex].type->getLLVMType(context));
+    }
+    if (this->align > 0)
     {
-        fieldTypes.push_back(field.type->getLLVMType(context));
+        // Vectors are naturally aligned, [0 x <align x i8>] takes no space but raises the alignment of the struct
+        fieldTypes.push_back(llvm::ArrayType::get(llvm::FixedVectorType::get(llvm::Type::getInt8Ty(*context->context), this->align), 0));
     }
     if (this->name != "")
     {
@@ -562,20 +1104,66 @@ StructTypeField *StructType::getField(std::string name)
     return NULL;
 }
 
-int StructType::getFieldIndex(std::string name)
+int StructType::getFieldIndex(GenerationContext *context, std::string name)
 {
-    int index = 0;
-    for (auto &field : this->fields)
+    const std::vector<int> &layoutOrder = this->getLayoutOrder(context);
+    for (int index = 0; index < layoutOrder.size(); index++)
     {
-        if (field.name == name)
+        if (this->fields[layoutOrder[index]].name == name)
         {
             return index;
         }
-        index++;
     }
     return -1;
 }
 
+std::string StructType::getLayoutReport(GenerationContext *context)
+{
+    const int cacheLineSize = 64;
+    const llvm::DataLayout &dataLayout = context->module->getDataLayout();
+    llvm::StructType *llvmStructType = llvm::cast<llvm::StructType>(this->getLLVMType(context));
+    const llvm::StructLayout *structLayout = dataLayout.getStructLayout(llvmStructType);
+    uint64_t size = structLayout->getSizeInBytes();
+    uint64_t align = structLayout->getAlignment().value();
+
+    std::vector<llvm::Type *> llvmDeclaredTypes;
+    for (auto &field : this->fields)
+    {
+        llvmDeclaredTypes.push_back(field.type->getLLVMType(context));
+    }
+    if (this->align > 0)
+    {
+        llvmDeclaredTypes.push_back(llvmStructType->getElementType(this->fields.size()));
+    }
+    uint64_t declaredSize = dataLayout.getStructLayout(llvm::StructType::get(*context->context, llvmDeclaredTypes, this->packed))->getSizeInBytes();
+
+    // An instance starts at a multiple of its alignment, the worst start is the last one before a cache line boundary
+    uint64_t worstStart = align >= cacheLineSize ? 0 : cacheLineSize - align;
+    uint64_t bestLines = (size + cacheLineSize - 1) / cacheLineSize;
+    uint64_t worstLines = (worstStart + size + cacheLineSize - 1) / cacheLineSize;
+
+    std::string str = "struct " + this->toString() + ": size " + std::to_string(size) + ", align " + std::to_string(align);
+    uint64_t padding = size;
+    for (int i = 0; i < this->fields.size(); i++)
+    {
+        padding -= dataLayout.getTypeStoreSize(llvmStructType->getElementType(i));
+    }
+    str += ", padding " + std::to_string(padding);
+    if (declaredSize != size)
+    {
+        str += " (" + std::to_string(declaredSize) + " bytes in declaration order)";
+    }
+    str += ", spans " + std::to_string(bestLines) + (worstLines != bestLines ? "-" + std::to_string(worstLines) : "") + " cache line(s)\n";
+
+    const std::vector<int> &layoutOrder = this->getLayoutOrder(context);
+    for (int i = 0; i < layoutOrder.size(); i++)
+    {
+        const StructTypeField &field = this->fields[layoutOrder[i]];
+        str += "  " + std::to_string(structLayout->getElementOffset(i)) + ": " + field.name + " " + field.type->toString() + " (" + std::to_string(dataLayout.getTypeStoreSize(llvmStructType->getElementType(i))) + " bytes)\n";
+    }
+    return str;
+}
+
 int StructType::getMaxIndex()
 {
     return this->fields.size();
@@ -593,6 +1181,10 @@ std::string StructType::toString()
     {
         str += "packed ";
     }
+    if (this->align > 0)
+    {
+        str += "align(" + std::to_string(this->align) + ") ";
+    }
     if (this->name != "")
     {
         str += this->name;
@@ -9,6 +9,7 @@ class FunctionScope;
 class GenerationContext;
 class ASTNode;
 class PointerType;
+class Token;
 
 enum class TypeCode
 {
@@ -25,6 +26,10 @@ enum class TypeCode
     POINTER,
     MODULE,
     NULLT,
+    ARRAY_EXPRESSION,
+    SOA_ITEM,
+    TENSOR,
+    TUPLE,
 };
 
 class Type
@@ -176,6 +181,17 @@ public:
     }
 };
 
+enum class UnionLayout
+{
+    // { iN typeId, iM data }, the type id field is the smallest integer that fits the largest type id of the union
+    // The highest bit of the type id field is set when the data is a managed pointer
+    TAGGED,
+    // A single pointer and Null, the null pointer means Null so no type id is stored
+    NULL_POINTER_NICHE,
+    // Only managed pointers (and Null), the tag is stored in the low bits which are always zero for managed allocations
+    POINTER_SPARE_BITS,
+};
+
 class UnionType : public Type
 {
 public:
@@ -193,6 +209,25 @@ public:
 
     llvm::Type *getLLVMDataType(GenerationContext *context) const;
 
+    UnionLayout getLayout() const;
+
+    // Returns the type of the values returned by generateGetTag
+    llvm::Type *getLLVMTagType(GenerationContext *context) const;
+
+    // Returns the tag value that is stored when the union contains memberType
+    llvm::Constant *getLLVMTag(GenerationContext *context, Type *memberType) const;
+
+    llvm::Value *generateGetTag(GenerationContext *context, llvm::Value *llvmUnionValue) const;
+
+    bool containsManagedPointer() const;
+
+    // Returns true when the union currently holds any managed pointer, using a single test
+    llvm::Value *generateHasManagedPointer(GenerationContext *context, llvm::Value *llvmUnionValue) const;
+
+    // Reinterprets the union data as asType, does not check the tag
+    llvm::Value *generateGetData(GenerationContext *context, llvm::Value *llvmUnionValue, Type *asType) const;
+
+    // Creates a union value, value may be a Null type
     llvm::Value *createValue(GenerationContext *context, TypedValue *value) const;
 
     void addTypes(std::vector<Type *> types)
@@ -277,7 +312,8 @@ private:
 class FloatType : public Type
 {
 public:
-    FloatType(int bitSize) : Type(TypeCode::FLOAT), bitSize(bitSize) {}
+    // A lane count larger than 1 makes this a SIMD vector of floats (Float32x8)
+    FloatType(int bitSize, int lanes = 1) : Type(TypeCode::FLOAT), bitSize(bitSize), lanes(lanes) {}
 
     bool operator==(const Type &b) const override;
 
@@ -286,18 +322,31 @@ public:
         return this->bitSize;
     }
 
+    int getLanes() const
+    {
+        return this->lanes;
+    }
+
+    // Returns the type of a single lane
+    FloatType *getLaneType() const
+    {
+        return new FloatType(this->bitSize);
+    }
+
     llvm::Type *getLLVMType(GenerationContext *context) const override;
 
     std::string toString() override;
 
 private:
     int bitSize;
+    int lanes;
 };
 
 class IntegerType : public Type
 {
 public:
-    IntegerType(int bitSize, bool isSigned) : Type(TypeCode::INTEGER), bitSize(bitSize), isSigned(isSigned) {}
+    // A lane count larger than 1 makes this a SIMD vector of integers (Int32x4), or a mask when bitSize is 1
+    IntegerType(int bitSize, bool isSigned, int lanes = 1) : Type(TypeCode::INTEGER), bitSize(bitSize), isSigned(isSigned), lanes(lanes) {}
 
     bool operator==(const Type &b) const override;
 
@@ -311,6 +360,17 @@ public:
         return this->isSigned;
     }
 
+    int getLanes() const
+    {
+        return this->lanes;
+    }
+
+    // Returns the type of a single lane
+    IntegerType *getLaneType() const
+    {
+        return new IntegerType(this->bitSize, this->isSigned);
+    }
+
     llvm::Type *getLLVMType(GenerationContext *context) const override;
 
     std::string toString() override;
@@ -318,6 +378,7 @@ public:
 private:
     bool isSigned;
     int bitSize;
+    int lanes;
 };
 
 class RangeType : public Type
@@ -336,11 +397,32 @@ private:
     int endExclusive;
 };
 
+// A UTF-8 string of 24 bytes, { pointer to bytes, length, [7 x padding], tag }, which is copied as a value and never mutated
+// Strings of up to stringInlineCapacity bytes are stored inline in the first 23 bytes and have tag 23 - length (0 after 23 bytes, like a terminator)
+// Longer strings have tag stringHeapTag and point to bytes that are never written to, which are preceded by a reference count (immortal for literals)
+class StringType : public Type
+{
+public:
+    StringType() : Type(TypeCode::STRING) {}
+
+    bool operator==(const Type &b) const override
+    {
+        return b.getTypeCode() == TypeCode::STRING;
+    }
+
+    llvm::Type *getLLVMType(GenerationContext *context) const override;
+
+    std::string toString() override
+    {
+        return "String";
+    }
+};
+
 class PointerType : public Type
 {
 public:
     // byValue contains whether the pointed value should be passed by value
-    PointerType(Type *pointedType, bool managed) : Type(TypeCode::POINTER), pointedType(pointedType), managed(managed)
+    PointerType(Type *pointedType, bool managed, bool unique = false) : Type(TypeCode::POINTER), pointedType(pointedType), managed(managed), unique(unique)
     {
     }
 
@@ -362,9 +444,16 @@ public:
         return this->managed;
     }
 
+    bool isUnique()
+    {
+        return this->unique;
+    }
+
 private:
     // True if a ref count field should be emitted
     bool managed;
+    // True if this pointer is the only owner of the object, it has no ref count field and is freed when its owner ends (never managed)
+    bool unique;
     // True if a length field should be emitted (does point to multiple objects of the same type)
     Type *pointedType;
 };
@@ -372,19 +461,26 @@ private:
 class FunctionParameter
 {
 public:
-    FunctionParameter(Type *type, std::string name = "") : type(type), name(name)
+    FunctionParameter(Type *type, std::string name = "", bool owned = false) : type(type), name(name), owned(owned)
     {
     }
 
+    // Counted and unique pointers (possibly in a union) are borrowed when the parameter is not owned
+    // A borrowed parameter is kept alive by the caller, the function does not count a reference to it or release it
+    bool isBorrowed();
+
     Type *type;
     std::string name;
+    bool owned;
 };
 
 class FunctionType : public Type
 {
 public:
-    FunctionType(Type *returnType) : Type(TypeCode::FUNCTION), returnType(returnType) {}
-    FunctionType(Type *returnType, std::vector<FunctionParameter> parameters) : Type(TypeCode::FUNCTION), returnType(returnType), parameters(parameters), isVarArg(false) {}
+    FunctionType(Type *returnType) : Type(TypeCode::FUNCTION), returnType(returnType), internal(false) {}
+    // Internal functions (not exported or extern) use the fast calling convention
+    // They return large value aggregates in memory of the caller (sret) and take large value aggregate parameters as a pointer to a copy made by the caller
+    FunctionType(Type *returnType, std::vector<FunctionParameter> parameters, bool internal = false) : Type(TypeCode::FUNCTION), returnType(returnType), parameters(parameters), isVarArg(false), internal(internal) {}
 
     bool operator==(const Type &b) const override
     {
@@ -408,26 +504,42 @@ public:
         return this->isVarArg;
     }
 
+    bool isInternal()
+    {
+        return this->internal;
+    }
+
+    // True when the return value is stored through a pointer, which is passed before the parameters
+    bool hasReturnPointer(GenerationContext *context) const;
+
+    // True when a parameter of this type is passed as a pointer to a copy that the function can use as its own
+    bool isPassedByPointer(GenerationContext *context, Type *parameterType) const;
+
     std::string toString() override;
 
 private:
     bool isVarArg;
     std::vector<FunctionParameter> parameters;
     Type *returnType;
+    bool internal;
 };
 
 class ArrayType : public Type
 {
 public:
-    ArrayType(Type *innerType, bool value, bool managed) : Type(TypeCode::ARRAY), innerType(innerType), count(-1), value(value), managed(managed) {}
-    ArrayType(Type *innerType, int64_t count, bool value, bool managed) : Type(TypeCode::ARRAY), innerType(innerType), count(count), value(value), managed(managed) {}
+    // A struct-of-arrays (soa) array stores each field of its value struct items in a separate column: { refcount, [n x field0], [n x field1], ... }
+    // An aligned array (align > 0) starts its items (or every column) at a multiple of align bytes
+    // A growable array is { length, capacity, pointer to items }, it lives behind a managed pointer which all its users share, so growing it is seen by everyone
+    // A slice is { length, pointer to items, pointer to the header of the managed array that owns the items (or null) }, it does not copy the items
+    ArrayType(Type *innerType, bool value, bool managed, bool soa = false, uint64_t align = 0, bool growable = false, bool slice = false) : Type(TypeCode::ARRAY), innerType(innerType), count(-1), value(value), managed(managed), soa(soa), align(align), growable(growable), slice(slice) {}
+    ArrayType(Type *innerType, int64_t count, bool value, bool managed, bool soa = false, uint64_t align = 0, bool growable = false, bool slice = false) : Type(TypeCode::ARRAY), innerType(innerType), count(count), value(value), managed(managed), soa(soa), align(align), growable(growable), slice(slice) {}
 
     bool operator==(const Type &b) const override
     {
         if (b.getTypeCode() == TypeCode::ARRAY)
         {
             auto other = static_cast<const ArrayType &>(b);
-            return other.count == this->count && *other.innerType == *this->innerType;
+            return other.count == this->count && other.soa == this->soa && other.align == this->align && other.growable == this->growable && other.slice == this->slice && *other.innerType == *this->innerType;
         }
         else
         {
@@ -470,6 +582,26 @@ public:
         return this->value;
     }
 
+    bool isSoA()
+    {
+        return this->soa;
+    }
+
+    uint64_t getAlign()
+    {
+        return this->align;
+    }
+
+    bool isGrowable()
+    {
+        return this->growable;
+    }
+
+    bool isSlice()
+    {
+        return this->slice;
+    }
+
     static llvm::Type *getLLVMLengthFieldType(GenerationContext *context);
 
 private:
@@ -477,6 +609,163 @@ private:
     Type *innerType;
     bool value;
     bool managed;
+    bool soa;
+    uint64_t align;
+    bool growable;
+    bool slice;
+};
+
+// An element-wise operation on whole arrays (a * b + c) that has not been computed yet, the value of an array expression is its item count
+// It is materialized in a single loop when it is converted to an array or reduced, so no intermediate arrays are allocated
+class ArrayExpressionType : public Type
+{
+public:
+    // An array operand, its items are loaded from llvmStorage (see generateArrayStoragePointer)
+    ArrayExpressionType(ArrayType *arrayType, llvm::Value *llvmStorage) : Type(TypeCode::ARRAY_EXPRESSION), operatorToken(NULL), left(NULL), right(NULL), arrayType(arrayType), llvmStorage(llvmStorage), itemType(arrayType->getItemType()) {}
+    // An operator applied to each item, the operands are array expressions or scalars which are used for every item
+    ArrayExpressionType(const Token *operatorToken, TypedValue *left, TypedValue *right, Type *itemType) : Type(TypeCode::ARRAY_EXPRESSION), operatorToken(operatorToken), left(left), right(right), arrayType(NULL), llvmStorage(NULL), itemType(itemType) {}
+
+    bool operator==(const Type &b) const override;
+
+    llvm::Type *getLLVMType(GenerationContext *context) const override;
+
+    std::string toString() override;
+
+    // The type of the array this expression is materialized into when no other type is given
+    ArrayType *getResultArrayType();
+
+    bool isOperand()
+    {
+        return this->operatorToken == NULL;
+    }
+
+    const Token *getOperatorToken()
+    {
+        return this->operatorToken;
+    }
+
+    TypedValue *getLeft()
+    {
+        return this->left;
+    }
+
+    TypedValue *getRight()
+    {
+        return this->right;
+    }
+
+    ArrayType *getArrayType()
+    {
+        return this->arrayType;
+    }
+
+    llvm::Value *getLLVMStorage()
+    {
+        return this->llvmStorage;
+    }
+
+    Type *getItemType()
+    {
+        return this->itemType;
+    }
+
+private:
+    const Token *operatorToken;
+    TypedValue *left;
+    TypedValue *right;
+    ArrayType *arrayType;
+    llvm::Value *llvmStorage;
+    Type *itemType;
+};
+
+// A view of a rank dimensional block of items in a single managed allocation, { pointer to the first item, pointer to the header of the owner, [rank x shape], [rank x strides] }
+// The item at [i, j, ...] is at i * strides[0] + j * strides[1] + ... items from the first item, so transposed and sub-block views share the items
+// Like a slice, it does not count references, managed arrays are never freed so the owner stays alive
+class TensorType : public Type
+{
+public:
+    TensorType(Type *itemType, int rank) : Type(TypeCode::TENSOR), itemType(itemType), rank(rank) {}
+
+    bool operator==(const Type &b) const override
+    {
+        if (b.getTypeCode() == TypeCode::TENSOR)
+        {
+            auto other = static_cast<const TensorType &>(b);
+            return other.rank == this->rank && *other.itemType == *this->itemType;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    llvm::Type *getLLVMType(GenerationContext *context) const override;
+
+    std::string toString() override;
+
+    Type *getItemType()
+    {
+        return this->itemType;
+    }
+
+    int getRank()
+    {
+        return this->rank;
+    }
+
+private:
+    Type *itemType;
+    int rank;
+};
+
+// The values returned together by a function, (Int64, Int64), which are taken apart with let (a, b) = ...
+// It is an LLVM first-class struct, so small tuples are returned in registers
+class TupleType : public Type
+{
+public:
+    TupleType(std::vector<Type *> itemTypes) : Type(TypeCode::TUPLE), itemTypes(itemTypes) {}
+
+    bool operator==(const Type &b) const override;
+
+    llvm::Type *getLLVMType(GenerationContext *context) const override;
+
+    std::string toString() override;
+
+    std::vector<Type *> &getItemTypes()
+    {
+        return this->itemTypes;
+    }
+
+private:
+    std::vector<Type *> itemTypes;
+};
+
+// An item of a struct-of-arrays array that is not loaded yet, the value of an soa item is its (bounds checked) index
+// Its fields are accessed in their columns directly, the whole item is only gathered when it is used as a value
+class SoAItemType : public Type
+{
+public:
+    SoAItemType(ArrayType *arrayType, llvm::Value *llvmArray) : Type(TypeCode::SOA_ITEM), arrayType(arrayType), llvmArray(llvmArray) {}
+
+    bool operator==(const Type &b) const override;
+
+    llvm::Type *getLLVMType(GenerationContext *context) const override;
+
+    std::string toString() override;
+
+    ArrayType *getArrayType()
+    {
+        return this->arrayType;
+    }
+
+    llvm::Value *getLLVMArray()
+    {
+        return this->llvmArray;
+    }
+
+private:
+    ArrayType *arrayType;
+    llvm::Value *llvmArray;
 };
 
 class StructTypeField
@@ -493,7 +782,9 @@ public:
 class StructType : public Type
 {
 public:
-    StructType(std::string name, std::vector<StructTypeField> fields, bool packed) : Type(TypeCode::STRUCT), name(name), fields(fields), packed(packed) {}
+    // Fields of a struct that is not packed or exported are reordered to minimize padding, fields keep their names
+    // An aligned struct (align > 0) gets a trailing zero sized field of that alignment, so LLVM aligns and pads it everywhere
+    StructType(std::string name, std::vector<StructTypeField> fields, bool packed, bool exported = false, uint64_t align = 0) : Type(TypeCode::STRUCT), name(name), fields(fields), packed(packed), reordered(!packed && !exported), align(align) {}
 
     bool operator==(const Type &b) const override;
 
@@ -501,7 +792,11 @@ public:
 
     StructTypeField *getField(std::string name);
 
-    int getFieldIndex(std::string name);
+    // Returns the index of the field in the LLVM struct, which differs from the declaration order when the fields are reordered
+    int getFieldIndex(GenerationContext *context, std::string name);
+
+    // Returns the size, alignment, padding and cache line span of the struct and the offset of every field
+    std::string getLayoutReport(GenerationContext *context);
 
     int getMaxIndex();
 
@@ -517,9 +812,20 @@ public:
         return this->name;
     }
 
+    uint64_t getAlign()
+    {
+        return this->align;
+    }
+
 private:
+    // Returns the declaration indices of the fields in the order they are laid out
+    const std::vector<int> &getLayoutOrder(GenerationContext *context) const;
+
     std::vector<StructTypeField> fields;
     bool packed;
+    bool reordered;
+    uint64_t align;
+    mutable std::vector<int> layoutOrder;
     std::string name;
 };
 
@@ -528,5 +834,12 @@ extern IntegerType CHAR_TYPE;
 extern IntegerType BOOL_TYPE;
 extern IntegerType UINT32_TYPE;
 extern IntegerType UINT64_TYPE;
-
-std::string typeCodeToString(TypeCode code);
\ No newline at end of file
+extern StringType STRING_TYPE;
+
+std::string typeCodeToString(TypeCode code);
+// Returns the SIMD lane count of integer and float types, 1 for scalars and all other types
+int getTypeLanes(Type *type);
+// Returns the type of a single lane of a vector type
+Type *getTypeLaneType(Type *type);
+// Returns the alignment a struct or array type was given with align(N), 0 for natural alignment
+uint64_t getTypeAlign(Type *type);
\ No newline at end of file
@@ -1,9 +1,14 @@
 #include "util.hpp"
 #include "typedValue.hpp"
 #include "context.hpp"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include <functional>
 
 const char *mallocName = "chocoAlloc";
+const char *alignedMallocName = "chocoAllocAligned";
 const char *freeName = "chocoFree";
+const char *reallocName = "chocoRealloc";
 const char *panicName = "chocoPanic";
 
 TypedValue *generateLoad(GenerationContext *context, TypedValue *valuePointer)
@@ -16,7 +21,13 @@ TypedValue *generateLoad(GenerationContext *context, TypedValue *valuePointer)
 
     std::string originVariable = valuePointer->getOriginVariable();
     PointerType *pointerType = static_cast<PointerType *>(valuePointer->getType());
-    llvm::Value *derefValue = context->irBuilder->CreateLoad(pointerType->getPointedType()->getLLVMType(context), valuePointer->getValue(), originVariable + ".load");
+    llvm::Value *llvmPointer = valuePointer->getValue();
+    if (pointerType->isManaged())
+    {
+        // Skip the reference count
+        llvmPointer = context->irBuilder->CreateStructGEP(pointerType->getLLVMPointedType(context), llvmPointer, 1, originVariable + ".value.ptr");
+    }
+    llvm::Value *derefValue = context->irBuilder->CreateLoad(pointerType->getPointedType()->getLLVMType(context), llvmPointer, originVariable + ".load");
 
     return new TypedValue(derefValue, pointerType->getPointedType(), originVariable);
 }
@@ -84,6 +95,11 @@ TypedValue *generateDereferenceToPointer(GenerationContext *context, TypedValue
 // T***** -> T
 TypedValue *generateDereferenceToValue(GenerationContext *context, TypedValue *currentValue)
 {
+    if (currentValue->getTypeCode() == TypeCode::SOA_ITEM)
+    {
+        return generateSoAItemLoad(context, currentValue);
+    }
+
     while (currentValue->getTypeCode() == TypeCode::POINTER)
     {
         currentValue = generateReferenceAwareLoad(context, currentValue);
@@ -108,6 +124,24 @@ bool generateTypeJugging(GenerationContext *context, TypedValue **leftInOut, Typ
     *leftInOut = generateDereferenceToValue(context, *leftInOut);
     *rightInOut = generateDereferenceToValue(context, *rightInOut);
 
+    // A scalar combined with a vector is copied to all lanes
+    int leftLanes = getTypeLanes((*leftInOut)->getType());
+    int rightLanes = getTypeLanes((*rightInOut)->getType());
+    if (leftLanes > 1 && rightLanes == 1)
+    {
+        *rightInOut = generateVectorSplat(context, *rightInOut, (*leftInOut)->getType(), false);
+        return *rightInOut != NULL;
+    }
+    else if (leftLanes == 1 && rightLanes > 1)
+    {
+        *leftInOut = generateVectorSplat(context, *leftInOut, (*rightInOut)->getType(), false);
+        return *leftInOut != NULL;
+    }
+    else if (leftLanes != rightLanes)
+    {
+        return false;
+    }
+
     auto leftType = (*leftInOut)->getType();
     auto leftValue = (*leftInOut)->getValue();
     auto rightType = (*rightInOut)->getType();
@@ -214,11 +248,6 @@ llvm::Type *getRefCountType(llvm::LLVMContext &context)
     return llvm::IntegerType::getInt64Ty(context);
 }
 
-llvm::Type *getUnionIdType(llvm::LLVMContext &context)
-{
-    return llvm::IntegerType::getInt64Ty(context);
-}
-
 void generateCallFreeFunction(GenerationContext *context, TypedValue *managedPointer)
 {
     assert(managedPointer->getTypeCode() == TypeCode::POINTER && "generateCallFreeFunction arg must be pointer");
@@ -254,7 +283,7 @@ void generateCallFreeFunction(GenerationContext *context, TypedValue *managedPoi
             StructType *structType = static_cast<StructType *>(pointerType->getPointedType());
             for (auto &field : structType->getFields())
             {
-                int fieldIndex = structType->getFieldIndex(field.name);
+                int fieldIndex = structType->getFieldIndex(context, field.name);
 
                 std::vector<llvm::Value *> indices;
                 indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0));
@@ -264,8 +293,19 @@ void generateCallFreeFunction(GenerationContext *context, TypedValue *managedPoi
                 auto fieldValue = context->irBuilder->CreateLoad(field.type->getLLVMType(context), fieldPointer, "member.free.load");
 
                 generateDecrementReferenceIfPointer(context, new TypedValue(fieldValue, field.type, field.name), true);
+                generateUniqueRelease(context, new TypedValue(fieldValue, field.type, field.name));
             }
         }
+        else if (pointerType->getPointedType()->getTypeCode() == TypeCode::ARRAY && static_cast<ArrayType *>(pointerType->getPointedType())->isGrowable())
+        {
+            // The items are owned by the growable array, they are released together with it
+            ArrayType *arrayType = static_cast<ArrayType *>(pointerType->getPointedType());
+            TypedValue *arrayValue = generateLoad(context, new TypedValue(pointerArg, pointerType));
+            llvm::Value *llvmLength;
+            llvm::Value *llvmItems = generateArrayStoragePointer(context, arrayValue, &llvmLength);
+            generateGrowableArrayRelease(context, arrayType, llvmItems, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false), llvmLength);
+            generateFree(context, llvmItems, "free.items");
+        }
 
         generateFree(context, pointerArg, "free");
 
@@ -281,12 +321,13 @@ void generateCallFreeFunction(GenerationContext *context, TypedValue *managedPoi
     context->irBuilder->CreateCall(freeFunction, params);
 }
 
-void generateDecrementReference(GenerationContext *context, TypedValue *managedPointer, bool checkFree)
+// Adds delta to the reference count of a managed pointer and returns the new reference count
+llvm::Value *generateReferenceCountAdd(GenerationContext *context, TypedValue *managedPointer, int64_t delta)
 {
-    assert(managedPointer->getTypeCode() == TypeCode::POINTER && "generateDecrementReference arg must be pointer");
+    assert(managedPointer->getTypeCode() == TypeCode::POINTER && "generateReferenceCountAdd arg must be pointer");
 
     PointerType *pointerType = static_cast<PointerType *>(managedPointer->getType());
-    assert(pointerType->isManaged() && "generateDecrementReference pointer arg must be managed");
+    assert(pointerType->isManaged() && "generateReferenceCountAdd pointer arg must be managed");
 
     std::string twine = managedPointer->getOriginVariable();
 
@@ -296,22 +337,93 @@ void generateDecrementReference(GenerationContext *context, TypedValue *managedP
     llvm::Value *refCountPointer = context->irBuilder->CreateGEP(pointerType->getLLVMPointedType(context), managedPointer->getValue(), indices, twine + ".refcount.ptr");
 
     llvm::Value *refCount = context->irBuilder->CreateLoad(getRefCountType(*context->context), refCountPointer, twine + ".refcount");
-    // Decrease ref count by 1
-    refCount = context->irBuilder->CreateSub(refCount, llvm::ConstantInt::get(getRefCountType(*context->context), 1, false), twine + ".refcount.dec", true, true);
-    context->irBuilder->CreateStore(refCount, refCountPointer, false);
 
-    // Free the block if refCount is zero
-    if (checkFree)
+    // Immortal objects (negative reference count) may live in read-only memory, their count must not be written
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *countBlock = llvm::BasicBlock::Create(*context->context, twine + ".refcount.mortal", currentFunction);
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, twine + ".refcount.continue", currentFunction);
+    llvm::BasicBlock *loadBlock = context->irBuilder->GetInsertBlock();
+    llvm::Value *isImmortal = context->irBuilder->CreateICmpSLT(refCount, llvm::ConstantInt::get(getRefCountType(*context->context), 0, true), twine + ".refcount.immortal");
+    llvm::MDNode *llvmUnlikelyWeights = llvm::MDBuilder(*context->context).createBranchWeights(1, 1 << 20);
+    context->irBuilder->CreateCondBr(isImmortal, continueBlock, countBlock, llvmUnlikelyWeights);
+
+    context->irBuilder->SetInsertPoint(countBlock);
+    llvm::Value *newRefCount;
+    if (delta < 0)
     {
-        llvm::Value *isRefZero = context->irBuilder->CreateICmpEQ(refCount, llvm::ConstantInt::get(getRefCountType(*context->context), 0, false), twine + ".refcount.dec.cmp");
+        newRefCount = context->irBuilder->CreateSub(refCount, llvm::ConstantInt::get(getRefCountType(*context->context), -delta, false), twine + ".refcount.dec", true, true);
+    }
+    else
+    {
+        newRefCount = context->irBuilder->CreateAdd(refCount, llvm::ConstantInt::get(getRefCountType(*context->context), delta, false), twine + ".refcount.inc", true, true);
+    }
+    context->irBuilder->CreateStore(newRefCount, refCountPointer, false);
+    context->irBuilder->CreateBr(continueBlock);
 
-        llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
-        llvm::BasicBlock *freeBlock = llvm::BasicBlock::Create(*context->context, twine + ".free", currentFunction);
-        llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, twine + ".nofree", currentFunction);
+    // The immortal path keeps its negative count, which never reaches zero
+    context->irBuilder->SetInsertPoint(continueBlock);
+    llvm::PHINode *resultRefCount = context->irBuilder->CreatePHI(getRefCountType(*context->context), 2, twine + ".refcount.new");
+    resultRefCount->addIncoming(refCount, loadBlock);
+    resultRefCount->addIncoming(newRefCount, countBlock);
+    return resultRefCount;
+}
 
-        context->irBuilder->CreateCondBr(isRefZero, freeBlock, continueBlock);
+// Places a constant managed array in read-only data behind an immortal reference count, using it does not allocate
+// It is shared like any other array and only copied when it is written (see generateArrayUnshare)
+TypedValue *generateImmortalArray(GenerationContext *context, ArrayType *arrayType, std::vector<llvm::Constant *> &llvmItems, std::string twine)
+{
+    auto arrayPointerType = new PointerType(new ArrayType(arrayType->getItemType(), (int64_t)llvmItems.size(), true, false), true);
+    llvm::StructType *llvmStorageType = llvm::cast<llvm::StructType>(arrayPointerType->getLLVMPointedType(context));
+    llvm::ArrayType *llvmItemsType = llvm::cast<llvm::ArrayType>(llvmStorageType->getElementType(1));
+
+    std::vector<llvm::Constant *> llvmStorageFields;
+    llvmStorageFields.push_back(llvm::ConstantInt::get(getRefCountType(*context->context), immortalRefCount, true));
+    llvmStorageFields.push_back(llvm::ConstantArray::get(llvmItemsType, llvmItems));
+    llvm::GlobalVariable *llvmGlobal = new llvm::GlobalVariable(*context->module, llvmStorageType, true, llvm::GlobalValue::PrivateLinkage, llvm::ConstantStruct::get(llvmStorageType, llvmStorageFields), twine);
+    llvmGlobal->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+
+    std::vector<llvm::Constant *> llvmLengthStructFields;
+    llvmLengthStructFields.push_back(llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), llvmItems.size(), false));
+    llvmLengthStructFields.push_back(llvm::ConstantExpr::getBitCast(llvmGlobal, arrayType->getLLVMArrayPointerType(context)));
+    return new TypedValue(llvm::ConstantStruct::get(arrayType->getLLVMLengthStructType(context), llvmLengthStructFields), arrayType);
+}
+
+// Returns true when the managed pointer is known to point to a global object, which is immortal and never needs counting
+bool isStaticObject(TypedValue *managedPointer)
+{
+    return llvm::isa<llvm::GlobalVariable>(managedPointer->getValue()->stripPointerCasts());
+}
+
+// Generates a branch to a new block when refCount reached zero, the insert point is set to that block
+// Returns the block that must be branched to when freeing is done
+llvm::BasicBlock *generateIfReferenceCountZero(GenerationContext *context, llvm::Value *refCount, std::string twine)
+{
+    llvm::Value *isRefZero = context->irBuilder->CreateICmpEQ(refCount, llvm::ConstantInt::get(getRefCountType(*context->context), 0, false), twine + ".refcount.dec.cmp");
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *freeBlock = llvm::BasicBlock::Create(*context->context, twine + ".free", currentFunction);
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, twine + ".nofree", currentFunction);
+
+    context->irBuilder->CreateCondBr(isRefZero, freeBlock, continueBlock);
+
+    context->irBuilder->SetInsertPoint(freeBlock);
+    return continueBlock;
+}
+
+void generateDecrementReference(GenerationContext *context, TypedValue *managedPointer, bool checkFree)
+{
+    if (isStaticObject(managedPointer))
+    {
+        return;
+    }
+
+    // Decrease ref count by 1
+    llvm::Value *refCount = generateReferenceCountAdd(context, managedPointer, -1);
 
-        context->irBuilder->SetInsertPoint(freeBlock);
+    // Free the block if refCount is zero
+    if (checkFree)
+    {
+        llvm::BasicBlock *continueBlock = generateIfReferenceCountZero(context, refCount, managedPointer->getOriginVariable());
 
         // Also decrement pointers for nested pointers
         generateCallFreeFunction(context, managedPointer);
@@ -324,22 +436,199 @@ void generateDecrementReference(GenerationContext *context, TypedValue *managedP
 
 void generateIncrementReference(GenerationContext *context, TypedValue *managedPointer)
 {
-    assert(managedPointer->getTypeCode() == TypeCode::POINTER && "generateIncrementReference arg must be pointer");
+    if (isStaticObject(managedPointer))
+    {
+        return;
+    }
 
-    PointerType *pointerType = static_cast<PointerType *>(managedPointer->getType());
-    assert(pointerType->isManaged() && "generateIncrementReference pointer arg must be managed");
+    // Increase refCount by 1
+    generateReferenceCountAdd(context, managedPointer, 1);
+}
 
-    std::string twine = managedPointer->getOriginVariable();
+// Releases the values of a scope in reverse declaration order and ends the lifetime of their stack slots
+// Must be generated on every edge that leaves the scope (fallthrough and return)
+void generateScopeEnd(GenerationContext *context, FunctionScope *scope)
+{
+    for (auto it = scope->locals.rbegin(); it != scope->locals.rend(); it++)
+    {
+        TypedValue *valuePointer = *it;
+        if (valuePointer->isType())
+        {
+            continue;
+        }
 
-    std::vector<llvm::Value *> indices;
-    indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
-    indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
-    llvm::Value *refCountPointer = context->irBuilder->CreateGEP(pointerType->getLLVMPointedType(context), managedPointer->getValue(), indices, twine + ".refcount.ptr");
+        PointerType *valuePointerType = static_cast<PointerType *>(valuePointer->getType());
+        llvm::Value *finalizedValue = context->irBuilder->CreateLoad(valuePointerType->getPointedType()->getLLVMType(context), valuePointer->getValue(), valuePointer->getOriginVariable() + ".load");
+        generateDecrementReferenceIfPointer(context, new TypedValue(finalizedValue, valuePointerType->getPointedType()), true);
+        generateUniqueRelease(context, new TypedValue(finalizedValue, valuePointerType->getPointedType(), valuePointer->getOriginVariable()));
 
-    llvm::Value *refCount = context->irBuilder->CreateLoad(getRefCountType(*context->context), refCountPointer, twine + ".refcount");
-    // Increase refCount by 1
-    refCount = context->irBuilder->CreateAdd(refCount, llvm::ConstantInt::get(getRefCountType(*context->context), 1, false), twine + ".refcount.inc", true, true);
-    context->irBuilder->CreateStore(refCount, refCountPointer, false);
+        if (llvm::isa<llvm::AllocaInst>(valuePointer->getValue()))
+        {
+            context->irBuilder->CreateLifetimeEnd(valuePointer->getValue());
+        }
+    }
+}
+
+// Returns the unique pointer type that values of type own, or NULL when they do not own one
+// A union can only contain a unique pointer together with null, which is then stored as a null pointer
+PointerType *getUniquePointerType(Type *type)
+{
+    if (type->getTypeCode() == TypeCode::POINTER)
+    {
+        PointerType *pointerType = static_cast<PointerType *>(type);
+        return pointerType->isUnique() ? pointerType : NULL;
+    }
+    if (type->getTypeCode() == TypeCode::UNION)
+    {
+        UnionType *unionType = static_cast<UnionType *>(type);
+        for (Type *containedType : unionType->getTypes())
+        {
+            if (containedType->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(containedType)->isUnique())
+            {
+                if (unionType->getLayout() != UnionLayout::NULL_POINTER_NICHE)
+                {
+                    std::cout << "ERROR: A unique pointer can only be in a union with null, not in " << type->toString() << "\n";
+                    exit(-1);
+                    return NULL;
+                }
+                return static_cast<PointerType *>(containedType);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Moves the value out of a variable or field that owns a unique pointer, null is left behind so it is not freed again
+// When the move is known at compile time, the null store and the check in generateUniqueRelease are optimized away
+TypedValue *generateUniqueMove(GenerationContext *context, TypedValue *ownerPointer)
+{
+    TypedValue *value = generateLoad(context, ownerPointer);
+    context->irBuilder->CreateStore(llvm::Constant::getNullValue(value->getValue()->getType()), ownerPointer->getValue());
+    return value;
+}
+
+// Returns the function that releases what the fields of a unique object own and then frees the object
+static llvm::Function *getUniqueFreeFunction(GenerationContext *context, PointerType *pointerType)
+{
+    // Unique objects have no reference count, so their pointed type never collides with the managed ones
+    llvm::Type *llvmTypeToFree = pointerType->getLLVMPointedType(context);
+    if (context->freeFunctions.count(llvmTypeToFree) > 0)
+    {
+        return context->freeFunctions[llvmTypeToFree];
+    }
+
+    std::vector<llvm::Type *> freeParams;
+    freeParams.push_back(pointerType->getLLVMType(context));
+    llvm::FunctionType *functionType = llvm::FunctionType::get(llvm::Type::getVoidTy(*context->context), freeParams, false);
+    llvm::Function *freeFunction = llvm::Function::Create(functionType, llvm::Function::InternalLinkage, std::to_string(context->freeFunctions.size()) + ".free.unique", *context->module);
+    context->freeFunctions[llvmTypeToFree] = freeFunction;
+
+    auto savedBlock = context->irBuilder->GetInsertBlock();
+    context->irBuilder->SetInsertPoint(llvm::BasicBlock::Create(*context->context, "free.entry", freeFunction));
+    auto pointerArg = freeFunction->getArg(0);
+
+    if (pointerType->getPointedType()->getTypeCode() == TypeCode::STRUCT)
+    {
+        StructType *structType = static_cast<StructType *>(pointerType->getPointedType());
+        for (auto &field : structType->getFields())
+        {
+            auto fieldPointer = context->irBuilder->CreateStructGEP(llvmTypeToFree, pointerArg, structType->getFieldIndex(context, field.name), "member.free");
+            auto fieldValue = context->irBuilder->CreateLoad(field.type->getLLVMType(context), fieldPointer, "member.free.load");
+
+            generateDecrementReferenceIfPointer(context, new TypedValue(fieldValue, field.type, field.name), true);
+            generateUniqueRelease(context, new TypedValue(fieldValue, field.type, field.name));
+        }
+    }
+
+    generateFree(context, pointerArg, "free");
+    context->irBuilder->CreateRetVoid();
+
+    context->irBuilder->SetInsertPoint(savedBlock);
+
+    assert(!llvm::verifyFunction(*freeFunction, &llvm::errs()));
+    return freeFunction;
+}
+
+// Frees the object a unique pointer (or a union of one with null) owns, together with what its fields own
+// Nothing is done for null, which is what a move leaves behind
+void generateUniqueRelease(GenerationContext *context, TypedValue *uniqueValue)
+{
+    PointerType *pointerType = getUniquePointerType(uniqueValue->getType());
+    if (pointerType == NULL)
+    {
+        return;
+    }
+
+    llvm::Value *llvmPointer = uniqueValue->getValue();
+    if (uniqueValue->getTypeCode() == TypeCode::UNION)
+    {
+        llvmPointer = generateUnionGetData(context, uniqueValue, pointerType)->getValue();
+    }
+
+    std::string twine = uniqueValue->getOriginVariable();
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *freeBlock = llvm::BasicBlock::Create(*context->context, twine + ".unique.free", currentFunction);
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, twine + ".unique.continue", currentFunction);
+    context->irBuilder->CreateCondBr(context->irBuilder->CreateIsNull(llvmPointer, twine + ".unique.moved"), continueBlock, freeBlock);
+
+    context->irBuilder->SetInsertPoint(freeBlock);
+    std::vector<llvm::Value *> params;
+    params.push_back(llvmPointer);
+    context->irBuilder->CreateCall(getUniqueFreeFunction(context, pointerType), params);
+    context->irBuilder->CreateBr(continueBlock);
+
+    context->irBuilder->SetInsertPoint(continueBlock);
+}
+
+// Generates a single test to check if the union holds a managed pointer, the insert point is set to the block where it does
+// Returns the block that must be branched to afterwards, or NULL when the union cannot contain managed pointers
+llvm::BasicBlock *generateIfUnionHasManagedPointer(GenerationContext *context, TypedValue *unionValue, std::string twine)
+{
+    UnionType *unionType = static_cast<UnionType *>(unionValue->getType());
+    if (!unionType->containsManagedPointer())
+    {
+        return NULL;
+    }
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *pointerBlock = llvm::BasicBlock::Create(*context->context, twine + ".pointer", currentFunction);
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, twine + ".continue", currentFunction);
+
+    context->irBuilder->CreateCondBr(unionType->generateHasManagedPointer(context, unionValue->getValue()), pointerBlock, continueBlock);
+
+    context->irBuilder->SetInsertPoint(pointerBlock);
+    return continueBlock;
+}
+
+// Adds delta to the reference count in front of the heap bytes of a String value and frees them when it reaches zero (checkFree)
+// Inline strings are not counted, heap literals have an immortal reference count
+static void generateStringReferenceCountAdd(GenerationContext *context, TypedValue *stringValue, int64_t delta, bool checkFree)
+{
+    llvm::Value *llvmTag = context->irBuilder->CreateExtractValue(stringValue->getValue(), 3, "string.tag");
+    llvm::Value *llvmIsHeap = context->irBuilder->CreateICmpEQ(llvmTag, llvm::ConstantInt::get(llvmTag->getType(), stringHeapTag, false), "string.isheap");
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *heapBlock = llvm::BasicBlock::Create(*context->context, "string.ref.heap", currentFunction);
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "string.ref.continue", currentFunction);
+    context->irBuilder->CreateCondBr(llvmIsHeap, heapBlock, continueBlock);
+
+    context->irBuilder->SetInsertPoint(heapBlock);
+    PointerType *anyPointerType = new PointerType(NULL, true);
+    llvm::Value *llvmBytes = context->irBuilder->CreateExtractValue(stringValue->getValue(), 0, "string.bytes");
+    llvm::Value *llvmCountedBytes = context->irBuilder->CreateBitCast(llvmBytes, getRefCountType(*context->context)->getPointerTo(), "string.bytes.counted");
+    llvm::Value *llvmHeader = context->irBuilder->CreateInBoundsGEP(getRefCountType(*context->context), llvmCountedBytes, llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context->context), -1, true), "string.header");
+    TypedValue *header = new TypedValue(context->irBuilder->CreateBitCast(llvmHeader, anyPointerType->getLLVMType(context), "string.header.ptr"), anyPointerType, "string");
+    llvm::Value *refCount = generateReferenceCountAdd(context, header, delta);
+    if (checkFree)
+    {
+        llvm::BasicBlock *noFreeBlock = generateIfReferenceCountZero(context, refCount, "string");
+        generateFree(context, header->getValue(), "string.free");
+        context->irBuilder->CreateBr(noFreeBlock);
+        context->irBuilder->SetInsertPoint(noFreeBlock);
+    }
+    context->irBuilder->CreateBr(continueBlock);
+
+    context->irBuilder->SetInsertPoint(continueBlock);
 }
 
 void generateDecrementReferenceIfPointer(GenerationContext *context, TypedValue *maybeManagedPointer, bool checkFree)
@@ -349,25 +638,43 @@ void generateDecrementReferenceIfPointer(GenerationContext *context, TypedValue
     {
         UnionType *unionType = static_cast<UnionType *>(maybeManagedPointer->getType());
 
-        // Check if union contains pointer types
-        for (Type *containedUnionType : unionType->getTypes())
+        llvm::BasicBlock *continueBlock = generateIfUnionHasManagedPointer(context, maybeManagedPointer, "union.ref.dec");
+        if (continueBlock == NULL)
         {
-            // If the union can be a pointer
-            if (containedUnionType->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(containedUnionType)->isManaged())
-            {
-                auto okBlock = generateUnionIsBranches(context, maybeManagedPointer, containedUnionType);
-                llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "union.ref.dec.continue", context->irBuilder->GetInsertBlock()->getParent());
-                context->irBuilder->CreateBr(continueBlock);
+            return;
+        }
+
+        // Every managed allocation starts with the reference count, the actual pointed type is only needed when freeing
+        TypedValue *anyPointer = generateUnionGetData(context, maybeManagedPointer, new PointerType(NULL, true));
+        llvm::Value *refCount = generateReferenceCountAdd(context, anyPointer, -1);
+
+        if (checkFree)
+        {
+            llvm::BasicBlock *noFreeBlock = generateIfReferenceCountZero(context, refCount, "union");
 
-                context->irBuilder->SetInsertPoint(okBlock);
-                // At this point, we are sure maybeManagedPointer is containedUnionType
-                auto llvmUnionData = generateUnionGetData(context, maybeManagedPointer, containedUnionType);
-                generateDecrementReference(context, llvmUnionData, checkFree);
-                context->irBuilder->CreateBr(continueBlock);
+            std::vector<Type *> pointerTypes;
+            for (Type *containedUnionType : unionType->getTypes())
+            {
+                if (containedUnionType->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(containedUnionType)->isManaged())
+                {
+                    pointerTypes.push_back(containedUnionType);
+                }
+            }
 
-                context->irBuilder->SetInsertPoint(continueBlock);
+            std::vector<llvm::BasicBlock *> caseBlocks = generateUnionSwitch(context, maybeManagedPointer, pointerTypes, noFreeBlock);
+            for (int i = 0; i < pointerTypes.size(); i++)
+            {
+                context->irBuilder->SetInsertPoint(caseBlocks[i]);
+                // At this point, we are sure maybeManagedPointer is pointerTypes[i]
+                generateCallFreeFunction(context, generateUnionGetData(context, maybeManagedPointer, pointerTypes[i]));
+                context->irBuilder->CreateBr(noFreeBlock);
             }
+
+            context->irBuilder->SetInsertPoint(noFreeBlock);
         }
+
+        context->irBuilder->CreateBr(continueBlock);
+        context->irBuilder->SetInsertPoint(continueBlock);
     }
     else if (maybeManagedPointer->getTypeCode() == TypeCode::POINTER)
     {
@@ -378,6 +685,10 @@ void generateDecrementReferenceIfPointer(GenerationContext *context, TypedValue
             generateDecrementReference(context, maybeManagedPointer, checkFree);
         }
     }
+    else if (maybeManagedPointer->getTypeCode() == TypeCode::STRING)
+    {
+        generateStringReferenceCountAdd(context, maybeManagedPointer, -1, checkFree);
+    }
 }
 
 void generateIncrementReferenceIfPointer(GenerationContext *context, TypedValue *maybeManagedPointer)
@@ -385,27 +696,17 @@ void generateIncrementReferenceIfPointer(GenerationContext *context, TypedValue
     // Union type could include pointer
     if (maybeManagedPointer->getTypeCode() == TypeCode::UNION)
     {
-        UnionType *unionType = static_cast<UnionType *>(maybeManagedPointer->getType());
-
-        // Check if union contains pointer types
-        for (Type *containedUnionType : unionType->getTypes())
+        llvm::BasicBlock *continueBlock = generateIfUnionHasManagedPointer(context, maybeManagedPointer, "union.ref.inc");
+        if (continueBlock == NULL)
         {
-            // If the union can be a pointer
-            if (containedUnionType->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(containedUnionType)->isManaged())
-            {
-                auto okBlock = generateUnionIsBranches(context, maybeManagedPointer, containedUnionType);
-                llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "union.ref.inc.continue", context->irBuilder->GetInsertBlock()->getParent());
-                context->irBuilder->CreateBr(continueBlock);
+            return;
+        }
 
-                context->irBuilder->SetInsertPoint(okBlock);
-                // At this point, we are sure maybeManagedPointer is containedUnionType
-                auto llvmUnionData = generateUnionGetData(context, maybeManagedPointer, containedUnionType);
-                generateIncrementReference(context, llvmUnionData);
-                context->irBuilder->CreateBr(continueBlock);
+        TypedValue *anyPointer = generateUnionGetData(context, maybeManagedPointer, new PointerType(NULL, true));
+        generateReferenceCountAdd(context, anyPointer, 1);
 
-                context->irBuilder->SetInsertPoint(continueBlock);
-            }
-        }
+        context->irBuilder->CreateBr(continueBlock);
+        context->irBuilder->SetInsertPoint(continueBlock);
     }
     else if (maybeManagedPointer->getTypeCode() == TypeCode::POINTER)
     {
@@ -416,54 +717,80 @@ void generateIncrementReferenceIfPointer(GenerationContext *context, TypedValue
             generateIncrementReference(context, maybeManagedPointer);
         }
     }
+    else if (maybeManagedPointer->getTypeCode() == TypeCode::STRING)
+    {
+        generateStringReferenceCountAdd(context, maybeManagedPointer, 1, false);
+    }
 }
 
 llvm::Value *generateUnionGetTypeId(GenerationContext *context, TypedValue *unionToExtract)
 {
     assert(unionToExtract->getTypeCode() == TypeCode::UNION);
 
-    std::vector<unsigned int> indices;
-    indices.push_back(0);
-    return context->irBuilder->CreateExtractValue(unionToExtract->getValue(), indices, "union.typeid");
+    UnionType *unionType = static_cast<UnionType *>(unionToExtract->getType());
+    return unionType->generateGetTag(context, unionToExtract->getValue());
+}
+
+// Generates a single switch on the union tag, with a new case block for each of the given member types
+// Values that are none of the types branch to defaultBlock
+std::vector<llvm::BasicBlock *> generateUnionSwitch(GenerationContext *context, TypedValue *unionValue, std::vector<Type *> types, llvm::BasicBlock *defaultBlock)
+{
+    assert(unionValue->getTypeCode() == TypeCode::UNION);
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    UnionType *unionType = static_cast<UnionType *>(unionValue->getType());
+
+    llvm::Value *llvmTypeIdValue = generateUnionGetTypeId(context, unionValue);
+    llvm::SwitchInst *llvmSwitch = context->irBuilder->CreateSwitch(llvmTypeIdValue, defaultBlock, types.size());
+
+    std::vector<llvm::BasicBlock *> caseBlocks;
+    for (auto type : types)
+    {
+        llvm::BasicBlock *caseBlock = llvm::BasicBlock::Create(*context->context, "union.case", currentFunction);
+        llvmSwitch->addCase(llvm::cast<llvm::ConstantInt>(unionType->getLLVMTag(context, type)), caseBlock);
+        caseBlocks.push_back(caseBlock);
+    }
+    return caseBlocks;
 }
 
+// Generates a single switch that branches to the returned block when the union contains compareType (or one of its types if it is a union)
+// The insert point is set to the block where it does not
 llvm::BasicBlock *generateUnionIsBranches(GenerationContext *context, TypedValue *unionToCompare, Type *compareType)
 {
     assert(unionToCompare->getTypeCode() == TypeCode::UNION);
 
     llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    UnionType *unionType = static_cast<UnionType *>(unionToCompare->getType());
 
     llvm::Value *llvmTypeIdValue = generateUnionGetTypeId(context, unionToCompare);
 
-    std::vector<uint64_t> allowedTypeIds;
+    std::vector<llvm::ConstantInt *> allowedTypeIds;
     if (compareType->getTypeCode() == TypeCode::UNION)
     {
         UnionType *targetUnionType = static_cast<UnionType *>(compareType);
         for (auto type : targetUnionType->getTypes())
         {
-            allowedTypeIds.push_back(context->getTypeId(type));
+            if (unionType->containsType(type))
+            {
+                allowedTypeIds.push_back(llvm::cast<llvm::ConstantInt>(unionType->getLLVMTag(context, type)));
+            }
         }
     }
-    else
+    else if (unionType->containsType(compareType))
     {
-        allowedTypeIds.push_back(context->getTypeId(compareType));
+        allowedTypeIds.push_back(llvm::cast<llvm::ConstantInt>(unionType->getLLVMTag(context, compareType)));
     }
-    assert(allowedTypeIds.size() > 0);
 
     llvm::BasicBlock *okBlock = llvm::BasicBlock::Create(*context->context, "union.match", currentFunction);
+    llvm::BasicBlock *notOkBlock = llvm::BasicBlock::Create(*context->context, "union.nomatch", currentFunction);
 
-    llvm::BasicBlock *nextBlock;
-    for (int i = 0; i < allowedTypeIds.size(); i++)
+    llvm::SwitchInst *llvmSwitch = context->irBuilder->CreateSwitch(llvmTypeIdValue, notOkBlock, allowedTypeIds.size());
+    for (auto typeId : allowedTypeIds)
     {
-        uint64_t typeId = allowedTypeIds[i];
-
-        auto llvmMatchesValue = context->irBuilder->CreateICmpEQ(llvm::ConstantInt::get(getUnionIdType(*context->context), typeId, false), llvmTypeIdValue, "union.cmp." + std::to_string(i));
-
-        nextBlock = llvm::BasicBlock::Create(*context->context, "union.check", currentFunction);
-        context->irBuilder->CreateCondBr(llvmMatchesValue, okBlock, nextBlock);
-        context->irBuilder->SetInsertPoint(nextBlock);
+        llvmSwitch->addCase(typeId, okBlock);
     }
 
+    context->irBuilder->SetInsertPoint(notOkBlock);
     return okBlock;
 }
 
@@ -471,19 +798,45 @@ TypedValue *generateUnionGetData(GenerationContext *context, TypedValue *unionTo
 {
     assert(unionToConvert->getTypeCode() == TypeCode::UNION);
 
-    std::vector<unsigned int> indices;
-    indices.push_back(1);
-    llvm::Value *llvmUnionData = context->irBuilder->CreateExtractValue(unionToConvert->getValue(), indices, "union.data.asint");
-    auto llvmTargetType = asType->getLLVMType(context);
-
-    int asTypeBitSize = context->module->getDataLayout().getTypeStoreSizeInBits(llvmTargetType);
-    auto llvmCastedAsIntValue = context->irBuilder->CreateTruncOrBitCast(llvmUnionData, llvm::Type::getIntNTy(*context->context, asTypeBitSize), "union.data.trunc");
-    auto llvmCastedValue = context->irBuilder->CreateBitOrPointerCast(llvmCastedAsIntValue, llvmTargetType, "union.data");
-    return new TypedValue(llvmCastedValue, asType);
+    UnionType *unionType = static_cast<UnionType *>(unionToConvert->getType());
+    return new TypedValue(unionType->generateGetData(context, unionToConvert->getValue(), asType), asType);
 }
 
 TypedValue *generateUnionConversion(GenerationContext *context, TypedValue *unionToConvert, Type *targetType)
 {
+    if (targetType->getTypeCode() == TypeCode::UNION)
+    {
+        // The target union can have another layout, repack the value for every type it can contain
+        UnionType *targetUnionType = static_cast<UnionType *>(targetType);
+        llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+        llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "union.convert.continue");
+
+        std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> incoming;
+        for (auto type : targetUnionType->getTypes())
+        {
+            llvm::BasicBlock *okBlock = generateUnionIsBranches(context, unionToConvert, type);
+            llvm::BasicBlock *notOkBlock = context->irBuilder->GetInsertBlock();
+
+            context->irBuilder->SetInsertPoint(okBlock);
+            TypedValue *data = generateUnionGetData(context, unionToConvert, type);
+            incoming.push_back(std::make_pair(targetUnionType->createValue(context, data), context->irBuilder->GetInsertBlock()));
+            context->irBuilder->CreateBr(continueBlock);
+
+            context->irBuilder->SetInsertPoint(notOkBlock);
+        }
+
+        generatePanic(context, "Cannot cast " + unionToConvert->getType()->toString() + " to " + targetType->toString());
+
+        continueBlock->insertInto(currentFunction);
+        context->irBuilder->SetInsertPoint(continueBlock);
+        auto phi = context->irBuilder->CreatePHI(targetType->getLLVMType(context), incoming.size(), "union.converted");
+        for (auto &p : incoming)
+        {
+            phi->addIncoming(p.first, p.second);
+        }
+        return new TypedValue(phi, targetType);
+    }
+
     llvm::BasicBlock *okBlock = generateUnionIsBranches(context, unionToConvert, targetType);
 
     // After the last block is reached, the value does not match the union, panic
@@ -491,15 +844,7 @@ TypedValue *generateUnionConversion(GenerationContext *context, TypedValue *unio
 
     context->irBuilder->SetInsertPoint(okBlock);
 
-    if (targetType->getTypeCode() == TypeCode::UNION)
-    {
-        auto llvmBitCastedValue = context->irBuilder->CreateBitCast(unionToConvert->getValue(), targetType->getLLVMType(context));
-        return new TypedValue(llvmBitCastedValue, targetType);
-    }
-    else
-    {
-        return generateUnionGetData(context, unionToConvert, targetType);
-    }
+    return generateUnionGetData(context, unionToConvert, targetType);
 }
 
 TypedValue *generateUnionIs(GenerationContext *context, TypedValue *unionToCompare, Type *compareType)
@@ -531,10 +876,24 @@ TypedValue *generateTypeConversion(GenerationContext *context, TypedValue *value
         return valueToConvert;
     }
 
+    if (targetType->getTypeCode() == TypeCode::UNION)
+    {
+        // A pointer to a value (like a union field, cur = cur.next) is loaded, unless the union contains the pointer itself
+        UnionType *unionType = static_cast<UnionType *>(targetType);
+        while (valueToConvert->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(valueToConvert->getType())->getPointedType() != NULL && !unionType->containsType(valueToConvert->getType()))
+        {
+            valueToConvert = generateReferenceAwareLoad(context, valueToConvert);
+        }
+        if (*valueToConvert->getType() == *targetType)
+        {
+            return valueToConvert;
+        }
+    }
+
     if (valueToConvert->getTypeCode() == TypeCode::UNION)
     {
         UnionType *unionType = static_cast<UnionType *>(valueToConvert->getType());
-        if (!unionType->containsType(targetType))
+        if (!unionType->containsType(targetType) && targetType->getTypeCode() != TypeCode::UNION)
         {
             std::cout << "ERROR: Cannot convert union " << valueToConvert->getType()->toString() << " to " << targetType->toString() << " (not included in union)\n";
             return NULL;
@@ -579,15 +938,94 @@ TypedValue *generateTypeConversion(GenerationContext *context, TypedValue *value
         }
     }
 
+    if (targetType->getTypeCode() == TypeCode::ARRAY && static_cast<ArrayType *>(targetType)->isSlice() && *static_cast<ArrayType *>(targetType)->getItemType() == BYTE_TYPE)
+    {
+        // A String can be used as a slice of its bytes
+        TypedValue *stringPointer = generateStringToPointer(context, valueToConvert);
+        if (stringPointer != NULL)
+        {
+            // The slice gets a copy of the bytes, a String value that was converted is not used anymore
+            TypedValue *bytesSlice = generateStringSlice(context, stringPointer, NULL, NULL, true);
+            generateDecrementReferenceIfPointer(context, valueToConvert, true);
+            return bytesSlice;
+        }
+    }
+
     valueToConvert = generateDereferenceToValue(context, valueToConvert);
     if (*valueToConvert->getType() == *targetType)
     {
         return valueToConvert;
     }
 
+    if (valueToConvert->getTypeCode() == TypeCode::ARRAY_EXPRESSION)
+    {
+        if (targetType->getTypeCode() != TypeCode::ARRAY)
+        {
+            std::cout << "ERROR: Cannot convert " << valueToConvert->getType()->toString() << " to " << targetType->toString() << ", array expressions can only become arrays\n";
+            return NULL;
+        }
+        if (static_cast<ArrayType *>(targetType)->isSlice())
+        {
+            // The computed array owns the items of the slice
+            TypedValue *computedArray = generateArrayExpressionToArray(context, valueToConvert, static_cast<ArrayExpressionType *>(valueToConvert->getType())->getResultArrayType());
+            return computedArray == NULL ? NULL : generateTypeConversion(context, computedArray, targetType, allowLosePrecision);
+        }
+        return generateArrayExpressionToArray(context, valueToConvert, static_cast<ArrayType *>(targetType));
+    }
+
     llvm::Value *currentValue = valueToConvert->getValue();
     Type *currentType = valueToConvert->getType();
 
+    if (currentType->getTypeCode() == TypeCode::ARRAY && targetType->getTypeCode() == TypeCode::ARRAY)
+    {
+        // An aligned array can be used as an unaligned one, and the columns of an soa array are located using its length field,
+        // so a sized soa array can be used as an unsized one, their representation is the same
+        ArrayType *currentArrayType = static_cast<ArrayType *>(currentType);
+        ArrayType *targetArrayType = static_cast<ArrayType *>(targetType);
+        bool sameLayout = currentArrayType->isSoA() == targetArrayType->isSoA() && currentArrayType->isGrowable() == targetArrayType->isGrowable() && currentArrayType->isSlice() == targetArrayType->isSlice() && currentArrayType->getManaged() == targetArrayType->getManaged() && currentArrayType->getByValue() == targetArrayType->getByValue() && *currentArrayType->getItemType() == *targetArrayType->getItemType();
+        bool compatibleCount = currentArrayType->getCount() == targetArrayType->getCount() || (targetArrayType->isSoA() && !targetArrayType->hasKnownCount());
+        bool compatibleAlign = targetArrayType->getAlign() == 0 || targetArrayType->getAlign() == currentArrayType->getAlign();
+        if (sameLayout && compatibleCount && compatibleAlign)
+        {
+            return new TypedValue(currentValue, targetType);
+        }
+        if (sameLayout && compatibleAlign && currentArrayType->getManaged() && !targetArrayType->hasKnownCount())
+        {
+            // A sized managed array only differs from an unsized one in the type of its storage pointer
+            llvm::Value *llvmStorage = context->irBuilder->CreateExtractValue(currentValue, 1, "array.ptr");
+            llvm::Value *llvmCastedStorage = context->irBuilder->CreateBitCast(llvmStorage, targetArrayType->getLLVMArrayPointerType(context), "array.unsized.ptr");
+            llvm::Value *llvmUnsized = context->irBuilder->CreateInsertValue(llvm::UndefValue::get(targetType->getLLVMType(context)), context->irBuilder->CreateExtractValue(currentValue, 0, "array.length"), 0, "array.unsized.length");
+            llvmUnsized = context->irBuilder->CreateInsertValue(llvmUnsized, llvmCastedStorage, 1, "array.unsized");
+            return new TypedValue(llvmUnsized, targetType);
+        }
+        if (targetArrayType->isSlice() && *currentArrayType->getItemType() == *targetArrayType->getItemType())
+        {
+            // Any array that has its items in memory can be used as a slice of all its items
+            return generateArraySlice(context, valueToConvert, NULL, NULL);
+        }
+    }
+
+    int targetLanes = getTypeLanes(targetType);
+    int currentLanes = getTypeLanes(currentType);
+    if (targetLanes > 1 && currentType->getTypeCode() == TypeCode::ARRAY)
+    {
+        return generateArrayToVector(context, valueToConvert, targetType);
+    }
+    else if (currentLanes > 1 && targetType->getTypeCode() == TypeCode::ARRAY)
+    {
+        return generateVectorToArray(context, valueToConvert, targetType);
+    }
+    else if (targetLanes > 1 && currentLanes == 1)
+    {
+        return generateVectorSplat(context, valueToConvert, targetType, allowLosePrecision);
+    }
+    else if (targetLanes != currentLanes)
+    {
+        std::cout << "ERROR: Cannot convert " << currentType->toString() << " to " << targetType->toString() << ", the lane counts differ\n";
+        return NULL;
+    }
+    // The conversions below work per lane on vectors
+
     if (targetType->getTypeCode() == TypeCode::INTEGER && currentType->getTypeCode() == TypeCode::INTEGER)
     {
         IntegerType *currentIntType = static_cast<IntegerType *>(currentType);
@@ -708,14 +1146,2302 @@ TypedValue *generateTypeConversion(GenerationContext *context, TypedValue *value
     return new TypedValue(currentValue, targetType);
 }
 
-bool generateAssignment(GenerationContext *context, TypedValue *valuePointer, TypedValue *newValue, bool isVolatile)
+// Copies a scalar to all lanes of vectorType, the scalar is converted to the lane type first
+// Constants may always lose precision (Float32x8 * 2.0)
+TypedValue *generateVectorSplat(GenerationContext *context, TypedValue *scalarValue, Type *vectorType, bool allowLosePrecision)
 {
-    std::cout << "debug: Assign " << newValue->getType()->toString() << " to " << valuePointer->getType()->toString() << " ('" << valuePointer->getOriginVariable() << "')\n";
-
-    if (valuePointer->getTypeCode() != TypeCode::POINTER)
+    bool isConstant = llvm::isa<llvm::Constant>(scalarValue->getValue());
+    TypedValue *laneValue = generateTypeConversion(context, scalarValue, getTypeLaneType(vectorType), allowLosePrecision || isConstant);
+    if (laneValue == NULL)
     {
-        std::cout << "ERROR: Can only assign to a pointer\n";
-        return false;
+        std::cout << "ERROR: Cannot convert " << scalarValue->getType()->toString() << " to the lanes of " << vectorType->toString() << "\n";
+        return NULL;
+    }
+    return new TypedValue(context->irBuilder->CreateVectorSplat(getTypeLanes(vectorType), laneValue->getValue(), "splat"), vectorType);
+}
+
+// Returns a pointer to the items start..start + lanes of an array, these must be in bounds of the array (and end when it is not NULL)
+// alignOut is the alignment of the items, this is the declared align(N) of the array when the start is a multiple of it
+static llvm::Value *generateVectorItemsPointer(GenerationContext *context, TypedValue *arrayValue, llvm::Value *llvmStart, llvm::Value *llvmEnd, Type *vectorType, llvm::Align *alignOut, std::string twine)
+{
+    ArrayType *arrayType = static_cast<ArrayType *>(arrayValue->getType());
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    int lanes = getTypeLanes(vectorType);
+
+    llvm::Value *llvmLength;
+    llvm::Value *llvmStoragePointer = generateArrayStoragePointer(context, arrayValue, &llvmLength);
+    if (llvmEnd != NULL)
+    {
+        if (llvmLength != NULL)
+        {
+            generateBoundsCheck(context, llvmEnd, context->irBuilder->CreateAdd(llvmLength, llvm::ConstantInt::get(llvmLengthType, 1, false), twine + ".end.limit"), twine + ".end");
+        }
+        llvmLength = llvmEnd;
+    }
+    if (llvmLength != NULL)
+    {
+        generateBoundsCheck(context, context->irBuilder->CreateAdd(llvmStart, llvm::ConstantInt::get(llvmLengthType, lanes - 1, false), twine + ".last"), llvmLength, twine);
+    }
+
+    const llvm::DataLayout &dataLayout = context->module->getDataLayout();
+    llvm::Type *llvmItemType = arrayType->getItemType()->getLLVMType(context);
+    *alignOut = dataLayout.getABITypeAlign(llvmItemType);
+    llvm::ConstantInt *llvmConstantStart = llvm::dyn_cast<llvm::ConstantInt>(llvmStart);
+    if (arrayType->getAlign() > 0 && llvmConstantStart != NULL && llvmConstantStart->getZExtValue() * dataLayout.getTypeAllocSize(llvmItemType) % arrayType->getAlign() == 0)
+    {
+        *alignOut = std::max(*alignOut, llvm::Align(arrayType->getAlign()));
+    }
+
+    llvm::Value *llvmItemPointer = generateArrayItemPointer(context, arrayType, llvmStoragePointer, llvmStart, twine);
+    return context->irBuilder->CreatePointerCast(llvmItemPointer, vectorType->getLLVMType(context)->getPointerTo(), twine + ".ptr");
+}
+
+// Loads the first items of an array into a vector, the array must contain at least as many items as the vector has lanes
+TypedValue *generateArrayToVector(GenerationContext *context, TypedValue *arrayValue, Type *vectorType)
+{
+    ArrayType *arrayType = static_cast<ArrayType *>(arrayValue->getType());
+    Type *laneType = getTypeLaneType(vectorType);
+    int lanes = getTypeLanes(vectorType);
+    if (*arrayType->getItemType() != *laneType)
+    {
+        std::cout << "ERROR: Cannot convert " << arrayType->toString() << " to " << vectorType->toString() << ", the item type must be " << laneType->toString() << "\n";
+        return NULL;
+    }
+
+    llvm::Type *llvmVectorType = vectorType->getLLVMType(context);
+    if (arrayType->getByValue())
+    {
+        if (arrayType->getCount() != lanes)
+        {
+            std::cout << "ERROR: Cannot convert " << arrayType->toString() << " to " << vectorType->toString() << ", the item count must be " << lanes << "\n";
+            return NULL;
+        }
+
+        llvm::Value *llvmVector = llvm::UndefValue::get(llvmVectorType);
+        for (int i = 0; i < lanes; i++)
+        {
+            llvm::Value *llvmItem = context->irBuilder->CreateExtractValue(arrayValue->getValue(), (unsigned int)i, "vector.item");
+            llvmVector = context->irBuilder->CreateInsertElement(llvmVector, llvmItem, (uint64_t)i, "vector.insert");
+        }
+        return new TypedValue(llvmVector, vectorType);
+    }
+
+    // Array storage is only aligned to its item type unless it is declared with align(N), otherwise this is an unaligned vector load
+    llvm::Align align;
+    llvm::Value *llvmVectorPointer = generateVectorItemsPointer(context, arrayValue, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false), NULL, vectorType, &align, "vector.load");
+    llvm::Value *llvmVector = context->irBuilder->CreateAlignedLoad(llvmVectorType, llvmVectorPointer, align, "vector.load");
+    return new TypedValue(llvmVector, vectorType);
+}
+
+// Stores the lanes of a vector into the items start..start + lanes of an array, a[lo..hi] = v
+// The items must be unshared, like when they are mutated one by one
+bool generateVectorStore(GenerationContext *context, TypedValue *arrayValue, llvm::Value *llvmStart, llvm::Value *llvmEnd, TypedValue *vectorValue)
+{
+    ArrayType *arrayType = static_cast<ArrayType *>(arrayValue->getType());
+    Type *vectorType = vectorValue->getType();
+    if (getTypeLanes(vectorType) <= 1)
+    {
+        std::cout << "ERROR: Only vectors can be stored into a range of items, got " << vectorType->toString() << "\n";
+        return false;
+    }
+    if (*arrayType->getItemType() != *getTypeLaneType(vectorType))
+    {
+        std::cout << "ERROR: Cannot store " << vectorType->toString() << " into " << arrayType->toString() << ", the item type must be " << getTypeLaneType(vectorType)->toString() << "\n";
+        return false;
+    }
+    if (arrayType->getByValue() || arrayType->isSoA())
+    {
+        // Value arrays have no address and soa items are not stored together
+        std::cout << "ERROR: Cannot store " << vectorType->toString() << " into " << arrayType->toString() << "\n";
+        return false;
+    }
+
+    llvm::Align align;
+    llvm::Value *llvmVectorPointer = generateVectorItemsPointer(context, arrayValue, llvmStart, llvmEnd, vectorType, &align, "vector.store");
+    context->irBuilder->CreateAlignedStore(vectorValue->getValue(), llvmVectorPointer, align);
+    return true;
+}
+
+// Converts a vector to a value array with the same item count
+TypedValue *generateVectorToArray(GenerationContext *context, TypedValue *vectorValue, Type *targetType)
+{
+    ArrayType *arrayType = static_cast<ArrayType *>(targetType);
+    int lanes = getTypeLanes(vectorValue->getType());
+    if (!arrayType->getByValue() || arrayType->getCount() != lanes || *arrayType->getItemType() != *getTypeLaneType(vectorValue->getType()))
+    {
+        std::cout << "ERROR: Cannot convert " << vectorValue->getType()->toString() << " to " << targetType->toString() << ", only value arrays with the same item type and count are supported\n";
+        return NULL;
+    }
+
+    llvm::Value *llvmArray = llvm::UndefValue::get(arrayType->getLLVMType(context));
+    for (int i = 0; i < lanes; i++)
+    {
+        llvm::Value *llvmItem = context->irBuilder->CreateExtractElement(vectorValue->getValue(), (uint64_t)i, "vector.item");
+        llvmArray = context->irBuilder->CreateInsertValue(llvmArray, llvmItem, (unsigned int)i, "array.set." + std::to_string(i));
+    }
+    return new TypedValue(llvmArray, targetType);
+}
+
+// Generates a horizontal operation over all lanes of a vector (v.sum, v.min, mask.any ...), returns NULL for unknown names
+TypedValue *generateVectorReduction(GenerationContext *context, TypedValue *vectorValue, std::string name)
+{
+    Type *laneType = getTypeLaneType(vectorValue->getType());
+    llvm::Value *llvmVector = vectorValue->getValue();
+
+    if (name == "lanes")
+    {
+        return new TypedValue(llvm::ConstantInt::get(UINT32_TYPE.getLLVMType(context), getTypeLanes(vectorValue->getType()), false), &UINT32_TYPE);
+    }
+
+    llvm::Value *llvmResult = NULL;
+    if (laneType->getTypeCode() == TypeCode::FLOAT)
+    {
+        // Float sums and products are reassociated into a tree, this changes rounding compared to a sequential loop
+        llvm::Type *llvmLaneType = laneType->getLLVMType(context);
+        if (name == "sum")
+        {
+            llvmResult = context->irBuilder->CreateFAddReduce(llvm::ConstantFP::getNegativeZero(llvmLaneType), llvmVector);
+            llvm::cast<llvm::Instruction>(llvmResult)->setHasAllowReassoc(true);
+        }
+        else if (name == "product")
+        {
+            llvmResult = context->irBuilder->CreateFMulReduce(llvm::ConstantFP::get(llvmLaneType, 1.0), llvmVector);
+            llvm::cast<llvm::Instruction>(llvmResult)->setHasAllowReassoc(true);
+        }
+        else if (name == "min")
+        {
+            llvmResult = context->irBuilder->CreateFPMinReduce(llvmVector);
+        }
+        else if (name == "max")
+        {
+            llvmResult = context->irBuilder->CreateFPMaxReduce(llvmVector);
+        }
+    }
+    else
+    {
+        IntegerType *laneIntType = static_cast<IntegerType *>(laneType);
+        if (laneIntType->getBitSize() == 1)
+        {
+            if (name == "all")
+            {
+                llvmResult = context->irBuilder->CreateAndReduce(llvmVector);
+            }
+            else if (name == "any")
+            {
+                llvmResult = context->irBuilder->CreateOrReduce(llvmVector);
+            }
+        }
+        else if (name == "sum")
+        {
+            llvmResult = context->irBuilder->CreateAddReduce(llvmVector);
+        }
+        else if (name == "product")
+        {
+            llvmResult = context->irBuilder->CreateMulReduce(llvmVector);
+        }
+        else if (name == "min")
+        {
+            llvmResult = context->irBuilder->CreateIntMinReduce(llvmVector, laneIntType->getSigned());
+        }
+        else if (name == "max")
+        {
+            llvmResult = context->irBuilder->CreateIntMaxReduce(llvmVector, laneIntType->getSigned());
+        }
+    }
+
+    if (llvmResult == NULL)
+    {
+        return NULL;
+    }
+    return new TypedValue(llvmResult, laneType);
+}
+
+// Applies an operator to two values, the values are juggled to the same type first
+// Used by ASTOperator and for each item of an array expression
+TypedValue *generateBinaryOperator(GenerationContext *context, const Token *operatorToken, TypedValue *left, TypedValue *right)
+{
+    TokenType operatorType = operatorToken->type;
+
+    bool allowTypeJuggling;
+    switch (operatorType)
+    {
+    case TokenType::OPERATOR_DOUBLE_AND:
+    case TokenType::OPERATOR_DOUBLE_OR:
+        allowTypeJuggling = false;
+        break;
+    default:
+        allowTypeJuggling = true;
+        break;
+    }
+
+    if (allowTypeJuggling)
+    {
+        if (!generateTypeJugging(context, &left, &right))
+        {
+            std::cout << "ERROR: Cannot " << operatorToken->value << " values, their types cannot be matched\n";
+            exit(-1);
+
+            return NULL;
+        }
+    }
+    else
+    {
+        if (*left->getType() != *right->getType())
+        {
+            std::cout << "ERROR: Left and right operands must be the same type to perform " << operatorToken->value << "\n";
+            exit(-1);
+
+            return NULL;
+        }
+    }
+
+    auto sharedType = left->getType(); // or right->getType()
+    if (sharedType->getTypeCode() == TypeCode::POINTER)
+    {
+        left = generateDereferenceToValue(context, left);
+        right = generateDereferenceToValue(context, right);
+        sharedType = left->getType(); // or right->getType()
+    }
+
+    auto leftValue = left->getValue();
+    auto rightValue = right->getValue();
+    if (sharedType->getTypeCode() == TypeCode::FLOAT)
+    {
+        FloatType *sharedFloatType = static_cast<FloatType *>(sharedType);
+        Type *resultingType = sharedType;
+        llvm::Value *result;
+
+        switch (operatorType)
+        {
+        case TokenType::OPERATOR_ADDITION:
+            result = context->irBuilder->CreateFAdd(leftValue, rightValue, "opaddfp");
+            break;
+        case TokenType::OPERATOR_SUBSTRACTION:
+            result = context->irBuilder->CreateFSub(leftValue, rightValue, "opsubfp");
+            break;
+        case TokenType::OPERATOR_MULTIPLICATION:
+            result = context->irBuilder->CreateFMul(leftValue, rightValue, "opmulfp");
+            break;
+        case TokenType::OPERATOR_DIVISION:
+            result = context->irBuilder->CreateFDiv(leftValue, rightValue, "opdivfp");
+            break;
+        case TokenType::OPERATOR_PERCENT:
+            result = context->irBuilder->CreateFRem(leftValue, rightValue, "opmodfp");
+            break;
+        case TokenType::OPERATOR_LT:
+            result = context->irBuilder->CreateFCmpULT(leftValue, rightValue, "opcmpltfp");
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_GT:
+            result = context->irBuilder->CreateFCmpUGT(leftValue, rightValue, "opcmpgtfp");
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_LTE:
+            result = context->irBuilder->CreateFCmpULE(leftValue, rightValue, "opcmplefp");
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_GTE:
+            result = context->irBuilder->CreateFCmpUGE(leftValue, rightValue, "opcmpgefp");
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_EQUALS:
+            result = context->irBuilder->CreateFCmpUEQ(leftValue, rightValue, "opcmpeqfp");
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_NOT_EQUALS:
+            result = context->irBuilder->CreateFCmpUNE(leftValue, rightValue, "opcmpnefp");
+            resultingType = &BOOL_TYPE;
+            break;
+
+        case TokenType::OPERATOR_DOUBLE_GT:
+        case TokenType::OPERATOR_DOUBLE_LT:
+        case TokenType::OPERATOR_AND:
+        case TokenType::OPERATOR_OR:
+        case TokenType::OPERATOR_DOUBLE_AND:
+        case TokenType::OPERATOR_DOUBLE_OR:
+        case TokenType::OPERATOR_CARET:
+        default:
+            std::cout << "ERROR: Invalid operator '" << operatorToken->value << "' on floats\n";
+            exit(-1);
+
+            return NULL;
+        }
+
+        if (resultingType == &BOOL_TYPE && sharedFloatType->getLanes() > 1)
+        {
+            // Comparing vectors results in a mask with a bool per lane
+            resultingType = new IntegerType(1, false, sharedFloatType->getLanes());
+        }
+        return new TypedValue(result, resultingType);
+    }
+    else if (sharedType->getTypeCode() == TypeCode::INTEGER)
+    {
+        IntegerType *sharedIntType = static_cast<IntegerType *>(sharedType);
+        Type *resultingType = sharedType;
+        llvm::Value *result;
+
+        switch (operatorType)
+        {
+        case TokenType::OPERATOR_ADDITION:
+            result = context->irBuilder->CreateAdd(leftValue, rightValue, "addint");
+            break;
+        case TokenType::OPERATOR_SUBSTRACTION:
+            result = context->irBuilder->CreateSub(leftValue, rightValue, "opsubint");
+            break;
+        case TokenType::OPERATOR_MULTIPLICATION:
+            result = context->irBuilder->CreateMul(leftValue, rightValue, "opmulint");
+            break;
+        case TokenType::OPERATOR_DIVISION:
+            if (sharedIntType->getSigned())
+            {
+                result = context->irBuilder->CreateSDiv(leftValue, rightValue, "opdivint");
+            }
+            else
+            {
+                result = context->irBuilder->CreateUDiv(leftValue, rightValue, "opdivint");
+            }
+            break;
+        case TokenType::OPERATOR_PERCENT:
+            if (sharedIntType->getSigned())
+            {
+                result = context->irBuilder->CreateSRem(leftValue, rightValue, "opmodint");
+            }
+            else
+            {
+                result = context->irBuilder->CreateURem(leftValue, rightValue, "opmodint");
+            }
+            break;
+        case TokenType::OPERATOR_LT:
+            if (sharedIntType->getSigned())
+            {
+                result = context->irBuilder->CreateICmpSLT(leftValue, rightValue, "opcmpltint");
+            }
+            else
+            {
+                result = context->irBuilder->CreateICmpULT(leftValue, rightValue, "opcmpltint");
+            }
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_GT:
+            if (sharedIntType->getSigned())
+            {
+                result = context->irBuilder->CreateICmpSGT(leftValue, rightValue, "opcmpgtint");
+            }
+            else
+            {
+                result = context->irBuilder->CreateICmpUGT(leftValue, rightValue, "opcmpgtint");
+            }
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_LTE:
+            if (sharedIntType->getSigned())
+            {
+                result = context->irBuilder->CreateICmpSLE(leftValue, rightValue, "opcmpleint");
+            }
+            else
+            {
+                result = context->irBuilder->CreateICmpULE(leftValue, rightValue, "opcmpleint");
+            }
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_GTE:
+            if (sharedIntType->getSigned())
+            {
+                result = context->irBuilder->CreateICmpSGE(leftValue, rightValue, "opcmpgeint");
+            }
+            else
+            {
+                result = context->irBuilder->CreateICmpUGE(leftValue, rightValue, "opcmpgeint");
+            }
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_EQUALS:
+            result = context->irBuilder->CreateICmpEQ(leftValue, rightValue, "opcmpeqint");
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_NOT_EQUALS:
+            result = context->irBuilder->CreateICmpNE(leftValue, rightValue, "opcmpneint");
+            resultingType = &BOOL_TYPE;
+            break;
+        case TokenType::OPERATOR_DOUBLE_GT:
+            // TODO: ashr instruction
+            result = context->irBuilder->CreateLShr(leftValue, rightValue, "oplshrint");
+            break;
+        case TokenType::OPERATOR_DOUBLE_LT:
+            result = context->irBuilder->CreateShl(leftValue, rightValue, "opshlint");
+            break;
+        case TokenType::OPERATOR_DOUBLE_AND:
+        {
+            IntegerType *leftIntegerType = static_cast<IntegerType *>(left->getType());
+            IntegerType *rightIntegerType = static_cast<IntegerType *>(right->getType());
+            if (leftIntegerType->getBitSize() != 1 || rightIntegerType->getBitSize() != 1)
+            {
+                std::cout << "ERROR: Logical and operator can only be used on booleans\n";
+                exit(-1);
+
+                return NULL;
+            }
+            result = context->irBuilder->CreateAnd(leftValue, rightValue, "opandint");
+            break;
+        }
+        case TokenType::OPERATOR_DOUBLE_OR:
+        {
+            IntegerType *leftIntegerType = static_cast<IntegerType *>(left->getType());
+            IntegerType *rightIntegerType = static_cast<IntegerType *>(right->getType());
+            if (leftIntegerType->getBitSize() != 1 || rightIntegerType->getBitSize() != 1)
+            {
+                std::cout << "ERROR: Logical or operator can only be used on booleans\n";
+                exit(-1);
+
+                return NULL;
+            }
+            result = context->irBuilder->CreateOr(leftValue, rightValue, "oporint");
+            break;
+        }
+        case TokenType::OPERATOR_AND:
+            result = context->irBuilder->CreateAnd(leftValue, rightValue, "opandint");
+            break;
+        case TokenType::OPERATOR_OR:
+            result = context->irBuilder->CreateOr(leftValue, rightValue, "oporint");
+            break;
+        case TokenType::OPERATOR_CARET:
+            result = context->irBuilder->CreateXor(leftValue, rightValue, "opxorint");
+            break;
+
+        default:
+            std::cout << "ERROR: Invalid operator '" << operatorToken->value << "' on integers\n";
+            exit(-1);
+
+            return NULL;
+        }
+
+        if (resultingType == &BOOL_TYPE && sharedIntType->getLanes() > 1)
+        {
+            // Comparing vectors results in a mask with a bool per lane
+            resultingType = new IntegerType(1, false, sharedIntType->getLanes());
+        }
+        return new TypedValue(result, resultingType);
+    }
+    else
+    {
+        std::cout << "ERROR: Cannot " << operatorToken->value << " values, the type does not support this operator\n";
+        exit(-1);
+
+        return NULL;
+    }
+
+}
+
+// Stores the segments of an array literal into its storage ({ refcount, [n x T] } when managed, [n x T] otherwise)
+// Repeated segments become a memset or a fill loop and long constant literals are copied from a constant global,
+// so the amount of generated code does not depend on the item count
+void generateArrayLiteralFill(GenerationContext *context, llvm::Type *llvmStorageType, llvm::Value *llvmStoragePointer, bool managed, std::vector<TypedValue *> &segmentValues, std::vector<uint64_t> &segmentTimes)
+{
+    llvm::Type *llvmIndexType = ArrayType::getLLVMLengthFieldType(context);
+    auto generateItemPointer = [&](llvm::Value *llvmIndex, std::string twine)
+    {
+        std::vector<llvm::Value *> indices;
+        indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
+        if (managed)
+        {
+            indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 1, false));
+        }
+        indices.push_back(llvmIndex);
+        return context->irBuilder->CreateGEP(llvmStorageType, llvmStoragePointer, indices, twine + ".gep");
+    };
+
+    uint64_t itemCount = 0;
+    bool allConstant = true;
+    bool hasRepeatedSegment = false;
+    for (int i = 0; i < segmentValues.size(); i++)
+    {
+        itemCount += segmentTimes[i];
+        allConstant &= llvm::isa<llvm::Constant>(segmentValues[i]->getValue());
+        hasRepeatedSegment |= segmentTimes[i] > arrayLiteralUnrollLimit;
+    }
+
+    llvm::Type *llvmItemType = segmentValues[0]->getType()->getLLVMType(context);
+    if (allConstant && !hasRepeatedSegment && itemCount > arrayLiteralUnrollLimit)
+    {
+        llvm::ArrayType *llvmConstantArrayType = llvm::ArrayType::get(llvmItemType, itemCount);
+        std::vector<llvm::Constant *> llvmConstantItems;
+        for (int i = 0; i < segmentValues.size(); i++)
+        {
+            llvmConstantItems.insert(llvmConstantItems.end(), segmentTimes[i], llvm::cast<llvm::Constant>(segmentValues[i]->getValue()));
+        }
+        llvm::GlobalVariable *llvmGlobal = new llvm::GlobalVariable(*context->module, llvmConstantArrayType, true, llvm::GlobalValue::PrivateLinkage, llvm::ConstantArray::get(llvmConstantArrayType, llvmConstantItems), "array.literal");
+        llvmGlobal->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+
+        llvm::Value *llvmFirstItemPointer = generateItemPointer(llvm::ConstantInt::get(llvmIndexType, 0, false), "array.copy");
+        context->irBuilder->CreateMemCpy(llvmFirstItemPointer, llvm::MaybeAlign(), llvmGlobal, llvm::MaybeAlign(), generateSizeOf(context, llvmConstantArrayType, "array.copy"));
+        return;
+    }
+
+    uint64_t offset = 0;
+    for (int i = 0; i < segmentValues.size(); i++)
+    {
+        llvm::Value *llvmValue = segmentValues[i]->getValue();
+        uint64_t times = segmentTimes[i];
+        if (times <= arrayLiteralUnrollLimit)
+        {
+            for (uint64_t j = 0; j < times; j++, offset++)
+            {
+                auto llvmArrayItemPtr = generateItemPointer(llvm::ConstantInt::get(llvmIndexType, offset, false), "array.set." + std::to_string(offset));
+                context->irBuilder->CreateStore(llvmValue, llvmArrayItemPtr, false);
+            }
+            continue;
+        }
+
+        llvm::Value *llvmSegmentStart = generateItemPointer(llvm::ConstantInt::get(llvmIndexType, offset, false), "array.fill");
+
+        // Zero and other values that consist of the same byte repeated (like 0xFFFFFFFF) are filled with memset
+        llvm::Value *llvmByte = llvm::isa<llvm::Constant>(llvmValue) ? llvm::isBytewiseValue(llvmValue, context->module->getDataLayout()) : NULL;
+        if (llvmByte != NULL && llvm::isa<llvm::ConstantInt>(llvmByte))
+        {
+            llvm::Value *llvmSize = context->irBuilder->CreateMul(generateSizeOf(context, llvmItemType, "array.fill"), llvm::ConstantInt::get(llvmIndexType, times, false), "array.fill.size");
+            context->irBuilder->CreateMemSet(llvmSegmentStart, llvmByte, llvmSize, llvm::MaybeAlign());
+            offset += times;
+            continue;
+        }
+
+        llvm::Function *parentFunction = context->irBuilder->GetInsertBlock()->getParent();
+        llvm::BasicBlock *loopBlock = llvm::BasicBlock::Create(*context->context, "array.fill.loop", parentFunction);
+        llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "array.fill.cont", parentFunction);
+        llvm::AllocaInst *llvmIndexPointer = generateAllocaInCurrentFunction(context, llvmIndexType, "array.fill.index");
+        context->irBuilder->CreateStore(llvm::ConstantInt::get(llvmIndexType, offset, false), llvmIndexPointer);
+        context->irBuilder->CreateBr(loopBlock);
+
+        context->irBuilder->SetInsertPoint(loopBlock);
+        llvm::Value *llvmIndex = context->irBuilder->CreateLoad(llvmIndexType, llvmIndexPointer, "array.fill.index.load");
+        context->irBuilder->CreateStore(llvmValue, generateItemPointer(llvmIndex, "array.fill.item"), false);
+        llvm::Value *llvmNextIndex = context->irBuilder->CreateAdd(llvmIndex, llvm::ConstantInt::get(llvmIndexType, 1), "array.fill.index.next", true, true);
+        context->irBuilder->CreateStore(llvmNextIndex, llvmIndexPointer);
+        llvm::Value *llvmLoopCondition = context->irBuilder->CreateICmpULT(llvmNextIndex, llvm::ConstantInt::get(llvmIndexType, offset + times, false), "array.fill.cond");
+        llvm::BranchInst *llvmLatch = context->irBuilder->CreateCondBr(llvmLoopCondition, loopBlock, continueBlock);
+        llvmLatch->setMetadata(llvm::LLVMContext::MD_loop, generateLoopMetadata(context, 0, 0));
+
+        context->irBuilder->SetInsertPoint(continueBlock);
+        offset += times;
+    }
+}
+
+// Arrays in whole-array expressions are processed this many bits at a time, wider vectors are split by the backend
+const int arrayExpressionVectorBits = 256;
+
+// Allocates a managed array with a length only known at runtime, the items are not initialized
+TypedValue *generateArrayAllocation(GenerationContext *context, Type *itemType, llvm::Value *llvmLength, std::string twine, uint64_t align)
+{
+    ArrayType *arrayType = new ArrayType(itemType, false, true, false, align);
+    llvm::Type *llvmStorageType = arrayType->getArrayPointerType()->getLLVMPointedType(context);
+
+    // The size of { refcount, [0 x T] } with length items is the offset of the item after the last one
+    std::vector<llvm::Value *> indices;
+    indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
+    indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 1, false));
+    indices.push_back(llvmLength);
+    llvm::Value *llvmEndPointer = context->irBuilder->CreateGEP(llvmStorageType, llvm::ConstantPointerNull::get(llvmStorageType->getPointerTo()), indices, twine + ".sizeof");
+    llvm::Value *llvmSize = context->irBuilder->CreatePtrToInt(llvmEndPointer, llvm::Type::getInt64Ty(*context->context), twine + ".sizeof.int");
+
+    llvm::Value *llvmStoragePointer = generateArrayStorageMalloc(context, arrayType, llvmStorageType, llvmSize, twine);
+
+    std::vector<llvm::Value *> refCountIndices;
+    refCountIndices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
+    refCountIndices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
+    llvm::Value *llvmRefCountPointer = context->irBuilder->CreateGEP(llvmStorageType, llvmStoragePointer, refCountIndices, twine + ".ref");
+    context->irBuilder->CreateStore(llvm::ConstantInt::get(getRefCountType(*context->context), 1, false), llvmRefCountPointer, false);
+
+    llvm::Value *llvmLengthStruct = llvm::UndefValue::get(arrayType->getLLVMLengthStructType(context));
+    llvmLengthStruct = context->irBuilder->CreateInsertValue(llvmLengthStruct, llvmLength, 0, twine + ".length");
+    llvmLengthStruct = context->irBuilder->CreateInsertValue(llvmLengthStruct, llvmStoragePointer, 1, twine + ".sized");
+    return new TypedValue(llvmLengthStruct, arrayType);
+}
+
+// Copies the array stored at arrayPointer to a new allocation if it is a constant literal (immortal header), other values are ignored
+// Must be called before the array is written through arrayPointer, only that reference gets the copy, others keep the constant items
+void generateArrayUnshare(GenerationContext *context, TypedValue *arrayPointer)
+{
+    if (arrayPointer->getTypeCode() != TypeCode::POINTER)
+    {
+        return;
+    }
+    Type *pointedType = static_cast<PointerType *>(arrayPointer->getType())->getPointedType();
+    if (pointedType == NULL || pointedType->getTypeCode() != TypeCode::ARRAY)
+    {
+        return;
+    }
+    ArrayType *arrayType = static_cast<ArrayType *>(pointedType);
+    if (arrayType->isSlice())
+    {
+        generateSliceUnshare(context, arrayPointer);
+        return;
+    }
+    if (!arrayType->getManaged() || arrayType->getByValue() || arrayType->isSoA() || arrayType->isGrowable())
+    {
+        return;
+    }
+
+    TypedValue *arrayValue = generateLoad(context, arrayPointer);
+    llvm::Value *llvmLength;
+    llvm::Value *llvmStorage = generateArrayStoragePointer(context, arrayValue, &llvmLength);
+    llvm::Value *llvmRefCountPointer = context->irBuilder->CreateStructGEP(arrayType->getArrayPointerType()->getLLVMPointedType(context), llvmStorage, 0, "array.unshare.ref.ptr");
+    llvm::Value *llvmRefCount = context->irBuilder->CreateLoad(getRefCountType(*context->context), llvmRefCountPointer, "array.unshare.ref");
+    llvm::Value *llvmIsImmortal = context->irBuilder->CreateICmpSLT(llvmRefCount, llvm::ConstantInt::get(getRefCountType(*context->context), 0, true), "array.unshare.immortal");
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *copyBlock = llvm::BasicBlock::Create(*context->context, "array.unshare.copy", currentFunction);
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "array.unshare.cont", currentFunction);
+    llvm::MDNode *llvmUnlikelyWeights = llvm::MDBuilder(*context->context).createBranchWeights(1, 1 << 20);
+    context->irBuilder->CreateCondBr(llvmIsImmortal, copyBlock, continueBlock, llvmUnlikelyWeights);
+
+    context->irBuilder->SetInsertPoint(copyBlock);
+    TypedValue *copiedArray = generateArrayAllocation(context, arrayType->getItemType(), llvmLength, "array.unshare", arrayType->getAlign());
+    llvm::Value *llvmUnusedLength;
+    llvm::Value *llvmCopiedStorage = generateArrayStoragePointer(context, copiedArray, &llvmUnusedLength);
+    llvm::Value *llvmFirstItem = generateArrayItemPointer(context, arrayType, llvmStorage, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false), "array.unshare.source");
+    llvm::Value *llvmCopiedFirstItem = generateArrayItemPointer(context, static_cast<ArrayType *>(copiedArray->getType()), llvmCopiedStorage, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false), "array.unshare.target");
+    llvm::Value *llvmSize = context->irBuilder->CreateMul(generateSizeOf(context, arrayType->getItemType()->getLLVMType(context), "array.unshare"), llvmLength, "array.unshare.size");
+    context->irBuilder->CreateMemCpy(llvmCopiedFirstItem, llvm::MaybeAlign(), llvmFirstItem, llvm::MaybeAlign(), llvmSize);
+
+    llvm::Value *llvmCastedStorage = context->irBuilder->CreateBitCast(llvmCopiedStorage, arrayType->getLLVMArrayPointerType(context), "array.unshare.ptr");
+    llvm::Value *llvmCopiedValue = context->irBuilder->CreateInsertValue(arrayValue->getValue(), llvmCastedStorage, 1, "array.unshare.value");
+    context->irBuilder->CreateStore(llvmCopiedValue, arrayPointer->getValue());
+    context->irBuilder->CreateBr(continueBlock);
+
+    context->irBuilder->SetInsertPoint(continueBlock);
+}
+
+// Builds a slice value, llvmOwner points to the reference count of the managed array that owns the items or is null
+static TypedValue *generateSliceValue(GenerationContext *context, ArrayType *sliceType, llvm::Value *llvmLength, llvm::Value *llvmItems, llvm::Value *llvmOwner)
+{
+    llvm::Value *llvmSlice = llvm::UndefValue::get(sliceType->getLLVMType(context));
+    llvmSlice = context->irBuilder->CreateInsertValue(llvmSlice, llvmLength, 0, "slice.length");
+    llvmSlice = context->irBuilder->CreateInsertValue(llvmSlice, llvmItems, 1, "slice.items");
+    llvmSlice = context->irBuilder->CreateInsertValue(llvmSlice, llvmOwner, 2, "slice.owner");
+    return new TypedValue(llvmSlice, sliceType);
+}
+
+// Returns a slice of the items in [llvmStart, llvmEnd) of an array without copying them, a NULL bound means the start or end of the array
+// The slice points to the header of the managed array that owns the items, managed arrays are never freed, so the owner stays alive
+// as long as the slice does, and its reference count tells whether the items are a constant literal (see generateSliceUnshare)
+TypedValue *generateArraySlice(GenerationContext *context, TypedValue *arrayValue, llvm::Value *llvmStart, llvm::Value *llvmEnd)
+{
+    assert(arrayValue->getTypeCode() == TypeCode::ARRAY);
+    ArrayType *arrayType = static_cast<ArrayType *>(arrayValue->getType());
+    if (arrayType->getByValue() || arrayType->isSoA() || arrayType->isGrowable())
+    {
+        // Value arrays have no address, soa items are not stored together and growable array items move when they grow
+        std::cout << "ERROR: Cannot slice " << arrayType->toString() << "\n";
+        return NULL;
+    }
+    ArrayType *sliceType = new ArrayType(arrayType->getItemType(), false, false, false, 0, false, true);
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+
+    llvm::Value *llvmLength;
+    llvm::Value *llvmStorage = generateArrayStoragePointer(context, arrayValue, &llvmLength);
+    if (llvmLength == NULL)
+    {
+        std::cout << "ERROR: Cannot slice " << arrayType->toString() << ", its length is unknown\n";
+        return NULL;
+    }
+
+    llvm::Value *llvmItems;
+    llvm::Value *llvmOwner;
+    if (arrayType->isSlice())
+    {
+        llvmItems = llvmStorage;
+        llvmOwner = context->irBuilder->CreateExtractValue(arrayValue->getValue(), 2, "slice.owner");
+    }
+    else
+    {
+        llvmItems = generateArrayItemPointer(context, arrayType, llvmStorage, llvm::ConstantInt::get(llvmLengthType, 0, false), "slice.items");
+        if (arrayType->getManaged())
+        {
+            llvmOwner = context->irBuilder->CreateStructGEP(arrayType->getArrayPointerType()->getLLVMPointedType(context), llvmStorage, 0, "slice.owner");
+        }
+        else
+        {
+            llvmOwner = llvm::ConstantPointerNull::get(getRefCountType(*context->context)->getPointerTo());
+        }
+    }
+
+    if (llvmStart == NULL && llvmEnd == NULL)
+    {
+        return generateSliceValue(context, sliceType, llvmLength, llvmItems, llvmOwner);
+    }
+    if (llvmStart == NULL)
+    {
+        llvmStart = llvm::ConstantInt::get(llvmLengthType, 0, false);
+    }
+    if (llvmEnd == NULL)
+    {
+        llvmEnd = llvmLength;
+    }
+
+    llvm::ConstantInt *llvmConstantStart = llvm::dyn_cast<llvm::ConstantInt>(llvmStart);
+    llvm::ConstantInt *llvmConstantEnd = llvm::dyn_cast<llvm::ConstantInt>(llvmEnd);
+    llvm::ConstantInt *llvmConstantLength = llvm::dyn_cast<llvm::ConstantInt>(llvmLength);
+    if (llvmConstantStart != NULL && llvmConstantEnd != NULL && llvmConstantLength != NULL && (llvmConstantStart->getValue().ugt(llvmConstantEnd->getValue()) || llvmConstantEnd->getValue().ugt(llvmConstantLength->getValue())))
+    {
+        std::cout << "ERROR: Slice " << llvmConstantStart->getSExtValue() << ".." << llvmConstantEnd->getSExtValue() << " is out of bounds (length " << llvmConstantLength->getZExtValue() << ")\n";
+        exit(-1);
+    }
+
+    // 0 <= start <= end <= length
+    generateBoundsCheck(context, llvmEnd, context->irBuilder->CreateAdd(llvmLength, llvm::ConstantInt::get(llvmLengthType, 1, false), "slice.end.limit"), "slice.end");
+    generateBoundsCheck(context, llvmStart, context->irBuilder->CreateAdd(llvmEnd, llvm::ConstantInt::get(llvmLengthType, 1, false), "slice.start.limit"), "slice.start");
+
+    llvm::Value *llvmSliceItems = context->irBuilder->CreateInBoundsGEP(arrayType->getItemType()->getLLVMType(context), llvmItems, llvmStart, "slice.start.items");
+    llvm::Value *llvmSliceLength = context->irBuilder->CreateSub(llvmEnd, llvmStart, "slice.length", true, true);
+    return generateSliceValue(context, sliceType, llvmSliceLength, llvmSliceItems, llvmOwner);
+}
+
+// Copies the items of the slice stored at slicePointer to a new managed array if they belong to a constant literal (immortal header)
+// Like generateArrayUnshare, it must be called before the items are mutated, the literal and other slices of it are not changed
+void generateSliceUnshare(GenerationContext *context, TypedValue *slicePointer)
+{
+    PointerType *slicePointerType = static_cast<PointerType *>(slicePointer->getType());
+    ArrayType *sliceType = static_cast<ArrayType *>(slicePointerType->getPointedType());
+
+    TypedValue *sliceValue = generateLoad(context, slicePointer);
+    llvm::Value *llvmLength;
+    llvm::Value *llvmItems = generateArrayStoragePointer(context, sliceValue, &llvmLength);
+    llvm::Value *llvmOwner = context->irBuilder->CreateExtractValue(sliceValue->getValue(), 2, "slice.unshare.owner");
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *ownedBlock = llvm::BasicBlock::Create(*context->context, "slice.unshare.owned", currentFunction);
+    llvm::BasicBlock *copyBlock = llvm::BasicBlock::Create(*context->context, "slice.unshare.copy", currentFunction);
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "slice.unshare.cont", currentFunction);
+    llvm::MDNode *llvmUnlikelyWeights = llvm::MDBuilder(*context->context).createBranchWeights(1, 1 << 20);
+
+    // Slices of unmanaged arrays have no owner
+    llvm::Value *llvmHasOwner = context->irBuilder->CreateIsNotNull(llvmOwner, "slice.unshare.hasowner");
+    context->irBuilder->CreateCondBr(llvmHasOwner, ownedBlock, continueBlock);
+
+    context->irBuilder->SetInsertPoint(ownedBlock);
+    llvm::Value *llvmRefCount = context->irBuilder->CreateLoad(getRefCountType(*context->context), llvmOwner, "slice.unshare.ref");
+    llvm::Value *llvmIsImmortal = context->irBuilder->CreateICmpSLT(llvmRefCount, llvm::ConstantInt::get(getRefCountType(*context->context), 0, true), "slice.unshare.immortal");
+    context->irBuilder->CreateCondBr(llvmIsImmortal, copyBlock, continueBlock, llvmUnlikelyWeights);
+
+    context->irBuilder->SetInsertPoint(copyBlock);
+    TypedValue *copiedArray = generateArrayAllocation(context, sliceType->getItemType(), llvmLength, "slice.unshare");
+    llvm::Value *llvmSize = context->irBuilder->CreateMul(generateSizeOf(context, sliceType->getItemType()->getLLVMType(context), "slice.unshare"), llvmLength, "slice.unshare.size");
+    TypedValue *copiedSlice = generateArraySlice(context, copiedArray, NULL, NULL);
+    llvm::Value *llvmUnusedLength;
+    llvm::Value *llvmCopiedItems = generateArrayStoragePointer(context, copiedSlice, &llvmUnusedLength);
+    context->irBuilder->CreateMemCpy(llvmCopiedItems, llvm::MaybeAlign(), llvmItems, llvm::MaybeAlign(), llvmSize);
+    context->irBuilder->CreateStore(copiedSlice->getValue(), slicePointer->getValue());
+    context->irBuilder->CreateBr(continueBlock);
+
+    context->irBuilder->SetInsertPoint(continueBlock);
+}
+
+// Packs size bytes of text starting at offset into an integer, in the byte order of the target
+static llvm::Constant *getStringBytesConstant(GenerationContext *context, const std::string &text, uint64_t offset, unsigned int size)
+{
+    bool isLittleEndian = context->module->getDataLayout().isLittleEndian();
+    llvm::APInt bytes(size * 8, 0);
+    for (unsigned int i = 0; i < size && offset + i < text.size(); i++)
+    {
+        unsigned int byteIndex = isLittleEndian ? i : size - 1 - i;
+        bytes.insertBits((uint64_t)(uint8_t)text[offset + i], byteIndex * 8, 8);
+    }
+    return llvm::ConstantInt::get(*context->context, bytes);
+}
+
+// Returns a constant String, short strings are stored inline and longer ones point to bytes in read-only data
+// behind an immortal reference count (like the heap bytes of a String), so using a literal does not allocate
+TypedValue *generateStringLiteral(GenerationContext *context, std::string text)
+{
+    llvm::StructType *llvmStringType = llvm::cast<llvm::StructType>(STRING_TYPE.getLLVMType(context));
+    llvm::Type *llvmByteType = llvm::Type::getInt8Ty(*context->context);
+
+    std::vector<llvm::Constant *> llvmFields;
+    if (text.size() <= stringInlineCapacity)
+    {
+        // The inline bytes cover the pointer, length and padding fields
+        llvmFields.push_back(llvm::ConstantExpr::getIntToPtr(getStringBytesConstant(context, text, 0, 8), llvmStringType->getElementType(0)));
+        llvmFields.push_back(getStringBytesConstant(context, text, 8, 8));
+        std::vector<llvm::Constant *> llvmPaddingBytes;
+        for (uint64_t i = 16; i < stringInlineCapacity; i++)
+        {
+            llvmPaddingBytes.push_back(llvm::ConstantInt::get(llvmByteType, i < text.size() ? (uint64_t)(uint8_t)text[i] : 0, false));
+        }
+        llvmFields.push_back(llvm::ConstantArray::get(llvm::cast<llvm::ArrayType>(llvmStringType->getElementType(2)), llvmPaddingBytes));
+        llvmFields.push_back(llvm::ConstantInt::get(llvmByteType, stringInlineCapacity - text.size(), false));
+    }
+    else
+    {
+        std::vector<llvm::Constant *> llvmStorageFields;
+        llvmStorageFields.push_back(llvm::ConstantInt::get(getRefCountType(*context->context), immortalRefCount, true));
+        llvmStorageFields.push_back(llvm::ConstantDataArray::getString(*context->context, text, false));
+        llvm::Constant *llvmStorage = llvm::ConstantStruct::getAnon(*context->context, llvmStorageFields, false);
+        llvm::GlobalVariable *llvmGlobal = new llvm::GlobalVariable(*context->module, llvmStorage->getType(), true, llvm::GlobalValue::PrivateLinkage, llvmStorage, "str");
+        llvmGlobal->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+
+        std::vector<llvm::Constant *> llvmIndices;
+        llvmIndices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
+        llvmIndices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 1, false));
+        llvmIndices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
+        llvmFields.push_back(llvm::ConstantExpr::getInBoundsGetElementPtr(llvmStorage->getType(), llvmGlobal, llvmIndices));
+        llvmFields.push_back(llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), text.size(), false));
+        llvmFields.push_back(llvm::ConstantAggregateZero::get(llvmStringType->getElementType(2)));
+        llvmFields.push_back(llvm::ConstantInt::get(llvmByteType, stringHeapTag, false));
+    }
+    return new TypedValue(llvm::ConstantStruct::get(llvmStringType, llvmFields), &STRING_TYPE);
+}
+
+// Returns a pointer to a String, a String value that is not stored in a variable is stored in a temporary
+// Returns NULL when the value is not a String
+TypedValue *generateStringToPointer(GenerationContext *context, TypedValue *stringValue)
+{
+    Type *dereferencedType = stringValue->getType();
+    while (dereferencedType->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(dereferencedType)->getPointedType() != NULL)
+    {
+        dereferencedType = static_cast<PointerType *>(dereferencedType)->getPointedType();
+    }
+    if (dereferencedType->getTypeCode() != TypeCode::STRING)
+    {
+        return NULL;
+    }
+    if (stringValue->getTypeCode() == TypeCode::POINTER)
+    {
+        return generateDereferenceToPointer(context, stringValue);
+    }
+
+    llvm::Value *llvmStringPointer = generateAllocaInCurrentFunction(context, STRING_TYPE.getLLVMType(context), "string.temp");
+    context->irBuilder->CreateStore(stringValue->getValue(), llvmStringPointer);
+    return new TypedValue(llvmStringPointer, STRING_TYPE.getUnmanagedPointerToType());
+}
+
+// Returns a pointer to the first byte of the String at stringPointer and sets its length in bytes, without branching on the tag
+// The bytes of an inline string are inside the String and heap bytes are freed with the last String that uses them,
+// so the pointer is only valid as long as the String is
+llvm::Value *generateStringBytes(GenerationContext *context, TypedValue *stringPointer, llvm::Value **llvmLengthOut)
+{
+    llvm::Type *llvmStringType = STRING_TYPE.getLLVMType(context);
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    llvm::Value *llvmStringPointer = stringPointer->getValue();
+
+    llvm::Value *llvmTag = context->irBuilder->CreateLoad(llvm::Type::getInt8Ty(*context->context), context->irBuilder->CreateStructGEP(llvmStringType, llvmStringPointer, 3, "string.tag.ptr"), "string.tag");
+    llvm::Value *llvmIsHeap = context->irBuilder->CreateICmpEQ(llvmTag, llvm::ConstantInt::get(llvmTag->getType(), stringHeapTag, false), "string.isheap");
+
+    llvm::Value *llvmHeapBytes = context->irBuilder->CreateLoad(llvm::Type::getInt8PtrTy(*context->context), context->irBuilder->CreateStructGEP(llvmStringType, llvmStringPointer, 0, "string.bytes.ptr"), "string.heap.bytes");
+    llvm::Value *llvmHeapLength = context->irBuilder->CreateLoad(llvmLengthType, context->irBuilder->CreateStructGEP(llvmStringType, llvmStringPointer, 1, "string.length.ptr"), "string.heap.length");
+    llvm::Value *llvmInlineBytes = context->irBuilder->CreateBitCast(llvmStringPointer, llvm::Type::getInt8PtrTy(*context->context), "string.inline.bytes");
+    llvm::Value *llvmInlineLength = context->irBuilder->CreateSub(llvm::ConstantInt::get(llvmLengthType, stringInlineCapacity, false), context->irBuilder->CreateZExt(llvmTag, llvmLengthType, "string.tag.ext"), "string.inline.length");
+
+    *llvmLengthOut = context->irBuilder->CreateSelect(llvmIsHeap, llvmHeapLength, llvmInlineLength, "string.length");
+    return context->irBuilder->CreateSelect(llvmIsHeap, llvmHeapBytes, llvmInlineBytes, "string.bytes");
+}
+
+// Returns the length in bytes of a String value
+llvm::Value *generateStringLength(GenerationContext *context, TypedValue *stringValue)
+{
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    llvm::Value *llvmTag = context->irBuilder->CreateExtractValue(stringValue->getValue(), 3, "string.tag");
+    llvm::Value *llvmIsHeap = context->irBuilder->CreateICmpEQ(llvmTag, llvm::ConstantInt::get(llvmTag->getType(), stringHeapTag, false), "string.isheap");
+    llvm::Value *llvmHeapLength = context->irBuilder->CreateExtractValue(stringValue->getValue(), 1, "string.heap.length");
+    llvm::Value *llvmInlineLength = context->irBuilder->CreateSub(llvm::ConstantInt::get(llvmLengthType, stringInlineCapacity, false), context->irBuilder->CreateZExt(llvmTag, llvmLengthType, "string.tag.ext"), "string.inline.length");
+    return context->irBuilder->CreateSelect(llvmIsHeap, llvmHeapLength, llvmInlineLength, "string.length");
+}
+
+// Returns the owner of slices that point into a String, an immortal reference count, so the bytes are copied before they are written through the slice
+static llvm::Constant *getStringSliceOwner(GenerationContext *context)
+{
+    llvm::GlobalVariable *llvmOwner = context->module->getNamedGlobal("string.owner");
+    if (llvmOwner == NULL)
+    {
+        llvmOwner = new llvm::GlobalVariable(*context->module, getRefCountType(*context->context), true, llvm::GlobalValue::PrivateLinkage, llvm::ConstantInt::get(getRefCountType(*context->context), immortalRefCount, true), "string.owner");
+    }
+    return llvmOwner;
+}
+
+// Returns a [UInt8 ..] slice of the bytes in [llvmStart, llvmEnd) of the String at stringPointer, a NULL bound means the start or end
+// The bytes of an inline string are inside the String, so a slice that can outlive it (copy) gets its own copy of the sliced bytes in a new managed array,
+// otherwise the slice points into the String and must only be used while it is alive (like the operands of a byte kernel)
+TypedValue *generateStringSlice(GenerationContext *context, TypedValue *stringPointer, llvm::Value *llvmStart, llvm::Value *llvmEnd, bool copy)
+{
+    llvm::Value *llvmLength;
+    llvm::Value *llvmBytes = generateStringBytes(context, stringPointer, &llvmLength);
+    ArrayType *sliceType = new ArrayType(&BYTE_TYPE, false, false, false, 0, false, true);
+    TypedValue *bytesSlice = generateSliceValue(context, sliceType, llvmLength, llvmBytes, getStringSliceOwner(context));
+    if (llvmStart != NULL || llvmEnd != NULL)
+    {
+        bytesSlice = generateArraySlice(context, bytesSlice, llvmStart, llvmEnd);
+    }
+    if (!copy || bytesSlice == NULL)
+    {
+        return bytesSlice;
+    }
+
+    llvm::Value *llvmSliceLength;
+    llvm::Value *llvmSliceBytes = generateArrayStoragePointer(context, bytesSlice, &llvmSliceLength);
+    TypedValue *copiedArray = generateArrayAllocation(context, &BYTE_TYPE, llvmSliceLength, "string.slice");
+    llvm::Value *llvmUnusedLength;
+    llvm::Value *llvmCopiedStorage = generateArrayStoragePointer(context, copiedArray, &llvmUnusedLength);
+    llvm::Value *llvmCopiedBytes = generateArrayItemPointer(context, static_cast<ArrayType *>(copiedArray->getType()), llvmCopiedStorage, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false), "string.slice.target");
+    context->irBuilder->CreateMemCpy(llvmCopiedBytes, llvm::MaybeAlign(1), llvmSliceBytes, llvm::MaybeAlign(1), llvmSliceLength);
+    return generateArraySlice(context, copiedArray, NULL, NULL);
+}
+
+// Concatenates Strings with a single allocation of their total length, no allocation is done when the result fits inline
+// Parts that are String values (not pointers to a String) are owned by the concatenation and released once they are copied
+TypedValue *generateStringConcatenation(GenerationContext *context, std::vector<TypedValue *> &parts)
+{
+    llvm::Type *llvmStringType = STRING_TYPE.getLLVMType(context);
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    llvm::Type *llvmByteType = llvm::Type::getInt8Ty(*context->context);
+
+    std::vector<llvm::Value *> llvmPartBytes;
+    std::vector<llvm::Value *> llvmPartLengths;
+    llvm::Value *llvmTotalLength = llvm::ConstantInt::get(llvmLengthType, 0, false);
+    for (TypedValue *part : parts)
+    {
+        TypedValue *partPointer = generateStringToPointer(context, part);
+        if (partPointer == NULL)
+        {
+            std::cout << "ERROR: Cannot concatenate " << part->getType()->toString() << " to String\n";
+            return NULL;
+        }
+        llvm::Value *llvmPartLength;
+        llvmPartBytes.push_back(generateStringBytes(context, partPointer, &llvmPartLength));
+        llvmPartLengths.push_back(llvmPartLength);
+        llvmTotalLength = context->irBuilder->CreateAdd(llvmTotalLength, llvmPartLength, "string.concat.length", true, true);
+    }
+
+    // The unused inline bytes are zero
+    llvm::Value *llvmResultPointer = generateAllocaInCurrentFunction(context, llvmStringType, "string.concat");
+    context->irBuilder->CreateStore(llvm::Constant::getNullValue(llvmStringType), llvmResultPointer);
+    llvm::Value *llvmInlineBytes = context->irBuilder->CreateBitCast(llvmResultPointer, llvm::Type::getInt8PtrTy(*context->context), "string.concat.inline.bytes");
+    llvm::Value *llvmTagPointer = context->irBuilder->CreateStructGEP(llvmStringType, llvmResultPointer, 3, "string.concat.tag.ptr");
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *inlineBlock = llvm::BasicBlock::Create(*context->context, "string.concat.inline", currentFunction);
+    llvm::BasicBlock *heapBlock = llvm::BasicBlock::Create(*context->context, "string.concat.heap", currentFunction);
+    llvm::BasicBlock *copyBlock = llvm::BasicBlock::Create(*context->context, "string.concat.copy", currentFunction);
+    llvm::Value *llvmFitsInline = context->irBuilder->CreateICmpULE(llvmTotalLength, llvm::ConstantInt::get(llvmLengthType, stringInlineCapacity, false), "string.concat.fits");
+    context->irBuilder->CreateCondBr(llvmFitsInline, inlineBlock, heapBlock);
+
+    context->irBuilder->SetInsertPoint(inlineBlock);
+    llvm::Value *llvmInlineTag = context->irBuilder->CreateSub(llvm::ConstantInt::get(llvmLengthType, stringInlineCapacity, false), llvmTotalLength, "string.concat.inline.length");
+    context->irBuilder->CreateStore(context->irBuilder->CreateTrunc(llvmInlineTag, llvmByteType, "string.concat.tag"), llvmTagPointer);
+    context->irBuilder->CreateBr(copyBlock);
+
+    // The heap bytes are preceded by their reference count
+    context->irBuilder->SetInsertPoint(heapBlock);
+    llvm::Value *llvmHeapSize = context->irBuilder->CreateAdd(llvmTotalLength, generateSizeOf(context, getRefCountType(*context->context), "string.concat.header"), "string.concat.size", true, true);
+    llvm::Value *llvmHeader = generateMalloc(context, getRefCountType(*context->context), llvmHeapSize, "string.concat");
+    context->irBuilder->CreateStore(llvm::ConstantInt::get(getRefCountType(*context->context), 1, false), llvmHeader);
+    llvm::Value *llvmHeapBytes = context->irBuilder->CreateBitCast(context->irBuilder->CreateInBoundsGEP(getRefCountType(*context->context), llvmHeader, llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context->context), 1, false), "string.concat.bytes.start"), llvm::Type::getInt8PtrTy(*context->context), "string.concat.heap.bytes");
+    context->irBuilder->CreateStore(llvmHeapBytes, context->irBuilder->CreateStructGEP(llvmStringType, llvmResultPointer, 0, "string.concat.bytes.ptr"));
+    context->irBuilder->CreateStore(llvmTotalLength, context->irBuilder->CreateStructGEP(llvmStringType, llvmResultPointer, 1, "string.concat.length.ptr"));
+    context->irBuilder->CreateStore(llvm::ConstantInt::get(llvmByteType, stringHeapTag, false), llvmTagPointer);
+    context->irBuilder->CreateBr(copyBlock);
+
+    context->irBuilder->SetInsertPoint(copyBlock);
+    llvm::PHINode *llvmTargetBytes = context->irBuilder->CreatePHI(llvm::Type::getInt8PtrTy(*context->context), 2, "string.concat.bytes");
+    llvmTargetBytes->addIncoming(llvmInlineBytes, inlineBlock);
+    llvmTargetBytes->addIncoming(llvmHeapBytes, heapBlock);
+    llvm::Value *llvmOffset = llvm::ConstantInt::get(llvmLengthType, 0, false);
+    for (int i = 0; i < parts.size(); i++)
+    {
+        llvm::Value *llvmTarget = context->irBuilder->CreateInBoundsGEP(llvmByteType, llvmTargetBytes, llvmOffset, "string.concat.target");
+        context->irBuilder->CreateMemCpy(llvmTarget, llvm::MaybeAlign(1), llvmPartBytes[i], llvm::MaybeAlign(1), llvmPartLengths[i]);
+        llvmOffset = context->irBuilder->CreateAdd(llvmOffset, llvmPartLengths[i], "string.concat.offset", true, true);
+    }
+    for (TypedValue *part : parts)
+    {
+        if (part->getTypeCode() == TypeCode::STRING)
+        {
+            generateDecrementReferenceIfPointer(context, part, true);
+        }
+    }
+
+    return new TypedValue(context->irBuilder->CreateLoad(llvmStringType, llvmResultPointer, "string.concat.load"), &STRING_TYPE);
+}
+
+// Returns the internal byte kernel called name, it is generated by generateBody the first time, with the insert point at its entry block
+// Byte kernels take a pointer to bytes and a length, they are shared by every call in the module
+static llvm::Function *getBytesKernel(GenerationContext *context, std::string name, llvm::Type *llvmReturnType, std::vector<llvm::Type *> llvmParameterTypes, std::function<void(llvm::Function *)> generateBody)
+{
+    llvm::Function *kernel = context->module->getFunction(name);
+    if (kernel != NULL)
+    {
+        return kernel;
+    }
+
+    llvm::FunctionType *functionType = llvm::FunctionType::get(llvmReturnType, llvmParameterTypes, false);
+    kernel = llvm::Function::Create(functionType, llvm::Function::InternalLinkage, name, *context->module);
+    kernel->addFnAttr(llvm::Attribute::NoUnwind);
+    for (unsigned int i = 0; i < llvmParameterTypes.size(); i++)
+    {
+        if (llvmParameterTypes[i]->isPointerTy())
+        {
+            kernel->addParamAttr(i, llvm::Attribute::NoCapture);
+        }
+    }
+
+    llvm::IRBuilderBase::InsertPoint savedInsertPoint = context->irBuilder->saveIP();
+    context->irBuilder->SetInsertPoint(llvm::BasicBlock::Create(*context->context, "entry", kernel));
+    generateBody(kernel);
+    context->irBuilder->restoreIP(savedInsertPoint);
+
+    assert(!llvm::verifyFunction(*kernel, &llvm::errs()));
+    context->passManager->run(*kernel);
+    return kernel;
+}
+
+// Generates a loop over [llvmStart, llvmEnd) that calls generateStep for every whole step of step bytes, the bytes after the last whole step are not visited
+// llvmCarried are values that generateStep updates for the next step, generateStep may return from the kernel but must leave the insert point where the step continues
+// Returns the index after the last step, llvmCarried is set to the values after the last step
+static llvm::Value *generateBytesLoop(GenerationContext *context, llvm::Value *llvmStart, llvm::Value *llvmEnd, uint64_t step, std::string twine, std::vector<llvm::Value *> &llvmCarried, std::function<void(llvm::Value *, std::vector<llvm::Value *> &)> generateStep)
+{
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *preheaderBlock = context->irBuilder->GetInsertBlock();
+    llvm::BasicBlock *conditionBlock = llvm::BasicBlock::Create(*context->context, twine + ".cond", currentFunction);
+    llvm::BasicBlock *bodyBlock = llvm::BasicBlock::Create(*context->context, twine + ".body", currentFunction);
+    llvm::BasicBlock *exitBlock = llvm::BasicBlock::Create(*context->context, twine + ".exit", currentFunction);
+    context->irBuilder->CreateBr(conditionBlock);
+
+    context->irBuilder->SetInsertPoint(conditionBlock);
+    llvm::PHINode *llvmIndex = context->irBuilder->CreatePHI(llvmLengthType, 2, twine + ".index");
+    llvmIndex->addIncoming(llvmStart, preheaderBlock);
+    std::vector<llvm::PHINode *> llvmCarriedPhis;
+    for (llvm::Value *llvmInitial : llvmCarried)
+    {
+        llvm::PHINode *llvmCarriedPhi = context->irBuilder->CreatePHI(llvmInitial->getType(), 2, twine + ".carried");
+        llvmCarriedPhi->addIncoming(llvmInitial, preheaderBlock);
+        llvmCarriedPhis.push_back(llvmCarriedPhi);
+    }
+    llvm::Value *llvmStepEnd = context->irBuilder->CreateAdd(llvmIndex, llvm::ConstantInt::get(llvmLengthType, step, false), twine + ".stepend", true, true);
+    context->irBuilder->CreateCondBr(context->irBuilder->CreateICmpULE(llvmStepEnd, llvmEnd, twine + ".more"), bodyBlock, exitBlock);
+
+    context->irBuilder->SetInsertPoint(bodyBlock);
+    std::vector<llvm::Value *> llvmStepCarried(llvmCarriedPhis.begin(), llvmCarriedPhis.end());
+    generateStep(llvmIndex, llvmStepCarried);
+    llvmIndex->addIncoming(llvmStepEnd, context->irBuilder->GetInsertBlock());
+    for (int i = 0; i < llvmCarriedPhis.size(); i++)
+    {
+        llvmCarriedPhis[i]->addIncoming(llvmStepCarried[i], context->irBuilder->GetInsertBlock());
+    }
+    context->irBuilder->CreateBr(conditionBlock);
+
+    context->irBuilder->SetInsertPoint(exitBlock);
+    llvmCarried.assign(llvmCarriedPhis.begin(), llvmCarriedPhis.end());
+    return llvmIndex;
+}
+
+// Returns llvmResult from the kernel when llvmCondition is true, the insert point is set to where it is false
+static void generateBytesReturnIf(GenerationContext *context, llvm::Value *llvmCondition, llvm::Value *llvmResult, std::string twine)
+{
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *returnBlock = llvm::BasicBlock::Create(*context->context, twine + ".ret", currentFunction);
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, twine + ".cont", currentFunction);
+    context->irBuilder->CreateCondBr(llvmCondition, returnBlock, continueBlock);
+
+    context->irBuilder->SetInsertPoint(returnBlock);
+    context->irBuilder->CreateRet(llvmResult);
+
+    context->irBuilder->SetInsertPoint(continueBlock);
+}
+
+static llvm::Value *generateBytesLoad(GenerationContext *context, llvm::Value *llvmBytes, llvm::Value *llvmIndex, std::string twine)
+{
+    llvm::Type *llvmByteType = llvm::Type::getInt8Ty(*context->context);
+    return context->irBuilder->CreateLoad(llvmByteType, context->irBuilder->CreateInBoundsGEP(llvmByteType, llvmBytes, llvmIndex, twine + ".ptr"), twine);
+}
+
+// Loads bytesVectorWidth bytes at any alignment
+static llvm::Value *generateBytesVectorLoad(GenerationContext *context, llvm::Value *llvmBytes, llvm::Value *llvmIndex, std::string twine)
+{
+    llvm::Type *llvmByteType = llvm::Type::getInt8Ty(*context->context);
+    llvm::Type *llvmVectorType = llvm::FixedVectorType::get(llvmByteType, bytesVectorWidth);
+    llvm::Value *llvmPointer = context->irBuilder->CreateInBoundsGEP(llvmByteType, llvmBytes, llvmIndex, twine + ".ptr");
+    llvm::Value *llvmVectorPointer = context->irBuilder->CreateBitCast(llvmPointer, llvmVectorType->getPointerTo(), twine + ".vector.ptr");
+    return context->irBuilder->CreateAlignedLoad(llvmVectorType, llvmVectorPointer, llvm::MaybeAlign(1), twine);
+}
+
+// Packs the result of comparing bytesVectorWidth bytes into an integer with a bit per byte (pmovmskb on x86)
+static llvm::Value *generateBytesMask(GenerationContext *context, llvm::Value *llvmCompare, std::string twine)
+{
+    return context->irBuilder->CreateBitCast(llvmCompare, llvm::Type::getIntNTy(*context->context, bytesVectorWidth), twine);
+}
+
+// Returns the index of the lowest set bit of a non-zero mask as a length
+static llvm::Value *generateBytesMaskFirst(GenerationContext *context, llvm::Value *llvmMask, std::string twine)
+{
+    llvm::Value *llvmFirst = context->irBuilder->CreateBinaryIntrinsic(llvm::Intrinsic::cttz, llvmMask, context->irBuilder->getTrue(), nullptr, twine);
+    return context->irBuilder->CreateZExt(llvmFirst, ArrayType::getLLVMLengthFieldType(context), twine + ".ext");
+}
+
+// i64 bytes.findbyte(i8 *bytes, i64 length, i8 byte): the index of the first byte equal to byte, or -1 (like memchr)
+static llvm::Function *getBytesFindByteKernel(GenerationContext *context)
+{
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    return getBytesKernel(context, "bytes.findbyte", llvmLengthType, {llvm::Type::getInt8PtrTy(*context->context), llvmLengthType, llvm::Type::getInt8Ty(*context->context)}, [&](llvm::Function *kernel)
+                          {
+        llvm::Value *llvmBytes = kernel->getArg(0);
+        llvm::Value *llvmLength = kernel->getArg(1);
+        llvm::Value *llvmByte = kernel->getArg(2);
+        llvm::Value *llvmSplat = context->irBuilder->CreateVectorSplat(bytesVectorWidth, llvmByte, "find.splat");
+
+        std::vector<llvm::Value *> llvmNone;
+        llvm::Value *llvmTailStart = generateBytesLoop(context, llvm::ConstantInt::get(llvmLengthType, 0, false), llvmLength, bytesVectorWidth, "find.vector", llvmNone, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &)
+                                                       {
+            llvm::Value *llvmMask = generateBytesMask(context, context->irBuilder->CreateICmpEQ(generateBytesVectorLoad(context, llvmBytes, llvmIndex, "find.block"), llvmSplat, "find.eq"), "find.mask");
+            llvm::Value *llvmFound = context->irBuilder->CreateICmpNE(llvmMask, llvm::ConstantInt::get(llvmMask->getType(), 0, false), "find.found");
+            generateBytesReturnIf(context, llvmFound, context->irBuilder->CreateAdd(llvmIndex, generateBytesMaskFirst(context, llvmMask, "find.first"), "find.index"), "find.vector.found"); });
+        generateBytesLoop(context, llvmTailStart, llvmLength, 1, "find.tail", llvmNone, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &)
+                          { generateBytesReturnIf(context, context->irBuilder->CreateICmpEQ(generateBytesLoad(context, llvmBytes, llvmIndex, "find.byte"), llvmByte, "find.eq"), llvmIndex, "find.tail.found"); });
+        context->irBuilder->CreateRet(llvm::ConstantInt::get(llvmLengthType, -1, true)); });
+}
+
+// i64 bytes.count(i8 *bytes, i64 length, i8 byte): the number of bytes equal to byte
+static llvm::Function *getBytesCountKernel(GenerationContext *context)
+{
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    return getBytesKernel(context, "bytes.count", llvmLengthType, {llvm::Type::getInt8PtrTy(*context->context), llvmLengthType, llvm::Type::getInt8Ty(*context->context)}, [&](llvm::Function *kernel)
+                          {
+        llvm::Value *llvmBytes = kernel->getArg(0);
+        llvm::Value *llvmLength = kernel->getArg(1);
+        llvm::Value *llvmByte = kernel->getArg(2);
+        llvm::Value *llvmSplat = context->irBuilder->CreateVectorSplat(bytesVectorWidth, llvmByte, "count.splat");
+
+        std::vector<llvm::Value *> llvmCount = {llvm::ConstantInt::get(llvmLengthType, 0, false)};
+        llvm::Value *llvmTailStart = generateBytesLoop(context, llvm::ConstantInt::get(llvmLengthType, 0, false), llvmLength, bytesVectorWidth, "count.vector", llvmCount, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &llvmCarried)
+                                                       {
+            llvm::Value *llvmMask = generateBytesMask(context, context->irBuilder->CreateICmpEQ(generateBytesVectorLoad(context, llvmBytes, llvmIndex, "count.block"), llvmSplat, "count.eq"), "count.mask");
+            llvm::Value *llvmBlockCount = context->irBuilder->CreateZExt(context->irBuilder->CreateUnaryIntrinsic(llvm::Intrinsic::ctpop, llvmMask, nullptr, "count.popcount"), llvmLengthType, "count.popcount.ext");
+            llvmCarried[0] = context->irBuilder->CreateAdd(llvmCarried[0], llvmBlockCount, "count.add", true, true); });
+        generateBytesLoop(context, llvmTailStart, llvmLength, 1, "count.tail", llvmCount, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &llvmCarried)
+                          {
+            llvm::Value *llvmEqual = context->irBuilder->CreateICmpEQ(generateBytesLoad(context, llvmBytes, llvmIndex, "count.byte"), llvmByte, "count.eq");
+            llvmCarried[0] = context->irBuilder->CreateAdd(llvmCarried[0], context->irBuilder->CreateZExt(llvmEqual, llvmLengthType, "count.eq.ext"), "count.add", true, true); });
+        context->irBuilder->CreateRet(llvmCount[0]); });
+}
+
+// i64 bytes.mismatch(i8 *left, i8 *right, i64 length): the index of the first byte that differs, or length when all bytes are equal
+static llvm::Function *getBytesMismatchKernel(GenerationContext *context)
+{
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    return getBytesKernel(context, "bytes.mismatch", llvmLengthType, {llvm::Type::getInt8PtrTy(*context->context), llvm::Type::getInt8PtrTy(*context->context), llvmLengthType}, [&](llvm::Function *kernel)
+                          {
+        llvm::Value *llvmLeft = kernel->getArg(0);
+        llvm::Value *llvmRight = kernel->getArg(1);
+        llvm::Value *llvmLength = kernel->getArg(2);
+
+        std::vector<llvm::Value *> llvmNone;
+        llvm::Value *llvmTailStart = generateBytesLoop(context, llvm::ConstantInt::get(llvmLengthType, 0, false), llvmLength, bytesVectorWidth, "mismatch.vector", llvmNone, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &)
+                                                       {
+            llvm::Value *llvmDifferent = context->irBuilder->CreateICmpNE(generateBytesVectorLoad(context, llvmLeft, llvmIndex, "mismatch.left"), generateBytesVectorLoad(context, llvmRight, llvmIndex, "mismatch.right"), "mismatch.ne");
+            llvm::Value *llvmMask = generateBytesMask(context, llvmDifferent, "mismatch.mask");
+            llvm::Value *llvmFound = context->irBuilder->CreateICmpNE(llvmMask, llvm::ConstantInt::get(llvmMask->getType(), 0, false), "mismatch.found");
+            generateBytesReturnIf(context, llvmFound, context->irBuilder->CreateAdd(llvmIndex, generateBytesMaskFirst(context, llvmMask, "mismatch.first"), "mismatch.index"), "mismatch.vector.found"); });
+        generateBytesLoop(context, llvmTailStart, llvmLength, 1, "mismatch.tail", llvmNone, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &)
+                          {
+            llvm::Value *llvmDifferent = context->irBuilder->CreateICmpNE(generateBytesLoad(context, llvmLeft, llvmIndex, "mismatch.left"), generateBytesLoad(context, llvmRight, llvmIndex, "mismatch.right"), "mismatch.ne");
+            generateBytesReturnIf(context, llvmDifferent, llvmIndex, "mismatch.tail.found"); });
+        context->irBuilder->CreateRet(llvmLength); });
+}
+
+// i32 bytes.compare(i8 *left, i64 leftLength, i8 *right, i64 rightLength): -1, 0 or 1 when left sorts before, equal to or after right (like memcmp, then the shortest first)
+static llvm::Function *getBytesCompareKernel(GenerationContext *context)
+{
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    llvm::Type *llvmResultType = llvm::Type::getInt32Ty(*context->context);
+    llvm::Function *mismatchKernel = getBytesMismatchKernel(context);
+    return getBytesKernel(context, "bytes.compare", llvmResultType, {llvm::Type::getInt8PtrTy(*context->context), llvmLengthType, llvm::Type::getInt8PtrTy(*context->context), llvmLengthType}, [&](llvm::Function *kernel)
+                          {
+        llvm::Value *llvmLeft = kernel->getArg(0);
+        llvm::Value *llvmLeftLength = kernel->getArg(1);
+        llvm::Value *llvmRight = kernel->getArg(2);
+        llvm::Value *llvmRightLength = kernel->getArg(3);
+
+        llvm::Value *llvmCommonLength = context->irBuilder->CreateSelect(context->irBuilder->CreateICmpULT(llvmLeftLength, llvmRightLength, "compare.shorter"), llvmLeftLength, llvmRightLength, "compare.common");
+        llvm::Value *llvmMismatch = context->irBuilder->CreateCall(mismatchKernel, {llvmLeft, llvmRight, llvmCommonLength}, "compare.mismatch");
+
+        llvm::BasicBlock *differentBlock = llvm::BasicBlock::Create(*context->context, "compare.different", kernel);
+        llvm::BasicBlock *commonBlock = llvm::BasicBlock::Create(*context->context, "compare.common", kernel);
+        context->irBuilder->CreateCondBr(context->irBuilder->CreateICmpULT(llvmMismatch, llvmCommonLength, "compare.differs"), differentBlock, commonBlock);
+
+        context->irBuilder->SetInsertPoint(differentBlock);
+        llvm::Value *llvmLeftByte = generateBytesLoad(context, llvmLeft, llvmMismatch, "compare.left");
+        llvm::Value *llvmRightByte = generateBytesLoad(context, llvmRight, llvmMismatch, "compare.right");
+        context->irBuilder->CreateRet(context->irBuilder->CreateSelect(context->irBuilder->CreateICmpULT(llvmLeftByte, llvmRightByte, "compare.less"), llvm::ConstantInt::get(llvmResultType, -1, true), llvm::ConstantInt::get(llvmResultType, 1, false), "compare.result"));
+
+        // The common bytes are equal, the shortest sorts first
+        context->irBuilder->SetInsertPoint(commonBlock);
+        llvm::Value *llvmLonger = context->irBuilder->CreateSelect(context->irBuilder->CreateICmpUGT(llvmLeftLength, llvmRightLength, "compare.longer"), llvm::ConstantInt::get(llvmResultType, 1, false), llvm::ConstantInt::get(llvmResultType, 0, false), "compare.length.result");
+        context->irBuilder->CreateRet(context->irBuilder->CreateSelect(context->irBuilder->CreateICmpULT(llvmLeftLength, llvmRightLength, "compare.shorter"), llvm::ConstantInt::get(llvmResultType, -1, true), llvmLonger, "compare.result")); });
+}
+
+// i64 bytes.find(i8 *bytes, i64 length, i8 *needle, i64 needleLength): the index of the first occurrence of needle, or -1 (like memmem)
+// Every step compares the first and last byte of the needle at bytesVectorWidth positions at once, only the positions where both match are compared fully
+static llvm::Function *getBytesFindKernel(GenerationContext *context)
+{
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    llvm::Function *mismatchKernel = getBytesMismatchKernel(context);
+    return getBytesKernel(context, "bytes.find", llvmLengthType, {llvm::Type::getInt8PtrTy(*context->context), llvmLengthType, llvm::Type::getInt8PtrTy(*context->context), llvmLengthType}, [&](llvm::Function *kernel)
+                          {
+        llvm::Value *llvmBytes = kernel->getArg(0);
+        llvm::Value *llvmLength = kernel->getArg(1);
+        llvm::Value *llvmNeedle = kernel->getArg(2);
+        llvm::Value *llvmNeedleLength = kernel->getArg(3);
+        llvm::Value *llvmZero = llvm::ConstantInt::get(llvmLengthType, 0, false);
+        llvm::Value *llvmOne = llvm::ConstantInt::get(llvmLengthType, 1, false);
+
+        generateBytesReturnIf(context, context->irBuilder->CreateICmpEQ(llvmNeedleLength, llvmZero, "find.empty"), llvmZero, "find.empty");
+        generateBytesReturnIf(context, context->irBuilder->CreateICmpUGT(llvmNeedleLength, llvmLength, "find.toolong"), llvm::ConstantInt::get(llvmLengthType, -1, true), "find.toolong");
+
+        // A match can start at any of the positions [0, length - needleLength]
+        llvm::Value *llvmLastOffset = context->irBuilder->CreateSub(llvmNeedleLength, llvmOne, "find.lastoffset", true, true);
+        llvm::Value *llvmPositions = context->irBuilder->CreateAdd(context->irBuilder->CreateSub(llvmLength, llvmNeedleLength, "find.range", true, true), llvmOne, "find.positions", true, true);
+        llvm::Value *llvmFirstSplat = context->irBuilder->CreateVectorSplat(bytesVectorWidth, generateBytesLoad(context, llvmNeedle, llvmZero, "find.first"), "find.first.splat");
+        llvm::Value *llvmLastSplat = context->irBuilder->CreateVectorSplat(bytesVectorWidth, generateBytesLoad(context, llvmNeedle, llvmLastOffset, "find.last"), "find.last.splat");
+
+        std::vector<llvm::Value *> llvmNone;
+        llvm::Value *llvmTailStart = generateBytesLoop(context, llvmZero, llvmPositions, bytesVectorWidth, "find.vector", llvmNone, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &)
+                                                       {
+            llvm::Value *llvmFirstEqual = context->irBuilder->CreateICmpEQ(generateBytesVectorLoad(context, llvmBytes, llvmIndex, "find.block.first"), llvmFirstSplat, "find.first.eq");
+            llvm::Value *llvmLastIndex = context->irBuilder->CreateAdd(llvmIndex, llvmLastOffset, "find.block.lastindex", true, true);
+            llvm::Value *llvmLastEqual = context->irBuilder->CreateICmpEQ(generateBytesVectorLoad(context, llvmBytes, llvmLastIndex, "find.block.last"), llvmLastSplat, "find.last.eq");
+            llvm::Value *llvmMask = generateBytesMask(context, context->irBuilder->CreateAnd(llvmFirstEqual, llvmLastEqual, "find.candidates"), "find.mask");
+
+            // Compare the candidates from low to high, clearing the lowest bit of the mask after each
+            llvm::BasicBlock *candidatesBlock = context->irBuilder->GetInsertBlock();
+            llvm::BasicBlock *candidateConditionBlock = llvm::BasicBlock::Create(*context->context, "find.candidate.cond", kernel);
+            llvm::BasicBlock *candidateBlock = llvm::BasicBlock::Create(*context->context, "find.candidate", kernel);
+            llvm::BasicBlock *candidatesDoneBlock = llvm::BasicBlock::Create(*context->context, "find.candidate.done", kernel);
+            context->irBuilder->CreateBr(candidateConditionBlock);
+
+            context->irBuilder->SetInsertPoint(candidateConditionBlock);
+            llvm::PHINode *llvmCandidates = context->irBuilder->CreatePHI(llvmMask->getType(), 2, "find.candidate.mask");
+            llvmCandidates->addIncoming(llvmMask, candidatesBlock);
+            context->irBuilder->CreateCondBr(context->irBuilder->CreateICmpNE(llvmCandidates, llvm::ConstantInt::get(llvmMask->getType(), 0, false), "find.candidate.any"), candidateBlock, candidatesDoneBlock);
+
+            context->irBuilder->SetInsertPoint(candidateBlock);
+            llvm::Value *llvmCandidateIndex = context->irBuilder->CreateAdd(llvmIndex, generateBytesMaskFirst(context, llvmCandidates, "find.candidate.first"), "find.candidate.index", true, true);
+            llvm::Value *llvmCandidateBytes = context->irBuilder->CreateInBoundsGEP(llvm::Type::getInt8Ty(*context->context), llvmBytes, llvmCandidateIndex, "find.candidate.ptr");
+            llvm::Value *llvmMismatch = context->irBuilder->CreateCall(mismatchKernel, {llvmCandidateBytes, llvmNeedle, llvmNeedleLength}, "find.candidate.mismatch");
+            generateBytesReturnIf(context, context->irBuilder->CreateICmpEQ(llvmMismatch, llvmNeedleLength, "find.candidate.match"), llvmCandidateIndex, "find.candidate.found");
+            llvm::Value *llvmRemaining = context->irBuilder->CreateAnd(llvmCandidates, context->irBuilder->CreateSub(llvmCandidates, llvm::ConstantInt::get(llvmMask->getType(), 1, false), "find.candidate.lower"), "find.candidate.next");
+            llvmCandidates->addIncoming(llvmRemaining, context->irBuilder->GetInsertBlock());
+            context->irBuilder->CreateBr(candidateConditionBlock);
+
+            context->irBuilder->SetInsertPoint(candidatesDoneBlock); });
+        generateBytesLoop(context, llvmTailStart, llvmPositions, 1, "find.tail", llvmNone, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &)
+                          {
+            llvm::Value *llvmCandidateBytes = context->irBuilder->CreateInBoundsGEP(llvm::Type::getInt8Ty(*context->context), llvmBytes, llvmIndex, "find.tail.ptr");
+            llvm::Value *llvmMismatch = context->irBuilder->CreateCall(mismatchKernel, {llvmCandidateBytes, llvmNeedle, llvmNeedleLength}, "find.tail.mismatch");
+            generateBytesReturnIf(context, context->irBuilder->CreateICmpEQ(llvmMismatch, llvmNeedleLength, "find.tail.match"), llvmIndex, "find.tail.found"); });
+        context->irBuilder->CreateRet(llvm::ConstantInt::get(llvmLengthType, -1, true)); });
+}
+
+// i64 bytes.hash(i8 *bytes, i64 length): a 64 bit hash for hash tables, it is not cryptographic and depends on the byte order of the target
+// Whole steps are mixed into 4 independent 64 bit lanes, the lanes, the length and the remaining bytes are then mixed into one
+static llvm::Function *getBytesHashKernel(GenerationContext *context)
+{
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    return getBytesKernel(context, "bytes.hash", llvmLengthType, {llvm::Type::getInt8PtrTy(*context->context), llvmLengthType}, [&](llvm::Function *kernel)
+                          {
+        llvm::Value *llvmBytes = kernel->getArg(0);
+        llvm::Value *llvmLength = kernel->getArg(1);
+        unsigned int lanes = bytesVectorWidth / 8;
+        llvm::Type *llvmLanesType = llvm::FixedVectorType::get(llvmLengthType, lanes);
+        llvm::Constant *llvmMultiplier = llvm::ConstantInt::get(llvmLengthType, 0x9E3779B97F4A7C15ull, false);
+
+        std::vector<llvm::Constant *> llvmSeeds;
+        uint64_t seeds[] = {0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull};
+        for (unsigned int i = 0; i < lanes; i++)
+        {
+            llvmSeeds.push_back(llvm::ConstantInt::get(llvmLengthType, seeds[i % 4], false));
+        }
+
+        std::vector<llvm::Value *> llvmState = {llvm::ConstantVector::get(llvmSeeds)};
+        llvm::Value *llvmTailStart = generateBytesLoop(context, llvm::ConstantInt::get(llvmLengthType, 0, false), llvmLength, bytesVectorWidth, "hash.vector", llvmState, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &llvmCarried)
+                                                       {
+            llvm::Value *llvmPointer = context->irBuilder->CreateInBoundsGEP(llvm::Type::getInt8Ty(*context->context), llvmBytes, llvmIndex, "hash.block.ptr");
+            llvm::Value *llvmBlock = context->irBuilder->CreateAlignedLoad(llvmLanesType, context->irBuilder->CreateBitCast(llvmPointer, llvmLanesType->getPointerTo(), "hash.block.vector.ptr"), llvm::MaybeAlign(1), "hash.block");
+            llvm::Value *llvmMixed = context->irBuilder->CreateMul(context->irBuilder->CreateXor(llvmCarried[0], llvmBlock, "hash.xor"), context->irBuilder->CreateVectorSplat(lanes, llvmMultiplier, "hash.multiplier"), "hash.mul");
+            llvmCarried[0] = context->irBuilder->CreateXor(llvmMixed, context->irBuilder->CreateLShr(llvmMixed, 32, "hash.shift"), "hash.fold"); });
+
+        std::vector<llvm::Value *> llvmHash = {context->irBuilder->CreateMul(llvmLength, llvmMultiplier, "hash.length")};
+        for (unsigned int i = 0; i < lanes; i++)
+        {
+            llvm::Value *llvmLane = context->irBuilder->CreateExtractElement(llvmState[0], (uint64_t)i, "hash.lane");
+            llvmHash[0] = context->irBuilder->CreateMul(context->irBuilder->CreateXor(llvmHash[0], llvmLane, "hash.lane.xor"), llvmMultiplier, "hash.lane.mul");
+        }
+        generateBytesLoop(context, llvmTailStart, llvmLength, 1, "hash.tail", llvmHash, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &llvmCarried)
+                          {
+            llvm::Value *llvmByte = context->irBuilder->CreateZExt(generateBytesLoad(context, llvmBytes, llvmIndex, "hash.byte"), llvmLengthType, "hash.byte.ext");
+            llvmCarried[0] = context->irBuilder->CreateMul(context->irBuilder->CreateXor(llvmCarried[0], llvmByte, "hash.byte.xor"), llvm::ConstantInt::get(llvmLengthType, 0x100000001B3ull, false), "hash.byte.mul"); });
+
+        // The finalizer of MurmurHash3, every input bit affects every output bit
+        llvm::Value *llvmResult = llvmHash[0];
+        llvmResult = context->irBuilder->CreateXor(llvmResult, context->irBuilder->CreateLShr(llvmResult, 33, "hash.final.shift"), "hash.final");
+        llvmResult = context->irBuilder->CreateMul(llvmResult, llvm::ConstantInt::get(llvmLengthType, 0xFF51AFD7ED558CCDull, false), "hash.final.mul");
+        llvmResult = context->irBuilder->CreateXor(llvmResult, context->irBuilder->CreateLShr(llvmResult, 33, "hash.final.shift"), "hash.final");
+        llvmResult = context->irBuilder->CreateMul(llvmResult, llvm::ConstantInt::get(llvmLengthType, 0xC4CEB9FE1A85EC53ull, false), "hash.final.mul");
+        llvmResult = context->irBuilder->CreateXor(llvmResult, context->irBuilder->CreateLShr(llvmResult, 33, "hash.final.shift"), "hash.final");
+        context->irBuilder->CreateRet(llvmResult); });
+}
+
+// i1 bytes.isutf8(i8 *bytes, i64 length): true when the bytes are valid UTF-8 (no overlong encodings, surrogates or code points above U+10FFFF)
+// Runs of ASCII are skipped bytesVectorWidth bytes at a time, every other code point is checked on its own
+static llvm::Function *getBytesIsUtf8Kernel(GenerationContext *context)
+{
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    llvm::Type *llvmByteType = llvm::Type::getInt8Ty(*context->context);
+    return getBytesKernel(context, "bytes.isutf8", BOOL_TYPE.getLLVMType(context), {llvm::Type::getInt8PtrTy(*context->context), llvmLengthType}, [&](llvm::Function *kernel)
+                          {
+        llvm::Value *llvmBytes = kernel->getArg(0);
+        llvm::Value *llvmLength = kernel->getArg(1);
+        auto byteConstant = [&](uint64_t value)
+        { return llvm::ConstantInt::get(llvmByteType, value, false); };
+        auto lengthConstant = [&](uint64_t value)
+        { return llvm::ConstantInt::get(llvmLengthType, value, false); };
+
+        llvm::BasicBlock *entryBlock = context->irBuilder->GetInsertBlock();
+        llvm::BasicBlock *conditionBlock = llvm::BasicBlock::Create(*context->context, "utf8.cond", kernel);
+        llvm::BasicBlock *stepBlock = llvm::BasicBlock::Create(*context->context, "utf8.step", kernel);
+        llvm::BasicBlock *vectorBlock = llvm::BasicBlock::Create(*context->context, "utf8.vector", kernel);
+        llvm::BasicBlock *vectorAsciiBlock = llvm::BasicBlock::Create(*context->context, "utf8.vector.ascii", kernel);
+        llvm::BasicBlock *vectorSkipBlock = llvm::BasicBlock::Create(*context->context, "utf8.vector.skip", kernel);
+        llvm::BasicBlock *byteBlock = llvm::BasicBlock::Create(*context->context, "utf8.byte", kernel);
+        llvm::BasicBlock *byteAsciiBlock = llvm::BasicBlock::Create(*context->context, "utf8.byte.ascii", kernel);
+        llvm::BasicBlock *codePointBlock = llvm::BasicBlock::Create(*context->context, "utf8.codepoint", kernel);
+        llvm::BasicBlock *secondBlock = llvm::BasicBlock::Create(*context->context, "utf8.codepoint.second", kernel);
+        llvm::BasicBlock *thirdBlock = llvm::BasicBlock::Create(*context->context, "utf8.codepoint.third", kernel);
+        llvm::BasicBlock *codePointDoneBlock = llvm::BasicBlock::Create(*context->context, "utf8.codepoint.done", kernel);
+        llvm::BasicBlock *validBlock = llvm::BasicBlock::Create(*context->context, "utf8.valid", kernel);
+        context->irBuilder->CreateBr(conditionBlock);
+
+        context->irBuilder->SetInsertPoint(conditionBlock);
+        llvm::PHINode *llvmIndex = context->irBuilder->CreatePHI(llvmLengthType, 4, "utf8.index");
+        llvmIndex->addIncoming(lengthConstant(0), entryBlock);
+        context->irBuilder->CreateCondBr(context->irBuilder->CreateICmpULT(llvmIndex, llvmLength, "utf8.more"), stepBlock, validBlock);
+
+        context->irBuilder->SetInsertPoint(stepBlock);
+        llvm::Value *llvmBlockEnd = context->irBuilder->CreateAdd(llvmIndex, lengthConstant(bytesVectorWidth), "utf8.block.end", true, true);
+        context->irBuilder->CreateCondBr(context->irBuilder->CreateICmpULE(llvmBlockEnd, llvmLength, "utf8.block.fits"), vectorBlock, byteBlock);
+
+        // Bytes with the highest bit set are not ASCII
+        context->irBuilder->SetInsertPoint(vectorBlock);
+        llvm::Value *llvmBlock = generateBytesVectorLoad(context, llvmBytes, llvmIndex, "utf8.block");
+        llvm::Value *llvmMask = generateBytesMask(context, context->irBuilder->CreateICmpSLT(llvmBlock, llvm::Constant::getNullValue(llvmBlock->getType()), "utf8.block.high"), "utf8.block.mask");
+        context->irBuilder->CreateCondBr(context->irBuilder->CreateICmpEQ(llvmMask, llvm::ConstantInt::get(llvmMask->getType(), 0, false), "utf8.block.ascii"), vectorAsciiBlock, vectorSkipBlock);
+
+        context->irBuilder->SetInsertPoint(vectorAsciiBlock);
+        llvmIndex->addIncoming(llvmBlockEnd, vectorAsciiBlock);
+        context->irBuilder->CreateBr(conditionBlock);
+
+        context->irBuilder->SetInsertPoint(vectorSkipBlock);
+        llvm::Value *llvmFirstHigh = context->irBuilder->CreateAdd(llvmIndex, generateBytesMaskFirst(context, llvmMask, "utf8.block.first"), "utf8.block.skip", true, true);
+        context->irBuilder->CreateBr(codePointBlock);
+
+        context->irBuilder->SetInsertPoint(byteBlock);
+        llvm::Value *llvmByte = generateBytesLoad(context, llvmBytes, llvmIndex, "utf8.byte");
+        context->irBuilder->CreateCondBr(context->irBuilder->CreateICmpSLT(llvmByte, byteConstant(0), "utf8.byte.high"), codePointBlock, byteAsciiBlock);
+
+        context->irBuilder->SetInsertPoint(byteAsciiBlock);
+        llvmIndex->addIncoming(context->irBuilder->CreateAdd(llvmIndex, lengthConstant(1), "utf8.byte.next", true, true), byteAsciiBlock);
+        context->irBuilder->CreateBr(conditionBlock);
+
+        // A lead byte C2..DF, E0..EF or F0..F4 is followed by 1, 2 or 3 continuation bytes 80..BF,
+        // the second byte has a smaller range after E0 (overlong), ED (surrogates), F0 (overlong) and F4 (above U+10FFFF)
+        context->irBuilder->SetInsertPoint(codePointBlock);
+        llvm::PHINode *llvmStart = context->irBuilder->CreatePHI(llvmLengthType, 2, "utf8.codepoint.start");
+        llvmStart->addIncoming(llvmFirstHigh, vectorSkipBlock);
+        llvmStart->addIncoming(llvmIndex, byteBlock);
+        llvm::Value *llvmLead = generateBytesLoad(context, llvmBytes, llvmStart, "utf8.lead");
+        llvm::Value *llvmInvalidLead = context->irBuilder->CreateOr(context->irBuilder->CreateICmpULT(llvmLead, byteConstant(0xC2), "utf8.lead.low"), context->irBuilder->CreateICmpUGT(llvmLead, byteConstant(0xF4), "utf8.lead.high"), "utf8.lead.invalid");
+        llvm::Value *llvmContinuations = context->irBuilder->CreateSelect(context->irBuilder->CreateICmpULT(llvmLead, byteConstant(0xE0), "utf8.lead.two"), lengthConstant(1), context->irBuilder->CreateSelect(context->irBuilder->CreateICmpULT(llvmLead, byteConstant(0xF0), "utf8.lead.three"), lengthConstant(2), lengthConstant(3), "utf8.continuations.long"), "utf8.continuations");
+        llvm::Value *llvmSecondLow = context->irBuilder->CreateSelect(context->irBuilder->CreateICmpEQ(llvmLead, byteConstant(0xE0), "utf8.lead.e0"), byteConstant(0xA0), context->irBuilder->CreateSelect(context->irBuilder->CreateICmpEQ(llvmLead, byteConstant(0xF0), "utf8.lead.f0"), byteConstant(0x90), byteConstant(0x80), "utf8.second.low.f0"), "utf8.second.low");
+        llvm::Value *llvmSecondHigh = context->irBuilder->CreateSelect(context->irBuilder->CreateICmpEQ(llvmLead, byteConstant(0xED), "utf8.lead.ed"), byteConstant(0x9F), context->irBuilder->CreateSelect(context->irBuilder->CreateICmpEQ(llvmLead, byteConstant(0xF4), "utf8.lead.f4"), byteConstant(0x8F), byteConstant(0xBF), "utf8.second.high.f4"), "utf8.second.high");
+        llvm::Value *llvmLast = context->irBuilder->CreateAdd(llvmStart, llvmContinuations, "utf8.codepoint.last", true, true);
+        llvm::Value *llvmTruncated = context->irBuilder->CreateICmpUGE(llvmLast, llvmLength, "utf8.codepoint.truncated");
+        generateBytesReturnIf(context, context->irBuilder->CreateOr(llvmInvalidLead, llvmTruncated, "utf8.lead.bad"), context->irBuilder->getFalse(), "utf8.lead.bad");
+
+        llvm::Value *llvmSecond = generateBytesLoad(context, llvmBytes, context->irBuilder->CreateAdd(llvmStart, lengthConstant(1), "utf8.second.index", true, true), "utf8.second");
+        llvm::Value *llvmSecondOutside = context->irBuilder->CreateOr(context->irBuilder->CreateICmpULT(llvmSecond, llvmSecondLow, "utf8.second.below"), context->irBuilder->CreateICmpUGT(llvmSecond, llvmSecondHigh, "utf8.second.above"), "utf8.second.outside");
+        generateBytesReturnIf(context, llvmSecondOutside, context->irBuilder->getFalse(), "utf8.second.bad");
+        context->irBuilder->CreateCondBr(context->irBuilder->CreateICmpUGT(llvmContinuations, lengthConstant(1), "utf8.has.third"), secondBlock, codePointDoneBlock);
+
+        auto generateContinuationCheck = [&](uint64_t offset, std::string twine)
+        {
+            llvm::Value *llvmContinuation = generateBytesLoad(context, llvmBytes, context->irBuilder->CreateAdd(llvmStart, lengthConstant(offset), twine + ".index", true, true), twine);
+            llvm::Value *llvmIsContinuation = context->irBuilder->CreateICmpEQ(context->irBuilder->CreateAnd(llvmContinuation, byteConstant(0xC0), twine + ".top"), byteConstant(0x80), twine + ".valid");
+            generateBytesReturnIf(context, context->irBuilder->CreateNot(llvmIsContinuation, twine + ".invalid"), context->irBuilder->getFalse(), twine + ".bad");
+        };
+
+        context->irBuilder->SetInsertPoint(secondBlock);
+        generateContinuationCheck(2, "utf8.third");
+        context->irBuilder->CreateCondBr(context->irBuilder->CreateICmpUGT(llvmContinuations, lengthConstant(2), "utf8.has.fourth"), thirdBlock, codePointDoneBlock);
+
+        context->irBuilder->SetInsertPoint(thirdBlock);
+        generateContinuationCheck(3, "utf8.fourth");
+        context->irBuilder->CreateBr(codePointDoneBlock);
+
+        context->irBuilder->SetInsertPoint(codePointDoneBlock);
+        llvm::Value *llvmNext = context->irBuilder->CreateAdd(llvmLast, lengthConstant(1), "utf8.codepoint.next", true, true);
+        llvmIndex->addIncoming(llvmNext, codePointDoneBlock);
+        context->irBuilder->CreateBr(conditionBlock);
+
+        context->irBuilder->SetInsertPoint(validBlock);
+        context->irBuilder->CreateRet(context->irBuilder->getTrue()); });
+}
+
+// void bytes.lower(i8 *bytes, i8 *target, i64 length) and bytes.upper: copies the bytes to target, changing the case of ASCII letters, other bytes are copied unchanged
+static llvm::Function *getBytesCaseKernel(GenerationContext *context, bool upper)
+{
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    llvm::Type *llvmByteType = llvm::Type::getInt8Ty(*context->context);
+    std::string twine = upper ? "upper" : "lower";
+    return getBytesKernel(context, "bytes." + twine, llvm::Type::getVoidTy(*context->context), {llvm::Type::getInt8PtrTy(*context->context), llvm::Type::getInt8PtrTy(*context->context), llvmLengthType}, [&](llvm::Function *kernel)
+                          {
+        llvm::Value *llvmBytes = kernel->getArg(0);
+        llvm::Value *llvmTarget = kernel->getArg(1);
+        llvm::Value *llvmLength = kernel->getArg(2);
+
+        // A letter is changed when byte - first letter <= 25, the case is the 0x20 bit
+        auto generateCaseChange = [&](llvm::Value *llvmValue, llvm::Value *llvmFirstLetter, llvm::Value *llvmLetterRange, llvm::Value *llvmCaseBit)
+        {
+            llvm::Value *llvmIsLetter = context->irBuilder->CreateICmpULE(context->irBuilder->CreateSub(llvmValue, llvmFirstLetter, twine + ".offset"), llvmLetterRange, twine + ".isletter");
+            return context->irBuilder->CreateSelect(llvmIsLetter, context->irBuilder->CreateXor(llvmValue, llvmCaseBit, twine + ".changed"), llvmValue, twine + ".result");
+        };
+        llvm::Value *llvmFirstLetter = llvm::ConstantInt::get(llvmByteType, upper ? 'a' : 'A', false);
+        llvm::Value *llvmLetterRange = llvm::ConstantInt::get(llvmByteType, 25, false);
+        llvm::Value *llvmCaseBit = llvm::ConstantInt::get(llvmByteType, 0x20, false);
+
+        std::vector<llvm::Value *> llvmNone;
+        llvm::Value *llvmTailStart = generateBytesLoop(context, llvm::ConstantInt::get(llvmLengthType, 0, false), llvmLength, bytesVectorWidth, twine + ".vector", llvmNone, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &)
+                                                       {
+            llvm::Value *llvmBlock = generateBytesVectorLoad(context, llvmBytes, llvmIndex, twine + ".block");
+            llvm::Value *llvmChanged = generateCaseChange(llvmBlock, context->irBuilder->CreateVectorSplat(bytesVectorWidth, llvmFirstLetter), context->irBuilder->CreateVectorSplat(bytesVectorWidth, llvmLetterRange), context->irBuilder->CreateVectorSplat(bytesVectorWidth, llvmCaseBit));
+            llvm::Value *llvmTargetPointer = context->irBuilder->CreateInBoundsGEP(llvmByteType, llvmTarget, llvmIndex, twine + ".target.ptr");
+            context->irBuilder->CreateAlignedStore(llvmChanged, context->irBuilder->CreateBitCast(llvmTargetPointer, llvmBlock->getType()->getPointerTo(), twine + ".target.vector.ptr"), llvm::MaybeAlign(1)); });
+        generateBytesLoop(context, llvmTailStart, llvmLength, 1, twine + ".tail", llvmNone, [&](llvm::Value *llvmIndex, std::vector<llvm::Value *> &)
+                          {
+            llvm::Value *llvmChanged = generateCaseChange(generateBytesLoad(context, llvmBytes, llvmIndex, twine + ".byte"), llvmFirstLetter, llvmLetterRange, llvmCaseBit);
+            context->irBuilder->CreateStore(llvmChanged, context->irBuilder->CreateInBoundsGEP(llvmByteType, llvmTarget, llvmIndex, twine + ".target.ptr")); });
+        context->irBuilder->CreateRetVoid(); });
+}
+
+// Returns a [UInt8 ..] slice of the bytes of a String or an array of UInt8, returns NULL without generating anything for other values
+// The bytes of a String are only copied with copyString, for results that keep pointing into them (split)
+TypedValue *generateBytesSlice(GenerationContext *context, TypedValue *value, bool copyString)
+{
+    Type *dereferencedType = value->getType();
+    while (dereferencedType->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(dereferencedType)->getPointedType() != NULL)
+    {
+        dereferencedType = static_cast<PointerType *>(dereferencedType)->getPointedType();
+    }
+
+    if (dereferencedType->getTypeCode() == TypeCode::STRING)
+    {
+        return generateStringSlice(context, generateStringToPointer(context, value), NULL, NULL, copyString);
+    }
+    if (dereferencedType->getTypeCode() != TypeCode::ARRAY || !(*static_cast<ArrayType *>(dereferencedType)->getItemType() == BYTE_TYPE))
+    {
+        return NULL;
+    }
+
+    TypedValue *arrayValue = generateDereferenceToValue(context, value);
+    if (static_cast<ArrayType *>(arrayValue->getType())->isSlice())
+    {
+        return arrayValue;
+    }
+    return generateArraySlice(context, arrayValue, NULL, NULL);
+}
+
+bool isBytesOperation(std::string name)
+{
+    return name == "find" || name == "count" || name == "compare" || name == "split" || name == "hash" || name == "isUtf8" || name == "lines" || name == "lower" || name == "upper";
+}
+
+// Generates a built-in operation on the bytes of a [UInt8 ..] slice (see generateBytesSlice), the work is done by the byte kernels
+// find(byte or bytes), count(byte), compare(bytes), split(byte), hash, isUtf8, lines, lower and upper, returns NULL on an error
+TypedValue *generateBytesOperation(GenerationContext *context, TypedValue *bytesSlice, std::string name, std::vector<TypedValue *> &arguments)
+{
+    assert(isBytesOperation(name));
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+    llvm::Value *llvmLength;
+    llvm::Value *llvmBytes = generateArrayStoragePointer(context, bytesSlice, &llvmLength);
+
+    int expectedArgumentCount = name == "find" || name == "count" || name == "compare" || name == "split" ? 1 : 0;
+    if (arguments.size() != expectedArgumentCount)
+    {
+        std::cout << "ERROR: " << name << " expects " << expectedArgumentCount << " parameters, got " << arguments.size() << "\n";
+        return NULL;
+    }
+
+    // A byte argument is a UInt8, a bytes argument anything generateBytesSlice accepts
+    TypedValue *byteArgument = NULL;
+    TypedValue *bytesArgument = NULL;
+    if (expectedArgumentCount > 0)
+    {
+        bytesArgument = name == "count" || name == "split" ? NULL : generateBytesSlice(context, arguments[0], false);
+        if (bytesArgument == NULL && name != "compare")
+        {
+            byteArgument = generateTypeConversion(context, arguments[0], &BYTE_TYPE, false);
+        }
+        if (bytesArgument == NULL && byteArgument == NULL)
+        {
+            std::cout << "ERROR: Invalid parameter for " << name << ", got " << arguments[0]->getType()->toString() << "\n";
+            return NULL;
+        }
+    }
+    llvm::Value *llvmOtherLength = NULL;
+    llvm::Value *llvmOtherBytes = bytesArgument == NULL ? NULL : generateArrayStoragePointer(context, bytesArgument, &llvmOtherLength);
+
+    if (name == "find")
+    {
+        llvm::Value *llvmIndex = byteArgument != NULL ? context->irBuilder->CreateCall(getBytesFindByteKernel(context), {llvmBytes, llvmLength, byteArgument->getValue()}, "bytes.find") : context->irBuilder->CreateCall(getBytesFindKernel(context), {llvmBytes, llvmLength, llvmOtherBytes, llvmOtherLength}, "bytes.find");
+        return new TypedValue(llvmIndex, new IntegerType(64, true));
+    }
+    else if (name == "count")
+    {
+        return new TypedValue(context->irBuilder->CreateCall(getBytesCountKernel(context), {llvmBytes, llvmLength, byteArgument->getValue()}, "bytes.count"), &UINT64_TYPE);
+    }
+    else if (name == "compare")
+    {
+        return new TypedValue(context->irBuilder->CreateCall(getBytesCompareKernel(context), {llvmBytes, llvmLength, llvmOtherBytes, llvmOtherLength}, "bytes.compare"), new IntegerType(32, true));
+    }
+    else if (name == "hash")
+    {
+        return new TypedValue(context->irBuilder->CreateCall(getBytesHashKernel(context), {llvmBytes, llvmLength}, "bytes.hash"), &UINT64_TYPE);
+    }
+    else if (name == "isUtf8")
+    {
+        return new TypedValue(context->irBuilder->CreateCall(getBytesIsUtf8Kernel(context), {llvmBytes, llvmLength}, "bytes.isutf8"), &BOOL_TYPE);
+    }
+    else if (name == "lines")
+    {
+        // Like the number of lines an editor shows, a last line without a newline is counted too
+        llvm::Value *llvmNewlines = context->irBuilder->CreateCall(getBytesCountKernel(context), {llvmBytes, llvmLength, llvm::ConstantInt::get(llvm::Type::getInt8Ty(*context->context), '\n', false)}, "bytes.lines.newlines");
+        llvm::Value *llvmLastIndex = context->irBuilder->CreateSub(llvmLength, llvm::ConstantInt::get(llvmLengthType, 1, false), "bytes.lines.lastindex");
+        llvm::Value *llvmLastIsNewline = context->irBuilder->CreateICmpEQ(context->irBuilder->CreateCall(getBytesFindByteKernel(context), {context->irBuilder->CreateInBoundsGEP(llvm::Type::getInt8Ty(*context->context), llvmBytes, llvmLastIndex, "bytes.lines.last.ptr"), llvm::ConstantInt::get(llvmLengthType, 1, false), llvm::ConstantInt::get(llvm::Type::getInt8Ty(*context->context), '\n', false)}, "bytes.lines.last"), llvm::ConstantInt::get(llvmLengthType, 0, false), "bytes.lines.terminated");
+        llvm::Value *llvmUnterminated = context->irBuilder->CreateAnd(context->irBuilder->CreateICmpNE(llvmLength, llvm::ConstantInt::get(llvmLengthType, 0, false), "bytes.lines.notempty"), context->irBuilder->CreateNot(llvmLastIsNewline, "bytes.lines.unterminated.last"), "bytes.lines.unterminated");
+        return new TypedValue(context->irBuilder->CreateAdd(llvmNewlines, context->irBuilder->CreateZExt(llvmUnterminated, llvmLengthType, "bytes.lines.unterminated.ext"), "bytes.lines", true, true), &UINT64_TYPE);
+    }
+    else if (name == "lower" || name == "upper")
+    {
+        TypedValue *copiedArray = generateArrayAllocation(context, &BYTE_TYPE, llvmLength, "bytes." + name);
+        llvm::Value *llvmUnusedLength;
+        llvm::Value *llvmCopiedStorage = generateArrayStoragePointer(context, copiedArray, &llvmUnusedLength);
+        llvm::Value *llvmCopiedBytes = generateArrayItemPointer(context, static_cast<ArrayType *>(copiedArray->getType()), llvmCopiedStorage, llvm::ConstantInt::get(llvmLengthType, 0, false), "bytes." + name + ".target");
+        context->irBuilder->CreateCall(getBytesCaseKernel(context, name == "upper"), {llvmBytes, llvmCopiedBytes, llvmLength});
+        return copiedArray;
+    }
+    else
+    {
+        // split returns a growable array of slices of the bytes, they are not copied
+        ArrayType *sliceType = static_cast<ArrayType *>(bytesSlice->getType());
+        ArrayType *partsType = new ArrayType(sliceType, false, true, false, 0, true);
+        TypedValue *partsPointer = generateGrowableArrayAllocation(context, partsType, llvm::ConstantInt::get(llvmLengthType, 0, false), "bytes.split");
+        llvm::Value *llvmOwner = context->irBuilder->CreateExtractValue(bytesSlice->getValue(), 2, "bytes.split.owner");
+
+        llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+        llvm::BasicBlock *entryBlock = context->irBuilder->GetInsertBlock();
+        llvm::BasicBlock *partBlock = llvm::BasicBlock::Create(*context->context, "bytes.split.part", currentFunction);
+        llvm::BasicBlock *nextBlock = llvm::BasicBlock::Create(*context->context, "bytes.split.next", currentFunction);
+        llvm::BasicBlock *doneBlock = llvm::BasicBlock::Create(*context->context, "bytes.split.done", currentFunction);
+        context->irBuilder->CreateBr(partBlock);
+
+        context->irBuilder->SetInsertPoint(partBlock);
+        llvm::PHINode *llvmStart = context->irBuilder->CreatePHI(llvmLengthType, 2, "bytes.split.start");
+        llvmStart->addIncoming(llvm::ConstantInt::get(llvmLengthType, 0, false), entryBlock);
+        llvm::Value *llvmRest = context->irBuilder->CreateInBoundsGEP(llvm::Type::getInt8Ty(*context->context), llvmBytes, llvmStart, "bytes.split.rest");
+        llvm::Value *llvmRestLength = context->irBuilder->CreateSub(llvmLength, llvmStart, "bytes.split.rest.length", true, true);
+        llvm::Value *llvmSeparator = context->irBuilder->CreateCall(getBytesFindByteKernel(context), {llvmRest, llvmRestLength, byteArgument->getValue()}, "bytes.split.separator");
+        llvm::Value *llvmFound = context->irBuilder->CreateICmpSGE(llvmSeparator, llvm::ConstantInt::get(llvmLengthType, 0, false), "bytes.split.found");
+        llvm::Value *llvmPartLength = context->irBuilder->CreateSelect(llvmFound, llvmSeparator, llvmRestLength, "bytes.split.part.length");
+        if (!generateGrowableArrayPush(context, partsPointer, generateSliceValue(context, sliceType, llvmPartLength, llvmRest, llvmOwner)))
+        {
+            return NULL;
+        }
+        context->irBuilder->CreateCondBr(llvmFound, nextBlock, doneBlock);
+
+        context->irBuilder->SetInsertPoint(nextBlock);
+        llvmStart->addIncoming(context->irBuilder->CreateAdd(context->irBuilder->CreateAdd(llvmStart, llvmSeparator, "bytes.split.separator.index", true, true), llvm::ConstantInt::get(llvmLengthType, 1, false), "bytes.split.next.start", true, true), nextBlock);
+        context->irBuilder->CreateBr(partBlock);
+
+        context->irBuilder->SetInsertPoint(doneBlock);
+        return partsPointer;
+    }
+}
+
+// Allocates a zeroed tensor with the given shape in a single managed array, the items are stored row-major (the last index is contiguous)
+TypedValue *generateTensorAllocation(GenerationContext *context, TensorType *tensorType, std::vector<llvm::Value *> &llvmShape)
+{
+    assert(llvmShape.size() == tensorType->getRank());
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+
+    llvm::Value *llvmTensor = llvm::UndefValue::get(tensorType->getLLVMType(context));
+    llvm::Value *llvmCount = llvm::ConstantInt::get(llvmLengthType, 1, false);
+    for (int dimension = tensorType->getRank() - 1; dimension >= 0; dimension--)
+    {
+        llvmTensor = context->irBuilder->CreateInsertValue(llvmTensor, llvmShape[dimension], {2, (unsigned int)dimension}, "tensor.shape");
+        llvmTensor = context->irBuilder->CreateInsertValue(llvmTensor, llvmCount, {3, (unsigned int)dimension}, "tensor.stride");
+        llvmCount = context->irBuilder->CreateMul(llvmCount, llvmShape[dimension], "tensor.count", true, true);
+    }
+
+    TypedValue *arrayValue = generateArrayAllocation(context, tensorType->getItemType(), llvmCount, "tensor");
+    ArrayType *arrayType = static_cast<ArrayType *>(arrayValue->getType());
+    llvm::Value *llvmLength;
+    llvm::Value *llvmStorage = generateArrayStoragePointer(context, arrayValue, &llvmLength);
+    llvm::Value *llvmItems = generateArrayItemPointer(context, arrayType, llvmStorage, llvm::ConstantInt::get(llvmLengthType, 0, false), "tensor.items");
+    llvm::Value *llvmSize = context->irBuilder->CreateMul(generateSizeOf(context, tensorType->getItemType()->getLLVMType(context), "tensor.item"), llvmCount, "tensor.size");
+    context->irBuilder->CreateMemSet(llvmItems, llvm::ConstantInt::get(llvm::Type::getInt8Ty(*context->context), 0, false), llvmSize, llvm::MaybeAlign());
+
+    llvmTensor = context->irBuilder->CreateInsertValue(llvmTensor, llvmItems, 0, "tensor.items");
+    llvmTensor = context->irBuilder->CreateInsertValue(llvmTensor, context->irBuilder->CreateStructGEP(arrayType->getArrayPointerType()->getLLVMPointedType(context), llvmStorage, 0, "tensor.owner"), 1, "tensor.owner");
+    return new TypedValue(llvmTensor, tensorType);
+}
+
+// Indexes the first llvmStarts.size() dimensions of a tensor, dimension d is indexed by llvmStarts[d] or narrowed to [llvmStarts[d], llvmEnds[d]) when ranges[d] is set
+// A NULL bound means the start or end of the dimension, every index and bound is checked
+// Returns a pointer to the item when every dimension is indexed, otherwise a view of the narrowed and remaining dimensions, returns NULL on an error
+TypedValue *generateTensorIndex(GenerationContext *context, TypedValue *tensorValue, std::vector<llvm::Value *> &llvmStarts, std::vector<llvm::Value *> &llvmEnds, std::vector<bool> &ranges)
+{
+    assert(tensorValue->getTypeCode() == TypeCode::TENSOR);
+    TensorType *tensorType = static_cast<TensorType *>(tensorValue->getType());
+    if (llvmStarts.size() > tensorType->getRank())
+    {
+        std::cout << "ERROR: Cannot index " << tensorType->toString() << " with " << llvmStarts.size() << " indices\n";
+        return NULL;
+    }
+    llvm::Type *llvmLengthType = ArrayType::getLLVMLengthFieldType(context);
+
+    // The indexed dimensions only move the first item, the offset is added with a single getelementptr
+    llvm::Value *llvmOffset = llvm::ConstantInt::get(llvmLengthType, 0, false);
+    std::vector<llvm::Value *> llvmViewShape;
+    std::vector<llvm::Value *> llvmViewStrides;
+    for (int dimension = 0; dimension < tensorType->getRank(); dimension++)
+    {
+        llvm::Value *llvmExtent = context->irBuilder->CreateExtractValue(tensorValue->getValue(), {2, (unsigned int)dimension}, "tensor.shape");
+        llvm::Value *llvmStride = context->irBuilder->CreateExtractValue(tensorValue->getValue(), {3, (unsigned int)dimension}, "tensor.stride");
+        if (dimension >= llvmStarts.size())
+        {
+            llvmViewShape.push_back(llvmExtent);
+            llvmViewStrides.push_back(llvmStride);
+            continue;
+        }
+
+        llvm::Value *llvmStart = llvmStarts[dimension];
+        if (ranges[dimension])
+        {
+            // 0 <= start <= end <= extent, like a slice
+            llvm::Value *llvmEnd = llvmEnds[dimension] == NULL ? llvmExtent : llvmEnds[dimension];
+            llvmStart = llvmStart == NULL ? llvm::ConstantInt::get(llvmLengthType, 0, false) : llvmStart;
+            generateBoundsCheck(context, llvmEnd, context->irBuilder->CreateAdd(llvmExtent, llvm::ConstantInt::get(llvmLengthType, 1, false), "tensor.end.limit"), "tensor.end");
+            generateBoundsCheck(context, llvmStart, context->irBuilder->CreateAdd(llvmEnd, llvm::ConstantInt::get(llvmLengthType, 1, false), "tensor.start.limit"), "tensor.start");
+            llvmViewShape.push_back(context->irBuilder->CreateSub(llvmEnd, llvmStart, "tensor.view.shape", true, true));
+            llvmViewStrides.push_back(llvmStride);
+        }
+        else
+        {
+            generateBoundsCheck(context, llvmStart, llvmExtent, "tensor.index");
+        }
+        llvmOffset = context->irBuilder->CreateAdd(llvmOffset, context->irBuilder->CreateMul(llvmStart, llvmStride, "tensor.index.offset", true, true), "tensor.offset", true, true);
+    }
+
+    llvm::Value *llvmItems = context->irBuilder->CreateExtractValue(tensorValue->getValue(), 0, "tensor.items");
+    llvm::Value *llvmFirstItem = context->irBuilder->CreateInBoundsGEP(tensorType->getItemType()->getLLVMType(context), llvmItems, llvmOffset, "tensor.item.ptr");
+    if (llvmViewShape.empty())
+    {
+        return new TypedValue(llvmFirstItem, tensorType->getItemType()->getUnmanagedPointerToType());
+    }
+
+    TensorType *viewType = new TensorType(tensorType->getItemType(), llvmViewShape.size());
+    llvm::Value *llvmView = llvm::UndefValue::get(viewType->getLLVMType(context));
+    llvmView = context->irBuilder->CreateInsertValue(llvmView, llvmFirstItem, 0, "tensor.view.items");
+    llvmView = context->irBuilder->CreateInsertValue(llvmView, context->irBuilder->CreateExtractValue(tensorValue->getValue(), 1, "tensor.owner"), 1, "tensor.view.owner");
+    for (unsigned int dimension = 0; dimension < llvmViewShape.size(); dimension++)
+    {
+        llvmView = context->irBuilder->CreateInsertValue(llvmView, llvmViewShape[dimension], {2, dimension}, "tensor.view.shape");
+        llvmView = context->irBuilder->CreateInsertValue(llvmView, llvmViewStrides[dimension], {3, dimension}, "tensor.view.stride");
+    }
+    return new TypedValue(llvmView, viewType);
+}
+
+// Returns the built-in member of a tensor called name or NULL if it has no such member
+// shape and strides are UInt64 vectors with a lane per dimension (a UInt64 for rank 1), transpose is a view with the dimensions in reverse order
+TypedValue *generateTensorMember(GenerationContext *context, TypedValue *tensorValue, std::string name)
+{
+    assert(tensorValue->getTypeCode() == TypeCode::TENSOR);
+    TensorType *tensorType = static_cast<TensorType *>(tensorValue->getType());
+    if (name == "shape" || name == "strides")
+    {
+        IntegerType *dimensionsType = new IntegerType(64, false, tensorType->getRank());
+        llvm::Value *llvmDimensions = llvm::UndefValue::get(dimensionsType->getLLVMType(context));
+        for (int dimension = 0; dimension < tensorType->getRank(); dimension++)
+        {
+            llvm::Value *llvmDimension = context->irBuilder->CreateExtractValue(tensorValue->getValue(), {name == "shape" ? 2u : 3u, (unsigned int)dimension}, "tensor." + name);
+            llvmDimensions = tensorType->getRank() == 1 ? llvmDimension : context->irBuilder->CreateInsertElement(llvmDimensions, llvmDimension, (uint64_t)dimension, "tensor." + name + ".lanes");
+        }
+        return new TypedValue(llvmDimensions, dimensionsType);
+    }
+    if (name == "transpose")
+    {
+        llvm::Value *llvmShape = context->irBuilder->CreateExtractValue(tensorValue->getValue(), 2, "tensor.shape");
+        llvm::Value *llvmStrides = context->irBuilder->CreateExtractValue(tensorValue->getValue(), 3, "tensor.strides");
+        llvm::Value *llvmTransposed = tensorValue->getValue();
+        for (int dimension = 0; dimension < tensorType->getRank(); dimension++)
+        {
+            unsigned int transposedDimension = tensorType->getRank() - 1 - dimension;
+            llvmTransposed = context->irBuilder->CreateInsertValue(llvmTransposed, context->irBuilder->CreateExtractValue(llvmShape, (unsigned int)dimension, "tensor.shape"), {2, transposedDimension}, "tensor.transpose.shape");
+            llvmTransposed = context->irBuilder->CreateInsertValue(llvmTransposed, context->irBuilder->CreateExtractValue(llvmStrides, (unsigned int)dimension, "tensor.stride"), {3, transposedDimension}, "tensor.transpose.stride");
+        }
+        return new TypedValue(llvmTransposed, tensorType);
+    }
+    return NULL;
+}
+
+// Returns a pointer to a field of the growable array behind a managed pointer: 0 is the length, 1 the capacity and 2 the pointer to the items
+llvm::Value *generateGrowableArrayFieldPointer(GenerationContext *context, TypedValue *arrayPointer, unsigned int field, std::string twine)
+{
+    PointerType *pointerType = static_cast<PointerType *>(arrayPointer->getType());
+    assert(pointerType->isManaged() && pointerType->getPointedType()->getTypeCode() == TypeCode::ARRAY && static_cast<ArrayType *>(pointerType->getPointedType())->isGrowable());
+
+    std::vector<llvm::Value *> indices;
+    indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
+    // Select array (not ref count field)
+    indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 1, false));
+    indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), field, false));
+    return context->irBuilder->CreateInBoundsGEP(pointerType->getLLVMPointedType(context), arrayPointer->getValue(), indices, twine);
+}
+
+// Allocates an empty growable array with room for llvmCapacity items, its reference count starts at 1
+TypedValue *generateGrowableArrayAllocation(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmCapacity, std::string twine)
+{
+    PointerType *pointerType = new PointerType(arrayType, true);
+    TypedValue *arrayPointer = new TypedValue(generateMalloc(context, pointerType->getLLVMPointedType(context), twine), pointerType);
+
+    llvm::Value *llvmRefCountPointer = context->irBuilder->CreateStructGEP(pointerType->getLLVMPointedType(context), arrayPointer->getValue(), 0, twine + ".ref");
+    context->irBuilder->CreateStore(llvm::ConstantInt::get(getRefCountType(*context->context), 1, false), llvmRefCountPointer, false);
+
+    llvm::Type *llvmItemType = arrayType->getItemType()->getLLVMType(context);
+    llvm::Value *llvmItems;
+    llvm::ConstantInt *llvmConstantCapacity = llvm::dyn_cast<llvm::ConstantInt>(llvmCapacity);
+    if (llvmConstantCapacity != NULL && llvmConstantCapacity->isZero())
+    {
+        // The items are allocated by the first push
+        llvmItems = llvm::ConstantPointerNull::get(llvmItemType->getPointerTo());
+    }
+    else
+    {
+        llvm::Value *llvmSize = context->irBuilder->CreateMul(generateSizeOf(context, llvmItemType, twine + ".items"), llvmCapacity, twine + ".items.size", true, true);
+        llvmItems = generateRealloc(context, llvmItemType, llvm::ConstantPointerNull::get(llvmItemType->getPointerTo()), llvmSize, twine + ".items");
+    }
+
+    context->irBuilder->CreateStore(llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false), generateGrowableArrayFieldPointer(context, arrayPointer, 0, twine + ".length.ptr"));
+    context->irBuilder->CreateStore(llvmCapacity, generateGrowableArrayFieldPointer(context, arrayPointer, 1, twine + ".capacity.ptr"));
+    context->irBuilder->CreateStore(llvmItems, generateGrowableArrayFieldPointer(context, arrayPointer, 2, twine + ".items.ptr"));
+    return arrayPointer;
+}
+
+// Makes room for at least llvmMinCapacity items, the capacity is at least doubled so adding items one by one takes amortized constant time
+// The items are only referenced by the array, so chocoRealloc may move them, it grows the block in place when the allocator can
+static void generateGrowableArrayGrow(GenerationContext *context, TypedValue *arrayPointer, llvm::Value *llvmMinCapacity)
+{
+    ArrayType *arrayType = static_cast<ArrayType *>(static_cast<PointerType *>(arrayPointer->getType())->getPointedType());
+    llvm::Type *llvmItemType = arrayType->getItemType()->getLLVMType(context);
+
+    llvm::Value *llvmCapacityPointer = generateGrowableArrayFieldPointer(context, arrayPointer, 1, "array.grow.capacity.ptr");
+    llvm::Value *llvmItemsPointer = generateGrowableArrayFieldPointer(context, arrayPointer, 2, "array.grow.items.ptr");
+    llvm::Value *llvmCapacity = context->irBuilder->CreateLoad(ArrayType::getLLVMLengthFieldType(context), llvmCapacityPointer, "array.grow.capacity");
+    llvm::Value *llvmDoubledCapacity = context->irBuilder->CreateMul(llvmCapacity, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 2, false), "array.grow.doubled", true, true);
+    llvm::Value *llvmNewCapacity = context->irBuilder->CreateSelect(context->irBuilder->CreateICmpUGT(llvmMinCapacity, llvmDoubledCapacity, "array.grow.min"), llvmMinCapacity, llvmDoubledCapacity, "array.grow.newcapacity");
+
+    llvm::Value *llvmItems = context->irBuilder->CreateLoad(llvmItemType->getPointerTo(), llvmItemsPointer, "array.grow.items");
+    llvm::Value *llvmSize = context->irBuilder->CreateMul(generateSizeOf(context, llvmItemType, "array.grow"), llvmNewCapacity, "array.grow.size", true, true);
+    llvm::Value *llvmNewItems = generateRealloc(context, llvmItemType, llvmItems, llvmSize, "array.grow");
+
+    context->irBuilder->CreateStore(llvmNewItems, llvmItemsPointer);
+    context->irBuilder->CreateStore(llvmNewCapacity, llvmCapacityPointer);
+}
+
+// Grows the array when it has room for less than llvmCapacity items, the growth check is marked as unlikely to pass
+void generateGrowableArrayReserve(GenerationContext *context, TypedValue *arrayPointer, llvm::Value *llvmCapacity, llvm::Value *llvmMinCapacity)
+{
+    llvm::Value *llvmCurrentCapacity = context->irBuilder->CreateLoad(ArrayType::getLLVMLengthFieldType(context), generateGrowableArrayFieldPointer(context, arrayPointer, 1, "array.reserve.capacity.ptr"), "array.reserve.capacity");
+    llvm::Value *llvmFull = context->irBuilder->CreateICmpUGT(llvmCapacity, llvmCurrentCapacity, "array.reserve.full");
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *growBlock = llvm::BasicBlock::Create(*context->context, "array.reserve.grow", currentFunction);
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "array.reserve.cont", currentFunction);
+    llvm::MDNode *llvmUnlikelyWeights = llvm::MDBuilder(*context->context).createBranchWeights(1, 1 << 10);
+    context->irBuilder->CreateCondBr(llvmFull, growBlock, continueBlock, llvmUnlikelyWeights);
+
+    context->irBuilder->SetInsertPoint(growBlock);
+    generateGrowableArrayGrow(context, arrayPointer, llvmMinCapacity);
+    context->irBuilder->CreateBr(continueBlock);
+
+    context->irBuilder->SetInsertPoint(continueBlock);
+}
+
+// Appends an item, the array owns the reference of a managed item afterwards
+bool generateGrowableArrayPush(GenerationContext *context, TypedValue *arrayPointer, TypedValue *newValue)
+{
+    ArrayType *arrayType = static_cast<ArrayType *>(static_cast<PointerType *>(arrayPointer->getType())->getPointedType());
+
+    // An empty array starts with room for 4 items, see generateGrowableArrayGrow
+    llvm::Value *llvmLengthPointer = generateGrowableArrayFieldPointer(context, arrayPointer, 0, "array.push.length.ptr");
+    llvm::Value *llvmLength = context->irBuilder->CreateLoad(ArrayType::getLLVMLengthFieldType(context), llvmLengthPointer, "array.push.length");
+    llvm::Value *llvmNewLength = context->irBuilder->CreateAdd(llvmLength, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 1, false), "array.push.newlength", true, true);
+    generateGrowableArrayReserve(context, arrayPointer, llvmNewLength, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 4, false));
+
+    llvm::Value *llvmItems = context->irBuilder->CreateLoad(arrayType->getLLVMArrayPointerType(context), generateGrowableArrayFieldPointer(context, arrayPointer, 2, "array.push.items.ptr"), "array.push.items");
+    llvm::Value *llvmItemPointer = generateArrayItemPointer(context, arrayType, llvmItems, llvmLength, "array.push.item");
+    if (!generateAssignment(context, new TypedValue(llvmItemPointer, arrayType->getItemType()->getUnmanagedPointerToType()), newValue, false))
+    {
+        return false;
+    }
+
+    context->irBuilder->CreateStore(llvmNewLength, llvmLengthPointer);
+    return true;
+}
+
+// Removes the last item and returns it, the reference of a managed item moves to the returned value
+TypedValue *generateGrowableArrayPop(GenerationContext *context, TypedValue *arrayPointer)
+{
+    ArrayType *arrayType = static_cast<ArrayType *>(static_cast<PointerType *>(arrayPointer->getType())->getPointedType());
+
+    llvm::Value *llvmLengthPointer = generateGrowableArrayFieldPointer(context, arrayPointer, 0, "array.pop.length.ptr");
+    llvm::Value *llvmLength = context->irBuilder->CreateLoad(ArrayType::getLLVMLengthFieldType(context), llvmLengthPointer, "array.pop.length");
+    llvm::Value *llvmEmpty = context->irBuilder->CreateICmpEQ(llvmLength, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false), "array.pop.empty");
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *emptyBlock = llvm::BasicBlock::Create(*context->context, "array.pop.panic", currentFunction);
+    llvm::BasicBlock *okBlock = llvm::BasicBlock::Create(*context->context, "array.pop.ok", currentFunction);
+    llvm::MDNode *llvmUnlikelyWeights = llvm::MDBuilder(*context->context).createBranchWeights(1, 1 << 20);
+    context->irBuilder->CreateCondBr(llvmEmpty, emptyBlock, okBlock, llvmUnlikelyWeights);
+
+    context->irBuilder->SetInsertPoint(emptyBlock);
+    generatePanic(context, "Pop from empty array");
+
+    context->irBuilder->SetInsertPoint(okBlock);
+    llvm::Value *llvmNewLength = context->irBuilder->CreateSub(llvmLength, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 1, false), "array.pop.newlength", true, true);
+    llvm::Value *llvmItems = context->irBuilder->CreateLoad(arrayType->getLLVMArrayPointerType(context), generateGrowableArrayFieldPointer(context, arrayPointer, 2, "array.pop.items.ptr"), "array.pop.items");
+    llvm::Value *llvmItemPointer = generateArrayItemPointer(context, arrayType, llvmItems, llvmNewLength, "array.pop.item");
+    TypedValue *item = generateLoad(context, new TypedValue(llvmItemPointer, arrayType->getItemType()->getUnmanagedPointerToType()));
+
+    context->irBuilder->CreateStore(llvmNewLength, llvmLengthPointer);
+    return item;
+}
+
+// Shortens the array to llvmLength items, releasing the removed ones, a longer length leaves the array unchanged
+void generateGrowableArrayTruncate(GenerationContext *context, TypedValue *arrayPointer, llvm::Value *llvmNewLength)
+{
+    ArrayType *arrayType = static_cast<ArrayType *>(static_cast<PointerType *>(arrayPointer->getType())->getPointedType());
+
+    llvm::Value *llvmLengthPointer = generateGrowableArrayFieldPointer(context, arrayPointer, 0, "array.truncate.length.ptr");
+    llvm::Value *llvmLength = context->irBuilder->CreateLoad(ArrayType::getLLVMLengthFieldType(context), llvmLengthPointer, "array.truncate.length");
+    llvm::Value *llvmShorter = context->irBuilder->CreateICmpULT(llvmNewLength, llvmLength, "array.truncate.shorter");
+    llvmNewLength = context->irBuilder->CreateSelect(llvmShorter, llvmNewLength, llvmLength, "array.truncate.newlength");
+
+    llvm::Value *llvmItems = context->irBuilder->CreateLoad(arrayType->getLLVMArrayPointerType(context), generateGrowableArrayFieldPointer(context, arrayPointer, 2, "array.truncate.items.ptr"), "array.truncate.items");
+    generateGrowableArrayRelease(context, arrayType, llvmItems, llvmNewLength, llvmLength);
+
+    context->irBuilder->CreateStore(llvmNewLength, llvmLengthPointer);
+}
+
+// Releases the items in [llvmStart, llvmEnd) of a growable array, nothing is generated when its items are not managed pointers or Strings
+void generateGrowableArrayRelease(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmItems, llvm::Value *llvmStart, llvm::Value *llvmEnd)
+{
+    Type *itemType = arrayType->getItemType();
+    bool managedItems = (itemType->getTypeCode() == TypeCode::POINTER && static_cast<PointerType *>(itemType)->isManaged()) || (itemType->getTypeCode() == TypeCode::UNION && static_cast<UnionType *>(itemType)->containsManagedPointer()) || itemType->getTypeCode() == TypeCode::STRING;
+    if (!managedItems)
+    {
+        return;
+    }
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *startBlock = context->irBuilder->GetInsertBlock();
+    llvm::BasicBlock *loopBlock = llvm::BasicBlock::Create(*context->context, "array.release.loop", currentFunction);
+    llvm::BasicBlock *bodyBlock = llvm::BasicBlock::Create(*context->context, "array.release.body", currentFunction);
+    llvm::BasicBlock *endBlock = llvm::BasicBlock::Create(*context->context, "array.release.end", currentFunction);
+    context->irBuilder->CreateBr(loopBlock);
+
+    context->irBuilder->SetInsertPoint(loopBlock);
+    llvm::PHINode *llvmIndex = context->irBuilder->CreatePHI(ArrayType::getLLVMLengthFieldType(context), 2, "array.release.index");
+    llvmIndex->addIncoming(llvmStart, startBlock);
+    context->irBuilder->CreateCondBr(context->irBuilder->CreateICmpULT(llvmIndex, llvmEnd, "array.release.cmp"), bodyBlock, endBlock);
+
+    context->irBuilder->SetInsertPoint(bodyBlock);
+    llvm::Value *llvmItemPointer = generateArrayItemPointer(context, arrayType, llvmItems, llvmIndex, "array.release.item");
+    llvm::Value *llvmItem = context->irBuilder->CreateLoad(itemType->getLLVMType(context), llvmItemPointer, "array.release.item.load");
+    generateDecrementReferenceIfPointer(context, new TypedValue(llvmItem, itemType), true);
+    llvmIndex->addIncoming(context->irBuilder->CreateAdd(llvmIndex, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 1, false), "array.release.next", true, true), context->irBuilder->GetInsertBlock());
+    context->irBuilder->CreateBr(loopBlock);
+
+    context->irBuilder->SetInsertPoint(endBlock);
+}
+
+// Panics when two array lengths differ, differing constant lengths are a compile error
+static void generateArrayLengthCheck(GenerationContext *context, llvm::Value *llvmLength, llvm::Value *llvmOtherLength, std::string twine)
+{
+    llvm::ConstantInt *llvmConstantLength = llvm::dyn_cast<llvm::ConstantInt>(llvmLength);
+    llvm::ConstantInt *llvmConstantOtherLength = llvm::dyn_cast<llvm::ConstantInt>(llvmOtherLength);
+    if (llvmConstantLength != NULL && llvmConstantOtherLength != NULL)
+    {
+        if (llvmConstantLength->getZExtValue() != llvmConstantOtherLength->getZExtValue())
+        {
+            std::cout << "ERROR: Array lengths " << llvmConstantLength->getZExtValue() << " and " << llvmConstantOtherLength->getZExtValue() << " do not match\n";
+            exit(-1);
+        }
+        return;
+    }
+    if (!context->boundsChecks)
+    {
+        return;
+    }
+
+    llvm::Value *llvmDifferent = context->irBuilder->CreateICmpNE(llvmLength, llvmOtherLength, twine + ".lengthdiffers");
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *differentBlock = llvm::BasicBlock::Create(*context->context, twine + ".lengthdiffers", currentFunction);
+    llvm::BasicBlock *okBlock = llvm::BasicBlock::Create(*context->context, twine + ".lengthok", currentFunction);
+    llvm::MDNode *llvmLikelyWeights = llvm::MDBuilder(*context->context).createBranchWeights(1, 1 << 20);
+    context->irBuilder->CreateCondBr(llvmDifferent, differentBlock, okBlock, llvmLikelyWeights);
+
+    context->irBuilder->SetInsertPoint(differentBlock);
+    generatePanic(context, "Array lengths do not match");
+
+    context->irBuilder->SetInsertPoint(okBlock);
+}
+
+// Converts an operand of an array expression, arrays become array expression operands, scalars stay the same
+static TypedValue *generateArrayExpressionOperand(GenerationContext *context, TypedValue *value)
+{
+    if (value->getTypeCode() == TypeCode::POINTER)
+    {
+        value = generateDereferenceToValue(context, value);
+    }
+    if (value->getTypeCode() != TypeCode::ARRAY)
+    {
+        return value;
+    }
+
+    ArrayType *arrayType = static_cast<ArrayType *>(value->getType());
+    if (arrayType->getByValue())
+    {
+        std::cout << "ERROR: Value arrays cannot be used in array expressions, got " << arrayType->toString() << "\n";
+        exit(-1);
+        return NULL;
+    }
+    if (arrayType->getItemType()->getTypeCode() != TypeCode::INTEGER && arrayType->getItemType()->getTypeCode() != TypeCode::FLOAT)
+    {
+        std::cout << "ERROR: Array expressions only support arrays of numbers, got " << arrayType->toString() << "\n";
+        exit(-1);
+        return NULL;
+    }
+
+    llvm::Value *llvmLength;
+    llvm::Value *llvmStorage = generateArrayStoragePointer(context, value, &llvmLength);
+    if (llvmLength == NULL)
+    {
+        std::cout << "ERROR: Cannot use array " << arrayType->toString() << " in an array expression, its length is unknown\n";
+        exit(-1);
+        return NULL;
+    }
+    return new TypedValue(llvmLength, new ArrayExpressionType(arrayType, llvmStorage));
+}
+
+// Combines two arrays, array expressions or scalars into a new array expression, only the lengths are checked here
+TypedValue *generateArrayExpression(GenerationContext *context, const Token *operatorToken, TypedValue *left, TypedValue *right)
+{
+    left = generateArrayExpressionOperand(context, left);
+    right = generateArrayExpressionOperand(context, right);
+
+    bool leftIsArray = left->getTypeCode() == TypeCode::ARRAY_EXPRESSION;
+    bool rightIsArray = right->getTypeCode() == TypeCode::ARRAY_EXPRESSION;
+    Type *leftItemType = leftIsArray ? static_cast<ArrayExpressionType *>(left->getType())->getItemType() : left->getType();
+    Type *rightItemType = rightIsArray ? static_cast<ArrayExpressionType *>(right->getType())->getItemType() : right->getType();
+
+    llvm::Value *llvmLength;
+    if (leftIsArray && rightIsArray)
+    {
+        if (*leftItemType != *rightItemType)
+        {
+            std::cout << "ERROR: Cannot " << operatorToken->value << " arrays of " << leftItemType->toString() << " and " << rightItemType->toString() << "\n";
+            exit(-1);
+            return NULL;
+        }
+        generateArrayLengthCheck(context, left->getValue(), right->getValue(), "array.expression");
+        llvmLength = left->getValue();
+    }
+    else
+    {
+        // The scalar is converted once, like a vector splat
+        TypedValue **scalar = leftIsArray ? &right : &left;
+        Type *itemType = leftIsArray ? leftItemType : rightItemType;
+        TypedValue *convertedScalar = generateTypeConversion(context, *scalar, itemType, llvm::isa<llvm::Constant>((*scalar)->getValue()));
+        if (convertedScalar == NULL)
+        {
+            std::cout << "ERROR: Cannot " << operatorToken->value << " array of " << itemType->toString() << " and " << (*scalar)->getType()->toString() << "\n";
+            exit(-1);
+            return NULL;
+        }
+        *scalar = convertedScalar;
+        llvmLength = leftIsArray ? left->getValue() : right->getValue();
+    }
+
+    Type *itemType = leftIsArray ? leftItemType : rightItemType;
+    switch (operatorToken->type)
+    {
+    case TokenType::OPERATOR_LT:
+    case TokenType::OPERATOR_GT:
+    case TokenType::OPERATOR_LTE:
+    case TokenType::OPERATOR_GTE:
+    case TokenType::OPERATOR_EQUALS:
+    case TokenType::OPERATOR_NOT_EQUALS:
+        itemType = &BOOL_TYPE;
+        break;
+    default:
+        break;
+    }
+
+    return new TypedValue(llvmLength, new ArrayExpressionType(operatorToken, left, right, itemType));
+}
+
+// Generates the item at llvmIndex of an array expression, scalars are returned as is
+static TypedValue *generateArrayExpressionItem(GenerationContext *context, TypedValue *expression, llvm::Value *llvmIndex)
+{
+    if (expression->getTypeCode() != TypeCode::ARRAY_EXPRESSION)
+    {
+        return expression;
+    }
+
+    ArrayExpressionType *expressionType = static_cast<ArrayExpressionType *>(expression->getType());
+    if (expressionType->isOperand())
+    {
+        llvm::Value *llvmItemPointer = generateArrayItemPointer(context, expressionType->getArrayType(), expressionType->getLLVMStorage(), llvmIndex, "array.expression.item");
+        return generateLoad(context, new TypedValue(llvmItemPointer, expressionType->getItemType()->getUnmanagedPointerToType()));
+    }
+
+    TypedValue *leftItem = generateArrayExpressionItem(context, expressionType->getLeft(), llvmIndex);
+    TypedValue *rightItem = generateArrayExpressionItem(context, expressionType->getRight(), llvmIndex);
+    return generateBinaryOperator(context, expressionType->getOperatorToken(), leftItem, rightItem);
+}
+
+// Generates a loop over all items of an array expression, generateBody is called with the 64 bit index in the loop body
+// The loop has a vectorize hint because the iterations are independent
+static void generateArrayExpressionLoop(GenerationContext *context, TypedValue *expression, std::function<void(llvm::Value *)> generateBody)
+{
+    Type *itemType = static_cast<ArrayExpressionType *>(expression->getType())->getItemType();
+    int itemBits = itemType->getTypeCode() == TypeCode::FLOAT ? static_cast<FloatType *>(itemType)->getBitSize() : static_cast<IntegerType *>(itemType)->getBitSize();
+    int vectorizeWidth = std::min(16, std::max(2, arrayExpressionVectorBits / itemBits));
+
+    llvm::Type *llvmIndexType = ArrayType::getLLVMLengthFieldType(context);
+    llvm::Value *llvmLength = expression->getValue();
+
+    llvm::Function *parentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *loopBlock = llvm::BasicBlock::Create(*context->context, "array.expression.loop");
+    llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "array.expression.cont");
+
+    llvm::AllocaInst *llvmIndexPointer = generateAllocaInCurrentFunction(context, llvmIndexType, "array.expression.index");
+    context->irBuilder->CreateStore(llvm::ConstantInt::get(llvmIndexType, 0, false), llvmIndexPointer);
+    llvm::Value *llvmEnterCondition = context->irBuilder->CreateICmpNE(llvmLength, llvm::ConstantInt::get(llvmIndexType, 0, false), "array.expression.guard");
+    context->irBuilder->CreateCondBr(llvmEnterCondition, loopBlock, continueBlock);
+
+    context->irBuilder->SetInsertPoint(loopBlock);
+    loopBlock->insertInto(parentFunction);
+    llvm::Value *llvmIndex = context->irBuilder->CreateLoad(llvmIndexType, llvmIndexPointer, "array.expression.index.load");
+
+    generateBody(llvmIndex);
+
+    llvm::Value *llvmNextIndex = context->irBuilder->CreateAdd(llvmIndex, llvm::ConstantInt::get(llvmIndexType, 1), "array.expression.index.next", true, false);
+    context->irBuilder->CreateStore(llvmNextIndex, llvmIndexPointer);
+    llvm::Value *llvmLoopCondition = context->irBuilder->CreateICmpULT(llvmNextIndex, llvmLength, "array.expression.cond");
+    llvm::BranchInst *llvmLatch = context->irBuilder->CreateCondBr(llvmLoopCondition, loopBlock, continueBlock);
+    llvmLatch->setMetadata(llvm::LLVMContext::MD_loop, generateLoopMetadata(context, vectorizeWidth, 0));
+
+    context->irBuilder->SetInsertPoint(continueBlock);
+    continueBlock->insertInto(parentFunction);
+}
+
+// Computes an array expression into a new managed array or a value array, this is the only place where items are stored
+TypedValue *generateArrayExpressionToArray(GenerationContext *context, TypedValue *expression, ArrayType *targetType)
+{
+    ArrayExpressionType *expressionType = static_cast<ArrayExpressionType *>(expression->getType());
+    if (!targetType->getManaged() && !targetType->getByValue())
+    {
+        std::cout << "ERROR: Cannot convert " << expressionType->toString() << " to unmanaged array " << targetType->toString() << "\n";
+        return NULL;
+    }
+    if (targetType->hasKnownCount())
+    {
+        generateArrayLengthCheck(context, expression->getValue(), llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), targetType->getCount(), false), "array.expression");
+    }
+
+    TypedValue *resultArray;
+    ArrayType *storageArrayType;
+    llvm::Value *llvmStorage;
+    if (targetType->getByValue())
+    {
+        llvmStorage = generateAllocaInCurrentFunction(context, targetType->getLLVMType(context), "array.expression.value", targetType->getAlign());
+        storageArrayType = new ArrayType(targetType->getItemType(), targetType->getCount(), false, false);
+        resultArray = NULL;
+    }
+    else
+    {
+        resultArray = generateArrayAllocation(context, targetType->getItemType(), expression->getValue(), "array.expression", targetType->getAlign());
+        storageArrayType = static_cast<ArrayType *>(resultArray->getType());
+        llvm::Value *llvmUnusedLength;
+        llvmStorage = generateArrayStoragePointer(context, resultArray, &llvmUnusedLength);
+    }
+
+    bool converted = true;
+    generateArrayExpressionLoop(context, expression, [&](llvm::Value *llvmIndex)
+                                {
+        TypedValue *item = generateTypeConversion(context, generateArrayExpressionItem(context, expression, llvmIndex), targetType->getItemType(), false);
+        if (item == NULL)
+        {
+            converted = false;
+            return;
+        }
+        llvm::Value *llvmItemPointer = generateArrayItemPointer(context, storageArrayType, llvmStorage, llvmIndex, "array.expression.store");
+        context->irBuilder->CreateStore(item->getValue(), llvmItemPointer); });
+    if (!converted)
+    {
+        std::cout << "ERROR: Cannot convert " << expressionType->toString() << " to " << targetType->toString() << "\n";
+        return NULL;
+    }
+
+    if (targetType->getByValue())
+    {
+        return new TypedValue(context->irBuilder->CreateLoad(targetType->getLLVMType(context), llvmStorage, "array.expression.value.load"), targetType);
+    }
+    return new TypedValue(resultArray->getValue(), targetType);
+}
+
+// Reduces an array or array expression to a single value (a.sum, (a * b).max), returns NULL for unknown names
+// The reduction is computed in the same loop as the expression, the vectorizer turns it into vector reductions
+TypedValue *generateArrayReduction(GenerationContext *context, TypedValue *arrayValue, std::string name)
+{
+    if (name != "sum" && name != "product" && name != "min" && name != "max")
+    {
+        return NULL;
+    }
+
+    TypedValue *expression = generateArrayExpressionOperand(context, arrayValue);
+    if (expression->getTypeCode() != TypeCode::ARRAY_EXPRESSION)
+    {
+        return NULL;
+    }
+    Type *itemType = static_cast<ArrayExpressionType *>(expression->getType())->getItemType();
+    llvm::Type *llvmItemType = itemType->getLLVMType(context);
+
+    llvm::Value *llvmInitialValue;
+    if (itemType->getTypeCode() == TypeCode::FLOAT)
+    {
+        if (name == "sum")
+        {
+            llvmInitialValue = llvm::ConstantFP::getNegativeZero(llvmItemType);
+        }
+        else if (name == "product")
+        {
+            llvmInitialValue = llvm::ConstantFP::get(llvmItemType, 1.0);
+        }
+        else
+        {
+            llvmInitialValue = llvm::ConstantFP::getInfinity(llvmItemType, name == "max");
+        }
+    }
+    else
+    {
+        IntegerType *itemIntType = static_cast<IntegerType *>(itemType);
+        unsigned int bits = itemIntType->getBitSize();
+        if (name == "sum")
+        {
+            llvmInitialValue = llvm::ConstantInt::get(llvmItemType, 0, false);
+        }
+        else if (name == "product")
+        {
+            llvmInitialValue = llvm::ConstantInt::get(llvmItemType, 1, false);
+        }
+        else if (name == "min")
+        {
+            llvmInitialValue = llvm::ConstantInt::get(*context->context, itemIntType->getSigned() ? llvm::APInt::getSignedMaxValue(bits) : llvm::APInt::getMaxValue(bits));
+        }
+        else
+        {
+            llvmInitialValue = llvm::ConstantInt::get(*context->context, itemIntType->getSigned() ? llvm::APInt::getSignedMinValue(bits) : llvm::APInt::getMinValue(bits));
+        }
+    }
+
+    llvm::AllocaInst *llvmAccumulatorPointer = generateAllocaInCurrentFunction(context, llvmItemType, "array." + name);
+    context->irBuilder->CreateStore(llvmInitialValue, llvmAccumulatorPointer);
+
+    generateArrayExpressionLoop(context, expression, [&](llvm::Value *llvmIndex)
+                                {
+        llvm::Value *llvmItem = generateArrayExpressionItem(context, expression, llvmIndex)->getValue();
+        llvm::Value *llvmAccumulator = context->irBuilder->CreateLoad(llvmItemType, llvmAccumulatorPointer, "array." + name + ".load");
+        llvm::Value *llvmNext;
+        if (itemType->getTypeCode() == TypeCode::FLOAT)
+        {
+            // Allowing reassociation changes the rounding compared to a sequential sum, but lets the loop be vectorized
+            llvm::FastMathFlags flags;
+            flags.setAllowReassoc();
+            if (name == "sum")
+            {
+                llvmNext = context->irBuilder->CreateFAdd(llvmAccumulator, llvmItem, "array.sum.next");
+            }
+            else if (name == "product")
+            {
+                llvmNext = context->irBuilder->CreateFMul(llvmAccumulator, llvmItem, "array.product.next");
+            }
+            else
+            {
+                flags.setNoNaNs();
+                flags.setNoSignedZeros();
+                llvm::Value *llvmCompare = name == "min" ? context->irBuilder->CreateFCmpOLT(llvmItem, llvmAccumulator, "array.min.cmp") : context->irBuilder->CreateFCmpOGT(llvmItem, llvmAccumulator, "array.max.cmp");
+                llvm::cast<llvm::Instruction>(llvmCompare)->setFastMathFlags(flags);
+                llvmNext = context->irBuilder->CreateSelect(llvmCompare, llvmItem, llvmAccumulator, "array." + name + ".next");
+            }
+            llvm::cast<llvm::Instruction>(llvmNext)->setFastMathFlags(flags);
+        }
+        else
+        {
+            bool isSigned = static_cast<IntegerType *>(itemType)->getSigned();
+            if (name == "sum")
+            {
+                llvmNext = context->irBuilder->CreateAdd(llvmAccumulator, llvmItem, "array.sum.next");
+            }
+            else if (name == "product")
+            {
+                llvmNext = context->irBuilder->CreateMul(llvmAccumulator, llvmItem, "array.product.next");
+            }
+            else
+            {
+                llvm::Value *llvmCompare;
+                if (name == "min")
+                {
+                    llvmCompare = isSigned ? context->irBuilder->CreateICmpSLT(llvmItem, llvmAccumulator, "array.min.cmp") : context->irBuilder->CreateICmpULT(llvmItem, llvmAccumulator, "array.min.cmp");
+                }
+                else
+                {
+                    llvmCompare = isSigned ? context->irBuilder->CreateICmpSGT(llvmItem, llvmAccumulator, "array.max.cmp") : context->irBuilder->CreateICmpUGT(llvmItem, llvmAccumulator, "array.max.cmp");
+                }
+                llvmNext = context->irBuilder->CreateSelect(llvmCompare, llvmItem, llvmAccumulator, "array." + name + ".next");
+            }
+        }
+        context->irBuilder->CreateStore(llvmNext, llvmAccumulatorPointer); });
+
+    return new TypedValue(context->irBuilder->CreateLoad(llvmItemType, llvmAccumulatorPointer, "array." + name + ".result"), itemType);
+}
+
+bool generateAssignment(GenerationContext *context, TypedValue *valuePointer, TypedValue *newValue, bool isVolatile)
+{
+    std::cout << "debug: Assign " << newValue->getType()->toString() << " to " << valuePointer->getType()->toString() << " ('" << valuePointer->getOriginVariable() << "')\n";
+
+    if (valuePointer->getTypeCode() != TypeCode::POINTER)
+    {
+        std::cout << "ERROR: Can only assign to a pointer\n";
+        return false;
     }
     PointerType *valuePointerType = static_cast<PointerType *>(valuePointer->getType());
 
@@ -725,10 +3451,98 @@ bool generateAssignment(GenerationContext *context, TypedValue *valuePointer, Ty
         std::cout << "ERROR: Cannot assign " << newValue->getType()->toString() << " to " << valuePointer->getType()->toString() << " ('" << valuePointer->getOriginVariable() << "')\n";
         return false;
     }
-    context->irBuilder->CreateStore(convertedValue->getValue(), valuePointer->getValue(), isVolatile);
+    if (isVolatile)
+    {
+        context->irBuilder->CreateStore(convertedValue->getValue(), valuePointer->getValue(), isVolatile);
+    }
+    else
+    {
+        generateAggregateStore(context, convertedValue->getValue(), valuePointer->getValue());
+    }
     return true;
 }
 
+// Stores a value, large aggregates are not stored whole (which LLVM lowers poorly)
+// A struct or array built with insertvalue is stored field by field in place, a value that was just loaded is copied with memcpy
+void generateAggregateStore(GenerationContext *context, llvm::Value *llvmValue, llvm::Value *llvmPointer)
+{
+    llvm::Type *llvmType = llvmValue->getType();
+    if (!llvmType->isAggregateType() || context->module->getDataLayout().getTypeStoreSize(llvmType) <= aggregateCopyByteLimit || !llvmValue->use_empty())
+    {
+        context->irBuilder->CreateStore(llvmValue, llvmPointer, false);
+        return;
+    }
+
+    if (llvm::InsertValueInst *llvmInsert = llvm::dyn_cast<llvm::InsertValueInst>(llvmValue))
+    {
+        // Unwind the chain of inserts down to the aggregate it started from, which is usually undef
+        std::vector<llvm::InsertValueInst *> llvmInserts;
+        llvmInserts.push_back(llvmInsert);
+        llvm::Value *llvmBase = llvmInsert->getAggregateOperand();
+        while (llvm::isa<llvm::InsertValueInst>(llvmBase) && llvmBase->hasOneUse())
+        {
+            llvmInserts.push_back(llvm::cast<llvm::InsertValueInst>(llvmBase));
+            llvmBase = llvm::cast<llvm::InsertValueInst>(llvmBase)->getAggregateOperand();
+        }
+        if (llvm::isa<llvm::InsertValueInst>(llvmBase))
+        {
+            // The partial value is used elsewhere, it cannot be taken apart
+            context->irBuilder->CreateStore(llvmValue, llvmPointer, false);
+            return;
+        }
+
+        std::vector<llvm::Value *> llvmFieldValues;
+        std::vector<std::vector<unsigned int>> fieldIndices;
+        for (llvm::InsertValueInst *llvmChainInsert : llvmInserts)
+        {
+            llvmFieldValues.push_back(llvmChainInsert->getInsertedValueOperand());
+            fieldIndices.push_back(std::vector<unsigned int>(llvmChainInsert->idx_begin(), llvmChainInsert->idx_end()));
+        }
+        for (llvm::InsertValueInst *llvmChainInsert : llvmInserts)
+        {
+            llvmChainInsert->eraseFromParent();
+        }
+
+        if (!llvm::isa<llvm::UndefValue>(llvmBase))
+        {
+            generateAggregateStore(context, llvmBase, llvmPointer);
+        }
+        // The first insert is the last one in the chain, stores keep the order of the inserts
+        for (int i = llvmFieldValues.size() - 1; i >= 0; i--)
+        {
+            std::vector<llvm::Value *> indices;
+            indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
+            for (unsigned int index : fieldIndices[i])
+            {
+                indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), index, false));
+            }
+            llvm::Value *llvmFieldPointer = context->irBuilder->CreateGEP(llvmType, llvmPointer, indices, llvmPointer->getName() + ".field.ptr");
+            generateAggregateStore(context, llvmFieldValues[i], llvmFieldPointer);
+        }
+        return;
+    }
+
+    if (llvm::LoadInst *llvmLoad = llvm::dyn_cast<llvm::LoadInst>(llvmValue))
+    {
+        // Memory may not have changed since the load, it is only copied when nothing was written after it
+        llvm::BasicBlock *currentBlock = context->irBuilder->GetInsertBlock();
+        bool unchanged = !llvmLoad->isVolatile() && llvmLoad->getParent() == currentBlock && context->irBuilder->GetInsertPoint() == currentBlock->end();
+        for (llvm::Instruction *llvmAfter = llvmLoad->getNextNode(); unchanged && llvmAfter != NULL; llvmAfter = llvmAfter->getNextNode())
+        {
+            unchanged = !llvmAfter->mayWriteToMemory();
+        }
+        if (unchanged)
+        {
+            llvm::Align llvmAlign = context->module->getDataLayout().getABITypeAlign(llvmType);
+            context->irBuilder->CreateMemCpy(llvmPointer, llvmAlign, llvmLoad->getPointerOperand(), llvmAlign, context->module->getDataLayout().getTypeStoreSize(llvmType));
+            llvmLoad->eraseFromParent();
+            return;
+        }
+    }
+
+    context->irBuilder->CreateStore(llvmValue, llvmPointer, false);
+}
+
 llvm::Value *generateSizeOf(GenerationContext *context, llvm::Type *type, std::string twine)
 {
     auto fakePointer = context->irBuilder->CreateGEP(type, llvm::ConstantPointerNull::get(type->getPointerTo()), llvm::ConstantInt::get(llvm::IntegerType::getInt32Ty(*context->context), llvm::APInt(32, 1)), twine + ".sizeof");
@@ -752,8 +3566,383 @@ void generatePanic(GenerationContext *context, std::string reason)
     context->irBuilder->CreateUnreachable();
 }
 
+// Returns a pointer to the storage of an array value, the length is set to NULL when it is not known
+llvm::Value *generateArrayStoragePointer(GenerationContext *context, TypedValue *arrayValue, llvm::Value **llvmLengthOut)
+{
+    assert(arrayValue->getTypeCode() == TypeCode::ARRAY);
+    ArrayType *arrayType = static_cast<ArrayType *>(arrayValue->getType());
+
+    llvm::Value *llvmStoragePointer;
+    *llvmLengthOut = NULL;
+    if (arrayType->isGrowable())
+    {
+        // { length, capacity, pointer to items }, the storage is the pointer to the items
+        llvmStoragePointer = context->irBuilder->CreateExtractValue(arrayValue->getValue(), 2, "array.items");
+        *llvmLengthOut = context->irBuilder->CreateExtractValue(arrayValue->getValue(), 0, "array.length");
+        return llvmStoragePointer;
+    }
+    else if (arrayType->isSlice())
+    {
+        // { length, pointer to items, owner }
+        llvmStoragePointer = context->irBuilder->CreateExtractValue(arrayValue->getValue(), 1, "slice.items");
+        *llvmLengthOut = context->irBuilder->CreateExtractValue(arrayValue->getValue(), 0, "slice.length");
+        return llvmStoragePointer;
+    }
+    else if (arrayType->getManaged())
+    {
+        // { length, pointer to { refcount, [n x T] } }
+        std::vector<unsigned int> indices;
+        indices.push_back(1);
+        llvmStoragePointer = context->irBuilder->CreateExtractValue(arrayValue->getValue(), indices, "array.ptr");
+
+        indices[0] = 0;
+        *llvmLengthOut = context->irBuilder->CreateExtractValue(arrayValue->getValue(), indices, "array.length");
+    }
+    else
+    {
+        llvmStoragePointer = arrayValue->getValue();
+    }
+
+    if (arrayType->hasKnownCount())
+    {
+        *llvmLengthOut = llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), arrayType->getCount(), false);
+    }
+
+    if (arrayType->getAlign() > 0 && !arrayType->isSoA() && !arrayType->getByValue())
+    {
+        // Lets the optimizer give loads and stores of the items (and vectors of them) their alignment
+        llvm::Value *llvmFirstItem = generateArrayItemPointer(context, arrayType, llvmStoragePointer, llvm::ConstantInt::get(ArrayType::getLLVMLengthFieldType(context), 0, false), "array.aligned");
+        context->irBuilder->CreateAlignmentAssumption(context->module->getDataLayout(), llvmFirstItem, arrayType->getAlign());
+    }
+
+    return llvmStoragePointer;
+}
+
+// Returns a pointer to an item in the storage returned by generateArrayStoragePointer, the index must be 64 bit and is not checked
+llvm::Value *generateArrayItemPointer(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmStoragePointer, llvm::Value *llvmIndex, std::string twine)
+{
+    assert(!arrayType->isSoA() && "soa array items are stored in columns, use generateSoAColumnPointer");
+
+    if (arrayType->isGrowable() || arrayType->isSlice())
+    {
+        return context->irBuilder->CreateGEP(arrayType->getItemType()->getLLVMType(context), llvmStoragePointer, llvmIndex, twine + ".gep");
+    }
+
+    std::vector<llvm::Value *> indices;
+    indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 0, false));
+    if (arrayType->getManaged())
+    {
+        // Select array (not ref count field)
+        indices.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context->context), 1, false));
+    }
+    indices.push_back(llvmIndex);
+
+    return context->irBuilder->CreateGEP(arrayType->getArrayPointerType()->getLLVMPointedType(context), llvmStoragePointer, indices, twine + ".gep");
+}
+
+// Returns the byte offset of a column in the storage of an soa array, which is { refcount, [length x field0], [length x field1], ... }
+// Every column is aligned for its field, the offset of the column after the last field is the size of the storage
+llvm::Value *generateSoAColumnOffset(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmLength, unsigned int column, std::string twine)
+{
+    const llvm::DataLayout &dataLayout = context->module->getDataLayout();
+    llvm::StructType *llvmItemType = llvm::cast<llvm::StructType>(arrayType->getItemType()->getLLVMType(context));
+    llvm::Type *llvmOffsetType = ArrayType::getLLVMLengthFieldType(context);
+
+    llvm::Value *llvmOffset = llvm::ConstantInt::get(llvmOffsetType, dataLayout.getTypeAllocSize(getRefCountType(*context->context)), false);
+    for (unsigned int i = 0; i <= column && i < llvmItemType->getNumElements(); i++)
+    {
+        llvm::Type *llvmFieldType = llvmItemType->getElementType(i);
+        uint64_t fieldAlign = std::max(dataLayout.getABITypeAlign(llvmFieldType).value(), arrayType->getAlign());
+        if (fieldAlign > 1)
+        {
+            llvmOffset = context->irBuilder->CreateAdd(llvmOffset, llvm::ConstantInt::get(llvmOffsetType, fieldAlign - 1, false), twine + ".align", true, true);
+            llvmOffset = context->irBuilder->CreateAnd(llvmOffset, llvm::ConstantInt::get(llvmOffsetType, ~(fieldAlign - 1), false), twine + ".aligned");
+        }
+        if (i < column)
+        {
+            llvm::Value *llvmColumnSize = context->irBuilder->CreateMul(llvmLength, llvm::ConstantInt::get(llvmOffsetType, dataLayout.getTypeAllocSize(llvmFieldType), false), twine + ".column.size", true, true);
+            llvmOffset = context->irBuilder->CreateAdd(llvmOffset, llvmColumnSize, twine + ".column.end", true, true);
+        }
+    }
+    return llvmOffset;
+}
+
+// Returns a pointer to the first item of a column (field in LLVM order) of an soa array value
+llvm::Value *generateSoAColumnPointer(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmArray, unsigned int column, std::string twine)
+{
+    llvm::Value *llvmLength;
+    llvm::Value *llvmStorage = generateArrayStoragePointer(context, new TypedValue(llvmArray, arrayType), &llvmLength);
+    llvm::Value *llvmOffset = generateSoAColumnOffset(context, arrayType, llvmLength, column, twine);
+    llvm::Value *llvmColumn = context->irBuilder->CreateInBoundsGEP(llvm::Type::getInt8Ty(*context->context), llvmStorage, llvmOffset, twine + ".column");
+    if (arrayType->getAlign() > 0)
+    {
+        context->irBuilder->CreateAlignmentAssumption(context->module->getDataLayout(), llvmColumn, arrayType->getAlign());
+    }
+
+    llvm::StructType *llvmItemType = llvm::cast<llvm::StructType>(arrayType->getItemType()->getLLVMType(context));
+    return context->irBuilder->CreateBitCast(llvmColumn, llvmItemType->getElementType(column)->getPointerTo(), twine + ".column.ptr");
+}
+
+// Allocates the storage of an soa array with a length only known at runtime, the items are not initialized
+TypedValue *generateSoAAllocation(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmLength, std::string twine)
+{
+    if (arrayType->getItemType()->getTypeCode() != TypeCode::STRUCT)
+    {
+        std::cout << "ERROR: Struct-of-arrays can only hold value structs, got " << arrayType->getItemType()->toString() << "\n";
+        exit(-1);
+        return NULL;
+    }
+
+    llvm::StructType *llvmItemType = llvm::cast<llvm::StructType>(arrayType->getItemType()->getLLVMType(context));
+    llvm::Value *llvmSize = generateSoAColumnOffset(context, arrayType, llvmLength, llvmItemType->getNumElements(), twine + ".sizeof");
+    llvm::Value *llvmStoragePointer = generateMalloc(context, llvm::Type::getInt8Ty(*context->context), llvmSize, arrayType->getAlign(), twine);
+
+    llvm::Value *llvmRefCountPointer = context->irBuilder->CreateBitCast(llvmStoragePointer, getRefCountType(*context->context)->getPointerTo(), twine + ".ref");
+    context->irBuilder->CreateStore(llvm::ConstantInt::get(getRefCountType(*context->context), 1, false), llvmRefCountPointer, false);
+
+    llvm::Value *llvmLengthStruct = llvm::UndefValue::get(arrayType->getLLVMLengthStructType(context));
+    llvmLengthStruct = context->irBuilder->CreateInsertValue(llvmLengthStruct, llvmLength, 0, twine + ".length");
+    llvmLengthStruct = context->irBuilder->CreateInsertValue(llvmLengthStruct, context->irBuilder->CreateBitCast(llvmStoragePointer, arrayType->getLLVMArrayPointerType(context)), 1, twine + ".sized");
+    return new TypedValue(llvmLengthStruct, arrayType);
+}
+
+// Returns a pointer to a field of an soa item, which points into the column of that field
+TypedValue *generateSoAFieldPointer(GenerationContext *context, TypedValue *soaItem, std::string fieldName)
+{
+    SoAItemType *soaItemType = static_cast<SoAItemType *>(soaItem->getType());
+    StructType *structType = static_cast<StructType *>(soaItemType->getArrayType()->getItemType());
+
+    int fieldIndex = structType->getFieldIndex(context, fieldName);
+    if (fieldIndex < 0)
+    {
+        std::cout << "ERROR: Cannot access member '" << fieldName << "' of struct\n";
+        exit(-1);
+        return NULL;
+    }
+    StructTypeField *structField = structType->getField(fieldName);
+
+    llvm::Value *llvmColumn = generateSoAColumnPointer(context, soaItemType->getArrayType(), soaItemType->getLLVMArray(), fieldIndex, "soa." + fieldName);
+    llvm::Value *llvmFieldPointer = context->irBuilder->CreateInBoundsGEP(structField->type->getLLVMType(context), llvmColumn, soaItem->getValue(), "soa." + fieldName + ".ptr");
+    return new TypedValue(llvmFieldPointer, structField->type->getUnmanagedPointerToType(), "soa." + fieldName);
+}
+
+// Gathers the fields of an soa item from their columns into a struct value
+TypedValue *generateSoAItemLoad(GenerationContext *context, TypedValue *soaItem)
+{
+    SoAItemType *soaItemType = static_cast<SoAItemType *>(soaItem->getType());
+    ArrayType *arrayType = soaItemType->getArrayType();
+    llvm::StructType *llvmItemType = llvm::cast<llvm::StructType>(arrayType->getItemType()->getLLVMType(context));
+
+    llvm::Value *llvmItem = llvm::UndefValue::get(llvmItemType);
+    for (unsigned int i = 0; i < llvmItemType->getNumElements(); i++)
+    {
+        llvm::Value *llvmColumn = generateSoAColumnPointer(context, arrayType, soaItemType->getLLVMArray(), i, "soa.load");
+        llvm::Value *llvmFieldPointer = context->irBuilder->CreateInBoundsGEP(llvmItemType->getElementType(i), llvmColumn, soaItem->getValue(), "soa.load.ptr");
+        llvm::Value *llvmField = context->irBuilder->CreateLoad(llvmItemType->getElementType(i), llvmFieldPointer, "soa.load.field");
+        llvmItem = context->irBuilder->CreateInsertValue(llvmItem, llvmField, i, "soa.load.item");
+    }
+    return new TypedValue(llvmItem, arrayType->getItemType());
+}
+
+// Scatters a struct value into the columns of an soa item
+bool generateSoAItemStore(GenerationContext *context, TypedValue *soaItem, TypedValue *newValue)
+{
+    SoAItemType *soaItemType = static_cast<SoAItemType *>(soaItem->getType());
+    ArrayType *arrayType = soaItemType->getArrayType();
+    llvm::StructType *llvmItemType = llvm::cast<llvm::StructType>(arrayType->getItemType()->getLLVMType(context));
+
+    TypedValue *convertedValue = generateTypeConversion(context, newValue, arrayType->getItemType(), false);
+    if (convertedValue == NULL)
+    {
+        std::cout << "ERROR: Cannot assign " << newValue->getType()->toString() << " to " << soaItemType->toString() << "\n";
+        return false;
+    }
+
+    for (unsigned int i = 0; i < llvmItemType->getNumElements(); i++)
+    {
+        llvm::Value *llvmColumn = generateSoAColumnPointer(context, arrayType, soaItemType->getLLVMArray(), i, "soa.store");
+        llvm::Value *llvmFieldPointer = context->irBuilder->CreateInBoundsGEP(llvmItemType->getElementType(i), llvmColumn, soaItem->getValue(), "soa.store.ptr");
+        context->irBuilder->CreateStore(context->irBuilder->CreateExtractValue(convertedValue->getValue(), i, "soa.store.field"), llvmFieldPointer, false);
+    }
+    return true;
+}
+
+// Fills the columns of a new soa array with literal segments (value, times)
+// Segments of a value that consists of the same byte repeated are filled with a memset per column, other long segments with a loop
+void generateSoAArrayLiteralFill(GenerationContext *context, TypedValue *arrayValue, std::vector<TypedValue *> &segmentValues, std::vector<uint64_t> &segmentTimes)
+{
+    ArrayType *arrayType = static_cast<ArrayType *>(arrayValue->getType());
+    llvm::StructType *llvmItemType = llvm::cast<llvm::StructType>(arrayType->getItemType()->getLLVMType(context));
+    llvm::Type *llvmIndexType = ArrayType::getLLVMLengthFieldType(context);
+    auto generateItem = [&](llvm::Value *llvmIndex)
+    {
+        return new TypedValue(llvmIndex, new SoAItemType(arrayType, arrayValue->getValue()));
+    };
+
+    uint64_t offset = 0;
+    for (int i = 0; i < segmentValues.size(); i++)
+    {
+        uint64_t times = segmentTimes[i];
+        if (times <= arrayLiteralUnrollLimit)
+        {
+            for (uint64_t j = 0; j < times; j++, offset++)
+            {
+                generateSoAItemStore(context, generateItem(llvm::ConstantInt::get(llvmIndexType, offset, false)), segmentValues[i]);
+            }
+            continue;
+        }
+
+        llvm::Value *llvmValue = segmentValues[i]->getValue();
+        llvm::Value *llvmByte = llvm::isa<llvm::Constant>(llvmValue) ? llvm::isBytewiseValue(llvmValue, context->module->getDataLayout()) : NULL;
+        if (llvmByte != NULL && llvm::isa<llvm::ConstantInt>(llvmByte))
+        {
+            for (unsigned int c = 0; c < llvmItemType->getNumElements(); c++)
+            {
+                llvm::Type *llvmFieldType = llvmItemType->getElementType(c);
+                llvm::Value *llvmColumn = generateSoAColumnPointer(context, arrayType, arrayValue->getValue(), c, "soa.fill");
+                llvm::Value *llvmSegmentStart = context->irBuilder->CreateInBoundsGEP(llvmFieldType, llvmColumn, llvm::ConstantInt::get(llvmIndexType, offset, false), "soa.fill.start");
+                llvm::Value *llvmSize = llvm::ConstantInt::get(llvmIndexType, context->module->getDataLayout().getTypeAllocSize(llvmFieldType) * times, false);
+                context->irBuilder->CreateMemSet(llvmSegmentStart, llvmByte, llvmSize, llvm::MaybeAlign());
+            }
+            offset += times;
+            continue;
+        }
+
+        llvm::Function *parentFunction = context->irBuilder->GetInsertBlock()->getParent();
+        llvm::BasicBlock *loopBlock = llvm::BasicBlock::Create(*context->context, "soa.fill.loop", parentFunction);
+        llvm::BasicBlock *continueBlock = llvm::BasicBlock::Create(*context->context, "soa.fill.cont", parentFunction);
+        llvm::AllocaInst *llvmIndexPointer = generateAllocaInCurrentFunction(context, llvmIndexType, "soa.fill.index");
+        context->irBuilder->CreateStore(llvm::ConstantInt::get(llvmIndexType, offset, false), llvmIndexPointer);
+        context->irBuilder->CreateBr(loopBlock);
+
+        context->irBuilder->SetInsertPoint(loopBlock);
+        llvm::Value *llvmIndex = context->irBuilder->CreateLoad(llvmIndexType, llvmIndexPointer, "soa.fill.index.load");
+        generateSoAItemStore(context, generateItem(llvmIndex), segmentValues[i]);
+        llvm::Value *llvmNextIndex = context->irBuilder->CreateAdd(llvmIndex, llvm::ConstantInt::get(llvmIndexType, 1), "soa.fill.index.next", true, true);
+        context->irBuilder->CreateStore(llvmNextIndex, llvmIndexPointer);
+        llvm::Value *llvmLoopCondition = context->irBuilder->CreateICmpULT(llvmNextIndex, llvm::ConstantInt::get(llvmIndexType, offset + times, false), "soa.fill.cond");
+        llvm::BranchInst *llvmLatch = context->irBuilder->CreateCondBr(llvmLoopCondition, loopBlock, continueBlock);
+        llvmLatch->setMetadata(llvm::LLVMContext::MD_loop, generateLoopMetadata(context, 0, 0));
+
+        context->irBuilder->SetInsertPoint(continueBlock);
+        offset += times;
+    }
+}
+
+// Creates the llvm.loop metadata for a loop, vectorizeWidth and unrollCount are ignored when 0 (the optimizer decides)
+// A width or count of 1 disables vectorization or unrolling
+llvm::MDNode *generateLoopMetadata(GenerationContext *context, int vectorizeWidth, int unrollCount)
+{
+    llvm::LLVMContext &llvmContext = *context->context;
+    llvm::Type *llvmHintType = llvm::Type::getInt32Ty(llvmContext);
+
+    std::vector<llvm::Metadata *> properties;
+    // The first operand refers to the loop id itself
+    properties.push_back(NULL);
+    properties.push_back(llvm::MDNode::get(llvmContext, llvm::MDString::get(llvmContext, "llvm.loop.mustprogress")));
+    if (vectorizeWidth > 0)
+    {
+        llvm::Metadata *enable[] = {llvm::MDString::get(llvmContext, "llvm.loop.vectorize.enable"), llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(llvm::Type::getInt1Ty(llvmContext), vectorizeWidth > 1))};
+        properties.push_back(llvm::MDNode::get(llvmContext, enable));
+        llvm::Metadata *width[] = {llvm::MDString::get(llvmContext, "llvm.loop.vectorize.width"), llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(llvmHintType, vectorizeWidth))};
+        properties.push_back(llvm::MDNode::get(llvmContext, width));
+    }
+    if (unrollCount == 1)
+    {
+        properties.push_back(llvm::MDNode::get(llvmContext, llvm::MDString::get(llvmContext, "llvm.loop.unroll.disable")));
+    }
+    else if (unrollCount > 1)
+    {
+        llvm::Metadata *count[] = {llvm::MDString::get(llvmContext, "llvm.loop.unroll.count"), llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(llvmHintType, unrollCount))};
+        properties.push_back(llvm::MDNode::get(llvmContext, count));
+    }
+
+    llvm::MDNode *loopId = llvm::MDNode::getDistinct(llvmContext, properties);
+    loopId->replaceOperandWith(0, loopId);
+    return loopId;
+}
+
+// Generates a check that panics when index is not in [0, length), both values must be 64 bit integers
+// Checks that can be proven at compile time are not emitted, the remaining ones are marked as likely to pass so the
+// optimizer (see GenerationContext) can remove them when they are dominated by another check or covered by a loop range
+void generateBoundsCheck(GenerationContext *context, llvm::Value *index, llvm::Value *length, std::string twine)
+{
+    if (!context->boundsChecks)
+    {
+        return;
+    }
+
+    llvm::ConstantInt *llvmConstantIndex = llvm::dyn_cast<llvm::ConstantInt>(index);
+    llvm::ConstantInt *llvmConstantLength = llvm::dyn_cast<llvm::ConstantInt>(length);
+    if (llvmConstantIndex != NULL && llvmConstantLength != NULL)
+    {
+        if (llvmConstantIndex->getValue().ult(llvmConstantLength->getValue()))
+        {
+            return;
+        }
+
+        std::cout << "ERROR: Index " << llvmConstantIndex->getSExtValue() << " is out of bounds (length " << llvmConstantLength->getZExtValue() << ")\n";
+        exit(-1);
+    }
+
+    // An unsigned compare also catches negative indices
+    llvm::Value *llvmInBounds = context->irBuilder->CreateICmpULT(index, length, twine + ".inbounds");
+
+    llvm::Function *currentFunction = context->irBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *outOfBoundsBlock = llvm::BasicBlock::Create(*context->context, twine + ".outofbounds", currentFunction);
+    llvm::BasicBlock *okBlock = llvm::BasicBlock::Create(*context->context, twine + ".ok", currentFunction);
+
+    llvm::MDNode *llvmLikelyWeights = llvm::MDBuilder(*context->context).createBranchWeights(1 << 20, 1);
+    context->irBuilder->CreateCondBr(llvmInBounds, okBlock, outOfBoundsBlock, llvmLikelyWeights);
+
+    context->irBuilder->SetInsertPoint(outOfBoundsBlock);
+    generatePanic(context, "Index out of bounds");
+
+    context->irBuilder->SetInsertPoint(okBlock);
+}
+
 llvm::Value *generateMalloc(GenerationContext *context, llvm::Type *type, std::string twine)
 {
+    return generateMalloc(context, type, generateSizeOf(context, type, twine), twine);
+}
+
+// Allocates byteSize bytes, for types that end with a variable length array
+llvm::Value *generateMalloc(GenerationContext *context, llvm::Type *type, llvm::Value *byteSize, std::string twine)
+{
+    return generateMalloc(context, type, byteSize, context->module->getDataLayout().getABITypeAlign(type).value(), twine);
+}
+
+// Allocates byteSize bytes at a multiple of align, the memory can always be freed with chocoFree
+llvm::Value *generateMalloc(GenerationContext *context, llvm::Type *type, llvm::Value *byteSize, uint64_t align, std::string twine)
+{
+    if (context->irBuilder->GetInsertBlock() == NULL)
+    {
+        std::cout << "ERROR: Cannot allocate " << twine << " outside of a function, module-level values must be constant\n";
+        exit(-1);
+
+        return NULL;
+    }
+
+    if (align > mallocAlign)
+    {
+        llvm::Function *alignedMallocFunction = context->module->getFunction(alignedMallocName);
+        if (alignedMallocFunction == NULL)
+        {
+            std::vector<llvm::Type *> mallocParams;
+            mallocParams.push_back(llvm::Type::getInt64Ty(*context->context));
+            mallocParams.push_back(llvm::Type::getInt64Ty(*context->context));
+            llvm::FunctionType *functionType = llvm::FunctionType::get(llvm::PointerType::get(*context->context, 0), mallocParams, false);
+            alignedMallocFunction = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage, alignedMallocName, *context->module);
+        }
+
+        std::vector<llvm::Value *> parameters;
+        parameters.push_back(byteSize);
+        parameters.push_back(llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context->context), align, false));
+        llvm::CallInst *opaquePointer = context->irBuilder->CreateCall(alignedMallocFunction, parameters, twine + ".malloc.ptr.opaque");
+        opaquePointer->addRetAttr(llvm::Attribute::getWithAlignment(*context->context, llvm::Align(align)));
+        return context->irBuilder->CreateBitCast(opaquePointer, llvm::PointerType::get(type, 0), twine + ".malloc.ptr");
+    }
+
     llvm::Function *mallocFunction = context->module->getFunction(mallocName);
     if (mallocFunction == NULL)
     {
@@ -764,12 +3953,34 @@ llvm::Value *generateMalloc(GenerationContext *context, llvm::Type *type, std::s
     }
 
     std::vector<llvm::Value *> parameters;
-    llvm::Value *sizeOf = generateSizeOf(context, type, twine);
-    parameters.push_back(sizeOf);
+    parameters.push_back(byteSize);
     auto opaquePointer = context->irBuilder->CreateCall(mallocFunction, parameters, twine + ".malloc.ptr.opaque");
     return context->irBuilder->CreateBitCast(opaquePointer, llvm::PointerType::get(type, 0), twine + ".malloc.ptr");
 }
 
+// Allocates the storage of an array, the items of an aligned array start at a multiple of its alignment
+// The reference count of a managed array is stored right before its items, so its storage starts inside the allocated block
+llvm::Value *generateArrayStorageMalloc(GenerationContext *context, ArrayType *arrayType, llvm::Type *llvmStorageType, llvm::Value *byteSize, std::string twine)
+{
+    uint64_t align = arrayType->getAlign();
+    if (align == 0)
+    {
+        return generateMalloc(context, llvmStorageType, byteSize, twine);
+    }
+
+    uint64_t itemsOffset = 0;
+    if (arrayType->getManaged())
+    {
+        itemsOffset = context->module->getDataLayout().getStructLayout(llvm::cast<llvm::StructType>(llvmStorageType))->getElementOffset(1);
+    }
+    uint64_t padding = llvm::alignTo(itemsOffset, align) - itemsOffset;
+
+    llvm::Value *llvmPaddedSize = context->irBuilder->CreateAdd(byteSize, llvm::ConstantInt::get(byteSize->getType(), padding, false), twine + ".padded.size", true, true);
+    llvm::Value *llvmBlock = generateMalloc(context, llvm::Type::getInt8Ty(*context->context), llvmPaddedSize, align, twine);
+    llvm::Value *llvmStorage = context->irBuilder->CreateInBoundsGEP(llvm::Type::getInt8Ty(*context->context), llvmBlock, llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context->context), padding, false), twine + ".storage");
+    return context->irBuilder->CreateBitCast(llvmStorage, llvmStorageType->getPointerTo(), twine + ".storage.ptr");
+}
+
 llvm::Value *generateFree(GenerationContext *context, llvm::Value *toFree, std::string twine)
 {
     llvm::Function *freeFunction = context->module->getFunction(freeName);
@@ -787,9 +3998,43 @@ llvm::Value *generateFree(GenerationContext *context, llvm::Value *toFree, std::
     return context->irBuilder->CreateCall(freeFunction, parameters);
 }
 
-llvm::AllocaInst *generateAllocaInCurrentFunction(GenerationContext *context, llvm::Type *type, llvm::StringRef twine)
+// Resizes a block allocated with chocoAlloc to byteSize bytes, or allocates one when toRealloc is null
+// The contents are kept, but the block may move, so it must not be referenced from anywhere else
+llvm::Value *generateRealloc(GenerationContext *context, llvm::Type *type, llvm::Value *toRealloc, llvm::Value *byteSize, std::string twine)
+{
+    llvm::Function *reallocFunction = context->module->getFunction(reallocName);
+    if (reallocFunction == NULL)
+    {
+        std::vector<llvm::Type *> reallocParams;
+        reallocParams.push_back(llvm::PointerType::get(*context->context, 0));
+        reallocParams.push_back(llvm::Type::getInt64Ty(*context->context));
+        llvm::FunctionType *functionType = llvm::FunctionType::get(llvm::PointerType::get(*context->context, 0), reallocParams, false);
+        reallocFunction = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage, reallocName, *context->module);
+    }
+
+    std::vector<llvm::Value *> parameters;
+    parameters.push_back(context->irBuilder->CreateBitCast(toRealloc, llvm::PointerType::get(*context->context, 0), twine + ".realloc.old"));
+    parameters.push_back(byteSize);
+    auto opaquePointer = context->irBuilder->CreateCall(reallocFunction, parameters, twine + ".realloc.ptr.opaque");
+    return context->irBuilder->CreateBitCast(opaquePointer, llvm::PointerType::get(type, 0), twine + ".realloc.ptr");
+}
+
+llvm::AllocaInst *generateAllocaInCurrentFunction(GenerationContext *context, llvm::Type *type, llvm::StringRef twine, uint64_t align)
 {
+    if (context->irBuilder->GetInsertBlock() == NULL)
+    {
+        std::cout << "ERROR: Cannot allocate " << twine.str() << " outside of a function, module-level values must be constant\n";
+        exit(-1);
+
+        return NULL;
+    }
+
     llvm::Function *function = context->irBuilder->GetInsertBlock()->getParent();
     llvm::IRBuilder<> insertBuilder(&function->getEntryBlock(), function->getEntryBlock().begin());
-    return insertBuilder.CreateAlloca(type, NULL, twine + ".alloca.ptr");
+    llvm::AllocaInst *alloca = insertBuilder.CreateAlloca(type, NULL, twine + ".alloca.ptr");
+    if (align > alloca->getAlign().value())
+    {
+        alloca->setAlignment(llvm::Align(align));
+    }
+    return alloca;
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <list>
 #include <map>
+#include "token.hpp"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/BasicBlock.h"
@@ -26,28 +27,103 @@
 class TypedValue;
 class GenerationContext;
 class Type;
+class ArrayType;
+class PointerType;
+class TensorType;
+class FunctionScope;
+
+// Array literal segments up to this many items are stored item by item, longer segments are filled with memset or a loop
+const uint64_t arrayLiteralUnrollLimit = 16;
+// Constant managed array literals up to this many items are placed in read-only data instead of being allocated
+const uint64_t constantArrayLiteralLimit = 1 << 16;
+// Value structs and arrays larger than this many bytes are copied with memcpy and built in place
+const uint64_t aggregateCopyByteLimit = 64;
+// The reference count of objects that are never freed, negative so counting never reaches zero
+const int64_t immortalRefCount = INT64_MIN / 2;
+// The alignment of memory returned by chocoAlloc (like malloc), stricter alignments are allocated with chocoAllocAligned
+const uint64_t mallocAlign = 16;
+// Strings of up to this many bytes are stored inside the String value instead of being allocated
+const uint64_t stringInlineCapacity = 23;
+// The tag byte of a String that points to its bytes, inline strings have tag stringInlineCapacity - length
+const uint8_t stringHeapTag = 0xFF;
+// The byte kernels (find, count, hash, ...) handle this many bytes per step as an LLVM vector, which is split for targets with narrower registers
+const unsigned int bytesVectorWidth = 32;
 
 TypedValue *generateDereferenceToPointer(GenerationContext *context, TypedValue *currentValue);
 TypedValue *generateDereferenceToValue(GenerationContext *context, TypedValue *currentValue);
 bool generateTypeJugging(GenerationContext *context, TypedValue **leftInOut, TypedValue **rightInOut);
 TypedValue *generateTypeConversion(GenerationContext *context, TypedValue *valueToConvert, Type *targetType, bool allowLosePrecision);
+TypedValue *generateVectorSplat(GenerationContext *context, TypedValue *scalarValue, Type *vectorType, bool allowLosePrecision);
+TypedValue *generateArrayToVector(GenerationContext *context, TypedValue *arrayValue, Type *vectorType);
+bool generateVectorStore(GenerationContext *context, TypedValue *arrayValue, llvm::Value *llvmStart, llvm::Value *llvmEnd, TypedValue *vectorValue);
+TypedValue *generateVectorToArray(GenerationContext *context, TypedValue *vectorValue, Type *targetType);
+TypedValue *generateVectorReduction(GenerationContext *context, TypedValue *vectorValue, std::string name);
+TypedValue *generateBinaryOperator(GenerationContext *context, const Token *operatorToken, TypedValue *left, TypedValue *right);
+void generateArrayLiteralFill(GenerationContext *context, llvm::Type *llvmStorageType, llvm::Value *llvmStoragePointer, bool managed, std::vector<TypedValue *> &segmentValues, std::vector<uint64_t> &segmentTimes);
+TypedValue *generateImmortalArray(GenerationContext *context, ArrayType *arrayType, std::vector<llvm::Constant *> &llvmItems, std::string twine);
+void generateArrayUnshare(GenerationContext *context, TypedValue *arrayPointer);
+TypedValue *generateArraySlice(GenerationContext *context, TypedValue *arrayValue, llvm::Value *llvmStart, llvm::Value *llvmEnd);
+void generateSliceUnshare(GenerationContext *context, TypedValue *slicePointer);
+TypedValue *generateStringLiteral(GenerationContext *context, std::string text);
+TypedValue *generateStringToPointer(GenerationContext *context, TypedValue *stringValue);
+llvm::Value *generateStringBytes(GenerationContext *context, TypedValue *stringPointer, llvm::Value **llvmLengthOut);
+llvm::Value *generateStringLength(GenerationContext *context, TypedValue *stringValue);
+TypedValue *generateStringSlice(GenerationContext *context, TypedValue *stringPointer, llvm::Value *llvmStart, llvm::Value *llvmEnd, bool copy);
+TypedValue *generateStringConcatenation(GenerationContext *context, std::vector<TypedValue *> &parts);
+TypedValue *generateBytesSlice(GenerationContext *context, TypedValue *value, bool copyString);
+bool isBytesOperation(std::string name);
+TypedValue *generateBytesOperation(GenerationContext *context, TypedValue *bytesSlice, std::string name, std::vector<TypedValue *> &arguments);
+TypedValue *generateTensorAllocation(GenerationContext *context, TensorType *tensorType, std::vector<llvm::Value *> &llvmShape);
+TypedValue *generateTensorIndex(GenerationContext *context, TypedValue *tensorValue, std::vector<llvm::Value *> &llvmStarts, std::vector<llvm::Value *> &llvmEnds, std::vector<bool> &ranges);
+TypedValue *generateTensorMember(GenerationContext *context, TypedValue *tensorValue, std::string name);
+TypedValue *generateArrayAllocation(GenerationContext *context, Type *itemType, llvm::Value *llvmLength, std::string twine, uint64_t align = 0);
+TypedValue *generateArrayExpression(GenerationContext *context, const Token *operatorToken, TypedValue *left, TypedValue *right);
+TypedValue *generateArrayExpressionToArray(GenerationContext *context, TypedValue *expression, ArrayType *targetType);
+TypedValue *generateArrayReduction(GenerationContext *context, TypedValue *arrayValue, std::string name);
 bool generateAssignment(GenerationContext *context, TypedValue *valuePointer, TypedValue *newValue, bool isVolatile);
+void generateAggregateStore(GenerationContext *context, llvm::Value *llvmValue, llvm::Value *llvmPointer);
 TypedValue *generateReferenceAwareLoad(GenerationContext *context, TypedValue *valuePointer);
 TypedValue *generateLoad(GenerationContext *context, TypedValue *valuePointer);
 void generateIncrementReference(GenerationContext *context, TypedValue *managedPointer);
 void generateDecrementReference(GenerationContext *context, TypedValue *managedPointer, bool checkFree);
 void generateIncrementReferenceIfPointer(GenerationContext *context, TypedValue *managedPointer);
 void generateDecrementReferenceIfPointer(GenerationContext *context, TypedValue *maybeManagedPointer, bool checkFree);
+void generateScopeEnd(GenerationContext *context, FunctionScope *scope);
+PointerType *getUniquePointerType(Type *type);
+TypedValue *generateUniqueMove(GenerationContext *context, TypedValue *ownerPointer);
+void generateUniqueRelease(GenerationContext *context, TypedValue *uniqueValue);
 void generatePanic(GenerationContext *context, std::string reason);
+void generateBoundsCheck(GenerationContext *context, llvm::Value *index, llvm::Value *length, std::string twine);
+llvm::Value *generateArrayStoragePointer(GenerationContext *context, TypedValue *arrayValue, llvm::Value **llvmLengthOut);
+llvm::Value *generateArrayItemPointer(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmStoragePointer, llvm::Value *llvmIndex, std::string twine);
+llvm::Value *generateSoAColumnOffset(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmLength, unsigned int column, std::string twine);
+llvm::Value *generateSoAColumnPointer(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmArray, unsigned int column, std::string twine);
+TypedValue *generateSoAAllocation(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmLength, std::string twine);
+TypedValue *generateSoAFieldPointer(GenerationContext *context, TypedValue *soaItem, std::string fieldName);
+TypedValue *generateSoAItemLoad(GenerationContext *context, TypedValue *soaItem);
+bool generateSoAItemStore(GenerationContext *context, TypedValue *soaItem, TypedValue *newValue);
+llvm::Value *generateGrowableArrayFieldPointer(GenerationContext *context, TypedValue *arrayPointer, unsigned int field, std::string twine);
+TypedValue *generateGrowableArrayAllocation(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmCapacity, std::string twine);
+void generateGrowableArrayReserve(GenerationContext *context, TypedValue *arrayPointer, llvm::Value *llvmCapacity, llvm::Value *llvmMinCapacity);
+bool generateGrowableArrayPush(GenerationContext *context, TypedValue *arrayPointer, TypedValue *newValue);
+TypedValue *generateGrowableArrayPop(GenerationContext *context, TypedValue *arrayPointer);
+void generateGrowableArrayTruncate(GenerationContext *context, TypedValue *arrayPointer, llvm::Value *llvmNewLength);
+void generateGrowableArrayRelease(GenerationContext *context, ArrayType *arrayType, llvm::Value *llvmItems, llvm::Value *llvmStart, llvm::Value *llvmEnd);
+void generateSoAArrayLiteralFill(GenerationContext *context, TypedValue *arrayValue, std::vector<TypedValue *> &segmentValues, std::vector<uint64_t> &segmentTimes);
+llvm::MDNode *generateLoopMetadata(GenerationContext *context, int vectorizeWidth, int unrollCount);
 TypedValue *generateUnionIs(GenerationContext *context, TypedValue *unionToCompare, Type *compareType);
 TypedValue *generateUnionConversion(GenerationContext *context, TypedValue *unionToConvert, Type *targetType);
 TypedValue *generateUnionGetData(GenerationContext *context, TypedValue *unionToConvert, Type *asType);
 llvm::BasicBlock *generateUnionIsBranches(GenerationContext *context, TypedValue *unionToCompare, Type *compareType);
+std::vector<llvm::BasicBlock *> generateUnionSwitch(GenerationContext *context, TypedValue *unionValue, std::vector<Type *> types, llvm::BasicBlock *defaultBlock);
 
 llvm::Type *getRefCountType(llvm::LLVMContext &context);
-llvm::Type *getUnionIdType(llvm::LLVMContext &context);
 
 llvm::Value *generateSizeOf(GenerationContext *context, llvm::Type *type, std::string twine);
 llvm::Value *generateMalloc(GenerationContext *context, llvm::Type *type, std::string twine);
+llvm::Value *generateMalloc(GenerationContext *context, llvm::Type *type, llvm::Value *byteSize, std::string twine);
+llvm::Value *generateMalloc(GenerationContext *context, llvm::Type *type, llvm::Value *byteSize, uint64_t align, std::string twine);
+llvm::Value *generateArrayStorageMalloc(GenerationContext *context, ArrayType *arrayType, llvm::Type *llvmStorageType, llvm::Value *byteSize, std::string twine);
 llvm::Value *generateFree(GenerationContext *context, llvm::Value *toFree, std::string twine);
-llvm::AllocaInst *generateAllocaInCurrentFunction(GenerationContext *context, llvm::Type *type, llvm::StringRef twine);
\ No newline at end of file
+llvm::Value *generateRealloc(GenerationContext *context, llvm::Type *type, llvm::Value *toRealloc, llvm::Value *byteSize, std::string twine);
+llvm::AllocaInst *generateAllocaInCurrentFunction(GenerationContext *context, llvm::Type *type, llvm::StringRef twine, uint64_t align = 0);
\ No newline at end of file